@@ -571,10 +571,17 @@ unsigned kcRecordProgress(void)
 		return 100;
 }
 
-unsigned kcSizeofFrameBuffer(unsigned width, unsigned height, FrameType type)
+unsigned kcSizeofFrameData(unsigned width, unsigned height, FrameType type)
 {
 	unsigned area = width*height;
-	return area*3 + sizeof(KcFrame) + 32; // BGR
+	if (type==FRAME_I420)
+		return area*3/2;
+	return area*3; // BGR
+}
+
+unsigned kcSizeofFrameBuffer(unsigned width, unsigned height, FrameType type)
+{
+	return kcSizeofFrameData(width, height, type) + sizeof(KcFrame) + 32;
 }
 
 unsigned kcSizeofFrame(const KcFrame *frame)
@@ -70,6 +70,7 @@ void kcInitCallback(void);
 
 void kcSetIRFilter(void);
 
+unsigned kcSizeofFrameData(unsigned width, unsigned height, FrameType type);
 unsigned kcSizeofFrameBuffer(unsigned width, unsigned height, FrameType type);
 unsigned kcSizeofFrame(const KcFrame *frame);
 unsigned kcMemReserveExceeded(void);
@@ -77,6 +78,8 @@ unsigned kcMemReserveExceeded(void);
 uint32_t kcGetTimer(uint32_t timer);
 void kcSetTimer(uint32_t *timer);
 
+KcFrame *kcConvertFrame(KcFrame *frame, FrameType type);
+
 int kcStartCameraLoop(void);
 int kcStopCameraLoop(void);
 void kcSetBrightness(void);
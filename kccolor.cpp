@@ -0,0 +1,61 @@
+#include <mutex>
+#include <stdlib.h>
+#include <libcamera/formats.h>
+#include "color_converter.h"
+#include "kcamera.h"
+
+
+// The converter is kept between frames, as configuring it isn't free and the
+// frame size rarely changes.  
+static ColorConverter converter;
+static unsigned int converter_width = 0, converter_height = 0;
+static std::mutex converter_mutex;
+
+// Convert a BGR frame into a newly allocated frame of the given type, and free 
+// the original frame.  Returns NULL if the conversion isn't supported.  
+extern "C" KcFrame *kcConvertFrame(KcFrame *frame, FrameType type)
+{
+    KcFrame *newFrame;
+
+    if (frame->m_type==type)
+        return frame;
+
+    if (frame->m_type!=FRAME_BGR || type!=FRAME_I420)
+    {
+        free(frame);
+        return NULL;
+    }
+
+    newFrame = (KcFrame *)malloc(kcSizeofFrameBuffer(frame->m_width, frame->m_height, type));
+    if (newFrame==NULL)
+    {
+        free(frame);
+        return NULL;
+    }
+    newFrame->m_width = frame->m_width;
+    newFrame->m_height = frame->m_height;
+    newFrame->m_pts = frame->m_pts;
+    newFrame->m_type = type;
+
+    {
+        std::lock_guard<std::mutex> lock(converter_mutex);
+        // FRAME_BGR is stored B, G, R in memory, which is libcamera's RGB888
+        if (converter_width!=frame->m_width || converter_height!=frame->m_height)
+        {
+            converter_width = converter_height = 0;
+            if (converter.configure(libcamera::formats::RGB888, libcamera::formats::YUV420,
+                frame->m_width, frame->m_height)<0)
+            {
+                free(newFrame);
+                free(frame);
+                return NULL;
+            }
+            converter_width = frame->m_width;
+            converter_height = frame->m_height;
+        }
+        converter.convert(frame->m_data, newFrame->m_data);
+    }
+
+    free(frame);
+    return newFrame;
+}
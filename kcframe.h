@@ -3,7 +3,8 @@
 
 typedef enum
 {
-    FRAME_BGR
+    FRAME_BGR,
+    FRAME_I420
 } FrameType;
 
 typedef struct 
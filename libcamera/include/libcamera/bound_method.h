@@ -8,6 +8,7 @@
 #define __LIBCAMERA_BOUND_METHOD_H__
 
 #include <memory>
+#include <stddef.h>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -27,6 +28,41 @@ class BoundMethodPackBase
 {
 public:
 	virtual ~BoundMethodPackBase() = default;
+
+	static void *allocate(size_t size);
+	static void deallocate(void *ptr, size_t size);
+};
+
+template<typename T>
+class BoundMethodPackAllocator
+{
+public:
+	using value_type = T;
+
+	BoundMethodPackAllocator() = default;
+	template<typename U>
+	BoundMethodPackAllocator([[maybe_unused]] const BoundMethodPackAllocator<U> &other) {}
+
+	T *allocate(size_t n)
+	{
+		if (alignof(T) > alignof(max_align_t))
+			return std::allocator<T>().allocate(n);
+
+		return static_cast<T *>(BoundMethodPackBase::allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, size_t n)
+	{
+		if (alignof(T) > alignof(max_align_t))
+			return std::allocator<T>().deallocate(ptr, n);
+
+		BoundMethodPackBase::deallocate(ptr, n * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==([[maybe_unused]] const BoundMethodPackAllocator<U> &other) const { return true; }
+	template<typename U>
+	bool operator!=([[maybe_unused]] const BoundMethodPackAllocator<U> &other) const { return false; }
 };
 
 template<typename R, typename... Args>
@@ -63,6 +99,9 @@ public:
 	}
 	virtual ~BoundMethodBase() = default;
 
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
 	template<typename T, typename std::enable_if_t<!std::is_same<Object, T>::value> * = nullptr>
 	bool match(T *obj) { return obj == obj_; }
 	bool match(Object *object) { return object == object_; }
@@ -156,7 +195,7 @@ public:
 		if (!this->object_)
 			return (static_cast<T *>(this->obj_)->*func_)(args...);
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(BoundMethodPackAllocator<PackType>(), args...);
 		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
 		return sync ? pack->ret_ : R();
 	}
@@ -189,7 +228,7 @@ public:
 		if (!this->object_)
 			return (static_cast<T *>(this->obj_)->*func_)(args...);
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(BoundMethodPackAllocator<PackType>(), args...);
 		BoundMethodBase::activatePack(pack, deleteMethod);
 	}
 
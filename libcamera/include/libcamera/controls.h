@@ -336,11 +336,15 @@ public:
 	const_iterator find(unsigned int key) const;
 
 	const ControlIdMap &idmap() const { return idmap_; }
+	uint64_t generation() const { return generation_; }
 
 private:
+	static uint64_t nextGeneration();
+
 	void generateIdmap();
 
 	ControlIdMap idmap_;
+	uint64_t generation_ = nextGeneration();
 };
 
 class ControlList
@@ -75,6 +75,9 @@ private:
 	LIBCAMERA_DISABLE_COPY(CameraSensor)
 
 	int generateId();
+	std::string formatCacheKey() const;
+	bool loadCachedFormats(const std::string &path);
+	void storeCachedFormats(const std::string &path) const;
 	int validateSensorDriver();
 	void initVimcDefaultProperties();
 	int initProperties();
@@ -9,6 +9,8 @@
 
 #include <map>
 #include <memory>
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 #include <libcamera/controls.h>
@@ -20,7 +22,19 @@ class ByteStreamBuffer;
 class ControlSerializer
 {
 public:
-	ControlSerializer();
+	enum class Role {
+		Proxy,
+		Worker
+	};
+
+	struct Statistics {
+		uint64_t infoMaps;
+		uint64_t infoMapBytes;
+		uint64_t lists;
+		uint64_t listBytes;
+	};
+
+	explicit ControlSerializer(Role role);
 
 	void reset();
 
@@ -35,6 +49,9 @@ public:
 
 	bool isCached(const ControlInfoMap &infoMap);
 
+	const Statistics &statistics() const { return stats_; }
+	void resetStatistics() { stats_ = {}; }
+
 private:
 	static size_t binarySize(const ControlValue &value);
 	static size_t binarySize(const ControlInfo &info);
@@ -46,10 +63,23 @@ private:
 				      bool isArray = false, unsigned int count = 1);
 	ControlInfo loadControlInfo(ControlType type, ByteStreamBuffer &buffer);
 
+	struct HandleEntry {
+		unsigned int handle;
+		uint64_t generation;
+	};
+
+	static bool equal(const ControlInfoMap &a, const ControlInfoMap &b);
+
+	unsigned int findHandle(const ControlInfoMap &infoMap);
+
+	Role role_;
 	unsigned int serial_;
 	std::vector<std::unique_ptr<ControlId>> controlIds_;
 	std::map<unsigned int, ControlInfoMap> infoMaps_;
-	std::map<const ControlInfoMap *, unsigned int> infoMapHandles_;
+	std::unordered_map<const ControlInfoMap *, HandleEntry> infoMapHandles_;
+	std::unordered_map<unsigned int, const ControlInfoMap *> handleInfoMaps_;
+
+	Statistics stats_;
 };
 
 } /* namespace libcamera */
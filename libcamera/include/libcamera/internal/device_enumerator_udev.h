@@ -55,6 +55,7 @@ private:
 	};
 
 	int addUdevDevice(struct udev_device *dev);
+	int addMediaDevice(std::unique_ptr<MediaDevice> media);
 	int populateMediaDevice(MediaDevice *media, DependencyMap *deps);
 	std::string lookupDeviceNode(dev_t devnum);
 
@@ -48,6 +48,7 @@ private:
 
 	std::map<int, EventNotifierSetPoll> notifiers_;
 	std::list<Timer *> timers_;
+	std::vector<struct pollfd> pollfds_;
 	int eventfd_;
 
 	bool processingEvents_;
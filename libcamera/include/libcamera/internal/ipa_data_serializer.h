@@ -8,6 +8,7 @@
 #define __LIBCAMERA_INTERNAL_IPA_DATA_SERIALIZER_H__
 
 #include <deque>
+#include <errno.h>
 #include <iostream>
 #include <string.h>
 #include <tuple>
@@ -28,6 +29,9 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(IPADataSerializer)
 
+template<typename T>
+class IPADataSerializer;
+
 namespace {
 
 template<typename T,
@@ -39,6 +43,13 @@ void appendPOD(std::vector<uint8_t> &vec, T val)
 	memcpy(&*(vec.end() - byteWidth), &val, byteWidth);
 }
 
+template<typename T,
+	 std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
+void writePOD(ByteStreamBuffer &buffer, T val)
+{
+	buffer.write(&val);
+}
+
 template<typename T,
 	 std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
 T readPOD(std::vector<uint8_t>::const_iterator it, size_t pos,
@@ -59,14 +70,57 @@ T readPOD(std::vector<uint8_t> &vec, size_t pos)
 	return readPOD<T>(vec.cbegin(), pos, vec.end());
 }
 
+template<typename T>
+int serializeElement(const T &data, ByteStreamBuffer &buffer,
+		     std::vector<int32_t> &fds, ControlSerializer *cs)
+{
+	ByteStreamBuffer sizes = buffer.carveOut(8);
+	size_t dataStart = buffer.offset();
+	size_t fdsStart = fds.size();
+
+	int ret = IPADataSerializer<T>::serialize(data, buffer, fds, cs);
+	if (ret < 0)
+		return ret;
+
+	writePOD<uint32_t>(sizes, buffer.offset() - dataStart);
+	writePOD<uint32_t>(sizes, fds.size() - fdsStart);
+
+	return 0;
+}
+
+template<typename T>
+std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
+serializeToVector(const T &data, ControlSerializer *cs)
+{
+	std::vector<uint8_t> dataVec(IPADataSerializer<T>::binarySize(data, cs));
+	std::vector<int32_t> fdsVec;
+
+	ByteStreamBuffer buffer(dataVec.data(), dataVec.size());
+	if (IPADataSerializer<T>::serialize(data, buffer, fdsVec, cs) < 0)
+		return { {}, {} };
+
+	dataVec.resize(buffer.offset());
+
+	return { dataVec, fdsVec };
+}
+
 } /* namespace */
 
 template<typename T>
 class IPADataSerializer
 {
 public:
+	static size_t binarySize(const T &data, ControlSerializer *cs = nullptr);
+
+	static int serialize(const T &data, ByteStreamBuffer &buffer,
+			     std::vector<int32_t> &fds,
+			     ControlSerializer *cs = nullptr);
+
 	static std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-	serialize(const T &data, ControlSerializer *cs = nullptr);
+	serialize(const T &data, ControlSerializer *cs = nullptr)
+	{
+		return serializeToVector<T>(data, cs);
+	}
 
 	static T deserialize(const std::vector<uint8_t> &data,
 			     ControlSerializer *cs = nullptr);
@@ -103,32 +157,37 @@ template<typename V>
 class IPADataSerializer<std::vector<V>>
 {
 public:
-	static std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-	serialize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
+	static size_t binarySize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
 	{
-		std::vector<uint8_t> dataVec;
-		std::vector<int32_t> fdsVec;
+		size_t size = 4;
 
+		for (auto const &it : data)
+			size += 8 + IPADataSerializer<V>::binarySize(it, cs);
+
+		return size;
+	}
+
+	static int serialize(const std::vector<V> &data, ByteStreamBuffer &buffer,
+			     std::vector<int32_t> &fds, ControlSerializer *cs = nullptr)
+	{
 		/* Serialize the length. */
 		uint32_t vecLen = data.size();
-		appendPOD<uint32_t>(dataVec, vecLen);
+		writePOD<uint32_t>(buffer, vecLen);
 
 		/* Serialize the members. */
 		for (auto const &it : data) {
-			std::vector<uint8_t> dvec;
-			std::vector<int32_t> fvec;
-
-			std::tie(dvec, fvec) =
-				IPADataSerializer<V>::serialize(it, cs);
-
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
-
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
+			int ret = serializeElement<V>(it, buffer, fds, cs);
+			if (ret < 0)
+				return ret;
 		}
 
-		return { dataVec, fdsVec };
+		return buffer.overflow() ? -ENOSPC : 0;
+	}
+
+	static std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
+	serialize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
+	{
+		return serializeToVector<std::vector<V>>(data, cs);
 	}
 
 	static std::vector<V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
@@ -200,41 +259,42 @@ template<typename K, typename V>
 class IPADataSerializer<std::map<K, V>>
 {
 public:
-	static std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-	serialize(const std::map<K, V> &data, ControlSerializer *cs = nullptr)
+	static size_t binarySize(const std::map<K, V> &data, ControlSerializer *cs = nullptr)
 	{
-		std::vector<uint8_t> dataVec;
-		std::vector<int32_t> fdsVec;
+		size_t size = 4;
 
+		for (auto const &it : data)
+			size += 16 + IPADataSerializer<K>::binarySize(it.first, cs)
+			      + IPADataSerializer<V>::binarySize(it.second, cs);
+
+		return size;
+	}
+
+	static int serialize(const std::map<K, V> &data, ByteStreamBuffer &buffer,
+			     std::vector<int32_t> &fds, ControlSerializer *cs = nullptr)
+	{
 		/* Serialize the length. */
 		uint32_t mapLen = data.size();
-		appendPOD<uint32_t>(dataVec, mapLen);
+		writePOD<uint32_t>(buffer, mapLen);
 
 		/* Serialize the members. */
 		for (auto const &it : data) {
-			std::vector<uint8_t> dvec;
-			std::vector<int32_t> fvec;
-
-			std::tie(dvec, fvec) =
-				IPADataSerializer<K>::serialize(it.first, cs);
-
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
-
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
+			int ret = serializeElement<K>(it.first, buffer, fds, cs);
+			if (ret < 0)
+				return ret;
 
-			std::tie(dvec, fvec) =
-				IPADataSerializer<V>::serialize(it.second, cs);
-
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
-
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
+			ret = serializeElement<V>(it.second, buffer, fds, cs);
+			if (ret < 0)
+				return ret;
 		}
 
-		return { dataVec, fdsVec };
+		return buffer.overflow() ? -ENOSPC : 0;
+	}
+
+	static std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
+	serialize(const std::map<K, V> &data, ControlSerializer *cs = nullptr)
+	{
+		return serializeToVector<std::map<K, V>>(data, cs);
 	}
 
 	static std::map<K, V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
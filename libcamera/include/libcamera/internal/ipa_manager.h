@@ -7,7 +7,10 @@
 #ifndef __LIBCAMERA_INTERNAL_IPA_MANAGER_H__
 #define __LIBCAMERA_INTERNAL_IPA_MANAGER_H__
 
+#include <map>
+#include <memory>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include <libcamera/ipa/ipa_interface.h>
@@ -33,15 +36,7 @@ public:
 					    uint32_t maxVersion,
 					    uint32_t minVersion)
 	{
-		IPAModule *m = nullptr;
-
-		for (IPAModule *module : self_->modules_) {
-			if (module->match(pipe, minVersion, maxVersion)) {
-				m = module;
-				break;
-			}
-		}
-
+		IPAModule *m = self_->module(pipe, minVersion, maxVersion);
 		if (!m)
 			return nullptr;
 
@@ -55,15 +50,41 @@ public:
 	}
 
 private:
+	struct ModuleEntry {
+		std::string path;
+		int64_t mtime;
+		int64_t size;
+		bool valid;
+		bool verified;
+		struct IPAModuleInfo info;
+		std::unique_ptr<IPAModule> module;
+	};
+
 	static IPAManager *self_;
 
+	void scanModules();
 	void parseDir(const char *libDir, unsigned int maxDepth,
 		      std::vector<std::string> &files);
 	unsigned int addDir(const char *libDir, unsigned int maxDepth = 0);
+	bool verifyModule(ModuleEntry &entry);
+
+	void loadIndex();
+	void saveIndex() const;
+
+	IPAModule *findModule(PipelineHandler *pipe, uint32_t minVersion,
+			      uint32_t maxVersion);
+	IPAModule *module(PipelineHandler *pipe, uint32_t minVersion,
+			  uint32_t maxVersion);
+	bool isSignatureValid(IPAModule *ipa);
+
+	bool scanned_;
+	std::vector<ModuleEntry> modules_;
 
-	bool isSignatureValid(IPAModule *ipa) const;
+	std::string indexPath_;
+	std::map<std::string, ModuleEntry> index_;
+	bool indexDirty_;
 
-	std::vector<IPAModule *> modules_;
+	std::map<const IPAModule *, bool> signatures_;
 
 #if HAVE_IPA_PUBKEY
 	static const uint8_t publicKeyData_[];
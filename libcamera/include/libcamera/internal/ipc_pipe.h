@@ -7,6 +7,7 @@
 #ifndef __LIBCAMERA_INTERNAL_IPA_IPC_H__
 #define __LIBCAMERA_INTERNAL_IPA_IPC_H__
 
+#include <memory>
 #include <vector>
 
 #include "libcamera/internal/ipc_unixsocket.h"
@@ -54,7 +55,7 @@ public:
 	bool isConnected() const { return connected_; }
 
 	virtual int sendSync(const IPCMessage &in,
-			     IPCMessage *out) = 0;
+			     IPCMessage *out = nullptr) = 0;
 
 	virtual int sendAsync(const IPCMessage &data) = 0;
 
@@ -64,6 +65,9 @@ protected:
 	bool connected_;
 };
 
+std::unique_ptr<IPCPipe> createIPCPipe(const char *ipaModulePath,
+				       const char *ipaProxyWorkerPath);
+
 } /* namespace libcamera */
 
 #endif /* __LIBCAMERA_INTERNAL_IPA_IPC_H__ */
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipc_pipe_shared_memory.h - Image Processing Algorithm IPC module using shared memory
+ */
+#ifndef __LIBCAMERA_INTERNAL_IPC_PIPE_SHARED_MEMORY_H__
+#define __LIBCAMERA_INTERNAL_IPC_PIPE_SHARED_MEMORY_H__
+
+#include "libcamera/internal/ipc_pipe_transport.h"
+#include "libcamera/internal/ipc_shared_memory.h"
+
+namespace libcamera {
+
+template<>
+const char *IPCPipeTransport<IPCSharedMemory>::name();
+
+extern template class IPCPipeTransport<IPCSharedMemory>;
+
+using IPCPipeSharedMemory = IPCPipeTransport<IPCSharedMemory>;
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_IPC_PIPE_SHARED_MEMORY_H__ */
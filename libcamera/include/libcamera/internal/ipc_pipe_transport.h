@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * ipc_pipe_transport.h - Image Processing Algorithm IPC module over a transport
+ */
+#ifndef __LIBCAMERA_INTERNAL_IPC_PIPE_TRANSPORT_H__
+#define __LIBCAMERA_INTERNAL_IPC_PIPE_TRANSPORT_H__
+
+#include <map>
+#include <memory>
+
+#include "libcamera/internal/ipc_pipe.h"
+
+namespace libcamera {
+
+class Process;
+
+template<typename Transport>
+class IPCPipeTransport : public IPCPipe
+{
+public:
+	IPCPipeTransport(const char *ipaModulePath, const char *ipaProxyWorkerPath);
+	~IPCPipeTransport();
+
+	int sendSync(const IPCMessage &in,
+		     IPCMessage *out = nullptr) override;
+
+	int sendAsync(const IPCMessage &data) override;
+
+	static const char *name();
+
+private:
+	struct CallData {
+		typename Transport::Payload *response;
+		bool done;
+	};
+
+	void readyRead(Transport *transport);
+	int call(const typename Transport::Payload &message,
+		 typename Transport::Payload *response, uint32_t seq);
+
+	std::unique_ptr<Process> proc_;
+	std::unique_ptr<Transport> transport_;
+	std::map<uint32_t, CallData> callData_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_IPC_PIPE_TRANSPORT_H__ */
@@ -7,42 +7,17 @@
 #ifndef __LIBCAMERA_INTERNAL_IPA_IPC_UNIXSOCKET_H__
 #define __LIBCAMERA_INTERNAL_IPA_IPC_UNIXSOCKET_H__
 
-#include <map>
-#include <memory>
-#include <vector>
-
-#include "libcamera/internal/ipc_pipe.h"
+#include "libcamera/internal/ipc_pipe_transport.h"
 #include "libcamera/internal/ipc_unixsocket.h"
 
 namespace libcamera {
 
-class Process;
-
-class IPCPipeUnixSocket : public IPCPipe
-{
-public:
-	IPCPipeUnixSocket(const char *ipaModulePath, const char *ipaProxyWorkerPath);
-	~IPCPipeUnixSocket();
-
-	int sendSync(const IPCMessage &in,
-		     IPCMessage *out = nullptr) override;
-
-	int sendAsync(const IPCMessage &data) override;
-
-private:
-	struct CallData {
-		IPCUnixSocket::Payload *response;
-		bool done;
-	};
+template<>
+const char *IPCPipeTransport<IPCUnixSocket>::name();
 
-	void readyRead(IPCUnixSocket *socket);
-	int call(const IPCUnixSocket::Payload &message,
-		 IPCUnixSocket::Payload *response, uint32_t seq);
+extern template class IPCPipeTransport<IPCUnixSocket>;
 
-	std::unique_ptr<Process> proc_;
-	std::unique_ptr<IPCUnixSocket> socket_;
-	std::map<uint32_t, CallData> callData_;
-};
+using IPCPipeUnixSocket = IPCPipeTransport<IPCUnixSocket>;
 
 } /* namespace libcamera */
 
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipc_shared_memory.h - IPC mechanism based on shared memory rings
+ */
+
+#ifndef __LIBCAMERA_INTERNAL_IPC_SHARED_MEMORY_H__
+#define __LIBCAMERA_INTERNAL_IPC_SHARED_MEMORY_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include <libcamera/signal.h>
+
+#include "libcamera/internal/ipc_unixsocket.h"
+
+namespace libcamera {
+
+class EventNotifier;
+
+class IPCSharedMemory
+{
+public:
+	using Payload = IPCUnixSocket::Payload;
+
+	static constexpr size_t defaultRingSize = 1024 * 1024;
+
+	IPCSharedMemory(size_t ringSize = defaultRingSize);
+	~IPCSharedMemory();
+
+	int create();
+	int bind(int fd);
+	void close();
+	bool isBound() const;
+
+	int send(const Payload &payload);
+	int receive(Payload *payload);
+
+	Signal<IPCSharedMemory *> readyRead;
+
+private:
+	struct Ring;
+	struct SharedArea;
+
+	int setup(int fd, int memfd, int eventfdTx, int eventfdRx, bool creator);
+
+	bool ringWrite(const Payload &payload, uint32_t seq);
+	int ringPeek(uint32_t *seq, uint32_t *size);
+	void ringRead(uint32_t size, Payload *payload);
+
+	int socketSend(const Payload &payload, uint32_t seq);
+	int socketReceive();
+
+	int messageAvailable();
+	int protocolError(int error);
+	void dispatch();
+
+	void eventNotifier(EventNotifier *notifier);
+	void socketNotifier(EventNotifier *notifier);
+
+	size_t ringSize_;
+
+	int fd_;
+	int eventfdTx_;
+	int eventfdRx_;
+
+	SharedArea *area_;
+	size_t areaSize_;
+	Ring *tx_;
+	Ring *rx_;
+	uint8_t *txData_;
+	uint8_t *rxData_;
+
+	uint32_t sendSeq_;
+	uint32_t recvSeq_;
+
+	bool pendingValid_;
+	uint32_t pendingSeq_;
+	Payload pending_;
+
+	int error_;
+
+	EventNotifier *eventNotifier_;
+	EventNotifier *socketNotifier_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_IPC_SHARED_MEMORY_H__ */
@@ -40,6 +40,7 @@ public:
 	const std::string driver() const { return driver_; }
 	const std::string deviceNode() const { return deviceNode_; }
 	const std::string model() const { return model_; }
+	const std::string busInfo() const { return busInfo_; }
 	unsigned int version() const { return version_; }
 	unsigned int hwRevision() const { return hwRevision_; }
 
@@ -79,6 +80,7 @@ private:
 	std::string driver_;
 	std::string deviceNode_;
 	std::string model_;
+	std::string busInfo_;
 	unsigned int version_;
 	unsigned int hwRevision_;
 
@@ -14,6 +14,7 @@
 namespace libcamera {
 
 class BoundMethodBase;
+class MessageQueue;
 class Object;
 class Semaphore;
 class Thread;
@@ -38,10 +39,12 @@ public:
 	static Type registerMessageType();
 
 private:
+	friend class MessageQueue;
 	friend class Thread;
 
 	Type type_;
 	Object *receiver_;
+	Message *next_;
 
 	static std::atomic_uint nextUserType_;
 };
@@ -55,6 +58,9 @@ public:
 		      bool deleteMethod = false);
 	~InvokeMessage();
 
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
 	Semaphore *semaphore() const { return semaphore_; }
 
 	void invoke();
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * pool_allocator.h - Thread-caching pool for small short-lived allocations
+ */
+#ifndef __LIBCAMERA_INTERNAL_POOL_ALLOCATOR_H__
+#define __LIBCAMERA_INTERNAL_POOL_ALLOCATOR_H__
+
+#include <stddef.h>
+
+namespace libcamera {
+
+class PoolAllocator
+{
+public:
+	static constexpr size_t granularity = 32;
+	static constexpr size_t maxSize = 512;
+
+	static void *allocate(size_t size);
+	static void deallocate(void *ptr, size_t size);
+
+	static unsigned int systemAllocations();
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_POOL_ALLOCATOR_H__ */
@@ -21,6 +21,7 @@ namespace libcamera {
 
 class EventDispatcher;
 class Message;
+class MessageQueue;
 class Object;
 class ThreadData;
 class ThreadMain;
@@ -60,6 +61,8 @@ private:
 	void postMessage(std::unique_ptr<Message> msg, Object *receiver);
 	void removeMessages(Object *receiver);
 
+	static void collectMessages(MessageQueue &queue);
+
 	friend class Object;
 	friend class ThreadData;
 	friend class ThreadMain;
@@ -15,6 +15,7 @@
 #include <string>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/types.h>
 #include <vector>
 
 #ifndef __DOXYGEN__
@@ -34,6 +35,8 @@ const char *basename(const char *path);
 
 char *secure_getenv(const char *name);
 std::string dirname(const std::string &path);
+int mkdirs(const std::string &path, mode_t mode = 0755);
+int write_file_atomic(const std::string &path, const std::string &data);
 
 template<typename T>
 std::vector<typename T::key_type> map_keys(const T &map)
@@ -7,6 +7,8 @@
 #ifndef __ANDROID_JPEG_ENCODER_H__
 #define __ANDROID_JPEG_ENCODER_H__
 
+#include <functional>
+
 #include <libcamera/buffer.h>
 #include <libcamera/span.h>
 #include <libcamera/stream.h>
@@ -14,12 +16,19 @@
 class Encoder
 {
 public:
+	/*
+	 * Generate the Exif data of the image. The encoder calls it at most
+	 * once, when it needs to write the Exif data, which may be after the
+	 * image has been compressed.
+	 */
+	using ExifGenerator = std::function<libcamera::Span<const uint8_t>()>;
+
 	virtual ~Encoder() = default;
 
 	virtual int configure(const libcamera::StreamConfiguration &cfg) = 0;
 	virtual int encode(const libcamera::FrameBuffer &source,
 			   libcamera::Span<uint8_t> destination,
-			   libcamera::Span<const uint8_t> exifData,
+			   const ExifGenerator &exif,
 			   unsigned int quality) = 0;
 };
 
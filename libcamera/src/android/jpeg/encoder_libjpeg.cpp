@@ -7,12 +7,15 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -65,9 +68,49 @@ const struct JPEGPixelFormatInfo &findPixelInfo(const PixelFormat &format)
 	return iter->second;
 }
 
+/* Images of at least this number of pixels are encoded in stripes. */
+constexpr unsigned int kStripesMinPixels = 2 * 1024 * 1024;
+
+/*
+ * Find the end of the JFIF APP0 segment that libjpeg writes after the SOI
+ * marker, and the end of the SOS segment that precedes the entropy-coded
+ * data. The \a sof pointer is set to the SOF segment, if any.
+ */
+bool parseHeaders(const uint8_t *data, unsigned long size, unsigned long *app0End,
+		  unsigned long *sosEnd, unsigned long *sof)
+{
+	unsigned long offset = 2;
+
+	*app0End = 2;
+	*sof = 0;
+
+	while (offset + 4 <= size && data[offset] == 0xff) {
+		uint8_t marker = data[offset + 1];
+		unsigned long length = (data[offset + 2] << 8) | data[offset + 3];
+		unsigned long end = offset + 2 + length;
+
+		if (end > size)
+			return false;
+
+		if (marker == 0xe0 && offset == 2)
+			*app0End = end;
+		else if (marker == 0xc0)
+			*sof = offset;
+		else if (marker == 0xda) {
+			*sosEnd = end;
+			return *sof != 0;
+		}
+
+		offset = end;
+	}
+
+	return false;
+}
+
 } /* namespace */
 
 EncoderLibJpeg::EncoderLibJpeg()
+	: threads_(0)
 {
 	/* \todo Expand error handling coverage with a custom handler. */
 	compress_.err = jpeg_std_error(&jerr_);
@@ -99,9 +142,41 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
 
+	if (nv_) {
+		unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+
+		horzSubSample_ = 2 * compress_.image_width / c_stride;
+		vertSubSample_ = pixelFormatInfo_->planes[1].verticalSubSampling;
+
+		configureRawData(&compress_);
+	}
+
 	return 0;
 }
 
+/*
+ * The NV formats are passed to libjpeg as raw downsampled data, which skips
+ * the color conversion and downsampling steps of libjpeg, and lets the luma
+ * rows be read from the frame in place. Only the interleaved chroma samples
+ * need to be split in separate planes.
+ *
+ * A restart marker is written after each MCU row, whether the image is
+ * encoded in stripes or not, for the output not to depend on the number of
+ * stripes.
+ */
+void EncoderLibJpeg::configureRawData(struct jpeg_compress_struct *compress) const
+{
+	compress->raw_data_in = TRUE;
+	compress->restart_in_rows = 1;
+
+	compress->comp_info[0].h_samp_factor = horzSubSample_;
+	compress->comp_info[0].v_samp_factor = vertSubSample_;
+	compress->comp_info[1].h_samp_factor = 1;
+	compress->comp_info[1].v_samp_factor = 1;
+	compress->comp_info[2].h_samp_factor = 1;
+	compress->comp_info[2].v_samp_factor = 1;
+}
+
 void EncoderLibJpeg::compressRGB(Span<const uint8_t> frame)
 {
 	unsigned char *src = const_cast<unsigned char *>(frame.data());
@@ -117,68 +192,281 @@ void EncoderLibJpeg::compressRGB(Span<const uint8_t> frame)
 }
 
 /*
- * Compress the incoming buffer from a supported NV format.
- * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
+ * Compress the rows of the incoming buffer, from a supported NV format, that
+ * the \a compress instance is configured for, starting at \a firstRow.
  */
-void EncoderLibJpeg::compressNV(Span<const uint8_t> frame)
+void EncoderLibJpeg::compressNV(struct jpeg_compress_struct *compress,
+				Span<const uint8_t> frame,
+				unsigned int firstRow) const
 {
-	uint8_t tmprowbuf[compress_.image_width * 3];
-
-	/*
-	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
-	 * buffers. If possible, see if we can set appropriate pixel strides
-	 * too to save even that copy.
-	 *
-	 * Possible hints at:
-	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
-	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
-
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
-	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
+	const unsigned int width = compress->image_width;
+	const unsigned int lastRow = firstRow + compress->image_height - 1;
 
-	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
+	unsigned int y_stride = pixelFormatInfo_->stride(width, 0);
+	unsigned int c_stride = pixelFormatInfo_->stride(width, 1);
+	unsigned int c_width = c_stride / 2;
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 
+	/*
+	 * libjpeg reads whole blocks, so rows are padded to a multiple of the
+	 * block width by replicating the last sample. Luma rows are only
+	 * copied when the width requires padding.
+	 */
+	unsigned int y_padded = (width + DCTSIZE - 1) / DCTSIZE * DCTSIZE;
+	unsigned int c_padded = (c_width + DCTSIZE - 1) / DCTSIZE * DCTSIZE;
+	unsigned int mcu_rows = vertSubSample_ * DCTSIZE;
+
 	const unsigned char *src = frame.data();
 	const unsigned char *src_c = src + y_stride * compress_.image_height;
 
-	JSAMPROW row_pointer[1];
-	row_pointer[0] = &tmprowbuf[0];
-
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
-		unsigned char *dst = &tmprowbuf[0];
-
-		const unsigned char *src_y = src + y * compress_.image_width;
-		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 3;
-
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 3;
+	std::vector<unsigned char> y_buf(y_padded != width ? y_padded * mcu_rows : 0);
+	std::vector<unsigned char> cb_buf(c_padded * DCTSIZE);
+	std::vector<unsigned char> cr_buf(c_padded * DCTSIZE);
+
+	JSAMPROW y_rows[2 * DCTSIZE];
+	JSAMPROW cb_rows[DCTSIZE];
+	JSAMPROW cr_rows[DCTSIZE];
+	JSAMPARRAY planes[3] = { y_rows, cb_rows, cr_rows };
+
+	for (unsigned int y = firstRow; y <= lastRow; y += mcu_rows) {
+		/* Rows past the end of the image replicate the last row. */
+		for (unsigned int i = 0; i < mcu_rows; i++) {
+			unsigned int row = std::min(y + i, lastRow);
+			const unsigned char *src_y = src + row * y_stride;
+
+			if (y_buf.empty()) {
+				y_rows[i] = const_cast<unsigned char *>(src_y);
+				continue;
+			}
+
+			unsigned char *dst = &y_buf[i * y_padded];
+			memcpy(dst, src_y, width);
+			memset(dst + width, src_y[width - 1], y_padded - width);
+			y_rows[i] = dst;
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		for (unsigned int i = 0; i < DCTSIZE; i++) {
+			unsigned int row = std::min(y / vertSubSample_ + i,
+						    lastRow / vertSubSample_);
+			const unsigned char *src_cbcr = src_c + row * c_stride;
+			unsigned char *dst_cb = &cb_buf[i * c_padded];
+			unsigned char *dst_cr = &cr_buf[i * c_padded];
+
+			for (unsigned int x = 0; x < c_width; x++) {
+				dst_cb[x] = src_cbcr[2 * x + cb_pos];
+				dst_cr[x] = src_cbcr[2 * x + cr_pos];
+			}
+
+			memset(dst_cb + c_width, dst_cb[c_width - 1], c_padded - c_width);
+			memset(dst_cr + c_width, dst_cr[c_width - 1], c_padded - c_width);
+
+			cb_rows[i] = dst_cb;
+			cr_rows[i] = dst_cr;
+		}
+
+		jpeg_write_raw_data(compress, planes, mcu_rows);
 	}
 }
 
+/*
+ * Large NV images are split in horizontal stripes of whole MCU rows, encoded
+ * concurrently with a restart marker after each MCU row. As the DC predictors
+ * are reset at restart markers, and all stripes use the same tables, the
+ * entropy-coded data of the stripes can be concatenated into a single scan,
+ * once their restart markers are renumbered. The result is bit-identical to
+ * the encoding of the image in a single stripe.
+ */
+unsigned int EncoderLibJpeg::numStripes() const
+{
+	if (!nv_)
+		return 1;
+
+	unsigned int stripes = threads_;
+	if (!stripes)
+		stripes = compress_.image_width * compress_.image_height >= kStripesMinPixels
+			? std::thread::hardware_concurrency() : 1;
+
+	unsigned int mcu_rows = vertSubSample_ * DCTSIZE;
+	unsigned int rows = (compress_.image_height + mcu_rows - 1) / mcu_rows;
+
+	return std::max(std::min(stripes, rows), 1U);
+}
+
+void EncoderLibJpeg::compressStripe(Span<const uint8_t> frame,
+				    unsigned int quality, Stripe *stripe) const
+{
+	struct jpeg_compress_struct compress;
+	struct jpeg_error_mgr jerr;
+
+	compress.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&compress);
+
+	compress.image_width = compress_.image_width;
+	compress.image_height = stripe->rows;
+	compress.in_color_space = compress_.in_color_space;
+	compress.input_components = compress_.input_components;
+
+	jpeg_set_defaults(&compress);
+	configureRawData(&compress);
+	jpeg_set_quality(&compress, quality, TRUE);
+
+	/* Let libjpeg allocate the output, the stripes are copied later. */
+	stripe->data = nullptr;
+	stripe->size = 0;
+	jpeg_mem_dest(&compress, &stripe->data, &stripe->size);
+
+	jpeg_start_compress(&compress, TRUE);
+	compressNV(&compress, frame, stripe->firstRow);
+	jpeg_finish_compress(&compress);
+
+	jpeg_destroy_compress(&compress);
+}
+
+int EncoderLibJpeg::encodeStripes(Span<const uint8_t> src, Span<uint8_t> dest,
+				  const ExifGenerator &exif,
+				  unsigned int quality, unsigned int numStripes)
+{
+	const unsigned int mcu_rows = vertSubSample_ * DCTSIZE;
+	const unsigned int height = compress_.image_height;
+	const unsigned int rows = (height + mcu_rows - 1) / mcu_rows;
+
+	std::vector<Stripe> stripes(numStripes);
+	for (unsigned int i = 0; i < numStripes; i++) {
+		unsigned int first = rows * i / numStripes * mcu_rows;
+		unsigned int last = std::min(rows * (i + 1) / numStripes * mcu_rows,
+					     height);
+
+		stripes[i].firstRow = first;
+		stripes[i].rows = last - first;
+	}
+
+	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
+			 << "x" << height << " in " << numStripes << " stripes";
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numStripes; i++)
+		threads.emplace_back(&EncoderLibJpeg::compressStripe, this, src,
+				     quality, &stripes[i]);
+
+	compressStripe(src, quality, &stripes[0]);
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	/*
+	 * Assemble the headers of the first stripe, with the Exif data after
+	 * the JFIF marker as jpeg_write_marker() would store it, and the image
+	 * height patched in the SOF segment, followed by the entropy-coded
+	 * data of all stripes and the EOI marker.
+	 */
+	unsigned char *out = dest.data();
+	unsigned long size = 0;
+	int ret = 0;
+
+	auto append = [&](const void *data, unsigned long length) {
+		if (ret || size + length > dest.size()) {
+			ret = -ENOSPC;
+			return;
+		}
+		memcpy(out + size, data, length);
+		size += length;
+	};
+
+	unsigned long app0End, sosEnd, sof;
+	Stripe &first = stripes[0];
+	if (!parseHeaders(first.data, first.size, &app0End, &sosEnd, &sof)) {
+		LOG(JPEG, Error) << "Invalid JPEG stripe";
+		ret = -EINVAL;
+		goto done;
+	}
+
+	first.data[sof + 5] = height >> 8;
+	first.data[sof + 6] = height & 0xff;
+
+	append(first.data, app0End);
+
+	/* The Exif data may have been generated during the compression. */
+	if (exif) {
+		Span<const uint8_t> exifData = exif();
+		if (exifData.size() + 2 > 0xffff) {
+			LOG(JPEG, Error) << "Exif data too large";
+			ret = -EINVAL;
+			goto done;
+		}
+
+		if (exifData.size()) {
+			const uint8_t app1[] = {
+				0xff, JPEG_APP0 + 1,
+				static_cast<uint8_t>((exifData.size() + 2) >> 8),
+				static_cast<uint8_t>((exifData.size() + 2) & 0xff),
+			};
+			append(app1, sizeof(app1));
+			append(exifData.data(), exifData.size());
+		}
+	}
+
+	append(first.data + app0End, sosEnd - app0End);
+
+	for (unsigned int i = 0; i < numStripes && !ret; i++) {
+		Stripe &stripe = stripes[i];
+		unsigned long app0, sos, sofOffset;
+
+		if (!parseHeaders(stripe.data, stripe.size, &app0, &sos, &sofOffset)) {
+			LOG(JPEG, Error) << "Invalid JPEG stripe";
+			ret = -EINVAL;
+			break;
+		}
+
+		/*
+		 * Copy the entropy-coded data up to the EOI marker, and number
+		 * the restart markers from the first MCU row of the stripe. A
+		 * 0xff byte in the data is always followed by a stuffed 0x00
+		 * or by a marker code, so markers can't be mismatched.
+		 */
+		unsigned int restart = stripe.firstRow / mcu_rows;
+		const uint8_t *data = stripe.data + sos;
+		const uint8_t *end = stripe.data + stripe.size - 2;
+
+		while (data < end && !ret) {
+			const uint8_t *marker = static_cast<const uint8_t *>(
+				memchr(data, 0xff, end - data - 1));
+			if (!marker) {
+				append(data, end - data);
+				break;
+			}
+
+			append(data, marker - data + 1);
+			uint8_t code = marker[1];
+			if (code >= JPEG_RST0 && code <= JPEG_RST0 + 7)
+				code = JPEG_RST0 + restart++ % 8;
+			append(&code, 1);
+			data = marker + 2;
+		}
+
+		if (i + 1 < numStripes) {
+			const uint8_t rst[] = { 0xff, static_cast<uint8_t>(JPEG_RST0 + restart % 8) };
+			append(rst, sizeof(rst));
+		}
+	}
+
+	{
+		const uint8_t eoi[] = { 0xff, JPEG_EOI };
+		append(eoi, sizeof(eoi));
+	}
+
+done:
+	for (Stripe &stripe : stripes)
+		free(stripe.data);
+
+	if (ret == -ENOSPC)
+		LOG(JPEG, Error) << "JPEG destination buffer too small";
+
+	return ret ? ret : size;
+}
+
 int EncoderLibJpeg::encode(const FrameBuffer &source, Span<uint8_t> dest,
-			   Span<const uint8_t> exifData, unsigned int quality)
+			   const ExifGenerator &exif, unsigned int quality)
 {
 	MappedFrameBuffer frame(&source, PROT_READ);
 	if (!frame.isValid()) {
@@ -187,15 +475,33 @@ int EncoderLibJpeg::encode(const FrameBuffer &source, Span<uint8_t> dest,
 		return frame.error();
 	}
 
-	return encode(frame.maps()[0], dest, exifData, quality);
+	return encodeFrame(frame.maps()[0], dest, exif, quality);
 }
 
 int EncoderLibJpeg::encode(Span<const uint8_t> src, Span<uint8_t> dest,
 			   Span<const uint8_t> exifData, unsigned int quality)
+{
+	return encodeFrame(src, dest, [&]() { return exifData; }, quality);
+}
+
+int EncoderLibJpeg::encodeFrame(Span<const uint8_t> src, Span<uint8_t> dest,
+				const ExifGenerator &exif, unsigned int quality)
 {
 	unsigned char *destination = dest.data();
 	unsigned long size = dest.size();
 
+	unsigned int stripes = numStripes();
+	if (stripes > 1)
+		return encodeStripes(src, dest, exif, quality, stripes);
+
+	/*
+	 * libjpeg writes the frame headers before the first row is
+	 * compressed, the Exif data is thus generated first.
+	 */
+	Span<const uint8_t> exifData;
+	if (exif)
+		exifData = exif();
+
 	jpeg_set_quality(&compress_, quality, TRUE);
 
 	/*
@@ -220,7 +526,7 @@ int EncoderLibJpeg::encode(Span<const uint8_t> src, Span<uint8_t> dest,
 			 << "x" << compress_.image_height;
 
 	if (nv_)
-		compressNV(src);
+		compressNV(&compress_, src, 0);
 	else
 		compressRGB(src);
 
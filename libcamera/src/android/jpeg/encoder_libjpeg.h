@@ -9,6 +9,8 @@
 
 #include "encoder.h"
 
+#include <vector>
+
 #include "libcamera/internal/buffer.h"
 #include "libcamera/internal/formats.h"
 
@@ -23,16 +25,41 @@ public:
 	int configure(const libcamera::StreamConfiguration &cfg) override;
 	int encode(const libcamera::FrameBuffer &source,
 		   libcamera::Span<uint8_t> destination,
-		   libcamera::Span<const uint8_t> exifData,
+		   const ExifGenerator &exif,
 		   unsigned int quality) override;
 	int encode(libcamera::Span<const uint8_t> source,
 		   libcamera::Span<uint8_t> destination,
 		   libcamera::Span<const uint8_t> exifData,
 		   unsigned int quality);
 
+	void setThreads(unsigned int threads) { threads_ = threads; }
+
 private:
+	struct Stripe {
+		unsigned int firstRow;
+		unsigned int rows;
+		unsigned char *data;
+		unsigned long size;
+	};
+
+	int encodeFrame(libcamera::Span<const uint8_t> src,
+			libcamera::Span<uint8_t> dest,
+			const ExifGenerator &exif, unsigned int quality);
+
+	void configureRawData(struct jpeg_compress_struct *compress) const;
+
 	void compressRGB(libcamera::Span<const uint8_t> frame);
-	void compressNV(libcamera::Span<const uint8_t> frame);
+	void compressNV(struct jpeg_compress_struct *compress,
+			libcamera::Span<const uint8_t> frame,
+			unsigned int firstRow) const;
+
+	unsigned int numStripes() const;
+	void compressStripe(libcamera::Span<const uint8_t> frame,
+			    unsigned int quality, Stripe *stripe) const;
+	int encodeStripes(libcamera::Span<const uint8_t> src,
+			  libcamera::Span<uint8_t> dest,
+			  const ExifGenerator &exif,
+			  unsigned int quality, unsigned int numStripes);
 
 	struct jpeg_compress_struct compress_;
 	struct jpeg_error_mgr jerr_;
@@ -41,6 +68,10 @@ private:
 
 	bool nv_;
 	bool nvSwap_;
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+
+	unsigned int threads_;
 };
 
 #endif /* __ANDROID_JPEG_ENCODER_LIBJPEG_H__ */
@@ -8,6 +8,7 @@
 #include "post_processor_jpeg.h"
 
 #include <chrono>
+#include <thread>
 
 #include "../camera_device.h"
 #include "../camera_metadata.h"
@@ -132,6 +133,10 @@ int PostProcessorJpeg::process(const FrameBuffer &source,
 					 entry.data.i64, 1);
 	}
 
+	std::vector<unsigned char> thumbnail;
+	std::thread thumbnailThread;
+	uint8_t thumbnailQuality;
+
 	ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_SIZE, &entry);
 	if (ret) {
 		const int32_t *data = entry.data.i32;
@@ -139,15 +144,20 @@ int PostProcessorJpeg::process(const FrameBuffer &source,
 				       static_cast<uint32_t>(data[1]) };
 
 		ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, &entry);
-		uint8_t quality = ret ? *entry.data.u8 : 95;
-		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, &quality, 1);
-
-		if (thumbnailSize != Size(0, 0)) {
-			std::vector<unsigned char> thumbnail;
-			generateThumbnail(source, thumbnailSize, quality, &thumbnail);
-			if (!thumbnail.empty())
-				exif.setThumbnail(thumbnail, Exif::Compression::JPEG);
-		}
+		thumbnailQuality = ret ? *entry.data.u8 : 95;
+		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY,
+					 &thumbnailQuality, 1);
+
+		/*
+		 * The thumbnail is scaled and encoded concurrently with the
+		 * main image, and the Exif data is generated once the encoder
+		 * needs it.
+		 */
+		if (thumbnailSize != Size(0, 0))
+			thumbnailThread = std::thread(&PostProcessorJpeg::generateThumbnail,
+						      this, std::cref(source),
+						      thumbnailSize, thumbnailQuality,
+						      &thumbnail);
 
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_SIZE, data, 2);
 	}
@@ -167,15 +177,35 @@ int PostProcessorJpeg::process(const FrameBuffer &source,
 					 entry.data.u8, entry.count);
 	}
 
-	if (exif.generate() != 0)
-		LOG(JPEG, Error) << "Failed to generate valid EXIF data";
-
 	ret = requestMetadata.getEntry(ANDROID_JPEG_QUALITY, &entry);
 	const uint8_t quality = ret ? *entry.data.u8 : 95;
 	resultMetadata->addEntry(ANDROID_JPEG_QUALITY, &quality, 1);
 
+	/*
+	 * The encoder writes the Exif data in place, after the thumbnail has
+	 * been completed, without moving the compressed image.
+	 */
+	auto generateExif = [&]() -> Span<const uint8_t> {
+		if (thumbnailThread.joinable())
+			thumbnailThread.join();
+
+		if (!thumbnail.empty())
+			exif.setThumbnail(thumbnail, Exif::Compression::JPEG);
+
+		if (exif.generate() != 0) {
+			LOG(JPEG, Error) << "Failed to generate valid EXIF data";
+			return {};
+		}
+
+		return exif.data();
+	};
+
 	int jpeg_size = encoder_->encode(source, destination->plane(0),
-					 exif.data(), quality);
+					 generateExif, quality);
+
+	if (thumbnailThread.joinable())
+		thumbnailThread.join();
+
 	if (jpeg_size < 0) {
 		LOG(JPEG, Error) << "Failed to encode stream image";
 		return jpeg_size;
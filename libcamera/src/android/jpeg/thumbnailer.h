@@ -7,6 +7,8 @@
 #ifndef __ANDROID_JPEG_THUMBNAILER_H__
 #define __ANDROID_JPEG_THUMBNAILER_H__
 
+#include "../yuv/box_scaler.h"
+
 #include <libcamera/geometry.h>
 
 #include "libcamera/internal/buffer.h"
@@ -27,6 +29,7 @@ public:
 private:
 	libcamera::PixelFormat pixelFormat_;
 	libcamera::Size sourceSize_;
+	BoxScaler scaler_;
 
 	bool valid_;
 };
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * box_scaler.cpp - NV12 box filter scaler
+ */
+
+#include "box_scaler.h"
+
+#include <algorithm>
+
+using namespace libcamera;
+
+namespace {
+
+/*
+ * Compute the source taps at the edges of the destination samples along one
+ * axis. Destination sample i is filtered from taps i and i + 1, the source
+ * samples in which its area starts and ends, so neighbouring destination
+ * samples share a tap.
+ */
+std::vector<unsigned int> edgeTaps(unsigned int source, unsigned int destination)
+{
+	std::vector<unsigned int> taps(destination + 1);
+
+	for (unsigned int i = 0; i <= destination; i++) {
+		uint64_t tap = static_cast<uint64_t>(i) * source / destination;
+		taps[i] = std::min<uint64_t>(tap, source - 1);
+	}
+
+	return taps;
+}
+
+} /* namespace */
+
+/**
+ * \brief Configure the scaler for a source and destination size
+ * \param[in] sourceSize The size of the source NV12 images
+ * \param[in] destinationSize The size of the destination NV12 images
+ *
+ * The source taps of all rows and columns are computed once here, and reused
+ * for all images.
+ */
+void BoxScaler::configure(const Size &sourceSize, const Size &destinationSize)
+{
+	sourceSize_ = sourceSize;
+	destinationSize_ = destinationSize;
+
+	lumaCols_ = edgeTaps(sourceSize.width, destinationSize.width);
+	lumaRows_ = edgeTaps(sourceSize.height, destinationSize.height);
+	chromaCols_ = edgeTaps((sourceSize.width + 1) / 2,
+			       (destinationSize.width + 1) / 2);
+	chromaRows_ = edgeTaps((sourceSize.height + 1) / 2,
+			       (destinationSize.height + 1) / 2);
+}
+
+/*
+ * Two destination rows are produced per pass from three rows of taps, which
+ * halves the loads of the shared middle row. The vertical sums carry half of
+ * the rounding offset each, so the sum of four taps needs a single shift.
+ */
+template<unsigned int Components>
+void BoxScaler::scalePlane(const uint8_t *src, unsigned int srcStride,
+			   uint8_t *dst, unsigned int dstStride,
+			   const std::vector<unsigned int> &cols,
+			   const std::vector<unsigned int> &rows) const
+{
+	if (cols.size() < 2 || rows.size() < 2)
+		return;
+
+	const unsigned int *taps = cols.data();
+	const unsigned int width = cols.size() - 1;
+	const unsigned int height = rows.size() - 1;
+	unsigned int y = 0;
+
+	for (; y + 2 <= height; y += 2) {
+		const uint8_t *top = src + rows[y] * srcStride;
+		const uint8_t *middle = src + rows[y + 1] * srcStride;
+		const uint8_t *bottom = src + rows[y + 2] * srcStride;
+		uint8_t *line0 = dst + y * dstStride;
+		uint8_t *line1 = line0 + dstStride;
+
+		unsigned int left0[Components];
+		unsigned int left1[Components];
+
+		for (unsigned int c = 0; c < Components; c++) {
+			unsigned int offset = taps[0] * Components + c;
+			left0[c] = top[offset] + middle[offset] + 1;
+			left1[c] = middle[offset] + bottom[offset] + 1;
+		}
+
+		for (unsigned int x = 0; x < width; x++) {
+			const unsigned int offset = taps[x + 1] * Components;
+
+			for (unsigned int c = 0; c < Components; c++) {
+				unsigned int centre = middle[offset + c];
+				unsigned int right0 = top[offset + c] + centre + 1;
+				unsigned int right1 = centre + bottom[offset + c] + 1;
+
+				line0[x * Components + c] = (left0[c] + right0) >> 2;
+				line1[x * Components + c] = (left1[c] + right1) >> 2;
+
+				left0[c] = right0;
+				left1[c] = right1;
+			}
+		}
+	}
+
+	if (y == height)
+		return;
+
+	/* The last row of an odd height. */
+	const uint8_t *top = src + rows[y] * srcStride;
+	const uint8_t *bottom = src + rows[y + 1] * srcStride;
+	uint8_t *line = dst + y * dstStride;
+
+	unsigned int left[Components];
+
+	for (unsigned int c = 0; c < Components; c++) {
+		unsigned int offset = taps[0] * Components + c;
+		left[c] = top[offset] + bottom[offset] + 1;
+	}
+
+	for (unsigned int x = 0; x < width; x++) {
+		const unsigned int offset = taps[x + 1] * Components;
+
+		for (unsigned int c = 0; c < Components; c++) {
+			unsigned int right = top[offset + c] + bottom[offset + c] + 1;
+			line[x * Components + c] = (left[c] + right) >> 2;
+			left[c] = right;
+		}
+	}
+}
+
+/**
+ * \brief Scale an NV12 image
+ * \param[in] srcY The source luma plane
+ * \param[in] srcStrideY The source luma plane stride in bytes
+ * \param[in] srcUV The source chroma plane
+ * \param[in] srcStrideUV The source chroma plane stride in bytes
+ * \param[out] dstY The destination luma plane
+ * \param[in] dstStrideY The destination luma plane stride in bytes
+ * \param[out] dstUV The destination chroma plane
+ * \param[in] dstStrideUV The destination chroma plane stride in bytes
+ *
+ * Each destination sample is the average of four taps, at the corners of the
+ * area of the source image it covers. This attenuates the frequencies that
+ * alias with nearest-neighbour sampling when downscaling by large factors, as
+ * for thumbnails. As neighbouring samples share their corners, the scaler
+ * reads one source sample per destination sample, like nearest-neighbour
+ * sampling, instead of the whole source image like an area average.
+ */
+void BoxScaler::scale(const uint8_t *srcY, unsigned int srcStrideY,
+		      const uint8_t *srcUV, unsigned int srcStrideUV,
+		      uint8_t *dstY, unsigned int dstStrideY,
+		      uint8_t *dstUV, unsigned int dstStrideUV) const
+{
+	scalePlane<1>(srcY, srcStrideY, dstY, dstStrideY, lumaCols_, lumaRows_);
+	scalePlane<2>(srcUV, srcStrideUV, dstUV, dstStrideUV,
+		      chromaCols_, chromaRows_);
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * box_scaler.h - NV12 box filter scaler
+ */
+#ifndef __ANDROID_YUV_BOX_SCALER_H__
+#define __ANDROID_YUV_BOX_SCALER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+class BoxScaler
+{
+public:
+	void configure(const libcamera::Size &sourceSize,
+		       const libcamera::Size &destinationSize);
+
+	const libcamera::Size &sourceSize() const { return sourceSize_; }
+	const libcamera::Size &destinationSize() const { return destinationSize_; }
+
+	void scale(const uint8_t *srcY, unsigned int srcStrideY,
+		   const uint8_t *srcUV, unsigned int srcStrideUV,
+		   uint8_t *dstY, unsigned int dstStrideY,
+		   uint8_t *dstUV, unsigned int dstStrideUV) const;
+
+private:
+	template<unsigned int Components>
+	void scalePlane(const uint8_t *src, unsigned int srcStride,
+			uint8_t *dst, unsigned int dstStride,
+			const std::vector<unsigned int> &cols,
+			const std::vector<unsigned int> &rows) const;
+
+	libcamera::Size sourceSize_;
+	libcamera::Size destinationSize_;
+
+	/* The source taps at the edges of the destination rows and columns. */
+	std::vector<unsigned int> lumaCols_;
+	std::vector<unsigned int> lumaRows_;
+	std::vector<unsigned int> chromaCols_;
+	std::vector<unsigned int> chromaRows_;
+};
+
+#endif /* __ANDROID_YUV_BOX_SCALER_H__ */
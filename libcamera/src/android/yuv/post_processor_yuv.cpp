@@ -2,12 +2,14 @@
 /*
  * Copyright (C) 2021, Google Inc.
  *
- * post_processor_yuv.cpp - Post Processor using libyuv
+ * post_processor_yuv.cpp - Post Processor using libyuv, or a box scaler
  */
 
 #include "post_processor_yuv.h"
 
+#if HAVE_LIBYUV
 #include <libyuv/scale.h>
+#endif
 
 #include <libcamera/formats.h>
 #include <libcamera/geometry.h>
@@ -44,6 +46,11 @@ int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 	}
 
 	calculateLengths(inCfg, outCfg);
+
+#if !HAVE_LIBYUV
+	scaler_.configure(inCfg.size, outCfg.size);
+#endif
+
 	return 0;
 }
 
@@ -61,6 +68,7 @@ int PostProcessorYuv::process(const FrameBuffer &source,
 		return -EINVAL;
 	}
 
+#if HAVE_LIBYUV
 	int ret = libyuv::NV12Scale(sourceMapped.maps()[0].data(),
 				    sourceStride_[0],
 				    sourceMapped.maps()[1].data(),
@@ -77,6 +85,12 @@ int PostProcessorYuv::process(const FrameBuffer &source,
 		LOG(YUV, Error) << "Failed NV12 scaling: " << ret;
 		return -EINVAL;
 	}
+#else
+	scaler_.scale(sourceMapped.maps()[0].data(), sourceStride_[0],
+		      sourceMapped.maps()[1].data(), sourceStride_[1],
+		      destination->plane(0).data(), destinationStride_[0],
+		      destination->plane(1).data(), destinationStride_[1]);
+#endif
 
 	return 0;
 }
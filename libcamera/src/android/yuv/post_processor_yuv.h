@@ -2,12 +2,15 @@
 /*
  * Copyright (C) 2021, Google Inc.
  *
- * post_processor_yuv.h - Post Processor using libyuv
+ * post_processor_yuv.h - Post Processor using libyuv, or a box scaler
  */
 #ifndef __ANDROID_POST_PROCESSOR_YUV_H__
 #define __ANDROID_POST_PROCESSOR_YUV_H__
 
 #include "../post_processor.h"
+#if !HAVE_LIBYUV
+#include "box_scaler.h"
+#endif
 
 #include <libcamera/geometry.h>
 
@@ -37,6 +40,10 @@ private:
 	unsigned int destinationLength_[2] = {};
 	unsigned int sourceStride_[2] = {};
 	unsigned int destinationStride_[2] = {};
+
+#if !HAVE_LIBYUV
+	BoxScaler scaler_;
+#endif
 };
 
 #endif /* __ANDROID_POST_PROCESSOR_YUV_H__ */
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * benchmark.cpp - cam - Capture performance statistics
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <time.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+/* Quote a string for JSON, escaping quotes, backslashes and control characters. */
+static std::string jsonString(const std::string &str)
+{
+	std::ostringstream out;
+
+	out << '"';
+
+	for (char c : str) {
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		case '\b':
+			out << "\\b";
+			break;
+		case '\f':
+			out << "\\f";
+			break;
+		case '\n':
+			out << "\\n";
+			break;
+		case '\r':
+			out << "\\r";
+			break;
+		case '\t':
+			out << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				out << "\\u" << std::hex << std::setw(4)
+				    << std::setfill('0')
+				    << static_cast<unsigned int>(c) << std::dec;
+			else
+				out << c;
+			break;
+		}
+	}
+
+	out << '"';
+
+	return out.str();
+}
+
+/*
+ * Histogram buckets are spaced logarithmically, with kBucketsPerOctave buckets
+ * for each power of two, giving a resolution of about 9%.
+ */
+static constexpr unsigned int kBucketsPerOctave = 8;
+
+static double timevalToSeconds(const struct timeval &tv)
+{
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+Benchmark::Benchmark(const std::string &cameraId, CameraConfiguration *config,
+		     const std::map<const Stream *, std::string> &streamNames)
+	: cameraId_(cameraId), config_(config), streamNames_(streamNames),
+	  startTime_(0), stopTime_(0), frames_(0), lastTimestamp_(0)
+{
+}
+
+uint64_t Benchmark::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void Benchmark::start()
+{
+	queueTimes_.clear();
+	streams_.clear();
+	latencies_.clear();
+	intervals_.clear();
+	frames_ = 0;
+	lastTimestamp_ = 0;
+
+	getrusage(RUSAGE_SELF, &startUsage_);
+	startTime_ = now();
+	stopTime_ = 0;
+}
+
+void Benchmark::stop()
+{
+	stopTime_ = now();
+	getrusage(RUSAGE_SELF, &stopUsage_);
+}
+
+/* Return the time elapsed since the benchmark started, in seconds. */
+double Benchmark::elapsed() const
+{
+	uint64_t end = stopTime_ ? stopTime_ : now();
+	return (end - startTime_) / 1000000000.0;
+}
+
+void Benchmark::requestQueued(Request *request)
+{
+	queueTimes_[request] = now();
+}
+
+/*
+ * Account for a completed request. The \a timestamp is the time at which the
+ * camera signalled completion, before the request was deferred to the event
+ * loop.
+ */
+void Benchmark::requestCompleted(Request *request, uint64_t timestamp)
+{
+	auto iter = queueTimes_.find(request);
+	if (iter != queueTimes_.end()) {
+		latencies_.push_back((timestamp - iter->second) / 1000.0);
+		queueTimes_.erase(iter);
+	}
+
+	const Request::BufferMap &buffers = request->buffers();
+	if (buffers.empty())
+		return;
+
+	frames_++;
+
+	/* Compute the frame interval from the sensor timestamps. */
+	uint64_t ts = buffers.begin()->second->metadata().timestamp;
+	if (lastTimestamp_ && ts > lastTimestamp_)
+		intervals_.push_back((ts - lastTimestamp_) / 1000.0);
+	lastTimestamp_ = ts;
+
+	/* Count the frames missing from the sequence of each stream. */
+	for (const auto &[stream, buffer] : buffers) {
+		StreamStats &stats = streams_[stream];
+		unsigned int sequence = buffer->metadata().sequence;
+
+		if (stats.started && sequence > stats.lastSequence)
+			stats.dropped += sequence - stats.lastSequence - 1;
+
+		stats.started = true;
+		stats.lastSequence = sequence;
+		stats.frames++;
+	}
+}
+
+void Benchmark::reportSamples(std::ostream &out, const char *name,
+			      std::vector<double> samples)
+{
+	out << "  " << jsonString(name) << ": {";
+
+	if (samples.empty()) {
+		out << " \"count\": 0 }";
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	double count = samples.size();
+	double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / count;
+	double variance = 0.0;
+	for (double sample : samples)
+		variance += (sample - mean) * (sample - mean);
+	variance /= count;
+
+	auto percentile = [&](double p) {
+		return samples[std::min<size_t>(p * count, samples.size() - 1)];
+	};
+
+	out << std::fixed << std::setprecision(1)
+	    << " \"count\": " << samples.size()
+	    << ", \"min\": " << samples.front()
+	    << ", \"mean\": " << mean
+	    << ", \"stddev\": " << std::sqrt(variance)
+	    << ", \"p50\": " << percentile(0.50)
+	    << ", \"p90\": " << percentile(0.90)
+	    << ", \"p99\": " << percentile(0.99)
+	    << ", \"max\": " << samples.back()
+	    << ",\n    \"histogram\": {";
+
+	/*
+	 * List the non-empty buckets, keyed by their upper bound. Samples are
+	 * sorted, so buckets are filled in order.
+	 */
+	int bucket = 0;
+	unsigned int bucketCount = 0;
+	bool first = true;
+
+	auto flush = [&]() {
+		if (!bucketCount)
+			return;
+
+		out << (first ? " " : ", ") << "\""
+		    << std::setprecision(0)
+		    << std::exp2(static_cast<double>(bucket + 1) / kBucketsPerOctave)
+		    << "\": " << bucketCount;
+		first = false;
+	};
+
+	for (double sample : samples) {
+		int index = std::floor(std::log2(std::max(sample, 1.0)) *
+				       kBucketsPerOctave);
+		if (index != bucket) {
+			flush();
+			bucket = index;
+			bucketCount = 0;
+		}
+
+		bucketCount++;
+	}
+
+	flush();
+
+	out << " } }";
+}
+
+/* Print a summary of the capture statistics as a JSON object. */
+void Benchmark::report(std::ostream &out) const
+{
+	double duration = elapsed();
+	double user = timevalToSeconds(stopUsage_.ru_utime) -
+		      timevalToSeconds(startUsage_.ru_utime);
+	double system = timevalToSeconds(stopUsage_.ru_stime) -
+			timevalToSeconds(startUsage_.ru_stime);
+
+	out << "{\n"
+	    << "  \"camera\": " << jsonString(cameraId_) << ",\n"
+	    << std::fixed << std::setprecision(3)
+	    << "  \"duration\": " << duration << ",\n"
+	    << "  \"frames\": " << frames_ << ",\n"
+	    << "  \"fps\": " << (duration > 0.0 ? frames_ / duration : 0.0)
+	    << ",\n"
+	    << "  \"streams\": [";
+
+	bool first = true;
+	for (const StreamConfiguration &cfg : *config_) {
+		auto iter = streams_.find(cfg.stream());
+		StreamStats stats = iter != streams_.end() ? iter->second
+							   : StreamStats{};
+		auto name = streamNames_.find(cfg.stream());
+
+		out << (first ? "\n" : ",\n")
+		    << "    { \"name\": "
+		    << jsonString(name != streamNames_.end() ? name->second : "")
+		    << ", \"configuration\": " << jsonString(cfg.toString())
+		    << ", \"frames\": " << stats.frames
+		    << ", \"dropped\": " << stats.dropped << " }";
+		first = false;
+	}
+
+	out << "\n  ],\n";
+
+	reportSamples(out, "frame_interval_us", intervals_);
+	out << ",\n";
+	reportSamples(out, "request_latency_us", latencies_);
+	out << ",\n";
+
+	out << std::fixed << std::setprecision(3)
+	    << "  \"cpu\": { \"user\": " << user
+	    << ", \"system\": " << system
+	    << ", \"usage\": " << std::setprecision(1)
+	    << (duration > 0.0 ? (user + system) * 100.0 / duration : 0.0)
+	    << " }\n"
+	    << "}" << std::endl;
+}
@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * benchmark.h - cam - Capture performance statistics
+ */
+#ifndef __CAM_BENCHMARK_H__
+#define __CAM_BENCHMARK_H__
+
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include <libcamera/camera.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+
+class Benchmark
+{
+public:
+	Benchmark(const std::string &cameraId,
+		  libcamera::CameraConfiguration *config,
+		  const std::map<const libcamera::Stream *, std::string> &streamNames);
+
+	void start();
+	void stop();
+	double elapsed() const;
+
+	void requestQueued(libcamera::Request *request);
+	void requestCompleted(libcamera::Request *request, uint64_t timestamp);
+
+	void report(std::ostream &out) const;
+
+	static uint64_t now();
+
+private:
+	struct StreamStats {
+		unsigned int frames = 0;
+		unsigned int dropped = 0;
+		bool started = false;
+		unsigned int lastSequence = 0;
+	};
+
+	static void reportSamples(std::ostream &out, const char *name,
+				  std::vector<double> samples);
+
+	std::string cameraId_;
+	libcamera::CameraConfiguration *config_;
+	std::map<const libcamera::Stream *, std::string> streamNames_;
+
+	uint64_t startTime_;
+	uint64_t stopTime_;
+	struct rusage startUsage_;
+	struct rusage stopUsage_;
+
+	std::map<libcamera::Request *, uint64_t> queueTimes_;
+	std::map<const libcamera::Stream *, StreamStats> streams_;
+	unsigned int frames_;
+	uint64_t lastTimestamp_;
+
+	/* Samples in microseconds. */
+	std::vector<double> latencies_;
+	std::vector<double> intervals_;
+};
+
+#endif /* __CAM_BENCHMARK_H__ */
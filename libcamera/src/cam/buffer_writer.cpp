@@ -5,6 +5,8 @@
  * buffer_writer.cpp - Buffer writer
  */
 
+#include <algorithm>
+#include <chrono>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
@@ -17,13 +19,24 @@
 
 using namespace libcamera;
 
+/*
+ * The buffer writer hands frames to a worker thread, to keep file I/O out of
+ * the event loop. Buffers are returned through the bufferWritten signal once
+ * written, and the queue depth is thus bounded by the number of buffers the
+ * caller cycles through.
+ */
 BufferWriter::BufferWriter(const std::string &pattern)
-	: pattern_(pattern)
+	: pattern_(pattern), fd_(-1), offset_(0), running_(false),
+	  framesWritten_(0), bytesWritten_(0), writeTime_(0.0),
+	  queueHighWater_(0)
 {
+	singleFile_ = pattern_.find_first_of('#') == std::string::npos;
 }
 
 BufferWriter::~BufferWriter()
 {
+	stop();
+
 	for (auto &iter : mappedBuffers_) {
 		void *memory = iter.second.first;
 		unsigned int length = iter.second.second;
@@ -32,6 +45,88 @@ BufferWriter::~BufferWriter()
 	mappedBuffers_.clear();
 }
 
+/*
+ * Start the worker thread. When all frames are written to a single file, open
+ * it in append mode, reserve \a reserve bytes of disk space for the frames to
+ * come, and record the location of each frame in an index file next to it.
+ */
+int BufferWriter::start(uint64_t reserve)
+{
+	if (running_)
+		return -EBUSY;
+
+	if (singleFile_) {
+		fd_ = ::open(pattern_.c_str(), O_CREAT | O_WRONLY | O_APPEND,
+			     S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd_ == -1)
+			return -errno;
+
+		off_t end = lseek(fd_, 0, SEEK_END);
+		offset_ = end > 0 ? end : 0;
+
+		/* Preallocation is an optimization, ignore failures. */
+		if (reserve)
+			fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset_, reserve);
+
+		std::string indexName = pattern_ + ".idx";
+		bool empty = access(indexName.c_str(), F_OK) != 0;
+
+		index_.open(indexName, std::ios::out | std::ios::app);
+		if (!index_.is_open()) {
+			close(fd_);
+			fd_ = -1;
+			return -EIO;
+		}
+
+		if (empty)
+			index_ << "# stream sequence timestamp offset size" << std::endl;
+	}
+
+	framesWritten_ = 0;
+	bytesWritten_ = 0;
+	writeTime_ = 0.0;
+	queueHighWater_ = 0;
+
+	running_ = true;
+	thread_ = std::thread(&BufferWriter::threadMain, this);
+
+	return 0;
+}
+
+/*
+ * Write all queued frames, stop the worker thread and report the write
+ * throughput.
+ */
+void BufferWriter::stop()
+{
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		if (!running_)
+			return;
+
+		running_ = false;
+	}
+
+	cv_.notify_one();
+	thread_.join();
+
+	if (fd_ != -1) {
+		close(fd_);
+		fd_ = -1;
+	}
+
+	index_.close();
+
+	double mbytes = bytesWritten_ / 1000000.0;
+	std::cout << "Wrote " << framesWritten_ << " buffers, "
+		  << std::fixed << std::setprecision(1) << mbytes << " MB in "
+		  << std::setprecision(3) << writeTime_ << " s ("
+		  << std::setprecision(1)
+		  << (writeTime_ > 0.0 ? mbytes / writeTime_ : 0.0)
+		  << " MB/s), queue high-water mark " << queueHighWater_
+		  << std::endl;
+}
+
 void BufferWriter::mapBuffer(FrameBuffer *buffer)
 {
 	for (const FrameBuffer::Plane &plane : buffer->planes()) {
@@ -43,32 +138,29 @@ void BufferWriter::mapBuffer(FrameBuffer *buffer)
 	}
 }
 
+/*
+ * Queue the buffer for writing. The buffer must not be reused until the
+ * bufferWritten signal is emitted for it, from the worker thread.
+ */
 int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
 {
-	std::string filename;
-	size_t pos;
-	int fd, ret = 0;
+	if (!running_)
+		return -EINVAL;
 
-	filename = pattern_;
-	pos = filename.find_first_of('#');
-	if (pos != std::string::npos) {
-		std::stringstream ss;
-		ss << streamName << "-" << std::setw(6)
-		   << std::setfill('0') << buffer->metadata().sequence;
-		filename.replace(pos, 1, ss.str());
-	}
-
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	if (fd == -1)
-		return -errno;
+	Job job;
+	job.buffer = buffer;
+	job.streamName = streamName;
+	job.sequence = buffer->metadata().sequence;
+	job.timestamp = buffer->metadata().timestamp;
 
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		const FrameBuffer::Plane &plane = buffer->planes()[i];
 		const FrameMetadata::Plane &meta = buffer->metadata().planes[i];
 
-		void *data = mappedBuffers_[plane.fd.fd()].first;
+		auto iter = mappedBuffers_.find(plane.fd.fd());
+		if (iter == mappedBuffers_.end())
+			return -ENOENT;
+
 		unsigned int length = std::min(meta.bytesused, plane.length);
 
 		if (meta.bytesused > plane.length)
@@ -76,21 +168,119 @@ int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
 				  << " larger than plane size " << plane.length
 				  << std::endl;
 
-		ret = ::write(fd, data, length);
-		if (ret < 0) {
+		job.iov.push_back({ iter->second.first, length });
+	}
+
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		queue_.push(std::move(job));
+		queueHighWater_ = std::max<unsigned int>(queueHighWater_,
+							 queue_.size());
+	}
+
+	cv_.notify_one();
+
+	return 0;
+}
+
+void BufferWriter::threadMain()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] { return !running_ || !queue_.empty(); });
+
+		/* Drain the queue before stopping. */
+		if (queue_.empty())
+			break;
+
+		Job job = std::move(queue_.front());
+		queue_.pop();
+		locker.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		int ret = writeJob(job);
+		std::chrono::duration<double> duration =
+			std::chrono::steady_clock::now() - start;
+
+		writeTime_ += duration.count();
+		if (!ret)
+			framesWritten_++;
+
+		bufferWritten.emit(job.buffer);
+
+		locker.lock();
+	}
+}
+
+int BufferWriter::writeJob(Job &job)
+{
+	int fd = fd_;
+
+	if (!singleFile_) {
+		std::string filename = pattern_;
+		size_t pos = filename.find_first_of('#');
+		std::stringstream ss;
+		ss << job.streamName << "-" << std::setw(6)
+		   << std::setfill('0') << job.sequence;
+		filename.replace(pos, 1, ss.str());
+
+		fd = open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+			  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd == -1) {
+			int ret = -errno;
+			std::cerr << "failed to open " << filename << ": "
+				  << strerror(-ret) << std::endl;
+			return ret;
+		}
+	}
+
+	/* Write all planes at once, resuming after short writes. */
+	uint64_t size = 0;
+	for (const struct iovec &iov : job.iov)
+		size += iov.iov_len;
+
+	struct iovec *iov = job.iov.data();
+	unsigned int count = job.iov.size();
+	uint64_t written = 0;
+	int ret = 0;
+
+	while (count) {
+		ssize_t len = writev(fd, iov, count);
+		if (len < 0) {
 			ret = -errno;
 			std::cerr << "write error: " << strerror(-ret)
 				  << std::endl;
 			break;
-		} else if (ret != (int)length) {
-			std::cerr << "write error: only " << ret
-				  << " bytes written instead of "
-				  << length << std::endl;
-			break;
+		}
+
+		written += len;
+
+		while (count && static_cast<size_t>(len) >= iov->iov_len) {
+			len -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count) {
+			iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + len;
+			iov->iov_len -= len;
 		}
 	}
 
-	close(fd);
+	bytesWritten_ += written;
+
+	if (!singleFile_) {
+		close(fd);
+		return ret;
+	}
+
+	if (!ret)
+		index_ << job.streamName << " " << job.sequence << " "
+		       << job.timestamp << " " << offset_ << " " << size
+		       << std::endl;
+
+	offset_ += written;
 
 	return ret;
 }
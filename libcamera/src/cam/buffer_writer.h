@@ -7,10 +7,19 @@
 #ifndef __CAM_BUFFER_WRITER_H__
 #define __CAM_BUFFER_WRITER_H__
 
+#include <condition_variable>
+#include <fstream>
 #include <map>
+#include <mutex>
+#include <queue>
+#include <stdint.h>
 #include <string>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
 
 #include <libcamera/buffer.h>
+#include <libcamera/signal.h>
 
 class BufferWriter
 {
@@ -18,14 +27,48 @@ public:
 	BufferWriter(const std::string &pattern = "frame-#.bin");
 	~BufferWriter();
 
+	int start(uint64_t reserve = 0);
+	void stop();
+
 	void mapBuffer(libcamera::FrameBuffer *buffer);
 
 	int write(libcamera::FrameBuffer *buffer,
 		  const std::string &streamName);
 
+	libcamera::Signal<libcamera::FrameBuffer *> bufferWritten;
+
 private:
+	struct Job {
+		libcamera::FrameBuffer *buffer;
+		std::string streamName;
+		unsigned int sequence;
+		uint64_t timestamp;
+		std::vector<struct iovec> iov;
+	};
+
+	void threadMain();
+	int writeJob(Job &job);
+
 	std::string pattern_;
 	std::map<int, std::pair<void *, unsigned int>> mappedBuffers_;
+
+	/* Single file output, when the pattern contains no '#'. */
+	bool singleFile_;
+	int fd_;
+	uint64_t offset_;
+	std::ofstream index_;
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::queue<Job> queue_;
+	bool running_;
+
+	/* Statistics, reported when the worker thread stops. */
+	unsigned int framesWritten_;
+	uint64_t bytesWritten_;
+	double writeTime_;
+	unsigned int queueHighWater_;
 };
 
 #endif /* __CAM_BUFFER_WRITER_H__ */
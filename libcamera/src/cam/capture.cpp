@@ -5,6 +5,8 @@
  * capture.cpp - Cam capture
  */
 
+#include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits.h>
@@ -17,8 +19,9 @@ using namespace libcamera;
 
 Capture::Capture(std::shared_ptr<Camera> camera, CameraConfiguration *config,
 		 EventLoop *loop)
-	: camera_(camera), config_(config), writer_(nullptr), last_(0), loop_(loop),
-	  queueCount_(0), captureCount_(0), captureLimit_(0)
+	: camera_(camera), config_(config), writer_(nullptr),
+	  benchmarkDuration_(0), last_(0), loop_(loop), queueCount_(0),
+	  captureCount_(0), captureLimit_(0)
 {
 }
 
@@ -47,25 +50,66 @@ int Capture::run(const OptionsParser::Options &options)
 		streamName_[cfg.stream()] = "stream" + std::to_string(index);
 	}
 
-	camera_->requestCompleted.connect(this, &Capture::requestComplete);
+	if (options.isSet(OptBenchmark)) {
+		benchmarkDuration_ = options[OptBenchmark].toInteger();
+		if (!benchmarkDuration_)
+			benchmarkDuration_ = 10;
+
+		/* Open the report file first, to fail before capturing. */
+		if (options.isSet(OptBenchmarkOutput)) {
+			std::string file = options[OptBenchmarkOutput].toString();
+			benchmarkOutput_.open(file);
+			if (!benchmarkOutput_.is_open()) {
+				std::cerr << "Failed to open benchmark output file "
+					  << file << std::endl;
+				return -EINVAL;
+			}
+		}
+
+		benchmark_ = std::make_unique<Benchmark>(camera_->id(), config_,
+							 streamName_);
+	}
 
 	if (options.isSet(OptFile)) {
 		if (!options[OptFile].toString().empty())
 			writer_ = new BufferWriter(options[OptFile]);
 		else
 			writer_ = new BufferWriter();
+
+		/* Reserve disk space when the number of frames is known. */
+		uint64_t frameSize = 0;
+		for (const StreamConfiguration &cfg : *config_)
+			frameSize += cfg.frameSize;
+
+		ret = writer_->start(frameSize * captureLimit_);
+		if (ret < 0) {
+			std::cout << "Failed to open output file" << std::endl;
+			delete writer_;
+			writer_ = nullptr;
+			return ret;
+		}
+
+		writer_->bufferWritten.connect(this, &Capture::bufferWritten);
 	}
 
+	camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
 	FrameBufferAllocator *allocator = new FrameBufferAllocator(camera_);
 
 	ret = capture(allocator);
 
 	if (options.isSet(OptFile)) {
+		writer_->stop();
+		writer_->bufferWritten.disconnect(this);
 		delete writer_;
 		writer_ = nullptr;
 	}
 
+	pendingWrites_.clear();
+	benchmark_.reset();
+	if (benchmarkOutput_.is_open())
+		benchmarkOutput_.close();
+
 	requests_.clear();
 
 	delete allocator;
@@ -128,6 +172,9 @@ int Capture::capture(FrameBufferAllocator *allocator)
 		return ret;
 	}
 
+	if (benchmark_)
+		benchmark_->start();
+
 	for (std::unique_ptr<Request> &request : requests_) {
 		ret = queueRequest(request.get());
 		if (ret < 0) {
@@ -137,19 +184,44 @@ int Capture::capture(FrameBufferAllocator *allocator)
 		}
 	}
 
-	if (captureLimit_)
+	if (benchmark_)
+		std::cout << "Benchmark for " << benchmarkDuration_ << " seconds"
+			  << std::endl;
+	else if (captureLimit_)
 		std::cout << "Capture " << captureLimit_ << " frames" << std::endl;
 	else
 		std::cout << "Capture until user interrupts by SIGINT" << std::endl;
 
+	/*
+	 * Stop the benchmark on time even if requests stop completing, when
+	 * the camera stalls.
+	 */
+	unsigned int timer = 0;
+	if (benchmark_)
+		timer = loop_->addTimer(std::chrono::seconds(benchmarkDuration_),
+					[this]() { loop_->exit(0); });
+
 	ret = loop_->exec();
 	if (ret)
 		std::cout << "Failed to run capture loop" << std::endl;
 
+	if (timer)
+		loop_->cancelTimer(timer);
+
+	if (benchmark_)
+		benchmark_->stop();
+
 	ret = camera_->stop();
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	if (benchmark_) {
+		if (benchmarkOutput_.is_open())
+			benchmark_->report(benchmarkOutput_);
+		else
+			benchmark_->report(std::cout);
+	}
+
 	return ret;
 }
 
@@ -160,6 +232,9 @@ int Capture::queueRequest(Request *request)
 
 	queueCount_++;
 
+	if (benchmark_)
+		benchmark_->requestQueued(request);
+
 	return camera_->queueRequest(request);
 }
 
@@ -170,9 +245,15 @@ void Capture::requestComplete(Request *request)
 
 	/*
 	 * Defer processing of the completed request to the event loop, to avoid
-	 * blocking the camera manager thread.
+	 * blocking the camera manager thread. The completion time is sampled
+	 * here to keep the deferral out of the measured latency.
 	 */
-	loop_->callLater([=]() { processRequest(request); });
+	uint64_t completed = benchmark_ ? Benchmark::now() : 0;
+	loop_->callLater([=]() {
+		if (benchmark_)
+			benchmark_->requestCompleted(request, completed);
+		processRequest(request);
+	});
 }
 
 void Capture::processRequest(Request *request)
@@ -211,11 +292,13 @@ void Capture::processRequest(Request *request)
 				info << "/";
 		}
 
-		if (writer_)
-			writer_->write(buffer, name);
+		if (writer_ && !writer_->write(buffer, name))
+			pendingWrites_[request]++;
 	}
 
-	std::cout << info.str() << std::endl;
+	/* Keep console output out of the benchmark. */
+	if (!benchmark_)
+		std::cout << info.str() << std::endl;
 
 	captureCount_++;
 	if (captureLimit_ && captureCount_ >= captureLimit_) {
@@ -223,6 +306,29 @@ void Capture::processRequest(Request *request)
 		return;
 	}
 
+	/* Queue the request again once the writer is done with its buffers. */
+	if (pendingWrites_.count(request))
+		return;
+
+	request->reuse(Request::ReuseBuffers);
+	queueRequest(request);
+}
+
+void Capture::bufferWritten(FrameBuffer *buffer)
+{
+	/* Called from the writer thread, defer to the event loop. */
+	Request *request = buffer->request();
+	loop_->callLater([=]() { writeComplete(request); });
+}
+
+void Capture::writeComplete(Request *request)
+{
+	auto iter = pendingWrites_.find(request);
+	if (iter == pendingWrites_.end() || --iter->second)
+		return;
+
+	pendingWrites_.erase(iter);
+
 	request->reuse(Request::ReuseBuffers);
 	queueRequest(request);
 }
@@ -7,6 +7,7 @@
 #ifndef __CAM_CAPTURE_H__
 #define __CAM_CAPTURE_H__
 
+#include <fstream>
 #include <memory>
 #include <stdint.h>
 #include <vector>
@@ -17,6 +18,7 @@
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
+#include "benchmark.h"
 #include "buffer_writer.h"
 #include "event_loop.h"
 #include "options.h"
@@ -35,12 +37,18 @@ private:
 	int queueRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
 	void processRequest(libcamera::Request *request);
+	void bufferWritten(libcamera::FrameBuffer *buffer);
+	void writeComplete(libcamera::Request *request);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	libcamera::CameraConfiguration *config_;
 
 	std::map<const libcamera::Stream *, std::string> streamName_;
 	BufferWriter *writer_;
+	std::unique_ptr<Benchmark> benchmark_;
+	unsigned int benchmarkDuration_;
+	std::ofstream benchmarkOutput_;
+	std::map<libcamera::Request *, unsigned int> pendingWrites_;
 	uint64_t last_;
 
 	EventLoop *loop_;
@@ -7,6 +7,7 @@
 
 #include "event_loop.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <event2/event.h>
 #include <event2/thread.h>
@@ -14,6 +15,7 @@
 EventLoop *EventLoop::instance_ = nullptr;
 
 EventLoop::EventLoop()
+	: lastTimerId_(0)
 {
 	assert(!instance_);
 
@@ -26,6 +28,9 @@ EventLoop::~EventLoop()
 {
 	instance_ = nullptr;
 
+	for (std::unique_ptr<Timer> &timer : timers_)
+		event_free(timer->event);
+
 	event_base_free(base_);
 	libevent_global_shutdown();
 }
@@ -58,6 +63,39 @@ void EventLoop::callLater(const std::function<void()> &func)
 	event_base_once(base_, -1, EV_TIMEOUT, dispatchCallback, this, nullptr);
 }
 
+/*
+ * Call \a func once from the event loop after \a timeout. The returned
+ * identifier can be passed to cancelTimer() until the timer fires.
+ */
+unsigned int EventLoop::addTimer(std::chrono::microseconds timeout,
+				 const std::function<void()> &func)
+{
+	std::unique_ptr<Timer> timer = std::make_unique<Timer>();
+	timer->loop = this;
+	timer->id = ++lastTimerId_;
+	timer->event = event_new(base_, -1, 0, timerCallback, timer.get());
+	timer->func = func;
+
+	struct timeval tv;
+	tv.tv_sec = timeout.count() / 1000000;
+	tv.tv_usec = timeout.count() % 1000000;
+	event_add(timer->event, &tv);
+
+	timers_.push_back(std::move(timer));
+
+	return lastTimerId_;
+}
+
+void EventLoop::cancelTimer(unsigned int id)
+{
+	auto iter = std::find_if(timers_.begin(), timers_.end(),
+				 [id](const std::unique_ptr<Timer> &timer) {
+					 return timer->id == id;
+				 });
+	if (iter != timers_.end())
+		removeTimer(iter->get());
+}
+
 void EventLoop::dispatchCallback([[maybe_unused]] evutil_socket_t fd,
 				 [[maybe_unused]] short flags, void *param)
 {
@@ -80,3 +118,21 @@ void EventLoop::dispatchCall()
 
 	call();
 }
+
+void EventLoop::timerCallback([[maybe_unused]] evutil_socket_t fd,
+			      [[maybe_unused]] short flags, void *param)
+{
+	Timer *timer = static_cast<Timer *>(param);
+	std::function<void()> func = std::move(timer->func);
+
+	timer->loop->removeTimer(timer);
+	func();
+}
+
+void EventLoop::removeTimer(Timer *timer)
+{
+	event_free(timer->event);
+	timers_.remove_if([timer](const std::unique_ptr<Timer> &t) {
+		return t.get() == timer;
+	});
+}
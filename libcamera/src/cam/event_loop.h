@@ -7,12 +7,15 @@
 #ifndef __CAM_EVENT_LOOP_H__
 #define __CAM_EVENT_LOOP_H__
 
+#include <chrono>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 
 #include <event2/util.h>
 
+struct event;
 struct event_base;
 
 class EventLoop
@@ -28,7 +31,18 @@ public:
 
 	void callLater(const std::function<void()> &func);
 
+	unsigned int addTimer(std::chrono::microseconds timeout,
+			      const std::function<void()> &func);
+	void cancelTimer(unsigned int id);
+
 private:
+	struct Timer {
+		EventLoop *loop;
+		unsigned int id;
+		struct event *event;
+		std::function<void()> func;
+	};
+
 	static EventLoop *instance_;
 
 	struct event_base *base_;
@@ -37,9 +51,15 @@ private:
 	std::list<std::function<void()>> calls_;
 	std::mutex lock_;
 
+	std::list<std::unique_ptr<Timer>> timers_;
+	unsigned int lastTimerId_;
+
 	static void dispatchCallback(evutil_socket_t fd, short flags,
 				     void *param);
 	void dispatchCall();
+
+	static void timerCallback(evutil_socket_t fd, short flags, void *param);
+	void removeTimer(Timer *timer);
 };
 
 #endif /* __CAM_EVENT_LOOP_H__ */
@@ -169,6 +169,14 @@ int CamApp::parseOptions(int argc, char *argv[])
 	StreamKeyValueParser streamKeyValue;
 
 	OptionsParser parser;
+	parser.addOption(OptBenchmark, OptionInteger,
+			 "Capture for <seconds> seconds (10 by default), and print the frame interval,\n"
+			 "request latency, dropped frames and CPU usage as a JSON object",
+			 "benchmark", ArgumentOptional, "seconds");
+	parser.addOption(OptBenchmarkOutput, OptionString,
+			 "Write the --benchmark JSON object to <file> instead of the standard output,\n"
+			 "keeping it apart from the console messages",
+			 "benchmark-output", ArgumentRequired, "file");
 	parser.addOption(OptCamera, OptionString,
 			 "Specify which camera to operate on, by id or by index", "camera",
 			 ArgumentRequired, "camera");
@@ -178,6 +186,8 @@ int CamApp::parseOptions(int argc, char *argv[])
 	parser.addOption(OptFile, OptionString,
 			 "Write captured frames to disk\n"
 			 "The first '#' character in the file name is expanded to the stream name and frame sequence number.\n"
+			 "Without a '#' character, all frames are appended to a single file, and their\n"
+			 "location is recorded in an index file with a '.idx' suffix.\n"
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename");
 	parser.addOption(OptStream, &streamKeyValue,
@@ -359,7 +369,7 @@ int CamApp::run()
 			return ret;
 	}
 
-	if (options_.isSet(OptCapture)) {
+	if (options_.isSet(OptCapture) || options_.isSet(OptBenchmark)) {
 		Capture capture(camera_, config_.get(), &loop_);
 		return capture.run(options_);
 	}
@@ -8,6 +8,7 @@
 #define __CAM_MAIN_H__
 
 enum {
+	OptBenchmark = 'B',
 	OptCamera = 'c',
 	OptCapture = 'C',
 	OptFile = 'F',
@@ -19,6 +20,7 @@ enum {
 	OptStream = 's',
 	OptListControls = 256,
 	OptStrictFormats = 257,
+	OptBenchmarkOutput = 258,
 };
 
 #endif /* __CAM_MAIN_H__ */
@@ -0,0 +1,982 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * color_converter.cpp - Convert images between YUV and RGB
+ */
+
+#include "color_converter.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <errno.h>
+#include <functional>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <libcamera/formats.h>
+
+/*
+ * The conversion uses the BT.601 limited range coefficients in 8-bit fixed
+ * point. All the kernels compute the same integer expressions as
+ * yuvToRgbScalar(), and are thus bit-exact with the scalar reference.
+ */
+#define RGBSHIFT		8
+
+/* Frames of at least this number of pixels are converted on all CPUs. */
+#define THREADED_MIN_PIXELS	(1024 * 1024)
+
+namespace {
+
+inline uint8_t clip(int value)
+{
+	return std::min(std::max(value, 0), 255);
+}
+
+inline void yuvToRgbScalar(int y, int u, int v, int *r, int *g, int *b)
+{
+	int c = y - 16;
+	int d = u - 128;
+	int e = v - 128;
+	*r = clip(( 298 * c           + 409 * e + 128) >> RGBSHIFT);
+	*g = clip(( 298 * c - 100 * d - 208 * e + 128) >> RGBSHIFT);
+	*b = clip(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
+}
+
+inline void rgbToYuvScalar(int r, int g, int b, uint8_t *y)
+{
+	*y = ((66 * r + 129 * g + 25 * b + 128) >> RGBSHIFT) + 16;
+}
+
+inline void rgbToUvScalar(int r, int g, int b, uint8_t *u, uint8_t *v)
+{
+	*u = ((-38 * r - 74 * g + 112 * b + 128) >> RGBSHIFT) + 128;
+	*v = ((112 * r - 94 * g - 18 * b + 128) >> RGBSHIFT) + 128;
+}
+
+/*
+ * Large frames are converted by a pool of threads created on first use and
+ * shared by all converters, as creating threads for every frame costs more
+ * than the conversion of a band at video rates. The caller thread converts
+ * bands too, and run() returns once all the bands have been converted.
+ * Conversions started concurrently from different threads are serialised.
+ */
+class WorkerPool
+{
+public:
+	static WorkerPool &instance()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+
+	unsigned int size() const { return workers_.size() + 1; }
+
+	void run(unsigned int count, const std::function<void(unsigned int)> &job)
+	{
+		std::lock_guard<std::mutex> runLocker(runMutex_);
+		std::unique_lock<std::mutex> locker(mutex_);
+
+		job_ = &job;
+		next_ = 0;
+		count_ = count;
+		pending_ = count;
+		wake_.notify_all();
+
+		while (next_ < count_)
+			runJob(locker);
+
+		done_.wait(locker, [&] { return !pending_; });
+		job_ = nullptr;
+	}
+
+private:
+	WorkerPool()
+		: job_(nullptr), next_(0), count_(0), pending_(0), stop_(false)
+	{
+		unsigned int threads = std::thread::hardware_concurrency();
+		for (unsigned int i = 1; i < threads; ++i)
+			workers_.emplace_back(&WorkerPool::work, this);
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+
+		for (std::thread &worker : workers_)
+			worker.join();
+	}
+
+	void work()
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+
+		while (true) {
+			wake_.wait(locker, [&] {
+				return stop_ || (job_ && next_ < count_);
+			});
+			if (stop_)
+				return;
+
+			runJob(locker);
+		}
+	}
+
+	void runJob(std::unique_lock<std::mutex> &locker)
+	{
+		const std::function<void(unsigned int)> &job = *job_;
+		unsigned int index = next_++;
+
+		locker.unlock();
+		job(index);
+		locker.lock();
+
+		if (!--pending_)
+			done_.notify_all();
+	}
+
+	std::vector<std::thread> workers_;
+
+	std::mutex runMutex_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	const std::function<void(unsigned int)> *job_;
+	unsigned int next_;
+	unsigned int count_;
+	unsigned int pending_;
+	bool stop_;
+};
+
+} /* namespace */
+
+/**
+ * \class ColorConverter
+ * \brief Convert images between YUV and RGB
+ *
+ * The converter handles the semi-planar (NV12, NV21, NV16, NV61, NV24, NV42),
+ * packed (YUYV, YVYU, UYVY, VYUY) and planar (YUV420, YVU420) YUV formats as
+ * input, converted to XRGB8888, ARGB8888, RGB888 or BGR888. It also converts
+ * RGB888, BGR888 and the 32-bit RGB formats to YUV420, for encoders.
+ *
+ * Images are converted one row at a time, or one pair of rows for YUV420
+ * output. The chroma samples of the row, or the red, green and blue samples of
+ * the pair of rows, are first gathered in contiguous arrays, and then
+ * converted by a kernel for the best instruction set supported by the CPU.
+ * Large frames are split in bands of rows converted concurrently by a pool of
+ * threads shared by all converters.
+ *
+ * The input and output images are contiguous, with planes stored one after the
+ * other without padding.
+ */
+
+/**
+ * \brief Retrieve the instruction sets supported by the CPU
+ * \return The supported instruction sets, the fastest last
+ */
+std::vector<ColorConverter::Isa> ColorConverter::supportedIsas()
+{
+	std::vector<Isa> isas{ Scalar };
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse4.1"))
+		isas.push_back(SSE4);
+	if (__builtin_cpu_supports("avx2"))
+		isas.push_back(AVX2);
+#endif
+#if defined(__ARM_NEON)
+	isas.push_back(NEON);
+#endif
+
+	return isas;
+}
+
+const char *ColorConverter::isaName(Isa isa)
+{
+	switch (isa) {
+	case Scalar:
+		return "scalar";
+	case SSE4:
+		return "SSE4.1";
+	case AVX2:
+		return "AVX2";
+	case NEON:
+		return "NEON";
+	}
+
+	return "unknown";
+}
+
+ColorConverter::ColorConverter()
+	: width_(0), height_(0), threads_(0), kernel_(nullptr),
+	  rgbKernel_(nullptr)
+{
+	setIsa(supportedIsas().back());
+}
+
+int ColorConverter::configure(const libcamera::PixelFormat &input,
+			      const libcamera::PixelFormat &output,
+			      unsigned int width, unsigned int height)
+{
+	horzSubSample_ = 2;
+	vertSubSample_ = 1;
+	swapUV_ = false;
+
+	switch (input) {
+	case libcamera::formats::NV12:
+		inputLayout_ = SemiPlanar;
+		vertSubSample_ = 2;
+		break;
+	case libcamera::formats::NV21:
+		inputLayout_ = SemiPlanar;
+		vertSubSample_ = 2;
+		swapUV_ = true;
+		break;
+	case libcamera::formats::NV16:
+		inputLayout_ = SemiPlanar;
+		break;
+	case libcamera::formats::NV61:
+		inputLayout_ = SemiPlanar;
+		swapUV_ = true;
+		break;
+	case libcamera::formats::NV24:
+		inputLayout_ = SemiPlanar;
+		horzSubSample_ = 1;
+		break;
+	case libcamera::formats::NV42:
+		inputLayout_ = SemiPlanar;
+		horzSubSample_ = 1;
+		swapUV_ = true;
+		break;
+
+	case libcamera::formats::VYUY:
+		inputLayout_ = Packed;
+		y_pos_ = 1;
+		cb_pos_ = 2;
+		break;
+	case libcamera::formats::YVYU:
+		inputLayout_ = Packed;
+		y_pos_ = 0;
+		cb_pos_ = 3;
+		break;
+	case libcamera::formats::UYVY:
+		inputLayout_ = Packed;
+		y_pos_ = 1;
+		cb_pos_ = 0;
+		break;
+	case libcamera::formats::YUYV:
+		inputLayout_ = Packed;
+		y_pos_ = 0;
+		cb_pos_ = 1;
+		break;
+
+	case libcamera::formats::YUV420:
+		inputLayout_ = Planar;
+		vertSubSample_ = 2;
+		break;
+	case libcamera::formats::YVU420:
+		inputLayout_ = Planar;
+		vertSubSample_ = 2;
+		swapUV_ = true;
+		break;
+
+	case libcamera::formats::RGB888:
+		inputLayout_ = RGBInput;
+		bpp_ = 3;
+		r_pos_ = 2;
+		g_pos_ = 1;
+		b_pos_ = 0;
+		break;
+	case libcamera::formats::BGR888:
+		inputLayout_ = RGBInput;
+		bpp_ = 3;
+		r_pos_ = 0;
+		g_pos_ = 1;
+		b_pos_ = 2;
+		break;
+	case libcamera::formats::XRGB8888:
+	case libcamera::formats::ARGB8888:
+		inputLayout_ = RGBInput;
+		bpp_ = 4;
+		r_pos_ = 2;
+		g_pos_ = 1;
+		b_pos_ = 0;
+		break;
+	case libcamera::formats::XBGR8888:
+	case libcamera::formats::ABGR8888:
+		inputLayout_ = RGBInput;
+		bpp_ = 4;
+		r_pos_ = 0;
+		g_pos_ = 1;
+		b_pos_ = 2;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	if (inputLayout_ == RGBInput) {
+		if (output != libcamera::formats::YUV420)
+			return -EINVAL;
+
+		outputLayout_ = I420;
+		vertSubSample_ = 2;
+	} else {
+		switch (output) {
+		case libcamera::formats::XRGB8888:
+		case libcamera::formats::ARGB8888:
+			outputLayout_ = BGRX;
+			break;
+		case libcamera::formats::RGB888:
+			outputLayout_ = BGR;
+			break;
+		case libcamera::formats::BGR888:
+			outputLayout_ = RGB;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	if (width % horzSubSample_ || height % vertSubSample_)
+		return -EINVAL;
+
+	width_ = width;
+	height_ = height;
+
+	return 0;
+}
+
+/**
+ * \brief Select the instruction set of the conversion kernels
+ *
+ * The best instruction set supported by the CPU is selected by default. This
+ * function is meant for tests and benchmarks.
+ *
+ * \return 0 on success, or -ENOTSUP if the CPU doesn't support \a isa
+ */
+int ColorConverter::setIsa(Isa isa)
+{
+	std::vector<Isa> isas = supportedIsas();
+	if (std::find(isas.begin(), isas.end(), isa) == isas.end())
+		return -ENOTSUP;
+
+	/*
+	 * The conversion to YUV420 has no AVX2 kernel, as the SSE4.1 kernel
+	 * is bound by the gathering of the samples.
+	 */
+	switch (isa) {
+	case Scalar:
+		kernel_ = &ColorConverter::yuvToRgbRowScalar;
+		rgbKernel_ = &ColorConverter::rgbToYuvRowsScalar;
+		break;
+#if defined(__x86_64__) || defined(__i386__)
+	case SSE4:
+		kernel_ = &ColorConverter::yuvToRgbRowSSE4;
+		rgbKernel_ = &ColorConverter::rgbToYuvRowsSSE4;
+		break;
+	case AVX2:
+		kernel_ = &ColorConverter::yuvToRgbRowAVX2;
+		rgbKernel_ = &ColorConverter::rgbToYuvRowsSSE4;
+		break;
+#endif
+#if defined(__ARM_NEON)
+	case NEON:
+		kernel_ = &ColorConverter::yuvToRgbRowNEON;
+		rgbKernel_ = &ColorConverter::rgbToYuvRowsNEON;
+		break;
+#endif
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Convert an image
+ *
+ * Frames of at least THREADED_MIN_PIXELS pixels are split in one band per
+ * thread of the worker pool, unless the number of bands has been set with
+ * setThreads().
+ */
+void ColorConverter::convert(const uint8_t *input, uint8_t *output) const
+{
+	unsigned int bands = threads_;
+	if (!bands)
+		bands = width_ * height_ >= THREADED_MIN_PIXELS
+		      ? WorkerPool::instance().size() : 1;
+
+	/* Split the frame in bands of full chroma rows. */
+	unsigned int rows = height_ / vertSubSample_;
+	bands = std::max(std::min(bands, rows), 1U);
+
+	if (bands == 1) {
+		convertRows(input, output, 0, height_);
+		return;
+	}
+
+	WorkerPool::instance().run(bands, [&](unsigned int band) {
+		unsigned int start = rows * band / bands * vertSubSample_;
+		unsigned int end = rows * (band + 1) / bands * vertSubSample_;
+		convertRows(input, output, start, end);
+	});
+}
+
+void ColorConverter::convertRows(const uint8_t *input, uint8_t *output,
+				 unsigned int start, unsigned int end) const
+{
+	if (outputLayout_ == I420)
+		convertToI420(input, output, start, end);
+	else
+		convertToRGB(input, output, start, end);
+}
+
+void ColorConverter::convertToRGB(const uint8_t *input, uint8_t *output,
+				  unsigned int start, unsigned int end) const
+{
+	const unsigned int chromaWidth = width_ / horzSubSample_;
+	const unsigned int bpp = outputLayout_ == BGRX ? 4 : 3;
+	const uint8_t *chroma = input + width_ * height_;
+
+	std::vector<uint8_t> yRow(inputLayout_ == Packed ? width_ : 0);
+	std::vector<uint8_t> uRow(chromaWidth);
+	std::vector<uint8_t> vRow(chromaWidth);
+
+	for (unsigned int row = start; row < end; ++row) {
+		const uint8_t *y = input + row * width_;
+		const uint8_t *u = uRow.data();
+		const uint8_t *v = vRow.data();
+
+		switch (inputLayout_) {
+		case SemiPlanar: {
+			const uint8_t *src = chroma + row / vertSubSample_ *
+					     chromaWidth * 2;
+			uint8_t *cb = swapUV_ ? vRow.data() : uRow.data();
+			uint8_t *cr = swapUV_ ? uRow.data() : vRow.data();
+
+			for (unsigned int x = 0; x < chromaWidth; ++x) {
+				cb[x] = src[2 * x];
+				cr[x] = src[2 * x + 1];
+			}
+			break;
+		}
+
+		case Packed: {
+			const uint8_t *src = input + row * width_ * 2;
+			const unsigned int cr_pos = (cb_pos_ + 2) % 4;
+
+			for (unsigned int x = 0; x < chromaWidth; ++x) {
+				yRow[2 * x] = src[4 * x + y_pos_];
+				yRow[2 * x + 1] = src[4 * x + y_pos_ + 2];
+				uRow[x] = src[4 * x + cb_pos_];
+				vRow[x] = src[4 * x + cr_pos];
+			}
+
+			y = yRow.data();
+			break;
+		}
+
+		case Planar: {
+			const unsigned int planeSize = chromaWidth * height_ / 2;
+			const uint8_t *cb = chroma + row / 2 * chromaWidth;
+
+			u = swapUV_ ? cb + planeSize : cb;
+			v = swapUV_ ? cb : cb + planeSize;
+			break;
+		}
+
+		case RGBInput:
+			return;
+		}
+
+		kernel_(y, u, v, output + row * width_ * bpp, width_,
+			horzSubSample_ == 2, outputLayout_);
+	}
+}
+
+void ColorConverter::convertToI420(const uint8_t *input, uint8_t *output,
+				   unsigned int start, unsigned int end) const
+{
+	const unsigned int stride = width_ * bpp_;
+	const unsigned int chromaWidth = width_ / 2;
+	const unsigned int pos[3] = { r_pos_, g_pos_, b_pos_ };
+	uint8_t *cb = output + width_ * height_;
+	uint8_t *cr = cb + chromaWidth * height_ / 2;
+
+	std::vector<uint8_t> samples(width_ * 6);
+	const uint8_t *rgb[2][3];
+	for (unsigned int i = 0; i < 6; ++i)
+		rgb[i / 3][i % 3] = samples.data() + i * width_;
+
+	for (unsigned int row = start; row < end; row += 2) {
+		uint8_t *const y[2] = { output + row * width_,
+					output + (row + 1) * width_ };
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			const uint8_t *src = input + (row + i) * stride;
+			uint8_t *r = samples.data() + i * 3 * width_;
+			uint8_t *g = r + width_;
+			uint8_t *b = g + width_;
+
+			for (unsigned int x = 0; x < width_; ++x) {
+				r[x] = src[pos[0]];
+				g[x] = src[pos[1]];
+				b[x] = src[pos[2]];
+				src += bpp_;
+			}
+		}
+
+		rgbKernel_(rgb, y, cb + row / 2 * chromaWidth,
+			   cr + row / 2 * chromaWidth, width_);
+	}
+}
+
+void ColorConverter::yuvToRgbRowScalar(const uint8_t *y, const uint8_t *u,
+				       const uint8_t *v, uint8_t *dst,
+				       unsigned int width, bool subsampled,
+				       OutputLayout layout)
+{
+	int r, g, b;
+
+	for (unsigned int x = 0; x < width; ++x) {
+		unsigned int c = subsampled ? x / 2 : x;
+
+		yuvToRgbScalar(y[x], u[c], v[c], &r, &g, &b);
+
+		switch (layout) {
+		case BGRX:
+			dst[0] = b;
+			dst[1] = g;
+			dst[2] = r;
+			dst[3] = 0xff;
+			dst += 4;
+			break;
+		case BGR:
+			dst[0] = b;
+			dst[1] = g;
+			dst[2] = r;
+			dst += 3;
+			break;
+		case RGB:
+		default:
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+			dst += 3;
+			break;
+		}
+	}
+}
+
+void ColorConverter::rgbToYuvRowsScalar(const uint8_t *const rgb[2][3],
+					uint8_t *const y[2], uint8_t *u,
+					uint8_t *v, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x += 2) {
+		int r = 0, g = 0, b = 0;
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			const uint8_t *const *src = rgb[i / 2];
+			unsigned int col = x + i % 2;
+
+			rgbToYuvScalar(src[0][col], src[1][col], src[2][col],
+				       &y[i / 2][col]);
+			r += src[0][col];
+			g += src[1][col];
+			b += src[2][col];
+		}
+
+		rgbToUvScalar((r + 2) / 4, (g + 2) / 4, (b + 2) / 4,
+			      &u[x / 2], &v[x / 2]);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * The x86 kernels compute 32-bit lanes, as the intermediate values don't fit
+ * in 16 bits, and pack each pixel in a lane before storing it. The 24-bit
+ * layouts are compacted with a byte shuffle, and written with stores that
+ * overrun the converted pixels by 4 bytes, which the next store or the scalar
+ * tail overwrites.
+ */
+
+__attribute__((target("sse4.1")))
+void ColorConverter::yuvToRgbRowSSE4(const uint8_t *y, const uint8_t *u,
+				     const uint8_t *v, uint8_t *dst,
+				     unsigned int width, bool subsampled,
+				     OutputLayout layout)
+{
+	const unsigned int bpp = layout == BGRX ? 4 : 3;
+	const unsigned int margin = bpp == 4 ? 4 : 6;
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+					   12, 13, 14, -1, -1, -1, -1);
+	const __m128i alpha = _mm_set1_epi32(bpp == 4 ? 0xff000000 : 0);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(255);
+	unsigned int x;
+
+	for (x = 0; x + margin <= width; x += 4) {
+		uint32_t y4, u4, v4;
+		__m128i vy, vu, vv;
+
+		memcpy(&y4, y + x, 4);
+		vy = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(y4));
+
+		if (subsampled) {
+			uint16_t u2, v2;
+
+			memcpy(&u2, u + x / 2, 2);
+			memcpy(&v2, v + x / 2, 2);
+			vu = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(u2));
+			vv = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v2));
+			vu = _mm_shuffle_epi32(vu, _MM_SHUFFLE(1, 1, 0, 0));
+			vv = _mm_shuffle_epi32(vv, _MM_SHUFFLE(1, 1, 0, 0));
+		} else {
+			memcpy(&u4, u + x, 4);
+			memcpy(&v4, v + x, 4);
+			vu = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(u4));
+			vv = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v4));
+		}
+
+		__m128i c = _mm_mullo_epi32(_mm_sub_epi32(vy, _mm_set1_epi32(16)),
+					    _mm_set1_epi32(298));
+		c = _mm_add_epi32(c, _mm_set1_epi32(128));
+		__m128i d = _mm_sub_epi32(vu, _mm_set1_epi32(128));
+		__m128i e = _mm_sub_epi32(vv, _mm_set1_epi32(128));
+
+		__m128i r = _mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409)));
+		__m128i g = _mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100)));
+		g = _mm_sub_epi32(g, _mm_mullo_epi32(e, _mm_set1_epi32(208)));
+		__m128i b = _mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516)));
+
+		r = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(r, RGBSHIFT), zero), max);
+		g = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(g, RGBSHIFT), zero), max);
+		b = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(b, RGBSHIFT), zero), max);
+
+		if (layout == RGB)
+			std::swap(r, b);
+
+		__m128i pixels = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)),
+					      _mm_or_si128(_mm_slli_epi32(r, 16), alpha));
+
+		if (bpp == 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+					 pixels);
+		} else {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3),
+					 _mm_shuffle_epi8(pixels, pack));
+		}
+	}
+
+	unsigned int c = subsampled ? x / 2 : x;
+	yuvToRgbRowScalar(y + x, u + c, v + c, dst + x * bpp, width - x,
+			  subsampled, layout);
+}
+
+__attribute__((target("avx2")))
+void ColorConverter::yuvToRgbRowAVX2(const uint8_t *y, const uint8_t *u,
+				     const uint8_t *v, uint8_t *dst,
+				     unsigned int width, bool subsampled,
+				     OutputLayout layout)
+{
+	const unsigned int bpp = layout == BGRX ? 4 : 3;
+	const unsigned int margin = bpp == 4 ? 8 : 10;
+	const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+					      12, 13, 14, -1, -1, -1, -1,
+					      0, 1, 2, 4, 5, 6, 8, 9, 10,
+					      12, 13, 14, -1, -1, -1, -1);
+	const __m256i alpha = _mm256_set1_epi32(bpp == 4 ? 0xff000000 : 0);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(255);
+	unsigned int x;
+
+	for (x = 0; x + margin <= width; x += 8) {
+		__m256i vy, vu, vv;
+
+		vy = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x)));
+
+		if (subsampled) {
+			uint32_t u4, v4;
+
+			memcpy(&u4, u + x / 2, 4);
+			memcpy(&v4, v + x / 2, 4);
+			vu = _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(u4));
+			vv = _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(v4));
+			vu = _mm256_permutevar8x32_epi32(vu, dup);
+			vv = _mm256_permutevar8x32_epi32(vv, dup);
+		} else {
+			vu = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x)));
+			vv = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x)));
+		}
+
+		__m256i c = _mm256_mullo_epi32(_mm256_sub_epi32(vy, _mm256_set1_epi32(16)),
+					       _mm256_set1_epi32(298));
+		c = _mm256_add_epi32(c, _mm256_set1_epi32(128));
+		__m256i d = _mm256_sub_epi32(vu, _mm256_set1_epi32(128));
+		__m256i e = _mm256_sub_epi32(vv, _mm256_set1_epi32(128));
+
+		__m256i r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+		__m256i g = _mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100)));
+		g = _mm256_sub_epi32(g, _mm256_mullo_epi32(e, _mm256_set1_epi32(208)));
+		__m256i b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+
+		r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, RGBSHIFT), zero), max);
+		g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, RGBSHIFT), zero), max);
+		b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, RGBSHIFT), zero), max);
+
+		if (layout == RGB)
+			std::swap(r, b);
+
+		__m256i pixels = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+						 _mm256_or_si256(_mm256_slli_epi32(r, 16), alpha));
+
+		if (bpp == 4) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4),
+					    pixels);
+		} else {
+			pixels = _mm256_shuffle_epi8(pixels, pack);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3),
+					 _mm256_castsi256_si128(pixels));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 3 + 12),
+					 _mm256_extracti128_si256(pixels, 1));
+		}
+	}
+
+	unsigned int c = subsampled ? x / 2 : x;
+	yuvToRgbRowScalar(y + x, u + c, v + c, dst + x * bpp, width - x,
+			  subsampled, layout);
+}
+
+/*
+ * The conversion to YUV fits in 16-bit lanes: the luma sum doesn't exceed
+ * 16 bits unsigned, and the partial chroma sums stay within 16 bits signed.
+ */
+__attribute__((target("sse4.1")))
+void ColorConverter::rgbToYuvRowsSSE4(const uint8_t *const rgb[2][3],
+				      uint8_t *const y[2], uint8_t *u,
+				      uint8_t *v, unsigned int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		/* Sums of the 2x2 blocks of each component, for the chroma. */
+		__m128i sum[3];
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			__m128i lo[3], hi[3];
+
+			for (unsigned int c = 0; c < 3; ++c) {
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb[i][c] + x));
+				lo[c] = _mm_cvtepu8_epi16(s);
+				hi[c] = _mm_unpackhi_epi8(s, zero);
+
+				__m128i pairs = _mm_hadd_epi16(lo[c], hi[c]);
+				sum[c] = i ? _mm_add_epi16(sum[c], pairs) : pairs;
+			}
+
+			__m128i ylo = _mm_add_epi16(_mm_mullo_epi16(lo[0], _mm_set1_epi16(66)),
+						    _mm_mullo_epi16(lo[1], _mm_set1_epi16(129)));
+			ylo = _mm_add_epi16(ylo, _mm_mullo_epi16(lo[2], _mm_set1_epi16(25)));
+			ylo = _mm_srli_epi16(_mm_add_epi16(ylo, _mm_set1_epi16(128)), RGBSHIFT);
+
+			__m128i yhi = _mm_add_epi16(_mm_mullo_epi16(hi[0], _mm_set1_epi16(66)),
+						    _mm_mullo_epi16(hi[1], _mm_set1_epi16(129)));
+			yhi = _mm_add_epi16(yhi, _mm_mullo_epi16(hi[2], _mm_set1_epi16(25)));
+			yhi = _mm_srli_epi16(_mm_add_epi16(yhi, _mm_set1_epi16(128)), RGBSHIFT);
+
+			__m128i luma = _mm_add_epi8(_mm_packus_epi16(ylo, yhi),
+						    _mm_set1_epi8(16));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(y[i] + x), luma);
+		}
+
+		__m128i r = _mm_srli_epi16(_mm_add_epi16(sum[0], _mm_set1_epi16(2)), 2);
+		__m128i g = _mm_srli_epi16(_mm_add_epi16(sum[1], _mm_set1_epi16(2)), 2);
+		__m128i b = _mm_srli_epi16(_mm_add_epi16(sum[2], _mm_set1_epi16(2)), 2);
+
+		__m128i cb = _mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+					   _mm_mullo_epi16(r, _mm_set1_epi16(38)));
+		cb = _mm_sub_epi16(cb, _mm_mullo_epi16(g, _mm_set1_epi16(74)));
+		cb = _mm_srai_epi16(_mm_add_epi16(cb, _mm_set1_epi16(128)), RGBSHIFT);
+		cb = _mm_add_epi16(cb, _mm_set1_epi16(128));
+
+		__m128i cr = _mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+					   _mm_mullo_epi16(g, _mm_set1_epi16(94)));
+		cr = _mm_sub_epi16(cr, _mm_mullo_epi16(b, _mm_set1_epi16(18)));
+		cr = _mm_srai_epi16(_mm_add_epi16(cr, _mm_set1_epi16(128)), RGBSHIFT);
+		cr = _mm_add_epi16(cr, _mm_set1_epi16(128));
+
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(u + x / 2),
+				 _mm_packus_epi16(cb, cb));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(v + x / 2),
+				 _mm_packus_epi16(cr, cr));
+	}
+
+	const uint8_t *const tail[2][3] = {
+		{ rgb[0][0] + x, rgb[0][1] + x, rgb[0][2] + x },
+		{ rgb[1][0] + x, rgb[1][1] + x, rgb[1][2] + x },
+	};
+	uint8_t *const ytail[2] = { y[0] + x, y[1] + x };
+	rgbToYuvRowsScalar(tail, ytail, u + x / 2, v + x / 2, width - x);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#if defined(__ARM_NEON)
+
+/*
+ * The NEON kernel widens the samples to 16 bits to subtract the offsets, and
+ * accumulates the products in 32 bits. The saturating narrowing shifts clip
+ * the result exactly as the scalar code does, and the interleaving stores
+ * produce all output layouts.
+ */
+void ColorConverter::yuvToRgbRowNEON(const uint8_t *y, const uint8_t *u,
+				     const uint8_t *v, uint8_t *dst,
+				     unsigned int width, bool subsampled,
+				     OutputLayout layout)
+{
+	const unsigned int bpp = layout == BGRX ? 4 : 3;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		uint8x8_t vy = vld1_u8(y + x);
+		uint8x8_t vu, vv;
+
+		if (subsampled) {
+			uint32_t u4, v4;
+
+			memcpy(&u4, u + x / 2, 4);
+			memcpy(&v4, v + x / 2, 4);
+			vu = vreinterpret_u8_u32(vdup_n_u32(u4));
+			vv = vreinterpret_u8_u32(vdup_n_u32(v4));
+			vu = vzip_u8(vu, vu).val[0];
+			vv = vzip_u8(vv, vv).val[0];
+		} else {
+			vu = vld1_u8(u + x);
+			vv = vld1_u8(v + x);
+		}
+
+		int16x8_t c = vreinterpretq_s16_u16(vsubl_u8(vy, vdup_n_u8(16)));
+		int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(vu, vdup_n_u8(128)));
+		int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(vv, vdup_n_u8(128)));
+
+		uint16x4_t r16[2], g16[2], b16[2];
+		for (unsigned int i = 0; i < 2; ++i) {
+			int16x4_t ci = i ? vget_high_s16(c) : vget_low_s16(c);
+			int16x4_t di = i ? vget_high_s16(d) : vget_low_s16(d);
+			int16x4_t ei = i ? vget_high_s16(e) : vget_low_s16(e);
+
+			int32x4_t base = vmlal_n_s16(vdupq_n_s32(128), ci, 298);
+			int32x4_t r = vmlal_n_s16(base, ei, 409);
+			int32x4_t g = vmlsl_n_s16(vmlsl_n_s16(base, di, 100), ei, 208);
+			int32x4_t b = vmlal_n_s16(base, di, 516);
+
+			r16[i] = vqshrun_n_s32(r, RGBSHIFT);
+			g16[i] = vqshrun_n_s32(g, RGBSHIFT);
+			b16[i] = vqshrun_n_s32(b, RGBSHIFT);
+		}
+
+		uint8x8_t r = vqmovn_u16(vcombine_u16(r16[0], r16[1]));
+		uint8x8_t g = vqmovn_u16(vcombine_u16(g16[0], g16[1]));
+		uint8x8_t b = vqmovn_u16(vcombine_u16(b16[0], b16[1]));
+
+		switch (layout) {
+		case BGRX: {
+			uint8x8x4_t pixels = { { b, g, r, vdup_n_u8(0xff) } };
+			vst4_u8(dst + x * 4, pixels);
+			break;
+		}
+		case BGR: {
+			uint8x8x3_t pixels = { { b, g, r } };
+			vst3_u8(dst + x * 3, pixels);
+			break;
+		}
+		case RGB:
+		default: {
+			uint8x8x3_t pixels = { { r, g, b } };
+			vst3_u8(dst + x * 3, pixels);
+			break;
+		}
+		}
+	}
+
+	unsigned int c = subsampled ? x / 2 : x;
+	yuvToRgbRowScalar(y + x, u + c, v + c, dst + x * bpp, width - x,
+			  subsampled, layout);
+}
+
+/*
+ * As the x86 kernel, the NEON kernel converts to YUV in 16-bit lanes. The
+ * pairwise additions sum the 2x2 blocks, and the rounding shift averages them.
+ */
+void ColorConverter::rgbToYuvRowsNEON(const uint8_t *const rgb[2][3],
+				      uint8_t *const y[2], uint8_t *u,
+				      uint8_t *v, unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		uint16x8_t sum[3];
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			uint8x16_t s[3];
+
+			for (unsigned int c = 0; c < 3; ++c) {
+				s[c] = vld1q_u8(rgb[i][c] + x);
+				sum[c] = i ? vpadalq_u8(sum[c], s[c]) : vpaddlq_u8(s[c]);
+			}
+
+			uint16x8_t ylo = vmull_u8(vget_low_u8(s[0]), vdup_n_u8(66));
+			ylo = vmlal_u8(ylo, vget_low_u8(s[1]), vdup_n_u8(129));
+			ylo = vmlal_u8(ylo, vget_low_u8(s[2]), vdup_n_u8(25));
+
+			uint16x8_t yhi = vmull_u8(vget_high_u8(s[0]), vdup_n_u8(66));
+			yhi = vmlal_u8(yhi, vget_high_u8(s[1]), vdup_n_u8(129));
+			yhi = vmlal_u8(yhi, vget_high_u8(s[2]), vdup_n_u8(25));
+
+			uint8x16_t luma = vcombine_u8(vrshrn_n_u16(ylo, RGBSHIFT),
+						      vrshrn_n_u16(yhi, RGBSHIFT));
+			vst1q_u8(y[i] + x, vaddq_u8(luma, vdupq_n_u8(16)));
+		}
+
+		int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(sum[0], 2));
+		int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(sum[1], 2));
+		int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(sum[2], 2));
+
+		int16x8_t cb = vmlsq_n_s16(vmulq_n_s16(b, 112), r, 38);
+		cb = vmlsq_n_s16(cb, g, 74);
+		cb = vaddq_s16(vrshrq_n_s16(cb, RGBSHIFT), vdupq_n_s16(128));
+
+		int16x8_t cr = vmlsq_n_s16(vmulq_n_s16(r, 112), g, 94);
+		cr = vmlsq_n_s16(cr, b, 18);
+		cr = vaddq_s16(vrshrq_n_s16(cr, RGBSHIFT), vdupq_n_s16(128));
+
+		vst1_u8(u + x / 2, vqmovun_s16(cb));
+		vst1_u8(v + x / 2, vqmovun_s16(cr));
+	}
+
+	const uint8_t *const tail[2][3] = {
+		{ rgb[0][0] + x, rgb[0][1] + x, rgb[0][2] + x },
+		{ rgb[1][0] + x, rgb[1][1] + x, rgb[1][2] + x },
+	};
+	uint8_t *const ytail[2] = { y[0] + x, y[1] + x };
+	rgbToYuvRowsScalar(tail, ytail, u + x / 2, v + x / 2, width - x);
+}
+
+#endif /* __ARM_NEON */
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * color_converter.h - Convert images between YUV and RGB
+ */
+#ifndef __COLOR_CONVERTER_H__
+#define __COLOR_CONVERTER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/pixel_format.h>
+
+class ColorConverter
+{
+public:
+	enum Isa {
+		Scalar,
+		SSE4,
+		AVX2,
+		NEON,
+	};
+
+	static std::vector<Isa> supportedIsas();
+	static const char *isaName(Isa isa);
+
+	ColorConverter();
+
+	int configure(const libcamera::PixelFormat &input,
+		      const libcamera::PixelFormat &output,
+		      unsigned int width, unsigned int height);
+
+	int setIsa(Isa isa);
+	void setThreads(unsigned int threads) { threads_ = threads; }
+
+	void convert(const uint8_t *input, uint8_t *output) const;
+
+private:
+	enum InputLayout {
+		SemiPlanar,
+		Packed,
+		Planar,
+		RGBInput,
+	};
+
+	enum OutputLayout {
+		BGRX,
+		BGR,
+		RGB,
+		I420,
+	};
+
+	using RowKernel = void (*)(const uint8_t *y, const uint8_t *u,
+				   const uint8_t *v, uint8_t *dst,
+				   unsigned int width, bool subsampled,
+				   OutputLayout layout);
+	using RgbRowKernel = void (*)(const uint8_t *const rgb[2][3],
+				      uint8_t *const y[2], uint8_t *u,
+				      uint8_t *v, unsigned int width);
+
+	void convertRows(const uint8_t *input, uint8_t *output,
+			 unsigned int start, unsigned int end) const;
+	void convertToRGB(const uint8_t *input, uint8_t *output,
+			  unsigned int start, unsigned int end) const;
+	void convertToI420(const uint8_t *input, uint8_t *output,
+			   unsigned int start, unsigned int end) const;
+
+	static void yuvToRgbRowScalar(const uint8_t *y, const uint8_t *u,
+				      const uint8_t *v, uint8_t *dst,
+				      unsigned int width, bool subsampled,
+				      OutputLayout layout);
+#if defined(__x86_64__) || defined(__i386__)
+	static void yuvToRgbRowSSE4(const uint8_t *y, const uint8_t *u,
+				    const uint8_t *v, uint8_t *dst,
+				    unsigned int width, bool subsampled,
+				    OutputLayout layout);
+	static void yuvToRgbRowAVX2(const uint8_t *y, const uint8_t *u,
+				    const uint8_t *v, uint8_t *dst,
+				    unsigned int width, bool subsampled,
+				    OutputLayout layout);
+#endif
+#if defined(__ARM_NEON)
+	static void yuvToRgbRowNEON(const uint8_t *y, const uint8_t *u,
+				    const uint8_t *v, uint8_t *dst,
+				    unsigned int width, bool subsampled,
+				    OutputLayout layout);
+#endif
+
+	static void rgbToYuvRowsScalar(const uint8_t *const rgb[2][3],
+				       uint8_t *const y[2], uint8_t *u,
+				       uint8_t *v, unsigned int width);
+#if defined(__x86_64__) || defined(__i386__)
+	static void rgbToYuvRowsSSE4(const uint8_t *const rgb[2][3],
+				     uint8_t *const y[2], uint8_t *u,
+				     uint8_t *v, unsigned int width);
+#endif
+#if defined(__ARM_NEON)
+	static void rgbToYuvRowsNEON(const uint8_t *const rgb[2][3],
+				     uint8_t *const y[2], uint8_t *u,
+				     uint8_t *v, unsigned int width);
+#endif
+
+	unsigned int width_;
+	unsigned int height_;
+	unsigned int threads_;
+
+	InputLayout inputLayout_;
+	OutputLayout outputLayout_;
+	RowKernel kernel_;
+	RgbRowKernel rgbKernel_;
+
+	/* Subsampling of the YUV input, or the RGB input pixel layout. */
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+	bool swapUV_;
+	unsigned int y_pos_;
+	unsigned int cb_pos_;
+	unsigned int bpp_;
+	unsigned int r_pos_;
+	unsigned int g_pos_;
+	unsigned int b_pos_;
+};
+
+#endif /* __COLOR_CONVERTER_H__ */
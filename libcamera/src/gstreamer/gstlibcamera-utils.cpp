@@ -8,6 +8,8 @@
 
 #include "gstlibcamera-utils.h"
 
+#include <gst/allocators/allocators.h>
+
 #include <libcamera/formats.h>
 
 using namespace libcamera;
@@ -131,6 +133,33 @@ gst_libcamera_stream_configuration_to_caps(const StreamConfiguration &stream_cfg
 	return caps;
 }
 
+GstCaps *
+gst_libcamera_caps_add_dmabuf_features(GstCaps *caps)
+{
+	/*
+	 * The buffers are exported by the camera as dmabufs. Offer caps with
+	 * the DMABuf memory feature first to let downstream import them.
+	 */
+	GstCaps *dmabuf_caps = gst_caps_copy(caps);
+
+	for (guint i = 0; i < gst_caps_get_size(dmabuf_caps); i++)
+		gst_caps_set_features(dmabuf_caps, i,
+				      gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_DMABUF, nullptr));
+
+	gst_caps_append(dmabuf_caps, caps);
+
+	return dmabuf_caps;
+}
+
+bool
+gst_libcamera_caps_has_dmabuf_features(GstCaps *caps)
+{
+	GstCapsFeatures *features = gst_caps_get_features(caps, 0);
+
+	return features &&
+	       gst_caps_features_contains(features, GST_CAPS_FEATURE_MEMORY_DMABUF);
+}
+
 void
 gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 					 GstCaps *caps)
@@ -92,7 +92,12 @@ GQuark FrameWrap::getQuark()
  */
 struct _GstLibcameraAllocator {
 	GstDmaBufAllocator parent;
-	FrameBufferAllocator *fb_allocator;
+	/*
+	 * The FrameBufferAllocator instances. Each of them allocates the
+	 * number of buffers of the stream configuration, and more instances
+	 * are created when more buffers are needed.
+	 */
+	std::vector<FrameBufferAllocator *> *fb_allocators;
 	/*
 	 * A hash table using Stream pointer as key and returning a GQueue of
 	 * FrameWrap.
@@ -145,6 +150,7 @@ gst_libcamera_allocator_init(GstLibcameraAllocator *self)
 {
 	self->pools = g_hash_table_new_full(nullptr, nullptr, nullptr,
 					    gst_libcamera_allocator_free_pool);
+	self->fb_allocators = new std::vector<FrameBufferAllocator *>();
 	GST_OBJECT_FLAG_SET(self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
 }
 
@@ -166,7 +172,9 @@ gst_libcamera_allocator_finalize(GObject *object)
 {
 	GstLibcameraAllocator *self = GST_LIBCAMERA_ALLOCATOR(object);
 
-	delete self->fb_allocator;
+	for (FrameBufferAllocator *fb_allocator : *self->fb_allocators)
+		delete fb_allocator;
+	delete self->fb_allocators;
 
 	G_OBJECT_CLASS(gst_libcamera_allocator_parent_class)->finalize(object);
 }
@@ -182,31 +190,59 @@ gst_libcamera_allocator_class_init(GstLibcameraAllocatorClass *klass)
 	allocator_class->alloc = nullptr;
 }
 
+/*
+ * Allocate the buffers for all the streams of \a config_. The i-th entry of
+ * \a buffer_counts, when present, sets the minimum number of buffers for the
+ * i-th stream, which otherwise defaults to the number of buffers of the stream
+ * configuration. The i-th entry of \a max_buffer_counts, when present and not
+ * zero, caps the number of buffers of the i-th stream.
+ */
 GstLibcameraAllocator *
 gst_libcamera_allocator_new(std::shared_ptr<Camera> camera,
-			    CameraConfiguration *config_)
+			    CameraConfiguration *config_,
+			    const std::vector<guint> &buffer_counts,
+			    const std::vector<guint> &max_buffer_counts)
 {
 	auto *self = GST_LIBCAMERA_ALLOCATOR(g_object_new(GST_TYPE_LIBCAMERA_ALLOCATOR,
 							  nullptr));
 
-	self->fb_allocator = new FrameBufferAllocator(camera);
-	for (StreamConfiguration &streamCfg : *config_) {
-		Stream *stream = streamCfg.stream();
-		gint ret;
-
-		ret = self->fb_allocator->allocate(stream);
-		if (ret == 0)
-			return nullptr;
+	for (gsize i = 0; i < config_->size(); i++) {
+		Stream *stream = config_->at(i).stream();
+		guint count = i < buffer_counts.size() ? buffer_counts[i] : 0;
+		guint max_count = i < max_buffer_counts.size() ? max_buffer_counts[i] : 0;
 
 		GQueue *pool = g_queue_new();
-		for (const std::unique_ptr<FrameBuffer> &buffer :
-		     self->fb_allocator->buffers(stream)) {
-			auto *fb = new FrameWrap(GST_ALLOCATOR(self),
-						 buffer.get(), stream);
-			g_queue_push_tail(pool, fb);
-		}
-
 		g_hash_table_insert(self->pools, stream, pool);
+
+		/*
+		 * The camera exports a fixed number of buffers at a time, use
+		 * as many allocators as needed to reach the requested count.
+		 * All the exported buffers go to the pool, up to the maximum.
+		 * The FrameBufferAllocator can only free all the buffers of a
+		 * stream, the ones above the maximum stay unused until the
+		 * allocator is destroyed.
+		 */
+		for (guint round = 0; round == 0 || pool->length < count; round++) {
+			if (round == self->fb_allocators->size())
+				self->fb_allocators->push_back(new FrameBufferAllocator(camera));
+
+			FrameBufferAllocator *fb_allocator = self->fb_allocators->at(round);
+			gint ret = fb_allocator->allocate(stream);
+			if (ret <= 0) {
+				g_object_unref(self);
+				return nullptr;
+			}
+
+			for (const std::unique_ptr<FrameBuffer> &buffer :
+			     fb_allocator->buffers(stream)) {
+				if (max_count && pool->length == max_count)
+					break;
+
+				auto *fb = new FrameWrap(GST_ALLOCATOR(self),
+							 buffer.get(), stream);
+				g_queue_push_tail(pool, fb);
+			}
+		}
 	}
 
 	return self;
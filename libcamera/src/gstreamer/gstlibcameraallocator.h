@@ -9,6 +9,8 @@
 #ifndef __GST_LIBCAMERA_ALLOCATOR_H__
 #define __GST_LIBCAMERA_ALLOCATOR_H__
 
+#include <vector>
+
 #include <gst/gst.h>
 #include <gst/allocators/allocators.h>
 
@@ -20,7 +22,9 @@ G_DECLARE_FINAL_TYPE(GstLibcameraAllocator, gst_libcamera_allocator,
 		     GST_LIBCAMERA, ALLOCATOR, GstDmaBufAllocator)
 
 GstLibcameraAllocator *gst_libcamera_allocator_new(std::shared_ptr<libcamera::Camera> camera,
-						   libcamera::CameraConfiguration *config_);
+						   libcamera::CameraConfiguration *config_,
+						   const std::vector<guint> &buffer_counts = {},
+						   const std::vector<guint> &max_buffer_counts = {});
 
 bool gst_libcamera_allocator_prepare_buffer(GstLibcameraAllocator *self,
 					    libcamera::Stream *stream,
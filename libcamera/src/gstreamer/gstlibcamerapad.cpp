@@ -24,7 +24,8 @@ struct _GstLibcameraPad {
 
 enum {
 	PROP_0,
-	PROP_STREAM_ROLE
+	PROP_STREAM_ROLE,
+	PROP_STATS
 };
 
 G_DEFINE_TYPE(GstLibcameraPad, gst_libcamera_pad, GST_TYPE_PAD)
@@ -57,6 +58,10 @@ gst_libcamera_pad_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_STREAM_ROLE:
 		g_value_set_enum(value, self->role);
 		break;
+	case PROP_STATS:
+		g_value_take_boxed(value, self->pool ? gst_libcamera_pool_get_stats(self->pool)
+						     : nullptr);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -117,6 +122,13 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 						     | G_PARAM_READWRITE
 						     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_STREAM_ROLE, spec);
+
+	spec = g_param_spec_boxed("stats", "Statistics",
+				  "Statistics of the buffer pool while streaming",
+				  GST_TYPE_STRUCTURE,
+				  (GParamFlags)(G_PARAM_READABLE
+						| G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_STATS, spec);
 }
 
 StreamRole
@@ -138,6 +150,7 @@ void
 gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
 
 	if (self->pool)
 		g_object_unref(self->pool);
@@ -27,6 +27,12 @@ struct _GstLibcameraPool {
 	GstAtomicQueue *queue;
 	GstLibcameraAllocator *allocator;
 	Stream *stream;
+
+	/* Statistics, updated by the streaming thread and read atomically. */
+	guint buffers;
+	guint acquired;
+	guint starved;
+	guint min_free;
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL)
@@ -36,15 +42,30 @@ gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 				  [[maybe_unused]] GstBufferPoolAcquireParams *params)
 {
 	GstLibcameraPool *self = GST_LIBCAMERA_POOL(pool);
+
+	/*
+	 * Running out of buffers isn't an error, downstream holds them all and
+	 * the buffer-notify signal is emitted when one is released. As the pool
+	 * never waits, report this with GST_FLOW_EOS, like a GstBufferPool
+	 * acquired with GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT.
+	 */
 	GstBuffer *buf = GST_BUFFER(gst_atomic_queue_pop(self->queue));
-	if (!buf)
-		return GST_FLOW_ERROR;
+	if (!buf) {
+		g_atomic_int_inc(&self->starved);
+		return GST_FLOW_EOS;
+	}
 
 	if (!gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf)) {
 		gst_atomic_queue_push(self->queue, buf);
-		return GST_FLOW_ERROR;
+		g_atomic_int_inc(&self->starved);
+		return GST_FLOW_EOS;
 	}
 
+	guint available = gst_atomic_queue_length(self->queue);
+	if (available < static_cast<guint>(g_atomic_int_get(&self->min_free)))
+		g_atomic_int_set(&self->min_free, available);
+	g_atomic_int_inc(&self->acquired);
+
 	*buffer = buf;
 	return GST_FLOW_OK;
 }
@@ -125,9 +146,28 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 		gst_atomic_queue_push(pool->queue, buffer);
 	}
 
+	pool->buffers = pool_size;
+	pool->min_free = pool_size;
+
 	return pool;
 }
 
+/*
+ * Return a structure with the pool statistics: the number of buffers, of
+ * buffers acquired, of failed acquisitions due to downstream holding all the
+ * buffers, and the lowest number of free buffers after an acquisition.
+ */
+GstStructure *
+gst_libcamera_pool_get_stats(GstLibcameraPool *self)
+{
+	return gst_structure_new("GstLibcameraPoolStats",
+				 "buffers", G_TYPE_UINT, self->buffers,
+				 "acquired", G_TYPE_UINT, g_atomic_int_get(&self->acquired),
+				 "starved", G_TYPE_UINT, g_atomic_int_get(&self->starved),
+				 "min-free", G_TYPE_UINT, g_atomic_int_get(&self->min_free),
+				 nullptr);
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
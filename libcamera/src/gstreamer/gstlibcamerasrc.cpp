@@ -33,6 +33,7 @@
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
 #include <queue>
 #include <vector>
 
@@ -113,6 +114,11 @@ struct GstLibcameraSrcState {
 	std::unique_ptr<CameraConfiguration> config_;
 	std::vector<GstPad *> srcpads_;
 	std::queue<std::unique_ptr<RequestWrap>> requests_;
+	/*
+	 * The maximum number of requests in flight, as the pools may hold more
+	 * buffers than the camera can queue.
+	 */
+	guint maxRequests_;
 
 	void requestCompleted(Request *request);
 };
@@ -139,7 +145,9 @@ G_DEFINE_TYPE_WITH_CODE(GstLibcameraSrc, gst_libcamera_src, GST_TYPE_ELEMENT,
 			GST_DEBUG_CATEGORY_INIT(source_debug, "libcamerasrc", 0,
 						"libcamera Source"))
 
-#define TEMPLATE_CAPS GST_STATIC_CAPS("video/x-raw; image/jpeg")
+#define TEMPLATE_CAPS GST_STATIC_CAPS("video/x-raw; " \
+					"video/x-raw(" GST_CAPS_FEATURE_MEMORY_DMABUF "); " \
+					"image/jpeg")
 
 /* For the simple case, we have a src pad that is always present. */
 GstStaticPadTemplate src_template = {
@@ -264,37 +272,53 @@ gst_libcamera_src_task_run(gpointer user_data)
 {
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(user_data);
 	GstLibcameraSrcState *state = self->state;
+	bool queue_request;
 
-	std::unique_ptr<Request> request = state->cam_->createRequest();
-	if (!request) {
-		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
-				  ("Failed to allocate request for camera '%s'.",
-				   state->cam_->id().c_str()),
-				  ("libcamera::Camera::createRequest() failed"));
-		gst_task_stop(self->task);
-		return;
+	/*
+	 * The pools may hold more buffers than the camera can queue. Limit the
+	 * number of requests in flight, the task is resumed when one completes.
+	 */
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		queue_request = state->requests_.size() < state->maxRequests_;
 	}
 
-	std::unique_ptr<RequestWrap> wrap =
-		std::make_unique<RequestWrap>(std::move(request));
+	std::unique_ptr<RequestWrap> wrap;
 
-	for (GstPad *srcpad : state->srcpads_) {
-		GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
-		GstBuffer *buffer;
-		GstFlowReturn ret;
-
-		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
-						     &buffer, nullptr);
-		if (ret != GST_FLOW_OK) {
-			/*
-			 * RequestWrap has ownership of the rquest, and we
-			 * won't be queueing this one due to lack of buffers.
-			 */
-			wrap.release();
-			break;
+	if (queue_request) {
+		std::unique_ptr<Request> request = state->cam_->createRequest();
+		if (!request) {
+			GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
+					  ("Failed to allocate request for camera '%s'.",
+					   state->cam_->id().c_str()),
+					  ("libcamera::Camera::createRequest() failed"));
+			gst_task_stop(self->task);
+			return;
 		}
 
-		wrap->attachBuffer(buffer);
+		wrap = std::make_unique<RequestWrap>(std::move(request));
+
+		for (GstPad *srcpad : state->srcpads_) {
+			GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
+			GstBuffer *buffer;
+			GstFlowReturn ret;
+
+			ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
+							     &buffer, nullptr);
+			if (ret != GST_FLOW_OK) {
+				/*
+				 * RequestWrap has ownership of the request and
+				 * of the buffers acquired so far, and we won't
+				 * be queueing this one due to lack of buffers.
+				 * Deleting it returns the buffers to their
+				 * pools.
+				 */
+				wrap.reset();
+				break;
+			}
+
+			wrap->attachBuffer(buffer);
+		}
 	}
 
 	if (wrap) {
@@ -356,6 +380,9 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 	GLibRecLocker lock(&self->stream_lock);
 	GstLibcameraSrcState *state = self->state;
 	GstFlowReturn flow_ret = GST_FLOW_OK;
+	std::vector<bool> dmabuf(state->srcpads_.size());
+	std::vector<guint> buffer_counts(state->srcpads_.size());
+	std::vector<guint> max_buffer_counts(state->srcpads_.size());
 	gint ret;
 
 	GST_DEBUG_OBJECT(self, "Streaming thread has started");
@@ -387,6 +414,7 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 
 		/* Retrieve the supported caps. */
 		g_autoptr(GstCaps) filter = gst_libcamera_stream_formats_to_caps(stream_cfg.formats());
+		filter = gst_libcamera_caps_add_dmabuf_features(filter);
 		g_autoptr(GstCaps) caps = gst_pad_peer_query_caps(srcpad, filter);
 		if (gst_caps_is_empty(caps)) {
 			flow_ret = GST_FLOW_NOT_NEGOTIATED;
@@ -396,6 +424,7 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		/* Fixate caps and configure the stream. */
 		caps = gst_caps_make_writable(caps);
 		gst_libcamera_configure_stream_from_caps(stream_cfg, caps);
+		dmabuf[i] = gst_libcamera_caps_has_dmabuf_features(caps);
 	}
 
 	if (flow_ret != GST_FLOW_OK)
@@ -416,6 +445,10 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
 
 		g_autoptr(GstCaps) caps = gst_libcamera_stream_configuration_to_caps(stream_cfg);
+		if (dmabuf[i])
+			gst_caps_set_features(caps, 0,
+					      gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_DMABUF, nullptr));
+
 		if (!gst_pad_push_event(srcpad, gst_event_new_caps(caps))) {
 			flow_ret = GST_FLOW_NOT_NEGOTIATED;
 			break;
@@ -436,7 +469,45 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		return;
 	}
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get());
+	/*
+	 * Downstream elements that hold on buffers, such as encoders, report
+	 * how many they need in the allocation query. Allocate that many
+	 * buffers on top of the ones the camera needs, to avoid starving the
+	 * camera, within the maximum requested by downstream. The camera may
+	 * export more buffers than needed, they're all used up to the maximum.
+	 */
+	state->maxRequests_ = G_MAXUINT;
+	for (gsize i = 0; i < state->srcpads_.size(); i++) {
+		GstPad *srcpad = state->srcpads_[i];
+		const StreamConfiguration &stream_cfg = state->config_->at(i);
+		guint min_buffers = 0, max_buffers = 0;
+
+		g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
+		if (caps) {
+			g_autoptr(GstQuery) query = gst_query_new_allocation(caps, FALSE);
+			if (gst_pad_peer_query(srcpad, query) &&
+			    gst_query_get_n_allocation_pools(query) > 0)
+				gst_query_parse_nth_allocation_pool(query, 0, nullptr, nullptr,
+								    &min_buffers, &max_buffers);
+		}
+
+		guint count = stream_cfg.bufferCount + min_buffers;
+		if (max_buffers)
+			count = std::max(std::min(count, max_buffers),
+					 stream_cfg.bufferCount);
+
+		GST_DEBUG_OBJECT(srcpad, "Allocating at least %u buffers, %u for downstream",
+				 count, count - stream_cfg.bufferCount);
+
+		buffer_counts[i] = count;
+		max_buffer_counts[i] = max_buffers ? std::max(max_buffers, stream_cfg.bufferCount)
+						   : 0;
+		state->maxRequests_ = std::min(state->maxRequests_,
+					       stream_cfg.bufferCount);
+	}
+
+	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get(),
+						      buffer_counts, max_buffer_counts);
 	if (!self->allocator) {
 		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
 				  ("Failed to allocate memory"),
@@ -490,8 +561,16 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 
 	state->cam_->stop();
 
-	for (GstPad *srcpad : state->srcpads_)
+	for (GstPad *srcpad : state->srcpads_) {
+		GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
+		if (pool) {
+			g_autoptr(GstStructure) stats = gst_libcamera_pool_get_stats(pool);
+			GST_INFO_OBJECT(srcpad, "Buffer pool statistics: %" GST_PTR_FORMAT,
+					stats);
+		}
+
 		gst_libcamera_pad_set_pool(srcpad, nullptr);
+	}
 
 	g_clear_object(&self->allocator);
 	g_clear_pointer(&self->flow_combiner,
@@ -38,6 +38,13 @@ public:
 	virtual void SwitchMode(CameraMode const &camera_mode, Metadata *metadata);
 	virtual void Prepare(Metadata *image_metadata);
 	virtual void Process(StatisticsPtr &stats, Metadata *image_metadata);
+	// The image metadata that Process reads and writes, as masks of
+	// Metadata::Tag() values. The Controller runs the Process methods of
+	// algorithms whose accesses don't conflict in parallel, so the default
+	// is to claim everything. Algorithms that don't override Process have no
+	// accesses to order, and return 0 from both.
+	virtual uint32_t ProcessReads() const { return Metadata::ALL_TAGS; }
+	virtual uint32_t ProcessWrites() const { return Metadata::ALL_TAGS; }
 	Metadata &GetGlobalMetadata() const
 	{
 		return controller_->GetGlobalMetadata();
@@ -6,11 +6,13 @@
  */
 
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
 
 #include "algorithm.hpp"
 #include "controller.hpp"
+#include "thread_pool.hpp"
+#include "tuning_cache.hpp"
 
-#include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 using namespace RPiController;
@@ -18,22 +20,45 @@ using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(RPiController)
 
+// Parallel processing is opt-in until its gain on the critical path of the
+// frames has been measured on the targets (see rpi-ipa-replay). It would only
+// add overhead on a single core.
+static bool default_parallel()
+{
+	char const *parallel = utils::secure_getenv("LIBCAMERA_RPI_PARALLEL_PROCESS");
+	if (!parallel || strcmp(parallel, "1"))
+		return false;
+	return std::thread::hardware_concurrency() > 1;
+}
+
 Controller::Controller()
-	: switch_mode_called_(false) {}
+	: switch_mode_called_(false), profiler_(nullptr),
+	  parallel_(default_parallel()), process_sequence_(0),
+	  process_helpers_(0) {}
 
 Controller::Controller(char const *json_filename)
-	: switch_mode_called_(false)
+	: switch_mode_called_(false), profiler_(nullptr),
+	  parallel_(default_parallel()), process_sequence_(0),
+	  process_helpers_(0)
 {
 	Read(json_filename);
 	Initialise();
 }
 
-Controller::~Controller() {}
+Controller::~Controller()
+{
+	// Helpers left over from the last frames may still be queued, and need
+	// the Controller to find out that there is nothing left for them to do.
+	std::unique_lock<std::mutex> lock(process_mutex_);
+	process_signal_.wait(lock, [&] {
+		return process_helpers_ == 0;
+	});
+}
 
 void Controller::Read(char const *filename)
 {
 	boost::property_tree::ptree root;
-	boost::property_tree::read_json(filename, root);
+	tuning_read(filename, tuning_cache_dir(), root);
 	for (auto const &key_and_value : root) {
 		Algorithm *algo = CreateAlgorithm(key_and_value.first.c_str());
 		if (algo) {
@@ -55,6 +80,18 @@ void Controller::Initialise()
 {
 	for (auto &algo : algorithms_)
 		algo->Initialise();
+	// An algorithm must wait for the earlier ones that write metadata it
+	// reads or writes, or that read metadata it writes.
+	depends_.assign(algorithms_.size(), 0);
+	for (size_t i = 0; i < algorithms_.size() && i < 32; i++) {
+		uint32_t reads = algorithms_[i]->ProcessReads();
+		uint32_t writes = algorithms_[i]->ProcessWrites();
+		for (size_t j = 0; j < i; j++) {
+			if ((algorithms_[j]->ProcessWrites() & (reads | writes)) ||
+			    (algorithms_[j]->ProcessReads() & writes))
+				depends_[i] |= 1u << j;
+		}
+	}
 }
 
 void Controller::SwitchMode(CameraMode const &camera_mode, Metadata *metadata)
@@ -67,17 +104,151 @@ void Controller::SwitchMode(CameraMode const &camera_mode, Metadata *metadata)
 void Controller::Prepare(Metadata *image_metadata)
 {
 	assert(switch_mode_called_);
-	for (auto &algo : algorithms_)
-		if (!algo->IsPaused())
+	for (auto &algo : algorithms_) {
+		if (algo->IsPaused())
+			continue;
+		if (profiler_) {
+			profiler_->Start(algo.get(), AlgorithmProfiler::Stage::Prepare);
+			algo->Prepare(image_metadata);
+			profiler_->Stop(algo.get(), AlgorithmProfiler::Stage::Prepare);
+		} else
 			algo->Prepare(image_metadata);
+	}
 }
 
 void Controller::Process(StatisticsPtr stats, Metadata *image_metadata)
 {
 	assert(switch_mode_called_);
-	for (auto &algo : algorithms_)
-		if (!algo->IsPaused())
-			algo->Process(stats, image_metadata);
+	// Several algorithms look at the histogram, so build it only once.
+	image_metadata->Set(Histogram(stats->hist[0].g_hist, NUM_HISTOGRAM_BINS));
+	std::unique_lock<std::mutex> lock(process_mutex_);
+	process_stats_ = stats;
+	process_metadata_ = image_metadata;
+	if (!parallel_ || algorithms_.size() > 32 ||
+	    depends_.size() != algorithms_.size()) {
+		lock.unlock();
+		for (auto &algo : algorithms_) {
+			if (!algo->IsPaused())
+				processAlgorithm(algo.get());
+		}
+		process_stats_.reset();
+		return;
+	}
+	// Paused algorithms count as finished straight away.
+	process_sequence_++;
+	process_todo_ = 0;
+	for (size_t i = 0; i < algorithms_.size(); i++) {
+		if (!algorithms_[i]->IsPaused())
+			process_todo_ |= 1u << i;
+	}
+	process_done_ = ~process_todo_;
+	// Ask for help with all the algorithms that can start but one, which
+	// we run ourselves. We keep running whatever becomes ready until all
+	// the algorithms have finished, so that the frame never has to wait for
+	// a helper stuck behind a long task on the thread pool.
+	unsigned int ready = __builtin_popcount(readyAlgorithms());
+	if (ready > 1)
+		submitHelpers(ready - 1);
+	while (process_done_ != ~0u) {
+		runReadyAlgorithms(lock);
+		process_signal_.wait(lock, [&] {
+			return process_done_ == ~0u || readyAlgorithms();
+		});
+	}
+	process_stats_.reset();
+	// Pass on the first error, as if the algorithms had run in turn here.
+	if (process_error_) {
+		std::exception_ptr error = process_error_;
+		process_error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void Controller::processAlgorithm(Algorithm *algo)
+{
+	if (profiler_) {
+		profiler_->Start(algo, AlgorithmProfiler::Stage::Process);
+		algo->Process(process_stats_, process_metadata_);
+		profiler_->Stop(algo, AlgorithmProfiler::Stage::Process);
+	} else
+		algo->Process(process_stats_, process_metadata_);
+}
+
+uint32_t Controller::readyAlgorithms() const
+{
+	uint32_t ready = 0;
+	for (uint32_t todo = process_todo_; todo; todo &= todo - 1) {
+		int i = __builtin_ctz(todo);
+		if (!(depends_[i] & ~process_done_))
+			ready |= 1u << i;
+	}
+	return ready;
+}
+
+void Controller::runReadyAlgorithms(std::unique_lock<std::mutex> &lock)
+{
+	uint32_t ready;
+	while ((ready = readyAlgorithms())) {
+		int i = __builtin_ctz(ready);
+		process_todo_ &= ~(1u << i);
+		lock.unlock();
+		std::exception_ptr error;
+		try {
+			processAlgorithm(algorithms_[i].get());
+		} catch (...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+		if (error && !process_error_)
+			process_error_ = error;
+		process_done_ |= 1u << i;
+		// We carry on with one of the algorithms that this one has made
+		// ready, if any, and ask for help with the others.
+		unsigned int unblocked = 0;
+		for (ready = readyAlgorithms(); ready; ready &= ready - 1) {
+			if (depends_[__builtin_ctz(ready)] & (1u << i))
+				unblocked++;
+		}
+		if (unblocked)
+			submitHelpers(unblocked - 1);
+		process_signal_.notify_all();
+	}
+}
+
+void Controller::submitHelpers(unsigned int count)
+{
+	// Called with process_mutex_ held.
+	for (unsigned int i = 0; i < count; i++) {
+		uint64_t sequence = process_sequence_;
+		process_helpers_++;
+		ThreadPool::Instance().Submit([this, sequence] {
+			std::unique_lock<std::mutex> lock(process_mutex_);
+			if (sequence == process_sequence_)
+				runReadyAlgorithms(lock);
+			process_helpers_--;
+			process_signal_.notify_all();
+		});
+	}
+}
+
+std::vector<std::pair<Algorithm const *, uint32_t>> Controller::ProcessGraph() const
+{
+	std::vector<std::pair<Algorithm const *, uint32_t>> graph;
+	for (size_t i = 0; i < algorithms_.size(); i++)
+		graph.emplace_back(algorithms_[i].get(),
+				   i < depends_.size() ? depends_[i] : 0);
+	return graph;
+}
+
+void Controller::SetParallelProcess(bool parallel)
+{
+	parallel_ = parallel;
+}
+
+void Controller::SetProfiler(AlgorithmProfiler *profiler)
+{
+	// The profiler, if any, must outlive its use by the Controller.
+	profiler_ = profiler;
 }
 
 Metadata &Controller::GetGlobalMetadata()
@@ -10,8 +10,12 @@
 // "control algorithms" (such as AWB etc.) and for running them all in a
 // convenient manner.
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <utility>
 
 #include <linux/bcm2835-isp.h>
 
@@ -25,10 +29,29 @@ class Algorithm;
 typedef std::unique_ptr<Algorithm> AlgorithmPtr;
 typedef std::shared_ptr<bcm2835_isp_stats> StatisticsPtr;
 
+// Hooks called by the Controller around each algorithm's Prepare and Process
+// methods, so that the algorithms can be profiled, for instance when replaying
+// statistics offline. The Process hooks may be called from several threads at
+// once.
+
+class AlgorithmProfiler
+{
+public:
+	enum class Stage { Prepare, Process };
+	virtual ~AlgorithmProfiler() = default;
+	virtual void Start(Algorithm const *algorithm, Stage stage) = 0;
+	virtual void Stop(Algorithm const *algorithm, Stage stage) = 0;
+};
+
 // The Controller holds a pointer to some global_metadata, which is how
 // different controllers and control algorithms within them can exchange
 // information. The Prepare method returns a pointer to metadata for this
 // specific image, and which should be passed on to the Process method.
+//
+// Process runs the algorithms in the order of the tuning file. When parallel
+// processing is enabled, algorithms that don't depend on each other's metadata
+// run in parallel on the shared ThreadPool instead, with the thread that
+// called Process taking part.
 
 class Controller
 {
@@ -37,6 +60,8 @@ public:
 	Controller(char const *json_filename);
 	~Controller();
 	Algorithm *CreateAlgorithm(char const *name);
+	// Read the tuning file, from its compiled image in the tuning cache
+	// when there is an up to date one (see tuning_cache.hpp).
 	void Read(char const *filename);
 	void Initialise();
 	void SwitchMode(CameraMode const &camera_mode, Metadata *metadata);
@@ -44,11 +69,48 @@ public:
 	void Process(StatisticsPtr stats, Metadata *image_metadata);
 	Metadata &GetGlobalMetadata();
 	Algorithm *GetAlgorithm(std::string const &name) const;
+	void SetProfiler(AlgorithmProfiler *profiler);
+	// Choose whether Process may run algorithms in parallel, or runs them
+	// one after the other on the calling thread. Parallel processing is
+	// off unless the LIBCAMERA_RPI_PARALLEL_PROCESS environment variable
+	// is set to 1 on a multicore system.
+	void SetParallelProcess(bool parallel);
+	// The algorithms in the order Process runs them, each with the mask of
+	// the earlier ones that must finish before its own Process starts.
+	std::vector<std::pair<Algorithm const *, uint32_t>> ProcessGraph() const;
 
 protected:
 	Metadata global_metadata_;
 	std::vector<AlgorithmPtr> algorithms_;
 	bool switch_mode_called_;
+	AlgorithmProfiler *profiler_;
+
+private:
+	void processAlgorithm(Algorithm *algo);
+	uint32_t readyAlgorithms() const;
+	void runReadyAlgorithms(std::unique_lock<std::mutex> &lock);
+	void submitHelpers(unsigned int count);
+	bool parallel_;
+	// for each algorithm, the mask of the earlier ones whose Process must
+	// have finished before its own can start
+	std::vector<uint32_t> depends_;
+	// The following are for the Process stage, and require process_mutex_:
+	std::mutex process_mutex_;
+	// condvar for the Process caller to wait for the algorithms to finish
+	// or become ready to run, and the destructor for the helpers to finish
+	std::condition_variable process_signal_;
+	// counts the Process calls, so that late helpers can tell when their
+	// frame is over
+	uint64_t process_sequence_;
+	// masks of algorithms yet to start, and finished
+	uint32_t process_todo_;
+	uint32_t process_done_;
+	// number of helpers queued on the thread pool
+	unsigned int process_helpers_;
+	StatisticsPtr process_stats_;
+	Metadata *process_metadata_;
+	// the first exception thrown by an algorithm
+	std::exception_ptr process_error_;
 };
 
 } // namespace RPiController
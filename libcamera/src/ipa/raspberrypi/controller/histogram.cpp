@@ -7,10 +7,55 @@
 #include <math.h>
 #include <stdio.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "histogram.hpp"
 
 using namespace RPiController;
 
+// Compute the cumulative frequencies four bins at a time. The prefix sum of
+// the four bins is computed in 32 bits, which can't overflow as the whole
+// histogram counts fewer than 2^32 pixels, and then widened and offset by the
+// running total.
+void Histogram::Accumulate(uint32_t const *histogram, int num)
+{
+	int i = 0;
+#if defined(__ARM_NEON)
+	uint64x2_t total = vdupq_n_u64(0);
+	uint32x4_t zero = vdupq_n_u32(0);
+	for (; i + 4 <= num; i += 4) {
+		uint32x4_t v = vld1q_u32(histogram + i);
+		v = vaddq_u32(v, vextq_u32(zero, v, 3));
+		v = vaddq_u32(v, vextq_u32(zero, v, 2));
+		uint64x2_t lo = vaddw_u32(total, vget_low_u32(v));
+		uint64x2_t hi = vaddw_u32(total, vget_high_u32(v));
+		vst1q_u64(&cumulative_[i + 1], lo);
+		vst1q_u64(&cumulative_[i + 3], hi);
+		total = vcombine_u64(vget_high_u64(hi), vget_high_u64(hi));
+	}
+#elif defined(__SSE2__)
+	__m128i total = _mm_setzero_si128();
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 4 <= num; i += 4) {
+		__m128i v = _mm_loadu_si128(
+			reinterpret_cast<__m128i const *>(histogram + i));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		__m128i lo = _mm_add_epi64(total, _mm_unpacklo_epi32(v, zero));
+		__m128i hi = _mm_add_epi64(total, _mm_unpackhi_epi32(v, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&cumulative_[i + 1]), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&cumulative_[i + 3]), hi);
+		total = _mm_unpackhi_epi64(hi, hi);
+	}
+#endif
+	for (; i < num; i++)
+		cumulative_[i + 1] = cumulative_[i] + histogram[i];
+}
+
 uint64_t Histogram::CumulativeFreq(double bin) const
 {
 	if (bin <= 0)
@@ -27,7 +72,7 @@ double Histogram::Quantile(double q, int first, int last) const
 	if (first == -1)
 		first = 0;
 	if (last == -1)
-		last = cumulative_.size() - 2;
+		last = bins_ - 1;
 	assert(first <= last);
 	uint64_t items = q * Total();
 	while (first < last) // binary search to find the right bin
@@ -45,6 +90,20 @@ double Histogram::Quantile(double q, int first, int last) const
 	return first + frac;
 }
 
+void Histogram::Quantiles(double const q[], double bins[], int num) const
+{
+	// The cumulative frequencies never decrease, so when the quantiles come
+	// in increasing order each search only needs to cover the bins after
+	// the previous result.
+	int first = 0;
+	for (int i = 0; i < num; i++) {
+		if (i && q[i] < q[i - 1])
+			first = 0;
+		bins[i] = Quantile(q[i], first);
+		first = (int)bins[i];
+	}
+}
+
 double Histogram::InterQuantileMean(double q_lo, double q_hi) const
 {
 	assert(q_hi > q_lo);
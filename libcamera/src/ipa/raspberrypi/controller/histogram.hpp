@@ -7,38 +7,56 @@
 #pragma once
 
 #include <stdint.h>
-#include <vector>
 #include <cassert>
+#include <type_traits>
+
+#include <linux/bcm2835-isp.h>
 
 // A simple histogram class, for use in particular to find "quantiles" and
-// averages between "quantiles".
+// averages between "quantiles". The histograms of the ISP statistics all have
+// the same number of bins, so the class can have a fixed size and is built
+// without any allocation. This lets the controller build it once for each
+// frame and share it with the algorithms through the image metadata.
 
 namespace RPiController {
 
 class Histogram
 {
 public:
+	static const int MAX_BINS = NUM_HISTOGRAM_BINS;
+	Histogram() : bins_(0) { cumulative_[0] = 0; }
 	template<typename T> Histogram(T *histogram, int num)
 	{
-		assert(num);
-		cumulative_.reserve(num + 1);
-		cumulative_.push_back(0);
+		assert(num && num <= MAX_BINS);
+		bins_ = num;
+		cumulative_[0] = 0;
+		// The ISP histograms have 32-bit bins, which have a vectorised
+		// prefix sum.
+		if constexpr (std::is_same_v<std::remove_cv_t<T>, uint32_t>) {
+			Accumulate(histogram, num);
+			return;
+		}
 		for (int i = 0; i < num; i++)
-			cumulative_.push_back(cumulative_.back() +
-					      histogram[i]);
+			cumulative_[i + 1] = cumulative_[i] + histogram[i];
 	}
-	uint32_t Bins() const { return cumulative_.size() - 1; }
-	uint64_t Total() const { return cumulative_[cumulative_.size() - 1]; }
+	uint32_t Bins() const { return bins_; }
+	uint64_t Total() const { return cumulative_[bins_]; }
 	// Cumulative frequency up to a (fractional) point in a bin.
 	uint64_t CumulativeFreq(double bin) const;
 	// Return the (fractional) bin of the point q (0 <= q <= 1) through the
 	// histogram. Optionally provide limits to help.
 	double Quantile(double q, int first = -1, int last = -1) const;
+	// Return the (fractional) bins of several quantiles at once. Each
+	// search starts from the previous result, so list them in increasing
+	// order where possible.
+	void Quantiles(double const q[], double bins[], int num) const;
 	// Return the average histogram bin value between the two quantiles.
 	double InterQuantileMean(double q_lo, double q_hi) const;
 
 private:
-	std::vector<uint64_t> cumulative_;
+	void Accumulate(uint32_t const *histogram, int num);
+	int bins_;
+	uint64_t cumulative_[MAX_BINS + 1];
 };
 
 } // namespace RPiController
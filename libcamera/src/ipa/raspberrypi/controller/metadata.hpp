@@ -6,59 +6,85 @@
  */
 #pragma once
 
-// A simple class for carrying arbitrary metadata, for example about an image.
+// A class for carrying the status of the control algorithms, for example about
+// an image. Every status type has its own fixed slot, selected at compile time
+// from the type, so that accessing the metadata needs neither string lookups
+// nor heap allocations.
 
-#include <any>
-#include <string>
-#include <mutex>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <tuple>
+
+#include "agc_status.h"
+#include "alsc_status.h"
+#include "awb_status.h"
+#include "black_level_status.h"
+#include "ccm_status.h"
+#include "contrast_status.h"
+#include "denoise_status.h"
+#include "device_status.h"
+#include "dpc_status.h"
+#include "focus_status.h"
+#include "geq_status.h"
+#include "histogram.hpp"
+#include "lux_status.h"
+#include "noise_status.h"
+#include "sharpen_status.h"
 
 namespace RPiController {
 
 class Metadata
 {
 public:
-	template<typename T> void Set(std::string const &tag, T const &value)
+	// Each slot also has a tag bit, so that sets of status types can be
+	// described by masks, for instance to list the metadata an algorithm
+	// reads or writes.
+	template<typename T> static constexpr uint32_t Tag()
+	{
+		return 1u << SlotIndex<T, Data>::value;
+	}
+	static constexpr uint32_t ALL_TAGS = ~0u;
+	template<typename T> void Set(T const &value)
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
-		data_[tag] = value;
+		slot<T>() = value;
 	}
-	template<typename T> int Get(std::string const &tag, T &value) const
+	template<typename T> int Get(T &value) const
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		std::optional<T> const &s = slot<T>();
+		if (!s)
 			return -1;
-		value = std::any_cast<T>(it->second);
+		value = *s;
 		return 0;
 	}
 	void Clear()
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
-		data_.clear();
+		std::apply([](auto &...s) { (s.reset(), ...); }, data_);
 	}
 	Metadata &operator=(Metadata const &other)
 	{
+		if (this == &other)
+			return *this;
 		std::lock_guard<std::mutex> lock(mutex_);
 		std::lock_guard<std::mutex> other_lock(other.mutex_);
 		data_ = other.data_;
 		return *this;
 	}
-	template<typename T> T *GetLocked(std::string const &tag)
+	template<typename T> T *GetLocked()
 	{
 		// This allows in-place access to the Metadata contents,
 		// for which you should be holding the lock.
-		auto it = data_.find(tag);
-		if (it == data_.end())
-			return nullptr;
-		return std::any_cast<T>(&it->second);
+		std::optional<T> &s = slot<T>();
+		return s ? &*s : nullptr;
 	}
-	template<typename T>
-	void SetLocked(std::string const &tag, T const &value)
+	template<typename T> void SetLocked(T const &value)
 	{
 		// Use this only if you're holding the lock yourself.
-		data_[tag] = value;
+		slot<T>() = value;
 	}
 	// Note: use of (lowercase) lock and unlock means you can create scoped
 	// locks with the standard lock classes.
@@ -67,8 +93,49 @@ public:
 	void unlock() { mutex_.unlock(); }
 
 private:
+	// The index of the slot holding the type T in the Data tuple.
+	template<typename T, typename Tuple> struct SlotIndex;
+	template<typename T, typename... Ts>
+	struct SlotIndex<T, std::tuple<std::optional<T>, Ts...>> {
+		static constexpr unsigned int value = 0;
+	};
+	template<typename T, typename U, typename... Ts>
+	struct SlotIndex<T, std::tuple<U, Ts...>> {
+		static constexpr unsigned int value =
+			1 + SlotIndex<T, std::tuple<Ts...>>::value;
+	};
+
+	// Storing a type that has no slot below fails to compile.
+	template<typename T> std::optional<T> &slot()
+	{
+		return std::get<std::optional<T>>(data_);
+	}
+	template<typename T> std::optional<T> const &slot() const
+	{
+		return std::get<std::optional<T>>(data_);
+	}
+
+	// The Histogram slot holds the green histogram of the frame statistics,
+	// which the Controller builds once for all the algorithms.
+	typedef std::tuple<std::optional<AgcStatus>,
+			   std::optional<AlscStatus>,
+			   std::optional<AwbStatus>,
+			   std::optional<BlackLevelStatus>,
+			   std::optional<CcmStatus>,
+			   std::optional<ContrastStatus>,
+			   std::optional<DenoiseStatus>,
+			   std::optional<DeviceStatus>,
+			   std::optional<DpcStatus>,
+			   std::optional<FocusStatus>,
+			   std::optional<GeqStatus>,
+			   std::optional<Histogram>,
+			   std::optional<LuxStatus>,
+			   std::optional<NoiseStatus>,
+			   std::optional<SharpenStatus>> Data;
+	static_assert(std::tuple_size<Data>::value <= 32,
+		      "Metadata tags do not fit in 32 bits");
 	mutable std::mutex mutex_;
-	std::map<std::string, std::any> data_;
+	Data data_;
 };
 
 typedef std::shared_ptr<Metadata> MetadataPtr;
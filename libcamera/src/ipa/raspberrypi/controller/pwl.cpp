@@ -12,102 +12,167 @@
 
 using namespace RPiController;
 
+// The lookup table gets enough cells for the narrowest span to cover about one
+// of them, within this limit.
+#define MAX_LUT_CELLS 256
+
+Pwl::Pwl(std::vector<Point> const &points)
+{
+	for (auto &p : points) {
+		x_.push_back(p.x);
+		y_.push_back(p.y);
+	}
+}
+
 void Pwl::Read(boost::property_tree::ptree const &params)
 {
 	for (auto it = params.begin(); it != params.end(); it++) {
 		double x = it->second.get_value<double>();
-		assert(it == params.begin() || x > points_.back().x);
+		assert(it == params.begin() || x > x_.back());
 		it++;
 		double y = it->second.get_value<double>();
-		points_.push_back(Point(x, y));
+		x_.push_back(x);
+		y_.push_back(y);
+	}
+	assert(x_.size() >= 2);
+	Bake();
+}
+
+void Pwl::Bake()
+{
+	lut_.clear();
+	int num_spans = x_.size() - 1;
+	if (num_spans < 2)
+		return;
+	assert(num_spans <= UINT16_MAX);
+	double min_len = x_[1] - x_[0];
+	for (int i = 1; i < num_spans; i++)
+		min_len = std::min(min_len, x_[i + 1] - x_[i]);
+	double len = x_.back() - x_[0];
+	int cells = std::min((double)MAX_LUT_CELLS, ceil(len / min_len));
+	lut_start_ = x_[0];
+	lut_scale_ = cells / len;
+	lut_.resize(cells);
+	int span = 0;
+	for (int i = 0; i < cells; i++) {
+		double x = lut_start_ + i / lut_scale_;
+		while (span < num_spans - 1 && x >= x_[span + 1])
+			span++;
+		lut_[i] = span;
 	}
-	assert(points_.size() >= 2);
 }
 
 void Pwl::Append(double x, double y, const double eps)
 {
-	if (points_.empty() || points_.back().x + eps < x)
-		points_.push_back(Point(x, y));
+	if (x_.empty() || x_.back() + eps < x) {
+		x_.push_back(x);
+		y_.push_back(y);
+		lut_.clear();
+	}
 }
 
 void Pwl::Prepend(double x, double y, const double eps)
 {
-	if (points_.empty() || points_.front().x - eps > x)
-		points_.insert(points_.begin(), Point(x, y));
+	if (x_.empty() || x_.front() - eps > x) {
+		x_.insert(x_.begin(), x);
+		y_.insert(y_.begin(), y);
+		lut_.clear();
+	}
 }
 
 Pwl::Interval Pwl::Domain() const
 {
-	return Interval(points_[0].x, points_[points_.size() - 1].x);
+	return Interval(x_[0], x_[x_.size() - 1]);
 }
 
 Pwl::Interval Pwl::Range() const
 {
-	double lo = points_[0].y, hi = lo;
-	for (auto &p : points_)
-		lo = std::min(lo, p.y), hi = std::max(hi, p.y);
+	double lo = y_[0], hi = lo;
+	for (double y : y_)
+		lo = std::min(lo, y), hi = std::max(hi, y);
 	return Interval(lo, hi);
 }
 
 bool Pwl::Empty() const
 {
-	return points_.empty();
+	return x_.empty();
 }
 
 double Pwl::Eval(double x, int *span_ptr, bool update_span) const
 {
-	int span = findSpan(x, span_ptr && *span_ptr != -1
-				       ? *span_ptr
-				       : points_.size() / 2 - 1);
+	int span;
+	if (span_ptr && *span_ptr != -1)
+		span = findSpan(x, *span_ptr);
+	else
+		span = findSpan(x, lut_.empty() ? x_.size() / 2 - 1 : lutSpan(x));
 	if (span_ptr && update_span)
 		*span_ptr = span;
-	return points_[span].y +
-	       (x - points_[span].x) * (points_[span + 1].y - points_[span].y) /
-		       (points_[span + 1].x - points_[span].x);
+	return interpolate(span, x);
+}
+
+void Pwl::Eval(double const x[], double y[], int num) const
+{
+	int span = x_.size() / 2 - 1;
+	for (int i = 0; i < num; i++) {
+		span = findSpan(x[i], lut_.empty() ? span : lutSpan(x[i]));
+		y[i] = interpolate(span, x[i]);
+	}
 }
 
 int Pwl::findSpan(double x, int span) const
 {
 	// Pwls are generally small, so linear search may well be faster than
 	// binary, though could review this if large PWls start turning up.
-	int last_span = points_.size() - 2;
+	int last_span = x_.size() - 2;
 	// some algorithms may call us with span pointing directly at the last
 	// control point
 	span = std::max(0, std::min(last_span, span));
-	while (span < last_span && x >= points_[span + 1].x)
+	while (span < last_span && x >= x_[span + 1])
 		span++;
-	while (span && x < points_[span].x)
+	while (span && x < x_[span])
 		span--;
 	return span;
 }
 
+int Pwl::lutSpan(double x) const
+{
+	// The table only gives a starting point, which findSpan corrects when
+	// rounding puts x in a neighbouring cell, or x is outside the domain.
+	double cell = (x - lut_start_) * lut_scale_;
+	if (!(cell >= 0))
+		return 0;
+	if (cell >= lut_.size())
+		return lut_.back();
+	return lut_[(int)cell];
+}
+
 Pwl::PerpType Pwl::Invert(Point const &xy, Point &perp, int &span,
 			  const double eps) const
 {
 	assert(span >= -1);
 	bool prev_off_end = false;
-	for (span = span + 1; span < (int)points_.size() - 1; span++) {
-		Point span_vec = points_[span + 1] - points_[span];
-		double t = ((xy - points_[span]) % span_vec) / span_vec.Len2();
+	for (span = span + 1; span < (int)x_.size() - 1; span++) {
+		Point span_vec = point(span + 1) - point(span);
+		double t = ((xy - point(span)) % span_vec) / span_vec.Len2();
 		if (t < -eps) // off the start of this span
 		{
 			if (span == 0) {
-				perp = points_[span];
+				perp = point(span);
 				return PerpType::Start;
 			} else if (prev_off_end) {
-				perp = points_[span];
+				perp = point(span);
 				return PerpType::Vertex;
 			}
 		} else if (t > 1 + eps) // off the end of this span
 		{
-			if (span == (int)points_.size() - 2) {
-				perp = points_[span + 1];
+			if (span == (int)x_.size() - 2) {
+				perp = point(span + 1);
 				return PerpType::End;
 			}
 			prev_off_end = true;
 		} else // a true perpendicular
 		{
-			perp = points_[span] + span_vec * t;
+			perp = point(span) + span_vec * t;
 			return PerpType::Perpendicular;
 		}
 	}
@@ -119,16 +184,17 @@ Pwl Pwl::Inverse(bool *true_inverse, const double eps) const
 	bool appended = false, prepended = false, neither = false;
 	Pwl inverse;
 
-	for (Point const &p : points_) {
+	for (size_t i = 0; i < x_.size(); i++) {
+		Point p = point(i);
 		if (inverse.Empty())
 			inverse.Append(p.y, p.x, eps);
-		else if (std::abs(inverse.points_.back().x - p.y) <= eps ||
-			 std::abs(inverse.points_.front().x - p.y) <= eps)
+		else if (std::abs(inverse.x_.back() - p.y) <= eps ||
+			 std::abs(inverse.x_.front() - p.y) <= eps)
 			/* do nothing */;
-		else if (p.y > inverse.points_.back().x) {
+		else if (p.y > inverse.x_.back()) {
 			inverse.Append(p.y, p.x, eps);
 			appended = true;
-		} else if (p.y < inverse.points_.front().x) {
+		} else if (p.y < inverse.x_.front()) {
 			inverse.Prepend(p.y, p.x, eps);
 			prepended = true;
 		} else
@@ -146,36 +212,32 @@ Pwl Pwl::Inverse(bool *true_inverse, const double eps) const
 
 Pwl Pwl::Compose(Pwl const &other, const double eps) const
 {
-	double this_x = points_[0].x, this_y = points_[0].y;
+	double this_x = x_[0], this_y = y_[0];
 	int this_span = 0, other_span = other.findSpan(this_y, 0);
 	Pwl result({ { this_x, other.Eval(this_y, &other_span, false) } });
-	while (this_span != (int)points_.size() - 1) {
-		double dx = points_[this_span + 1].x - points_[this_span].x,
-		       dy = points_[this_span + 1].y - points_[this_span].y;
-		if (abs(dy) > eps &&
-		    other_span + 1 < (int)other.points_.size() &&
-		    points_[this_span + 1].y >=
-			    other.points_[other_span + 1].x + eps) {
+	while (this_span != (int)x_.size() - 1) {
+		double dx = x_[this_span + 1] - x_[this_span],
+		       dy = y_[this_span + 1] - y_[this_span];
+		if (abs(dy) > eps && other_span + 1 < (int)other.x_.size() &&
+		    y_[this_span + 1] >= other.x_[other_span + 1] + eps) {
 			// next control point in result will be where this
 			// function's y reaches the next span in other
-			this_x = points_[this_span].x +
-				 (other.points_[other_span + 1].x -
-				  points_[this_span].y) * dx / dy;
-			this_y = other.points_[++other_span].x;
+			this_x = x_[this_span] +
+				 (other.x_[other_span + 1] - y_[this_span]) *
+					 dx / dy;
+			this_y = other.x_[++other_span];
 		} else if (abs(dy) > eps && other_span > 0 &&
-			   points_[this_span + 1].y <=
-				   other.points_[other_span - 1].x - eps) {
+			   y_[this_span + 1] <= other.x_[other_span - 1] - eps) {
 			// next control point in result will be where this
 			// function's y reaches the previous span in other
-			this_x = points_[this_span].x +
-				 (other.points_[other_span + 1].x -
-				  points_[this_span].y) * dx / dy;
-			this_y = other.points_[--other_span].x;
+			this_x = x_[this_span] +
+				 (other.x_[other_span + 1] - y_[this_span]) *
+					 dx / dy;
+			this_y = other.x_[--other_span];
 		} else {
 			// we stay in the same span in other
 			this_span++;
-			this_x = points_[this_span].x,
-			this_y = points_[this_span].y;
+			this_x = x_[this_span], this_y = y_[this_span];
 		}
 		result.Append(this_x, other.Eval(this_y, &other_span, false),
 			      eps);
@@ -185,26 +247,26 @@ Pwl Pwl::Compose(Pwl const &other, const double eps) const
 
 void Pwl::Map(std::function<void(double x, double y)> f) const
 {
-	for (auto &pt : points_)
-		f(pt.x, pt.y);
+	for (size_t i = 0; i < x_.size(); i++)
+		f(x_[i], y_[i]);
 }
 
 void Pwl::Map2(Pwl const &pwl0, Pwl const &pwl1,
 	       std::function<void(double x, double y0, double y1)> f)
 {
 	int span0 = 0, span1 = 0;
-	double x = std::min(pwl0.points_[0].x, pwl1.points_[0].x);
+	double x = std::min(pwl0.x_[0], pwl1.x_[0]);
 	f(x, pwl0.Eval(x, &span0, false), pwl1.Eval(x, &span1, false));
-	while (span0 < (int)pwl0.points_.size() - 1 ||
-	       span1 < (int)pwl1.points_.size() - 1) {
-		if (span0 == (int)pwl0.points_.size() - 1)
-			x = pwl1.points_[++span1].x;
-		else if (span1 == (int)pwl1.points_.size() - 1)
-			x = pwl0.points_[++span0].x;
-		else if (pwl0.points_[span0 + 1].x > pwl1.points_[span1 + 1].x)
-			x = pwl1.points_[++span1].x;
+	while (span0 < (int)pwl0.x_.size() - 1 ||
+	       span1 < (int)pwl1.x_.size() - 1) {
+		if (span0 == (int)pwl0.x_.size() - 1)
+			x = pwl1.x_[++span1];
+		else if (span1 == (int)pwl1.x_.size() - 1)
+			x = pwl0.x_[++span0];
+		else if (pwl0.x_[span0 + 1] > pwl1.x_[span1 + 1])
+			x = pwl1.x_[++span1];
 		else
-			x = pwl0.points_[++span0].x;
+			x = pwl0.x_[++span0];
 		f(x, pwl0.Eval(x, &span0, false), pwl1.Eval(x, &span1, false));
 	}
 }
@@ -223,24 +285,22 @@ Pwl Pwl::Combine(Pwl const &pwl0, Pwl const &pwl1,
 void Pwl::MatchDomain(Interval const &domain, bool clip, const double eps)
 {
 	int span = 0;
-	Prepend(domain.start, Eval(clip ? points_[0].x : domain.start, &span),
-		eps);
-	span = points_.size() - 2;
-	Append(domain.end, Eval(clip ? points_.back().x : domain.end, &span),
-	       eps);
+	Prepend(domain.start, Eval(clip ? x_[0] : domain.start, &span), eps);
+	span = x_.size() - 2;
+	Append(domain.end, Eval(clip ? x_.back() : domain.end, &span), eps);
 }
 
 Pwl &Pwl::operator*=(double d)
 {
-	for (auto &pt : points_)
-		pt.y *= d;
+	for (double &y : y_)
+		y *= d;
 	return *this;
 }
 
 void Pwl::Debug(FILE *fp) const
 {
 	fprintf(fp, "Pwl {\n");
-	for (auto &p : points_)
-		fprintf(fp, "\t(%g, %g)\n", p.x, p.y);
+	for (size_t i = 0; i < x_.size(); i++)
+		fprintf(fp, "\t(%g, %g)\n", x_[i], y_[i]);
 	fprintf(fp, "}\n");
 }
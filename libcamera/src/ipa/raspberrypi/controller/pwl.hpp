@@ -6,7 +6,9 @@
  */
 #pragma once
 
+#include <functional>
 #include <math.h>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/property_tree/ptree.hpp>
@@ -54,8 +56,14 @@ public:
 		double Len() const { return sqrt(Len2()); }
 	};
 	Pwl() {}
-	Pwl(std::vector<Point> const &points) : points_(points) {}
+	Pwl(std::vector<Point> const &points);
+	// Read the control points from the tuning file, and Bake() them.
 	void Read(boost::property_tree::ptree const &params);
+	// Build a lookup table of spans over a uniform grid, so that evaluating
+	// the Pwl without a span guess costs no search. Appending or prepending
+	// points drops the table, so only bake Pwls that are complete, such as
+	// the ones from the tuning file.
+	void Bake();
 	void Append(double x, double y, const double eps = 1e-6);
 	void Prepend(double x, double y, const double eps = 1e-6);
 	Interval Domain() const;
@@ -67,6 +75,10 @@ public:
 	// -1.
 	double Eval(double x, int *span_ptr = nullptr,
 		    bool update_span = true) const;
+	// Evaluate Pwl at num points at once. Each search starts from the span
+	// of the previous point unless the Pwl is baked, so unbaked Pwls should
+	// be given the points in increasing order.
+	void Eval(double const x[], double y[], int num) const;
 	// Find perpendicular closest to xy, starting from span+1 so you can
 	// call it repeatedly to check for multiple closest points (set span to
 	// -1 on the first call). Also returns "pseudo" perpendiculars; see
@@ -106,7 +118,20 @@ public:
 
 private:
 	int findSpan(double x, int span) const;
-	std::vector<Point> points_;
+	int lutSpan(double x) const;
+	double interpolate(int span, double x) const
+	{
+		return y_[span] + (x - x_[span]) * (y_[span + 1] - y_[span]) /
+					  (x_[span + 1] - x_[span]);
+	}
+	Point point(int i) const { return Point(x_[i], y_[i]); }
+	// The control points are stored as separate arrays of x and y values,
+	// so that the span searches only walk through the x values.
+	std::vector<double> x_, y_;
+	// The span at the start of each cell of a uniform grid over the domain,
+	// when baked.
+	std::vector<uint16_t> lut_;
+	double lut_start_, lut_scale_;
 };
 
 } // namespace RPiController
@@ -311,7 +311,7 @@ void Agc::Prepare(Metadata *image_metadata)
 	if (status_.total_exposure_value) {
 		// Process has run, so we have meaningful values.
 		DeviceStatus device_status;
-		if (image_metadata->Get("device.status", device_status) == 0) {
+		if (image_metadata->Get(device_status) == 0) {
 			double actual_exposure = device_status.shutter_speed *
 						 device_status.analogue_gain;
 			if (actual_exposure) {
@@ -332,7 +332,7 @@ void Agc::Prepare(Metadata *image_metadata)
 			}
 		} else
 			LOG(RPiAgc, Warning) << Name() << ": no device metadata";
-		image_metadata->Set("agc.status", status_);
+		image_metadata->Set(status_);
 	}
 }
 
@@ -455,13 +455,13 @@ void Agc::fetchCurrentExposure(Metadata *image_metadata)
 {
 	std::unique_lock<Metadata> lock(*image_metadata);
 	DeviceStatus *device_status =
-		image_metadata->GetLocked<DeviceStatus>("device.status");
+		image_metadata->GetLocked<DeviceStatus>();
 	if (!device_status)
 		throw std::runtime_error("Agc: no device metadata");
 	current_.shutter = device_status->shutter_speed;
 	current_.analogue_gain = device_status->analogue_gain;
 	AgcStatus *agc_status =
-		image_metadata->GetLocked<AgcStatus>("agc.status");
+		image_metadata->GetLocked<AgcStatus>();
 	current_.total_exposure = agc_status ? agc_status->total_exposure_value : 0;
 	current_.total_exposure_no_dg = current_.shutter * current_.analogue_gain;
 }
@@ -471,7 +471,7 @@ void Agc::fetchAwbStatus(Metadata *image_metadata)
 	awb_.gain_r = 1.0; // in case not found in metadata
 	awb_.gain_g = 1.0;
 	awb_.gain_b = 1.0;
-	if (image_metadata->Get("awb.status", awb_) != 0)
+	if (image_metadata->Get(awb_) != 0)
 		LOG(RPiAgc, Warning) << "Agc: no AWB status found";
 }
 
@@ -510,7 +510,7 @@ static double compute_initial_Y(bcm2835_isp_stats *stats, AwbStatus const &awb,
 
 #define EV_GAIN_Y_TARGET_LIMIT 0.9
 
-static double constraint_compute_gain(AgcConstraint &c, Histogram &h,
+static double constraint_compute_gain(AgcConstraint &c, Histogram const &h,
 				      double lux, double ev_gain,
 				      double &target_Y)
 {
@@ -525,9 +525,13 @@ void Agc::computeGain(bcm2835_isp_stats *statistics, Metadata *image_metadata,
 {
 	struct LuxStatus lux = {};
 	lux.lux = 400; // default lux level to 400 in case no metadata found
-	if (image_metadata->Get("lux.status", lux) != 0)
+	if (image_metadata->Get(lux) != 0)
 		LOG(RPiAgc, Warning) << "Agc: no lux level found";
-	Histogram h(statistics->hist[0].g_hist, NUM_HISTOGRAM_BINS);
+	// The Controller normally leaves the histogram in the image metadata
+	// for all the algorithms to share.
+	Histogram h;
+	if (image_metadata->Get(h) != 0)
+		h = Histogram(statistics->hist[0].g_hist, NUM_HISTOGRAM_BINS);
 	double ev_gain = status_.ev * config_.base_ev;
 	// The initial gain and target_Y come from some of the regions. After
 	// that we consider the histogram constraints.
@@ -743,7 +747,7 @@ void Agc::writeAndFinish(Metadata *image_metadata, bool desaturate)
 	status_.analogue_gain = filtered_.analogue_gain;
 	// Write to metadata as well, in case anyone wants to update the camera
 	// immediately.
-	image_metadata->Set("agc.status", status_);
+	image_metadata->Set(status_);
 	LOG(RPiAgc, Debug) << "Output written, total exposure requested is "
 			   << filtered_.total_exposure;
 	LOG(RPiAgc, Debug) << "Camera exposure update: shutter time " << filtered_.shutter
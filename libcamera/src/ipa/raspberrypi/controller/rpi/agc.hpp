@@ -87,6 +87,16 @@ public:
 	void SwitchMode(CameraMode const &camera_mode, Metadata *metadata) override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override
+	{
+		return Metadata::Tag<AgcStatus>() |
+		       Metadata::Tag<DeviceStatus>() |
+		       Metadata::Tag<Histogram>() | Metadata::Tag<LuxStatus>();
+	}
+	uint32_t ProcessWrites() const override
+	{
+		return Metadata::Tag<AgcStatus>();
+	}
 
 private:
 	void updateLockStatus(DeviceStatus const &device_status);
@@ -9,6 +9,7 @@
 #include "libcamera/internal/log.h"
 
 #include "../awb_status.h"
+#include "../thread_pool.hpp"
 #include "alsc.hpp"
 
 // Raspberry Pi ALSC (Auto Lens Shading Correction) algorithm.
@@ -23,23 +24,17 @@ LOG_DEFINE_CATEGORY(RPiAlsc)
 static const int X = ALSC_CELLS_X;
 static const int Y = ALSC_CELLS_Y;
 static const int XY = X * Y;
-static const double INSUFFICIENT_DATA = -1.0;
 
 Alsc::Alsc(Controller *controller)
 	: Algorithm(controller)
 {
-	async_abort_ = async_start_ = async_started_ = async_finished_ = false;
-	async_thread_ = std::thread(std::bind(&Alsc::asyncFunc, this));
+	async_started_ = async_finished_ = false;
 }
 
 Alsc::~Alsc()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		async_abort_ = true;
-	}
-	async_signal_.notify_one();
-	async_thread_.join();
+	// Wait for any calculation still running on the thread pool.
+	waitForAysncThread();
 }
 
 char const *Alsc::Name() const
@@ -149,6 +144,13 @@ void Alsc::Read(boost::property_tree::ptree const &params)
 	read_calibrations(config_.calibrations_Cb, params, "calibrations_Cb");
 	config_.default_ct = params.get<double>("default_ct", 4500.0);
 	config_.threshold = params.get<double>("threshold", 1e-3);
+	std::string solver = params.get<std::string>("solver", "gauss_seidel");
+	if (solver == "gauss_seidel")
+		config_.solver = AlscSolver::GaussSeidel;
+	else if (solver == "red_black")
+		config_.solver = AlscSolver::RedBlack;
+	else
+		throw std::runtime_error("Alsc: unknown solver " + solver);
 }
 
 static double get_ct(Metadata *metadata, double default_ct);
@@ -266,7 +268,7 @@ double get_ct(Metadata *metadata, double default_ct)
 {
 	AwbStatus awb_status;
 	awb_status.temperature_K = default_ct; // in case nothing found
-	if (metadata->Get("awb.status", awb_status) != 0)
+	if (metadata->Get(awb_status) != 0)
 		LOG(RPiAlsc, Warning) << "no AWB results found, using "
 				      << awb_status.temperature_K;
 	else
@@ -300,7 +302,7 @@ void Alsc::restartAsync(StatisticsPtr &stats, Metadata *image_metadata)
 	// We have to copy the statistics here, dividing out our best guess of
 	// the LSC table that the pipeline applied to them.
 	AlscStatus alsc_status;
-	if (image_metadata->Get("alsc.status", alsc_status) != 0) {
+	if (image_metadata->Get(alsc_status) != 0) {
 		LOG(RPiAlsc, Warning)
 			<< "No ALSC status found for applied gains!";
 		for (int y = 0; y < Y; y++)
@@ -313,11 +315,7 @@ void Alsc::restartAsync(StatisticsPtr &stats, Metadata *image_metadata)
 	copy_stats(statistics_, stats, alsc_status);
 	frame_phase_ = 0;
 	async_started_ = true;
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		async_start_ = true;
-	}
-	async_signal_.notify_one();
+	ThreadPool::Instance().Submit(std::bind(&Alsc::asyncFunc, this));
 }
 
 void Alsc::Prepare(Metadata *image_metadata)
@@ -347,7 +345,7 @@ void Alsc::Prepare(Metadata *image_metadata)
 	memcpy(status.r, prev_sync_results_[0], sizeof(status.r));
 	memcpy(status.g, prev_sync_results_[1], sizeof(status.g));
 	memcpy(status.b, prev_sync_results_[2], sizeof(status.b));
-	image_metadata->Set("alsc.status", status);
+	image_metadata->Set(status);
 }
 
 void Alsc::Process(StatisticsPtr &stats, Metadata *image_metadata)
@@ -368,23 +366,11 @@ void Alsc::Process(StatisticsPtr &stats, Metadata *image_metadata)
 
 void Alsc::asyncFunc()
 {
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			async_signal_.wait(lock, [&] {
-				return async_start_ || async_abort_;
-			});
-			async_start_ = false;
-			if (async_abort_)
-				break;
-		}
-		doAlsc();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			async_finished_ = true;
-		}
-		sync_signal_.notify_one();
-	}
+	doAlsc();
+	std::lock_guard<std::mutex> lock(mutex_);
+	async_finished_ = true;
+	// Notify with the lock held, as the destructor may be waiting for us.
+	sync_signal_.notify_one();
 }
 
 void get_cal_table(double ct, std::vector<AlscCalibration> const &calibrations,
@@ -479,7 +465,7 @@ static void calculate_Cr_Cb(bcm2835_isp_stats_region *awb_region, double Cr[XY],
 		bcm2835_isp_stats_region &zone = awb_region[i];
 		if (zone.counted <= min_count ||
 		    zone.g_sum / zone.counted <= min_G) {
-			Cr[i] = Cb[i] = INSUFFICIENT_DATA;
+			Cr[i] = Cb[i] = ALSC_INSUFFICIENT_DATA;
 			continue;
 		}
 		Cr[i] = zone.r_sum / (double)zone.g_sum;
@@ -490,7 +476,7 @@ static void calculate_Cr_Cb(bcm2835_isp_stats_region *awb_region, double Cr[XY],
 static void apply_cal_table(double const cal_table[XY], double C[XY])
 {
 	for (int i = 0; i < XY; i++)
-		if (C[i] != INSUFFICIENT_DATA)
+		if (C[i] != ALSC_INSUFFICIENT_DATA)
 			C[i] *= cal_table[i];
 }
 
@@ -521,128 +507,6 @@ void compensate_lambdas_for_cal(double const cal_table[XY],
 	printf("]\n");
 }
 
-// Compute weight out of 1.0 which reflects how similar we wish to make the
-// colours of these two regions.
-static double compute_weight(double C_i, double C_j, double sigma)
-{
-	if (C_i == INSUFFICIENT_DATA || C_j == INSUFFICIENT_DATA)
-		return 0;
-	double diff = (C_i - C_j) / sigma;
-	return exp(-diff * diff / 2);
-}
-
-// Compute all weights.
-static void compute_W(double const C[XY], double sigma, double W[XY][4])
-{
-	for (int i = 0; i < XY; i++) {
-		// Start with neighbour above and go clockwise.
-		W[i][0] = i >= X ? compute_weight(C[i], C[i - X], sigma) : 0;
-		W[i][1] = i % X < X - 1 ? compute_weight(C[i], C[i + 1], sigma)
-					: 0;
-		W[i][2] =
-			i < XY - X ? compute_weight(C[i], C[i + X], sigma) : 0;
-		W[i][3] = i % X ? compute_weight(C[i], C[i - 1], sigma) : 0;
-	}
-}
-
-// Compute M, the large but sparse matrix such that M * lambdas = 0.
-static void construct_M(double const C[XY], double const W[XY][4],
-			double M[XY][4])
-{
-	double epsilon = 0.001;
-	for (int i = 0; i < XY; i++) {
-		// Note how, if C[i] == INSUFFICIENT_DATA, the weights will all
-		// be zero so the equation is still set up correctly.
-		int m = !!(i >= X) + !!(i % X < X - 1) + !!(i < XY - X) +
-			!!(i % X); // total number of neighbours
-		// we'll divide the diagonal out straight away
-		double diagonal =
-			(epsilon + W[i][0] + W[i][1] + W[i][2] + W[i][3]) *
-			C[i];
-		M[i][0] = i >= X ? (W[i][0] * C[i - X] + epsilon / m * C[i]) /
-					   diagonal
-				 : 0;
-		M[i][1] = i % X < X - 1
-				  ? (W[i][1] * C[i + 1] + epsilon / m * C[i]) /
-					    diagonal
-				  : 0;
-		M[i][2] = i < XY - X
-				  ? (W[i][2] * C[i + X] + epsilon / m * C[i]) /
-					    diagonal
-				  : 0;
-		M[i][3] = i % X ? (W[i][3] * C[i - 1] + epsilon / m * C[i]) /
-					  diagonal
-				: 0;
-	}
-}
-
-// In the compute_lambda_ functions, note that the matrix coefficients for the
-// left/right neighbours are zero down the left/right edges, so we don't need
-// need to test the i value to exclude them.
-static double compute_lambda_bottom(int i, double const M[XY][4],
-				    double lambda[XY])
-{
-	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + X] +
-	       M[i][3] * lambda[i - 1];
-}
-static double compute_lambda_bottom_start(int i, double const M[XY][4],
-					  double lambda[XY])
-{
-	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + X];
-}
-static double compute_lambda_interior(int i, double const M[XY][4],
-				      double lambda[XY])
-{
-	return M[i][0] * lambda[i - X] + M[i][1] * lambda[i + 1] +
-	       M[i][2] * lambda[i + X] + M[i][3] * lambda[i - 1];
-}
-static double compute_lambda_top(int i, double const M[XY][4],
-				 double lambda[XY])
-{
-	return M[i][0] * lambda[i - X] + M[i][1] * lambda[i + 1] +
-	       M[i][3] * lambda[i - 1];
-}
-static double compute_lambda_top_end(int i, double const M[XY][4],
-				     double lambda[XY])
-{
-	return M[i][0] * lambda[i - X] + M[i][3] * lambda[i - 1];
-}
-
-// Gauss-Seidel iteration with over-relaxation.
-static double gauss_seidel2_SOR(double const M[XY][4], double omega,
-				double lambda[XY])
-{
-	double old_lambda[XY];
-	int i;
-	for (i = 0; i < XY; i++)
-		old_lambda[i] = lambda[i];
-	lambda[0] = compute_lambda_bottom_start(0, M, lambda);
-	for (i = 1; i < X; i++)
-		lambda[i] = compute_lambda_bottom(i, M, lambda);
-	for (; i < XY - X; i++)
-		lambda[i] = compute_lambda_interior(i, M, lambda);
-	for (; i < XY - 1; i++)
-		lambda[i] = compute_lambda_top(i, M, lambda);
-	lambda[i] = compute_lambda_top_end(i, M, lambda);
-	// Also solve the system from bottom to top, to help spread the updates
-	// better.
-	lambda[i] = compute_lambda_top_end(i, M, lambda);
-	for (i = XY - 2; i >= XY - X; i--)
-		lambda[i] = compute_lambda_top(i, M, lambda);
-	for (; i >= X; i--)
-		lambda[i] = compute_lambda_interior(i, M, lambda);
-	for (; i >= 1; i--)
-		lambda[i] = compute_lambda_bottom(i, M, lambda);
-	lambda[0] = compute_lambda_bottom_start(0, M, lambda);
-	double max_diff = 0;
-	for (i = 0; i < XY; i++) {
-		lambda[i] = old_lambda[i] + (lambda[i] - old_lambda[i]) * omega;
-		if (fabs(lambda[i] - old_lambda[i]) > fabs(max_diff))
-			max_diff = lambda[i] - old_lambda[i];
-	}
-	return max_diff;
-}
-
 // Normalise the values so that the smallest value is 1.
 static void normalise(double *ptr, size_t n)
 {
@@ -653,28 +517,14 @@ static void normalise(double *ptr, size_t n)
 		ptr[i] /= minval;
 }
 
-static void run_matrix_iterations(double const C[XY], double lambda[XY],
-				  double const W[XY][4], double omega,
-				  int n_iter, double threshold)
+static void run_matrix_iterations(AlscConfig const &config, double const C[XY],
+				  double lambda[XY], double const W[XY][4])
 {
 	double M[XY][4];
-	construct_M(C, W, M);
-	double last_max_diff = std::numeric_limits<double>::max();
-	for (int i = 0; i < n_iter; i++) {
-		double max_diff = fabs(gauss_seidel2_SOR(M, omega, lambda));
-		if (max_diff < threshold) {
-			LOG(RPiAlsc, Debug)
-				<< "Stop after " << i + 1 << " iterations";
-			break;
-		}
-		// this happens very occasionally (so make a note), though
-		// doesn't seem to matter
-		if (max_diff > last_max_diff)
-			LOG(RPiAlsc, Debug)
-				<< "Iteration " << i << ": max_diff gone up "
-				<< last_max_diff << " to " << max_diff;
-		last_max_diff = max_diff;
-	}
+	alsc_construct_M(C, W, M);
+	int n = alsc_solve(config.solver, M, config.omega, config.n_iter,
+			   config.threshold, lambda);
+	LOG(RPiAlsc, Debug) << "Stop after " << n << " iterations";
 	// We're going to normalise the lambdas so the smallest is 1. Not sure
 	// this is really necessary as they get renormalised later, but I
 	// suppose it does stop these quantities from wandering off...
@@ -733,13 +583,11 @@ void Alsc::doAlsc()
 	apply_cal_table(cal_table_r, Cr);
 	apply_cal_table(cal_table_b, Cb);
 	// Compute weights between zones.
-	compute_W(Cr, config_.sigma_Cr, Wr);
-	compute_W(Cb, config_.sigma_Cb, Wb);
-	// Run Gauss-Seidel iterations over the resulting matrix, for R and B.
-	run_matrix_iterations(Cr, lambda_r_, Wr, config_.omega, config_.n_iter,
-			      config_.threshold);
-	run_matrix_iterations(Cb, lambda_b_, Wb, config_.omega, config_.n_iter,
-			      config_.threshold);
+	alsc_compute_W(Cr, config_.sigma_Cr, Wr);
+	alsc_compute_W(Cb, config_.sigma_Cb, Wb);
+	// Run the solver iterations over the resulting matrix, for R and B.
+	run_matrix_iterations(config_, Cr, lambda_r_, Wr);
+	run_matrix_iterations(config_, Cb, lambda_b_, Wb);
 	// Fold the calibrated gains into our final lambda values. (Note that on
 	// the next run, we re-start with the lambda values that don't have the
 	// calibration gains included.)
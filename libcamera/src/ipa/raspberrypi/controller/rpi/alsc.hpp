@@ -8,10 +8,10 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <thread>
 
 #include "../algorithm.hpp"
 #include "../alsc_status.h"
+#include "alsc_solver.hpp"
 
 namespace RPiController {
 
@@ -41,6 +41,7 @@ struct AlscConfig {
 	std::vector<AlscCalibration> calibrations_Cb;
 	double default_ct; // colour temperature if no metadata found
 	double threshold; // iteration termination threshold
+	AlscSolver solver;
 };
 
 class Alsc : public Algorithm
@@ -54,6 +55,11 @@ public:
 	void Read(boost::property_tree::ptree const &params) override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override
+	{
+		return Metadata::Tag<AlscStatus>() | Metadata::Tag<AwbStatus>();
+	}
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	// configuration is read-only, and available to both threads
@@ -61,19 +67,13 @@ private:
 	bool first_time_;
 	CameraMode camera_mode_;
 	double luminance_table_[ALSC_CELLS_X * ALSC_CELLS_Y];
-	std::thread async_thread_;
-	void asyncFunc(); // asynchronous thread function
+	// The calculations run asynchronously on the shared thread pool.
+	void asyncFunc();
 	std::mutex mutex_;
-	// condvar for async thread to wait on
-	std::condition_variable async_signal_;
 	// condvar for synchronous thread to wait on
 	std::condition_variable sync_signal_;
 	// for sync thread to check  if async thread finished (requires mutex)
 	bool async_finished_;
-	// for async thread to check if it's been told to run (requires mutex)
-	bool async_start_;
-	// for async thread to check if it's been told to quit (requires mutex)
-	bool async_abort_;
 
 	// The following are only for the synchronous thread to use:
 	// for sync thread to note its has asked async thread to run
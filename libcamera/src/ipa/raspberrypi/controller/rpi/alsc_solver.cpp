@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * alsc_solver.cpp - ALSC (auto lens shading correction) linear solvers
+ */
+#include <algorithm>
+#include <math.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "alsc_solver.hpp"
+
+using namespace RPiController;
+
+static const int X = ALSC_CELLS_X;
+static const int Y = ALSC_CELLS_Y;
+static const int XY = ALSC_CELLS;
+
+// Compute weight out of 1.0 which reflects how similar we wish to make the
+// colours of these two regions.
+static double compute_weight(double C_i, double C_j, double sigma)
+{
+	if (C_i == ALSC_INSUFFICIENT_DATA || C_j == ALSC_INSUFFICIENT_DATA)
+		return 0;
+	double diff = (C_i - C_j) / sigma;
+	return exp(-diff * diff / 2);
+}
+
+void RPiController::alsc_compute_W(double const C[XY], double sigma,
+				   double W[XY][4])
+{
+	for (int i = 0; i < XY; i++) {
+		// Start with neighbour above and go clockwise.
+		W[i][0] = i >= X ? compute_weight(C[i], C[i - X], sigma) : 0;
+		W[i][1] = i % X < X - 1 ? compute_weight(C[i], C[i + 1], sigma)
+					: 0;
+		W[i][2] =
+			i < XY - X ? compute_weight(C[i], C[i + X], sigma) : 0;
+		W[i][3] = i % X ? compute_weight(C[i], C[i - 1], sigma) : 0;
+	}
+}
+
+void RPiController::alsc_construct_M(double const C[XY], double const W[XY][4],
+				     double M[XY][4])
+{
+	double epsilon = 0.001;
+	for (int i = 0; i < XY; i++) {
+		// Note how, if C[i] == INSUFFICIENT_DATA, the weights will all
+		// be zero so the equation is still set up correctly.
+		int m = !!(i >= X) + !!(i % X < X - 1) + !!(i < XY - X) +
+			!!(i % X); // total number of neighbours
+		// we'll divide the diagonal out straight away
+		double diagonal =
+			(epsilon + W[i][0] + W[i][1] + W[i][2] + W[i][3]) *
+			C[i];
+		M[i][0] = i >= X ? (W[i][0] * C[i - X] + epsilon / m * C[i]) /
+					   diagonal
+				 : 0;
+		M[i][1] = i % X < X - 1
+				  ? (W[i][1] * C[i + 1] + epsilon / m * C[i]) /
+					    diagonal
+				  : 0;
+		M[i][2] = i < XY - X
+				  ? (W[i][2] * C[i + X] + epsilon / m * C[i]) /
+					    diagonal
+				  : 0;
+		M[i][3] = i % X ? (W[i][3] * C[i - 1] + epsilon / m * C[i]) /
+					  diagonal
+				: 0;
+	}
+}
+
+// In the compute_lambda_ functions, note that the matrix coefficients for the
+// left/right neighbours are zero down the left/right edges, so we don't need
+// need to test the i value to exclude them.
+static double compute_lambda_bottom(int i, double const M[XY][4],
+				    double lambda[XY])
+{
+	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + X] +
+	       M[i][3] * lambda[i - 1];
+}
+static double compute_lambda_bottom_start(int i, double const M[XY][4],
+					  double lambda[XY])
+{
+	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + X];
+}
+static double compute_lambda_interior(int i, double const M[XY][4],
+				      double lambda[XY])
+{
+	return M[i][0] * lambda[i - X] + M[i][1] * lambda[i + 1] +
+	       M[i][2] * lambda[i + X] + M[i][3] * lambda[i - 1];
+}
+static double compute_lambda_top(int i, double const M[XY][4],
+				 double lambda[XY])
+{
+	return M[i][0] * lambda[i - X] + M[i][1] * lambda[i + 1] +
+	       M[i][3] * lambda[i - 1];
+}
+static double compute_lambda_top_end(int i, double const M[XY][4],
+				     double lambda[XY])
+{
+	return M[i][0] * lambda[i - X] + M[i][3] * lambda[i - 1];
+}
+
+// Gauss-Seidel iteration with over-relaxation.
+static double gauss_seidel2_SOR(double const M[XY][4], double omega,
+				double lambda[XY])
+{
+	double old_lambda[XY];
+	int i;
+	for (i = 0; i < XY; i++)
+		old_lambda[i] = lambda[i];
+	lambda[0] = compute_lambda_bottom_start(0, M, lambda);
+	for (i = 1; i < X; i++)
+		lambda[i] = compute_lambda_bottom(i, M, lambda);
+	for (; i < XY - X; i++)
+		lambda[i] = compute_lambda_interior(i, M, lambda);
+	for (; i < XY - 1; i++)
+		lambda[i] = compute_lambda_top(i, M, lambda);
+	lambda[i] = compute_lambda_top_end(i, M, lambda);
+	// Also solve the system from bottom to top, to help spread the updates
+	// better.
+	lambda[i] = compute_lambda_top_end(i, M, lambda);
+	for (i = XY - 2; i >= XY - X; i--)
+		lambda[i] = compute_lambda_top(i, M, lambda);
+	for (; i >= X; i--)
+		lambda[i] = compute_lambda_interior(i, M, lambda);
+	for (; i >= 1; i--)
+		lambda[i] = compute_lambda_bottom(i, M, lambda);
+	lambda[0] = compute_lambda_bottom_start(0, M, lambda);
+	double max_diff = 0;
+	for (i = 0; i < XY; i++) {
+		lambda[i] = old_lambda[i] + (lambda[i] - old_lambda[i]) * omega;
+		if (fabs(lambda[i] - old_lambda[i]) > fabs(max_diff))
+			max_diff = lambda[i] - old_lambda[i];
+	}
+	return max_diff;
+}
+
+static int solve_gauss_seidel(double const M[XY][4], double omega, int n_iter,
+			      double threshold, double lambda[XY])
+{
+	int i = 0;
+	while (i < n_iter) {
+		i++;
+		if (fabs(gauss_seidel2_SOR(M, omega, lambda)) < threshold)
+			break;
+	}
+	return i;
+}
+
+// For the red-black solver, the cells are coloured like a chequerboard, with
+// the top left cell red. Every neighbour of a red cell is black and vice
+// versa, so all the cells of one colour can be updated together from the
+// other colour. Each colour is stored packed, row by row, so that the cells of
+// a row are contiguous. Cell (x, y) lands in column x / 2 of its colour. The
+// lambdas get a border of zeros, which the zero coefficients of the edge
+// cells leave out of the sums without the need for any test.
+static const int HALF_X = X / 2;
+static const int STRIDE = HALF_X + 2;
+static_assert(X % 8 == 0, "ALSC red-black solver needs X to be a multiple of 8");
+
+struct RedBlackSystem {
+	// coefficients towards the above, right, below and left neighbours
+	float M[2][Y][4][HALF_X];
+	float lambda[2][Y + 2][STRIDE];
+};
+
+static int colour(int x, int y)
+{
+	return (x + y) & 1;
+}
+
+// Update a row of cells of one colour, given the packed rows of the other
+// colour above, beside and below it. The caller offsets the beside row so that
+// the left and right neighbours of column k are beside[k] and beside[k + 1].
+// Return the largest change in lambda.
+static float relax_row(float const M[4][HALF_X], float const *above,
+		       float const *beside, float const *below, float omega,
+		       float *lambda)
+{
+#if defined(__ARM_NEON)
+	float32x4_t w = vdupq_n_f32(omega);
+	float32x4_t max_diff = vdupq_n_f32(0);
+	for (int k = 0; k < HALF_X; k += 4) {
+		float32x4_t sum = vmulq_f32(vld1q_f32(&M[0][k]),
+					    vld1q_f32(above + k));
+		sum = vmlaq_f32(sum, vld1q_f32(&M[1][k]),
+				vld1q_f32(beside + k + 1));
+		sum = vmlaq_f32(sum, vld1q_f32(&M[2][k]), vld1q_f32(below + k));
+		sum = vmlaq_f32(sum, vld1q_f32(&M[3][k]), vld1q_f32(beside + k));
+		float32x4_t old = vld1q_f32(lambda + k);
+		float32x4_t diff = vmulq_f32(vsubq_f32(sum, old), w);
+		vst1q_f32(lambda + k, vaddq_f32(old, diff));
+		max_diff = vmaxq_f32(max_diff, vabsq_f32(diff));
+	}
+	float32x2_t max2 = vpmax_f32(vget_low_f32(max_diff),
+				     vget_high_f32(max_diff));
+	max2 = vpmax_f32(max2, max2);
+	return vget_lane_f32(max2, 0);
+#else
+	float max_diff = 0;
+	for (int k = 0; k < HALF_X; k++) {
+		float sum = M[0][k] * above[k] + M[1][k] * beside[k + 1] +
+			    M[2][k] * below[k] + M[3][k] * beside[k];
+		float diff = (sum - lambda[k]) * omega;
+		lambda[k] += diff;
+		max_diff = std::max(max_diff, fabsf(diff));
+	}
+	return max_diff;
+#endif
+}
+
+static float relax_colour(RedBlackSystem &sys, int c, float omega)
+{
+	float max_diff = 0;
+	float(*other)[STRIDE] = sys.lambda[c ^ 1];
+	for (int y = 0; y < Y; y++) {
+		// When the row starts with a cell of the other colour, the left
+		// neighbour of each cell is in the same packed column.
+		int shift = colour(0, y) != c;
+		float diff = relax_row(sys.M[c][y], &other[y][1],
+				       &other[y + 1][shift], &other[y + 2][1],
+				       omega, &sys.lambda[c][y + 1][1]);
+		max_diff = std::max(max_diff, diff);
+	}
+	return max_diff;
+}
+
+static int solve_red_black(double const M[XY][4], double omega, int n_iter,
+			   double threshold, double lambda[XY])
+{
+	// The lambdas of the previous run make the starting point, which saves
+	// most of the iterations once the algorithm has settled.
+	RedBlackSystem sys = {};
+	for (int y = 0; y < Y; y++) {
+		for (int x = 0; x < X; x++) {
+			int c = colour(x, y), i = y * X + x;
+			for (int j = 0; j < 4; j++)
+				sys.M[c][y][j][x / 2] = M[i][j];
+			sys.lambda[c][y + 1][x / 2 + 1] = lambda[i];
+		}
+	}
+	int i = 0;
+	while (i < n_iter) {
+		i++;
+		float max_diff = relax_colour(sys, 0, omega);
+		max_diff = std::max(max_diff, relax_colour(sys, 1, omega));
+		if (max_diff < threshold)
+			break;
+	}
+	for (int y = 0; y < Y; y++)
+		for (int x = 0; x < X; x++)
+			lambda[y * X + x] =
+				sys.lambda[colour(x, y)][y + 1][x / 2 + 1];
+	return i;
+}
+
+int RPiController::alsc_solve(AlscSolver solver, double const M[XY][4],
+			      double omega, int n_iter, double threshold,
+			      double lambda[XY])
+{
+	if (solver == AlscSolver::RedBlack)
+		return solve_red_black(M, omega, n_iter, threshold, lambda);
+	return solve_gauss_seidel(M, omega, n_iter, threshold, lambda);
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * alsc_solver.hpp - ALSC (auto lens shading correction) linear solvers
+ */
+#pragma once
+
+#include "../alsc_status.h"
+
+namespace RPiController {
+
+// The ALSC algorithm finds the lambdas (colour gains of each cell) by solving
+// the sparse system M * lambda = 0, where each row of M ties a cell to its four
+// neighbours (above, right, below, left) and the diagonal is divided out. The
+// functions here set up and solve that system, so that the different solvers
+// can be checked against each other outside the algorithm.
+
+static constexpr int ALSC_CELLS = ALSC_CELLS_X * ALSC_CELLS_Y;
+static constexpr double ALSC_INSUFFICIENT_DATA = -1.0;
+
+enum class AlscSolver {
+	// double precision Gauss-Seidel, sweeping forwards then backwards
+	GaussSeidel,
+	// single precision red-black SOR, vectorised where NEON is available
+	RedBlack,
+};
+
+// Compute the weights between each cell and its neighbours, from the colour
+// ratios C (ALSC_INSUFFICIENT_DATA where a cell has no usable statistics).
+void alsc_compute_W(double const C[ALSC_CELLS], double sigma,
+		    double W[ALSC_CELLS][4]);
+// Construct M, the large but sparse matrix such that M * lambda = 0.
+void alsc_construct_M(double const C[ALSC_CELLS], double const W[ALSC_CELLS][4],
+		      double M[ALSC_CELLS][4]);
+// Iterate over-relaxed solver passes starting from the given lambdas, until
+// no lambda moves by threshold or more, or for n_iter passes at most. Return
+// the number of passes run. The lambdas are not normalised.
+int alsc_solve(AlscSolver solver, double const M[ALSC_CELLS][4], double omega,
+	       int n_iter, double threshold, double lambda[ALSC_CELLS]);
+
+} // namespace RPiController
@@ -8,6 +8,7 @@
 #include "libcamera/internal/log.h"
 
 #include "../lux_status.h"
+#include "../thread_pool.hpp"
 
 #include "awb.hpp"
 
@@ -56,6 +57,8 @@ static void read_ct_curve(Pwl &ct_r, Pwl &ct_b,
 	if (num < 2)
 		throw std::runtime_error(
 			"AwbConfig: insufficient points in CT curve");
+	ct_r.Bake();
+	ct_b.Bake();
 }
 
 void AwbConfig::Read(boost::property_tree::ptree const &params)
@@ -117,26 +120,32 @@ void AwbConfig::Read(boost::property_tree::ptree const &params)
 	if (bayes == false)
 		sensitivity_r = sensitivity_b =
 			1.0; // nor do sensitivities make any sense
+	search_range = params.get<double>("search_range", 0.0);
+	if (search_range < 0)
+		throw std::runtime_error("AwbConfig: search_range must be >= 0");
 }
 
 Awb::Awb(Controller *controller)
 	: AwbAlgorithm(controller)
 {
-	async_abort_ = async_start_ = async_started_ = async_finished_ = false;
+	async_started_ = async_finished_ = false;
 	mode_ = nullptr;
 	manual_r_ = manual_b_ = 0.0;
 	first_switch_mode_ = true;
-	async_thread_ = std::thread(std::bind(&Awb::asyncFunc, this));
+	prior_lux_ = prior_scale_ = 0.0;
+	span_r_ = span_b_ = span_prior_ = -1;
+	last_ct_ = 0.0;
+	last_mode_ = nullptr;
+	async_search_stats_ = search_stats_ = {};
 }
 
 Awb::~Awb()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		async_abort_ = true;
-	}
-	async_signal_.notify_one();
-	async_thread_.join();
+	// Wait for any calculation still running on the thread pool.
+	std::unique_lock<std::mutex> lock(mutex_);
+	sync_signal_.wait(lock, [&] {
+		return !async_started_ || async_finished_;
+	});
 }
 
 char const *Awb::Name() const
@@ -215,7 +224,7 @@ void Awb::SwitchMode([[maybe_unused]] CameraMode const &camera_mode,
 		sync_results_.temperature_K = prev_sync_results_.temperature_K;
 	}
 	// Let other algorithms know the current white balance values.
-	metadata->Set("awb.status", prev_sync_results_);
+	metadata->Set(prev_sync_results_);
 	first_switch_mode_ = false;
 }
 
@@ -251,11 +260,7 @@ void Awb::restartAsync(StatisticsPtr &stats, double lux)
 	size_t len = mode_name_.copy(async_results_.mode,
 				     sizeof(async_results_.mode) - 1);
 	async_results_.mode[len] = '\0';
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		async_start_ = true;
-	}
-	async_signal_.notify_one();
+	ThreadPool::Instance().Submit(std::bind(&Awb::asyncFunc, this));
 }
 
 void Awb::Prepare(Metadata *image_metadata)
@@ -284,7 +289,7 @@ void Awb::Prepare(Metadata *image_metadata)
 				    (1.0 - speed) * prev_sync_results_.gain_g;
 	prev_sync_results_.gain_b = speed * sync_results_.gain_b +
 				    (1.0 - speed) * prev_sync_results_.gain_b;
-	image_metadata->Set("awb.status", prev_sync_results_);
+	image_metadata->Set(prev_sync_results_);
 	LOG(RPiAwb, Debug)
 		<< "Using AWB gains r " << prev_sync_results_.gain_r << " g "
 		<< prev_sync_results_.gain_g << " b "
@@ -304,7 +309,7 @@ void Awb::Process(StatisticsPtr &stats, Metadata *image_metadata)
 		// Update any settings and any image metadata that we need.
 		struct LuxStatus lux_status = {};
 		lux_status.lux = 400; // in case no metadata
-		if (image_metadata->Get("lux.status", lux_status) != 0)
+		if (image_metadata->Get(lux_status) != 0)
 			LOG(RPiAwb, Debug) << "No lux metadata found";
 		LOG(RPiAwb, Debug) << "Awb lux value is " << lux_status.lux;
 
@@ -313,25 +318,21 @@ void Awb::Process(StatisticsPtr &stats, Metadata *image_metadata)
 	}
 }
 
+AwbSearchStats Awb::GetSearchStats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return search_stats_;
+}
+
 void Awb::asyncFunc()
 {
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			async_signal_.wait(lock, [&] {
-				return async_start_ || async_abort_;
-			});
-			async_start_ = false;
-			if (async_abort_)
-				break;
-		}
-		doAwb();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			async_finished_ = true;
-		}
-		sync_signal_.notify_one();
-	}
+	doAwb();
+	std::lock_guard<std::mutex> lock(mutex_);
+	async_finished_ = true;
+	async_search_stats_.runs++;
+	search_stats_ = async_search_stats_;
+	// Notify with the lock held, as the destructor may be waiting for us.
+	sync_signal_.notify_one();
 }
 
 static void generate_stats(std::vector<Awb::RGB> &zones,
@@ -372,41 +373,68 @@ void Awb::prepareStats()
 double Awb::computeDelta2Sum(double gain_r, double gain_b)
 {
 	// Compute the sum of the squared colour error (non-greyness) as it
-	// appears in the log likelihood equation.
-	double delta2_sum = 0;
-	for (auto &z : zones_) {
-		double delta_r = gain_r * z.R - 1 - config_.whitepoint_r;
-		double delta_b = gain_b * z.B - 1 - config_.whitepoint_b;
+	// appears in the log likelihood equation. Keep a few partial sums so
+	// that the compiler can vectorise the loop.
+	async_search_stats_.evaluations++;
+	double const offset_r = 1 + config_.whitepoint_r;
+	double const offset_b = 1 + config_.whitepoint_b;
+	double const limit = config_.delta_limit;
+	double const *R = zones_r_.data(), *B = zones_b_.data();
+	size_t num = zones_r_.size(), i = 0;
+	double sum[4] = { 0, 0, 0, 0 };
+	for (; i + 4 <= num; i += 4) {
+		for (int j = 0; j < 4; j++) {
+			double delta_r = gain_r * R[i + j] - offset_r;
+			double delta_b = gain_b * B[i + j] - offset_b;
+			double delta2 = delta_r * delta_r + delta_b * delta_b;
+			sum[j] += delta2 < limit ? delta2 : limit;
+		}
+	}
+	for (; i < num; i++) {
+		double delta_r = gain_r * R[i] - offset_r;
+		double delta_b = gain_b * B[i] - offset_b;
 		double delta2 = delta_r * delta_r + delta_b * delta_b;
-		//LOG(RPiAwb, Debug) << "delta_r " << delta_r << " delta_b " << delta_b << " delta2 " << delta2;
-		delta2 = std::min(delta2, config_.delta_limit);
-		delta2_sum += delta2;
+		sum[0] += delta2 < limit ? delta2 : limit;
 	}
-	return delta2_sum;
+	return (sum[0] + sum[1]) + (sum[2] + sum[3]);
 }
 
-Pwl Awb::interpolatePrior()
+void Awb::interpolatePrior()
 {
 	// Interpolate the prior log likelihood function for our current lux
-	// value.
-	if (lux_ <= config_.priors.front().lux)
-		return config_.priors.front().prior;
-	else if (lux_ >= config_.priors.back().lux)
-		return config_.priors.back().prior;
+	// value, unless it's the one we already have.
+	double lux = std::max(config_.priors.front().lux,
+			      std::min(lux_, config_.priors.back().lux));
+	if (!prior_.Empty() && lux == prior_lux_)
+		return;
+	prior_lux_ = lux;
+	span_prior_ = -1;
+	if (lux == config_.priors.front().lux)
+		prior_ = config_.priors.front().prior;
+	else if (lux == config_.priors.back().lux)
+		prior_ = config_.priors.back().prior;
 	else {
 		int idx = 0;
 		// find which two we lie between
-		while (config_.priors[idx + 1].lux < lux_)
+		while (config_.priors[idx + 1].lux < lux)
 			idx++;
 		double lux0 = config_.priors[idx].lux,
 		       lux1 = config_.priors[idx + 1].lux;
-		return Pwl::Combine(config_.priors[idx].prior,
-				    config_.priors[idx + 1].prior,
-				    [&](double /*x*/, double y0, double y1) {
-					    return y0 + (y1 - y0) *
-							(lux_ - lux0) / (lux1 - lux0);
-				    });
+		prior_ = Pwl::Combine(config_.priors[idx].prior,
+				      config_.priors[idx + 1].prior,
+				      [&](double /*x*/, double y0, double y1) {
+					      return y0 + (y1 - y0) *
+							  (lux - lux0) / (lux1 - lux0);
+				      });
 	}
+	prior_.Map([](double x, double y) {
+		LOG(RPiAwb, Debug) << "(" << x << "," << y << ")";
+	});
+}
+
+double Awb::evalPrior(double t)
+{
+	return prior_scale_ * prior_.Eval(prior_.Domain().Clip(t), &span_prior_);
 }
 
 static double interpolate_quadatric(Pwl::Point const &A, Pwl::Point const &B,
@@ -426,36 +454,77 @@ static double interpolate_quadatric(Pwl::Point const &A, Pwl::Point const &B,
 	return A.y < C.y - eps ? A.x : (C.y < A.y - eps ? C.x : B.x);
 }
 
-double Awb::coarseSearch(Pwl const &prior)
+size_t Awb::searchRange(double ct_lo, double ct_hi, int stride)
 {
 	points_.clear(); // assume doesn't deallocate memory
-	size_t best_point = 0;
+	size_t end = 0;
 	double t = mode_->ct_lo;
-	int span_r = 0, span_b = 0;
-	// Step down the CT curve evaluating log likelihood.
-	while (true) {
-		double r = config_.ct_r.Eval(t, &span_r);
-		double b = config_.ct_b.Eval(t, &span_b);
-		double gain_r = 1 / r, gain_b = 1 / b;
-		double delta2_sum = computeDelta2Sum(gain_r, gain_b);
-		double prior_log_likelihood =
-			prior.Eval(prior.Domain().Clip(t));
-		double final_log_likelihood = delta2_sum - prior_log_likelihood;
-		LOG(RPiAwb, Debug)
-			<< "t: " << t << " gain_r " << gain_r << " gain_b "
-			<< gain_b << " delta2_sum " << delta2_sum
-			<< " prior " << prior_log_likelihood << " final "
-			<< final_log_likelihood;
-		points_.push_back(Pwl::Point(t, final_log_likelihood));
-		if (points_.back().y < points_[best_point].y)
-			best_point = points_.size() - 1;
+	// Step down the CT curve evaluating log likelihood. The steps are those
+	// of a search over the whole range of the mode, of which we evaluate
+	// all the ones from ct_lo to ct_hi, and one every "stride" elsewhere.
+	for (int step = 0;; step++) {
+		bool in_range = t >= ct_lo && (points_.empty() || points_.back().x < ct_hi);
+		if (in_range || step % stride == 0 || t == mode_->ct_hi) {
+			double r = config_.ct_r.Eval(t, &span_r_);
+			double b = config_.ct_b.Eval(t, &span_b_);
+			double gain_r = 1 / r, gain_b = 1 / b;
+			double delta2_sum = computeDelta2Sum(gain_r, gain_b);
+			double prior_log_likelihood = evalPrior(t);
+			double final_log_likelihood =
+				delta2_sum - prior_log_likelihood;
+			LOG(RPiAwb, Debug)
+				<< "t: " << t << " gain_r " << gain_r << " gain_b "
+				<< gain_b << " delta2_sum " << delta2_sum
+				<< " prior " << prior_log_likelihood << " final "
+				<< final_log_likelihood;
+			points_.push_back(Pwl::Point(t, final_log_likelihood));
+			if (in_range)
+				end = points_.size();
+		}
 		if (t == mode_->ct_hi)
 			break;
 		// for even steps along the r/b curve scale them by the current t
 		t = std::min(t + t / 10 * config_.coarse_step,
 			     mode_->ct_hi);
 	}
-	t = points_[best_point].x;
+	return end;
+}
+
+double Awb::coarseSearch()
+{
+	// Illumination usually changes slowly, so evaluate every step only
+	// around the previous result, if configured to, and sample the rest of
+	// the range in case the illumination changed after all.
+	const int SAMPLE_STRIDE = 4;
+	double ct_lo = mode_->ct_lo, ct_hi = mode_->ct_hi;
+	bool narrowed = false;
+	if (config_.search_range > 0 && mode_ == last_mode_) {
+		ct_lo = std::max(ct_lo, last_ct_ / (1 + config_.search_range));
+		ct_hi = std::min(ct_hi, last_ct_ * (1 + config_.search_range));
+		narrowed = ct_lo > mode_->ct_lo || ct_hi < mode_->ct_hi;
+	}
+	size_t end = searchRange(ct_lo, ct_hi, narrowed ? SAMPLE_STRIDE : 1);
+	size_t best_point = 0;
+	for (size_t i = 1; i < points_.size(); i++)
+		if (points_[i].y < points_[best_point].y)
+			best_point = i;
+	// Search the whole range after all if the best point isn't strictly
+	// within the narrowed range, as it could then be a neighbour of the
+	// best point that is missing.
+	if (narrowed &&
+	    (best_point == 0 || best_point + 1 >= end ||
+	     points_[best_point - 1].x < ct_lo)) {
+		LOG(RPiAwb, Debug) << "CT outside of the narrowed search range";
+		narrowed = false;
+		searchRange(mode_->ct_lo, mode_->ct_hi, 1);
+		best_point = 0;
+		for (size_t i = 1; i < points_.size(); i++)
+			if (points_[i].y < points_[best_point].y)
+				best_point = i;
+	}
+	if (!narrowed)
+		async_search_stats_.full_searches++;
+	double t = points_[best_point].x;
 	LOG(RPiAwb, Debug) << "Coarse search found CT " << t;
 	// We have the best point of the search, but refine it with a quadratic
 	// interpolation around its neighbours.
@@ -469,12 +538,14 @@ double Awb::coarseSearch(Pwl const &prior)
 			<< "After quadratic refinement, coarse search has CT "
 			<< t;
 	}
+	last_ct_ = t;
+	last_mode_ = mode_;
 	return t;
 }
 
-void Awb::fineSearch(double &t, double &r, double &b, Pwl const &prior)
+void Awb::fineSearch(double &t, double &r, double &b)
 {
-	int span_r = -1, span_b = -1;
+	int &span_r = span_r_, &span_b = span_b_;
 	config_.ct_r.Eval(t, &span_r);
 	config_.ct_b.Eval(t, &span_b);
 	double step = t / 10 * config_.coarse_step * 0.1;
@@ -502,8 +573,7 @@ void Awb::fineSearch(double &t, double &r, double &b, Pwl const &prior)
 	nsteps += num_deltas;
 	for (int i = -nsteps; i <= nsteps; i++) {
 		double t_test = t + i * step;
-		double prior_log_likelihood =
-			prior.Eval(prior.Domain().Clip(t_test));
+		double prior_log_likelihood = evalPrior(t_test);
 		double r_curve = config_.ct_r.Eval(t_test, &span_r);
 		double b_curve = config_.ct_b.Eval(t_test, &span_b);
 		// x will be distance off the curve, y the log likelihood there
@@ -556,16 +626,19 @@ void Awb::awbBayes()
 {
 	// May as well divide out G to save computeDelta2Sum from doing it over
 	// and over.
-	for (auto &z : zones_)
-		z.R = z.R / (z.G + 1), z.B = z.B / (z.G + 1);
+	zones_r_.clear();
+	zones_b_.clear();
+	for (auto &z : zones_) {
+		zones_r_.push_back(z.R / (z.G + 1));
+		zones_b_.push_back(z.B / (z.G + 1));
+	}
+	async_search_stats_.evaluations = 0;
 	// Get the current prior, and scale according to how many zones are
 	// valid... not entirely sure about this.
-	Pwl prior = interpolatePrior();
-	prior *= zones_.size() / (double)(AWB_STATS_SIZE_X * AWB_STATS_SIZE_Y);
-	prior.Map([](double x, double y) {
-		LOG(RPiAwb, Debug) << "(" << x << "," << y << ")";
-	});
-	double t = coarseSearch(prior);
+	interpolatePrior();
+	prior_scale_ =
+		zones_.size() / (double)(AWB_STATS_SIZE_X * AWB_STATS_SIZE_Y);
+	double t = coarseSearch();
 	double r = config_.ct_r.Eval(t);
 	double b = config_.ct_b.Eval(t);
 	LOG(RPiAwb, Debug)
@@ -577,10 +650,11 @@ void Awb::awbBayes()
 	// there may be more or less green light, this may prove beneficial,
 	// though I probably need more real datasets before deciding exactly how
 	// this should be controlled and tuned.
-	fineSearch(t, r, b, prior);
+	fineSearch(t, r, b);
 	LOG(RPiAwb, Debug)
 		<< "After fine search: r " << r << " b " << b << " (gains r "
-		<< 1 / r << " b " << 1 / b << ")";
+		<< 1 / r << " b " << 1 / b << "), "
+		<< async_search_stats_.evaluations << " evaluations";
 	// Write results out for the main thread to pick up. Remember to adjust
 	// the gains from the ones that the "canonical sensor" would require to
 	// the ones needed by *this* sensor.
@@ -8,7 +8,6 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <thread>
 
 #include "../awb_algorithm.hpp"
 #include "../pwl.hpp"
@@ -73,6 +72,18 @@ struct AwbConfig {
 	double whitepoint_r;
 	double whitepoint_b;
 	bool bayes; // use Bayesian algorithm
+	// Relative CT range searched step by step either side of the previous
+	// result, the rest of the range of the mode being only sampled, or 0 to
+	// always search the whole range. The whole range is still searched when
+	// the best CT is not strictly within the narrowed range.
+	double search_range;
+};
+
+// Counters of the work done by the asynchronous AWB calculations.
+struct AwbSearchStats {
+	unsigned int runs; // number of completed AWB calculations
+	unsigned int evaluations; // log likelihood evaluations in the last run
+	unsigned int full_searches; // coarse searches over the whole CT range
 };
 
 class Awb : public AwbAlgorithm
@@ -89,6 +100,12 @@ public:
 	void SwitchMode(CameraMode const &camera_mode, Metadata *metadata) override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override
+	{
+		return Metadata::Tag<LuxStatus>();
+	}
+	uint32_t ProcessWrites() const override { return 0; }
+	AwbSearchStats GetSearchStats();
 	struct RGB {
 		RGB(double _R = 0, double _G = 0, double _B = 0)
 			: R(_R), G(_G), B(_B)
@@ -106,19 +123,13 @@ private:
 	bool isAutoEnabled() const;
 	// configuration is read-only, and available to both threads
 	AwbConfig config_;
-	std::thread async_thread_;
-	void asyncFunc(); // asynchronous thread function
+	// The calculations run asynchronously on the shared thread pool.
+	void asyncFunc();
 	std::mutex mutex_;
-	// condvar for async thread to wait on
-	std::condition_variable async_signal_;
 	// condvar for synchronous thread to wait on
 	std::condition_variable sync_signal_;
 	// for sync thread to check  if async thread finished (requires mutex)
 	bool async_finished_;
-	// for async thread to check if it's been told to run (requires mutex)
-	bool async_start_;
-	// for async thread to check if it's been told to quit (requires mutex)
-	bool async_abort_;
 
 	// The following are only for the synchronous thread to use:
 	// for sync thread to note its has asked async thread to run
@@ -143,11 +154,34 @@ private:
 	void awbGrey();
 	void prepareStats();
 	double computeDelta2Sum(double gain_r, double gain_b);
-	Pwl interpolatePrior();
-	double coarseSearch(Pwl const &prior);
-	void fineSearch(double &t, double &r, double &b, Pwl const &prior);
+	void interpolatePrior();
+	double evalPrior(double t);
+	double coarseSearch();
+	size_t searchRange(double ct_lo, double ct_hi, int stride);
+	void fineSearch(double &t, double &r, double &b);
 	std::vector<RGB> zones_;
+	// R/G and B/G of the zones, stored apart so that computeDelta2Sum can
+	// be vectorised
+	std::vector<double> zones_r_;
+	std::vector<double> zones_b_;
 	std::vector<Pwl::Point> points_;
+	// The prior interpolated for prior_lux_ is kept across runs, as the
+	// lux level is often unchanged, or clipped to the first or last prior.
+	Pwl prior_;
+	double prior_lux_;
+	// scale of the prior, according to how many zones are valid
+	double prior_scale_;
+	// Spans of the last lookups in the CT curves and the prior, kept
+	// across runs to start the next lookups close to the right place.
+	int span_r_;
+	int span_b_;
+	int span_prior_;
+	// result and mode of the previous coarse search (0 and null if none)
+	double last_ct_;
+	AwbMode *last_mode_;
+	AwbSearchStats async_search_stats_;
+	// copy of async_search_stats_ published after each run (requires mutex)
+	AwbSearchStats search_stats_;
 	// manual r setting
 	double manual_r_;
 	// manual b setting
@@ -66,6 +66,8 @@ public:
 	void SetSaturation(double saturation) override;
 	void Initialise() override;
 	void Prepare(Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override { return 0; }
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	CcmConfig config_;
@@ -68,12 +68,16 @@ static void fill_in_status(ContrastStatus &status, double brightness,
 {
 	status.brightness = brightness;
 	status.contrast = contrast;
+	double x[CONTRAST_NUM_POINTS - 1], y[CONTRAST_NUM_POINTS - 1];
+	for (int i = 0; i < CONTRAST_NUM_POINTS - 1; i++)
+		x[i] = i < 16 ? i * 1024
+			      : (i < 24 ? (i - 16) * 2048 + 16384
+					: (i - 24) * 4096 + 32768);
+	// The points are in increasing order, so evaluate them in one go.
+	gamma_curve.Eval(x, y, CONTRAST_NUM_POINTS - 1);
 	for (int i = 0; i < CONTRAST_NUM_POINTS - 1; i++) {
-		int x = i < 16 ? i * 1024
-			       : (i < 24 ? (i - 16) * 2048 + 16384
-					 : (i - 24) * 4096 + 32768);
-		status.points[i].x = x;
-		status.points[i].y = std::min(65535.0, gamma_curve.Eval(x));
+		status.points[i].x = x[i];
+		status.points[i].y = std::min(65535.0, y[i]);
 	}
 	status.points[CONTRAST_NUM_POINTS - 1].x = 65535;
 	status.points[CONTRAST_NUM_POINTS - 1].y = 65535;
@@ -89,7 +93,7 @@ void Contrast::Initialise()
 void Contrast::Prepare(Metadata *image_metadata)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
-	image_metadata->Set("contrast.status", status_);
+	image_metadata->Set(status_);
 }
 
 Pwl compute_stretch_curve(Histogram const &histogram,
@@ -97,10 +101,14 @@ Pwl compute_stretch_curve(Histogram const &histogram,
 {
 	Pwl enhance;
 	enhance.Append(0, 0);
+	// Look up all three points in one go, in increasing order.
+	double const quantiles[3] = { config.lo_histogram, 0.5,
+				      config.hi_histogram };
+	double bins[3];
+	histogram.Quantiles(quantiles, bins, 3);
 	// If the start of the histogram is rather empty, try to pull it down a
 	// bit.
-	double hist_lo = histogram.Quantile(config.lo_histogram) *
-			 (65536 / NUM_HISTOGRAM_BINS);
+	double hist_lo = bins[0] * (65536 / NUM_HISTOGRAM_BINS);
 	double level_lo = config.lo_level * 65536;
 	LOG(RPiContrast, Debug)
 		<< "Move histogram point " << hist_lo << " to " << level_lo;
@@ -112,13 +120,12 @@ Pwl compute_stretch_curve(Histogram const &histogram,
 	enhance.Append(hist_lo, level_lo);
 	// Keep the mid-point (median) in the same place, though, to limit the
 	// apparent amount of global brightness shift.
-	double mid = histogram.Quantile(0.5) * (65536 / NUM_HISTOGRAM_BINS);
+	double mid = bins[1] * (65536 / NUM_HISTOGRAM_BINS);
 	enhance.Append(mid, mid);
 
 	// If the top to the histogram is empty, try to pull the pixel values
 	// there up.
-	double hist_hi = histogram.Quantile(config.hi_histogram) *
-			 (65536 / NUM_HISTOGRAM_BINS);
+	double hist_hi = bins[2] * (65536 / NUM_HISTOGRAM_BINS);
 	double level_hi = config.hi_level * 65536;
 	LOG(RPiContrast, Debug)
 		<< "Move histogram point " << hist_hi << " to " << level_hi;
@@ -147,18 +154,23 @@ Pwl apply_manual_contrast(Pwl const &gamma_curve, double brightness,
 	return new_gamma_curve;
 }
 
-void Contrast::Process(StatisticsPtr &stats,
-		       [[maybe_unused]] Metadata *image_metadata)
+void Contrast::Process(StatisticsPtr &stats, Metadata *image_metadata)
 {
-	Histogram histogram(stats->hist[0].g_hist, NUM_HISTOGRAM_BINS);
 	// We look at the histogram and adjust the gamma curve in the following
 	// ways: 1. Adjust the gamma curve so as to pull the start of the
 	// histogram down, and possibly push the end up.
 	Pwl gamma_curve = config_.gamma_curve;
 	if (config_.ce_enable) {
-		if (config_.lo_max != 0 || config_.hi_max != 0)
+		if (config_.lo_max != 0 || config_.hi_max != 0) {
+			// The Controller normally leaves the histogram in the
+			// image metadata for us.
+			Histogram histogram;
+			if (image_metadata->Get(histogram) != 0)
+				histogram = Histogram(stats->hist[0].g_hist,
+						      NUM_HISTOGRAM_BINS);
 			gamma_curve = compute_stretch_curve(histogram, config_)
 					      .Compose(gamma_curve);
+		}
 		// We could apply other adjustments (e.g. partial equalisation)
 		// based on the histogram...?
 	}
@@ -38,6 +38,11 @@ public:
 	void Initialise() override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override
+	{
+		return Metadata::Tag<Histogram>();
+	}
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	ContrastConfig config_;
@@ -23,6 +23,11 @@ public:
 	Focus(Controller *controller);
 	char const *Name() const override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override { return 0; }
+	uint32_t ProcessWrites() const override
+	{
+		return Metadata::Tag<FocusStatus>();
+	}
 };
 
 } /* namespace RPiController */
@@ -47,11 +47,11 @@ void Geq::Prepare(Metadata *image_metadata)
 {
 	LuxStatus lux_status = {};
 	lux_status.lux = 400;
-	if (image_metadata->Get("lux.status", lux_status))
+	if (image_metadata->Get(lux_status))
 		LOG(RPiGeq, Warning) << "no lux data found";
 	DeviceStatus device_status = {};
 	device_status.analogue_gain = 1.0; // in case not found
-	if (image_metadata->Get("device.status", device_status))
+	if (image_metadata->Get(device_status))
 		LOG(RPiGeq, Warning)
 			<< "no device metadata - use analogue gain of 1x";
 	GeqStatus geq_status = {};
@@ -70,7 +70,7 @@ void Geq::Prepare(Metadata *image_metadata)
 		<< geq_status.slope << " (analogue gain "
 		<< device_status.analogue_gain << " lux "
 		<< lux_status.lux << ")";
-	image_metadata->Set("geq.status", geq_status);
+	image_metadata->Set(geq_status);
 }
 
 // Register algorithm with the system.
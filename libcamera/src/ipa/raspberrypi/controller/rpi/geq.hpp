@@ -26,6 +26,8 @@ public:
 	char const *Name() const override;
 	void Read(boost::property_tree::ptree const &params) override;
 	void Prepare(Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override { return 0; }
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	GeqConfig config_;
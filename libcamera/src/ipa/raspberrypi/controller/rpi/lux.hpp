@@ -23,6 +23,14 @@ public:
 	void Read(boost::property_tree::ptree const &params) override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override
+	{
+		return Metadata::Tag<DeviceStatus>();
+	}
+	uint32_t ProcessWrites() const override
+	{
+		return Metadata::Tag<LuxStatus>();
+	}
 	void SetCurrentAperture(double aperture);
 
 private:
@@ -21,6 +21,8 @@ public:
 	void SwitchMode(CameraMode const &camera_mode, Metadata *metadata) override;
 	void Read(boost::property_tree::ptree const &params) override;
 	void Prepare(Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override { return 0; }
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	// the noise profile for analogue gain of 1.0
@@ -74,7 +74,7 @@ void Sharpen::Prepare(Metadata *image_metadata)
 	status.limit = limit_ / mode_factor_ * user_strength_sqrt;
 	// Finally, report any application-supplied parameters that were used.
 	status.user_strength = user_strength_;
-	image_metadata->Set("sharpen.status", status);
+	image_metadata->Set(status);
 }
 
 // Register algorithm with the system.
@@ -22,6 +22,8 @@ public:
 	void Read(boost::property_tree::ptree const &params) override;
 	void SetStrength(double strength) override;
 	void Prepare(Metadata *image_metadata) override;
+	uint32_t ProcessReads() const override { return 0; }
+	uint32_t ProcessWrites() const override { return 0; }
 
 private:
 	double threshold_;
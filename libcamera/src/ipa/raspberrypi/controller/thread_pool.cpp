@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * thread_pool.cpp - worker threads shared by the control algorithms
+ */
+#include <algorithm>
+#include <cassert>
+
+#include "thread_pool.hpp"
+
+using namespace RPiController;
+
+// A couple of algorithms run in parallel at most, so a few threads are plenty.
+#define MAX_THREADS 3
+
+// The pool and worker running on the current thread, if any.
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local unsigned int current_worker;
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+	: pending_(0), abort_(false), next_(0)
+{
+	assert(num_threads);
+	for (unsigned int i = 0; i < num_threads; i++)
+		workers_.push_back(std::make_unique<Worker>());
+	for (unsigned int i = 0; i < num_threads; i++)
+		workers_[i]->thread =
+			std::thread(std::bind(&ThreadPool::workerFunc, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		abort_ = true;
+	}
+	signal_.notify_all();
+	for (auto &worker : workers_)
+		worker->thread.join();
+}
+
+ThreadPool &ThreadPool::Instance()
+{
+	// Leave a core for the thread that runs the Controller. There is
+	// always one worker, as the algorithms rely on their asynchronous
+	// calculations running eventually.
+	static ThreadPool pool(std::clamp<int>(
+		std::thread::hardware_concurrency() - 1, 1, MAX_THREADS));
+	return pool;
+}
+
+void ThreadPool::Submit(Task task)
+{
+	unsigned int index;
+	if (current_pool == this)
+		index = current_worker;
+	else {
+		std::lock_guard<std::mutex> lock(mutex_);
+		index = next_;
+		next_ = (next_ + 1) % workers_.size();
+	}
+	Worker &worker = *workers_[index];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+		std::lock_guard<std::mutex> pool_lock(mutex_);
+		pending_++;
+	}
+	signal_.notify_one();
+}
+
+bool ThreadPool::popTask(unsigned int index, Task &task)
+{
+	// Take the most recent task of our own queue, as it is likely to
+	// follow on from the one we just ran, or failing that the oldest task
+	// of the other queues.
+	for (unsigned int i = 0; i < workers_.size(); i++) {
+		Worker &worker = *workers_[(index + i) % workers_.size()];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.tasks.empty())
+			continue;
+		if (i == 0) {
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+		} else {
+			task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+		}
+		std::lock_guard<std::mutex> pool_lock(mutex_);
+		pending_--;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::workerFunc(unsigned int index)
+{
+	current_pool = this;
+	current_worker = index;
+	while (true) {
+		Task task;
+		if (popTask(index, task)) {
+			task();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		signal_.wait(lock, [&] {
+			return pending_ || abort_;
+		});
+		// Run everything that was queued before quitting.
+		if (abort_ && !pending_)
+			break;
+	}
+}
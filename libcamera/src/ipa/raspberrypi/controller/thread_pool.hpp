@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * thread_pool.hpp - worker threads shared by the control algorithms
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RPiController {
+
+// A small pool of worker threads, on which the Controller runs the Process
+// methods of independent algorithms in parallel, and on which algorithms run
+// their asynchronous calculations. Each worker has its own queue of tasks:
+// tasks submitted by a task go to the queue of the worker running it, and
+// idle workers steal tasks from the other queues.
+
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+	ThreadPool(unsigned int num_threads);
+	~ThreadPool();
+	// The pool shared by all the controllers, and their algorithms.
+	static ThreadPool &Instance();
+	unsigned int NumThreads() const { return workers_.size(); }
+	// Queue a task to run on one of the worker threads. Tasks must not
+	// wait for other tasks to run, as all the workers could be waiting.
+	void Submit(Task task);
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+	void workerFunc(unsigned int index);
+	bool popTask(unsigned int index, Task &task);
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::mutex mutex_;
+	// condvar for idle workers to wait on
+	std::condition_variable signal_;
+	// number of queued tasks (requires mutex_)
+	unsigned int pending_;
+	// for the workers to check if they should quit (requires mutex_)
+	bool abort_;
+	// the queue to use for the next task submitted from outside the pool
+	// (requires mutex_)
+	unsigned int next_;
+};
+
+} // namespace RPiController
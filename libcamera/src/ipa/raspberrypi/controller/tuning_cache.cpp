@@ -0,0 +1,419 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * tuning_cache.cpp - compiled tuning file cache
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+
+#include "tuning_cache.hpp"
+
+using namespace RPiController;
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(RPiTuning)
+
+// The image is the header, followed by the nodes of the tree in pre-order, by
+// the pool of their keys and data and by the path of the tuning file. It is
+// only ever read back on the machine that wrote it, so it uses the native byte
+// order.
+#define TUNING_CACHE_MAGIC 0x43545052 // "RPTC"
+#define TUNING_CACHE_VERSION 2
+
+struct TuningCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	// hash of the JSON content
+	uint64_t hash;
+	// hash of the identity and modification time of the tuning file
+	uint64_t file_key;
+	uint32_t num_nodes;
+	uint32_t strings_size;
+	uint32_t source_size;
+};
+
+struct TuningCacheNode {
+	uint32_t key;
+	uint32_t key_length;
+	uint32_t data;
+	uint32_t data_length;
+	uint32_t num_children;
+};
+
+// 64-bit FNV-1a, which is plenty to tell versions of a file apart.
+static uint64_t fnv1a(void const *data, size_t size,
+		      uint64_t hash = 0xcbf29ce484222325ULL)
+{
+	unsigned char const *bytes = static_cast<unsigned char const *>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t RPiController::tuning_hash(std::string const &json)
+{
+	return fnv1a(json.data(), json.size());
+}
+
+uint64_t RPiController::tuning_file_key(struct stat const &st)
+{
+	uint64_t fields[] = {
+		static_cast<uint64_t>(st.st_dev),
+		static_cast<uint64_t>(st.st_ino),
+		static_cast<uint64_t>(st.st_size),
+		static_cast<uint64_t>(st.st_mtim.tv_sec),
+		static_cast<uint64_t>(st.st_mtim.tv_nsec),
+	};
+	return fnv1a(fields, sizeof(fields));
+}
+
+static void compile_node(boost::property_tree::ptree const &node,
+			 std::string const &key,
+			 std::vector<TuningCacheNode> &nodes,
+			 std::string &strings)
+{
+	TuningCacheNode n;
+	n.key = strings.size();
+	n.key_length = key.size();
+	strings += key;
+	n.data = strings.size();
+	n.data_length = node.data().size();
+	strings += node.data();
+	n.num_children = node.size();
+	nodes.push_back(n);
+	for (auto const &child : node)
+		compile_node(child.second, child.first, nodes, strings);
+}
+
+std::string RPiController::tuning_compile(boost::property_tree::ptree const &root,
+					  uint64_t hash, uint64_t file_key,
+					  std::string const &source)
+{
+	std::vector<TuningCacheNode> nodes;
+	std::string strings;
+	compile_node(root, "", nodes, strings);
+
+	TuningCacheHeader header = {};
+	header.magic = TUNING_CACHE_MAGIC;
+	header.version = TUNING_CACHE_VERSION;
+	header.hash = hash;
+	header.file_key = file_key;
+	header.num_nodes = nodes.size();
+	header.strings_size = strings.size();
+	header.source_size = source.size();
+
+	std::string image(reinterpret_cast<char const *>(&header), sizeof(header));
+	image.append(reinterpret_cast<char const *>(nodes.data()),
+		     nodes.size() * sizeof(TuningCacheNode));
+	image += strings;
+	image += source;
+	return image;
+}
+
+namespace {
+
+// Rebuilds the tree from the nodes, checking every index and offset, as the
+// image may have been truncated or damaged.
+class TuningLoader
+{
+public:
+	TuningLoader(TuningCacheNode const *nodes, uint32_t num_nodes,
+		     char const *strings, uint32_t strings_size)
+		: nodes_(nodes), num_nodes_(num_nodes), strings_(strings),
+		  strings_size_(strings_size), next_(0)
+	{
+	}
+	bool Load(boost::property_tree::ptree &root)
+	{
+		return num_nodes_ && nodes_[0].key_length == 0 &&
+		       loadNode(root) && next_ == num_nodes_;
+	}
+
+private:
+	bool getString(uint32_t offset, uint32_t length, std::string &str)
+	{
+		if (offset > strings_size_ || length > strings_size_ - offset)
+			return false;
+		str.assign(strings_ + offset, length);
+		return true;
+	}
+	// Fill in the data and children of the node at the current position,
+	// whose key the caller has already taken care of.
+	bool loadNode(boost::property_tree::ptree &node)
+	{
+		TuningCacheNode const &n = nodes_[next_++];
+		if (!getString(n.data, n.data_length, node.data()) ||
+		    n.num_children > num_nodes_ - next_)
+			return false;
+		std::string key;
+		for (uint32_t i = 0; i < n.num_children; i++) {
+			if (next_ >= num_nodes_)
+				return false;
+			TuningCacheNode const &child = nodes_[next_];
+			if (!getString(child.key, child.key_length, key))
+				return false;
+			auto it = node.push_back(
+				std::make_pair(key, boost::property_tree::ptree()));
+			if (!loadNode(it->second))
+				return false;
+		}
+		return true;
+	}
+	TuningCacheNode const *nodes_;
+	uint32_t num_nodes_;
+	char const *strings_;
+	uint32_t strings_size_;
+	uint32_t next_;
+};
+
+} // namespace
+
+bool RPiController::tuning_load(void const *data, size_t size, uint64_t hash,
+				boost::property_tree::ptree &root)
+{
+	TuningCacheHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != TUNING_CACHE_MAGIC ||
+	    header.version != TUNING_CACHE_VERSION || header.hash != hash)
+		return false;
+	// Sum the sizes in 64 bits, where they can't wrap around, as size_t
+	// may only have 32.
+	uint64_t nodes_size = static_cast<uint64_t>(header.num_nodes) *
+			      sizeof(TuningCacheNode);
+	if (size != sizeof(header) + nodes_size + header.strings_size +
+		    static_cast<uint64_t>(header.source_size))
+		return false;
+	char const *image = static_cast<char const *>(data);
+	TuningLoader loader(reinterpret_cast<TuningCacheNode const *>(image + sizeof(header)),
+			    header.num_nodes, image + sizeof(header) + nodes_size,
+			    header.strings_size);
+	boost::property_tree::ptree tree;
+	if (!loader.Load(tree))
+		return false;
+	root.swap(tree);
+	return true;
+}
+
+std::string RPiController::tuning_cache_dir()
+{
+	char const *dir = utils::secure_getenv("LIBCAMERA_RPI_TUNING_CACHE");
+	return dir ? dir : std::string();
+}
+
+namespace {
+
+// A cache image, memory-mapped for the time it takes to load it.
+class CacheImage
+{
+public:
+	CacheImage(std::string const &path)
+		: data_(MAP_FAILED), size_(0), header_({})
+	{
+		if (path.empty())
+			return;
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(header_)) {
+			data_ = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE,
+				     fd, 0);
+			if (data_ != MAP_FAILED) {
+				size_ = st.st_size;
+				memcpy(&header_, data_, sizeof(header_));
+			}
+		}
+		close(fd);
+	}
+	~CacheImage()
+	{
+		if (data_ != MAP_FAILED)
+			munmap(data_, size_);
+	}
+	bool Valid() const
+	{
+		return data_ != MAP_FAILED &&
+		       header_.magic == TUNING_CACHE_MAGIC &&
+		       header_.version == TUNING_CACHE_VERSION &&
+		       header_.source_size <= size_ - sizeof(header_);
+	}
+	bool Load(uint64_t hash, boost::property_tree::ptree &root) const
+	{
+		return Valid() && tuning_load(data_, size_, hash, root);
+	}
+	TuningCacheHeader const &Header() const { return header_; }
+	// The path of the tuning file the image was compiled from.
+	std::string Source() const
+	{
+		if (!Valid())
+			return std::string();
+		char const *end = static_cast<char const *>(data_) + size_;
+		return std::string(end - header_.source_size, end);
+	}
+
+private:
+	void *data_;
+	size_t size_;
+	TuningCacheHeader header_;
+};
+
+} // namespace
+
+// A temporary file is only left behind by a writer that didn't complete once
+// it is older than this, as writing an image takes far less time. Younger ones
+// may belong to another camera starting at the same time.
+#define TEMPORARY_FILE_LIFETIME (60 * 60) // seconds
+
+// Remove the temporary files left behind by writers that didn't complete, and
+// the images of older formats or of tuning files that don't exist any more.
+// The image of a tuning file that still exists is replaced when the file
+// changes.
+static void prune_cache(std::string const &dir)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return;
+	while (struct dirent *entry = readdir(d)) {
+		std::string name = entry->d_name;
+		if (name.compare(0, 11, "rpi-tuning-"))
+			continue;
+		std::string path = dir + "/" + name;
+		bool stale;
+		if (name.size() < 4 || name.compare(name.size() - 4, 4, ".bin")) {
+			struct stat st;
+			stale = stat(path.c_str(), &st) == 0 &&
+				st.st_mtim.tv_sec + TEMPORARY_FILE_LIFETIME <
+					now.tv_sec;
+		} else {
+			CacheImage image(path);
+			std::string source = image.Source();
+			stale = source.empty() || access(source.c_str(), F_OK);
+		}
+		if (stale && unlink(path.c_str()) == 0)
+			LOG(RPiTuning, Debug) << "Removed stale tuning cache " << path;
+	}
+	closedir(d);
+}
+
+static void write_cache(std::string const &dir, std::string const &path,
+			std::string const &image)
+{
+	int ret = utils::mkdirs(dir);
+	if (ret < 0) {
+		LOG(RPiTuning, Debug) << "Can't create tuning cache directory "
+				      << dir << ": " << strerror(-ret);
+		return;
+	}
+	prune_cache(dir);
+	// The image is replaced atomically, so that a camera starting at the
+	// same time never sees a partial image.
+	ret = utils::write_file_atomic(path, image);
+	if (ret < 0) {
+		LOG(RPiTuning, Warning) << "Failed to write tuning cache " << path
+					<< ": " << strerror(-ret);
+		return;
+	}
+	LOG(RPiTuning, Debug) << "Wrote tuning cache " << path;
+}
+
+// The modification time of a file only tells changes apart if they are further
+// apart than the resolution of the file timestamps, which may be as coarse as
+// a second. The key of a file modified more recently than this is not recorded,
+// so that a later change at the same timestamp can't go unnoticed.
+static bool recently_modified(struct stat const &st)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return st.st_mtim.tv_sec + 2 >= now.tv_sec;
+}
+
+bool RPiController::tuning_read(char const *filename,
+				std::string const &cache_dir,
+				boost::property_tree::ptree &root)
+{
+	// Each tuning file has a single image, named after its path.
+	std::string source;
+	std::string path;
+	uint64_t file_key = 0;
+	struct stat st;
+	if (!cache_dir.empty() && stat(filename, &st) == 0) {
+		char *real = realpath(filename, nullptr);
+		source = real ? real : filename;
+		free(real);
+		std::ostringstream name;
+		name << cache_dir << "/rpi-tuning-" << std::hex
+		     << std::setfill('0') << std::setw(16)
+		     << tuning_hash(source) << ".bin";
+		path = name.str();
+		if (!recently_modified(st))
+			file_key = tuning_file_key(st);
+	}
+
+	// While the tuning file isn't modified, load the image without reading
+	// the JSON at all.
+	CacheImage image(path);
+	if (file_key && image.Valid() && image.Header().file_key == file_key &&
+	    image.Load(image.Header().hash, root)) {
+		LOG(RPiTuning, Debug) << "Loaded " << filename << " from " << path;
+		return true;
+	}
+
+	std::ifstream file(filename, std::ios::binary);
+	std::ostringstream json;
+	json << file.rdbuf();
+	if (!file)
+		throw std::runtime_error(std::string("failed to read tuning file ") +
+					 filename);
+
+	uint64_t hash = tuning_hash(json.str());
+
+	// The file may have been touched without any change to its content,
+	// refresh the key in the image in that case.
+	if (image.Load(hash, root)) {
+		LOG(RPiTuning, Debug) << "Loaded " << filename << " from " << path;
+		if (file_key != image.Header().file_key)
+			write_cache(cache_dir, path,
+				    tuning_compile(root, hash, file_key, source));
+		return true;
+	}
+
+	std::istringstream stream(json.str());
+	try {
+		boost::property_tree::read_json(stream, root);
+	} catch (boost::property_tree::json_parser_error const &e) {
+		throw boost::property_tree::json_parser_error(e.message(),
+							      filename,
+							      e.line());
+	}
+
+	// Replace the image of the previous version of the file, if any.
+	if (!path.empty())
+		write_cache(cache_dir, path,
+			    tuning_compile(root, hash, file_key, source));
+	return false;
+}
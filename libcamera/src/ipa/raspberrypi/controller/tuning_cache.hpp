@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * tuning_cache.hpp - compiled tuning file cache
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace RPiController {
+
+// Parsing the JSON tuning files takes a good part of the IPA startup time. When
+// a cache directory is given, a parsed tuning file is compiled to a flat binary
+// image of its property tree, which is stored in the cache directory under the
+// hash of the path of the file, and memory-mapped the next time the same file
+// is read. The image records the hash of the JSON content and the modification
+// time of the tuning file, and is used without reading the JSON at all while
+// the file isn't modified. An image that doesn't match the JSON, has another
+// format version or fails validation is ignored, and replaced after parsing
+// the JSON again. Images whose tuning file doesn't exist any more are removed
+// when a new image is written.
+
+// Hash the JSON content of a tuning file.
+uint64_t tuning_hash(std::string const &json);
+// Hash the identity and modification time of a tuning file.
+uint64_t tuning_file_key(struct stat const &st);
+// Compile a property tree to the binary image for the given JSON hash, and the
+// key and path of the tuning file.
+std::string tuning_compile(boost::property_tree::ptree const &root,
+			   uint64_t hash, uint64_t file_key = 0,
+			   std::string const &source = std::string());
+// Rebuild the property tree from a binary image, after checking that it is
+// valid and matches the hash. Return false if it doesn't.
+bool tuning_load(void const *data, size_t size, uint64_t hash,
+		 boost::property_tree::ptree &root);
+// The cache directory, from the LIBCAMERA_RPI_TUNING_CACHE environment
+// variable. The cache is disabled when the variable isn't set or is empty.
+std::string tuning_cache_dir();
+// Read a tuning file, through the cache in cache_dir unless it is empty.
+// Return true if the tree was loaded from the cache. Throw if the JSON can't
+// be read or parsed.
+bool tuning_read(char const *filename, std::string const &cache_dir,
+		 boost::property_tree::ptree &root);
+
+} // namespace RPiController
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <array>
 #include <fcntl.h>
+#include <fstream>
 #include <math.h>
 #include <stdint.h>
 #include <string.h>
@@ -27,6 +28,7 @@
 #include "libcamera/internal/buffer.h"
 #include "libcamera/internal/camera_sensor.h"
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
 
 #include <linux/bcm2835-isp.h>
 
@@ -52,6 +54,7 @@
 #include "noise_status.h"
 #include "sharpen_algorithm.hpp"
 #include "sharpen_status.h"
+#include "stats_record.h"
 
 namespace libcamera {
 
@@ -61,6 +64,22 @@ constexpr unsigned int DefaultExposureTime = 20000;
 constexpr double defaultMinFrameDuration = 1e6 / 30.0;
 constexpr double defaultMaxFrameDuration = 1e6 / 0.01;
 
+/*
+ * The lens shading tables are resampled in fixed point, with the ALSC gains in
+ * Q4.14 and the interpolation weights in Q12, which keeps the products within
+ * 32 bits, and output in u4.10.
+ */
+constexpr unsigned int LsGainBits = 14;
+constexpr unsigned int LsWeightBits = 12;
+constexpr unsigned int LsOutputBits = 10;
+
+/* Only update the lens shading when a gain moves by half a step or more. */
+constexpr double LsUpdateThreshold = 0.5 / (1 << LsOutputBits);
+
+/* The largest lens shading grid, corner sampled, see configureLsGrid(). */
+constexpr unsigned int MaxLsGridWidth = 64;
+constexpr unsigned int MaxLsGridHeight = 49;
+
 LOG_DEFINE_CATEGORY(IPARPI)
 
 class IPARPi : public ipa::RPi::IPARPiInterface
@@ -68,7 +87,8 @@ class IPARPi : public ipa::RPi::IPARPiInterface
 public:
 	IPARPi()
 		: controller_(), frameCount_(0), checkCount_(0), mistrustCount_(0),
-		  lsTable_(nullptr), firstStart_(true)
+		  lsTable_(nullptr), lsCellSize_(0), lsApplied_(false),
+		  firstStart_(true)
 	{
 	}
 
@@ -105,6 +125,7 @@ private:
 	void fillDeviceStatus(uint32_t exposureLines, uint32_t gainCode,
 			      struct DeviceStatus &deviceStatus);
 	void processStats(unsigned int bufferId);
+	void recordStats(const bcm2835_isp_stats *stats);
 	void applyFrameDurations(double minFrameDuration, double maxFrameDuration);
 	void applyAGC(const struct AgcStatus *agcStatus, ControlList &ctrls);
 	void applyAWB(const struct AwbStatus *awbStatus, ControlList &ctrls);
@@ -116,8 +137,9 @@ private:
 	void applyDenoise(const struct DenoiseStatus *denoiseStatus, ControlList &ctrls);
 	void applySharpen(const struct SharpenStatus *sharpenStatus, ControlList &ctrls);
 	void applyDPC(const struct DpcStatus *dpcStatus, ControlList &ctrls);
+	void configureLsGrid();
 	void applyLS(const struct AlscStatus *lsStatus, ControlList &ctrls);
-	void resampleTable(uint16_t dest[], double const src[12][16], int destW, int destH);
+	void resampleTable(uint16_t dest[], double const src[ALSC_CELLS_Y][ALSC_CELLS_X]);
 
 	std::map<unsigned int, MappedFrameBuffer> buffers_;
 
@@ -149,12 +171,34 @@ private:
 	FileDescriptor lsTableHandle_;
 	void *lsTable_;
 
+	/*
+	 * LS grid for the current mode, with the ALSC cells and interpolation
+	 * weight to sample for each grid column and row.
+	 */
+	struct LsSample {
+		unsigned int lo;
+		unsigned int hi;
+		int32_t weight;
+	};
+	unsigned int lsCellSize_;
+	unsigned int lsWidth_;
+	unsigned int lsHeight_;
+	std::array<LsSample, MaxLsGridWidth> lsColumns_;
+	std::array<LsSample, MaxLsGridHeight> lsRows_;
+
+	/* The ALSC gains currently programmed into the LS table, if any. */
+	AlscStatus lsStatus_;
+	bool lsApplied_;
+
 	/* Distinguish the first camera start from others. */
 	bool firstStart_;
 
 	/* Frame duration (1/fps) limits, given in microseconds. */
 	double minFrameDuration_;
 	double maxFrameDuration_;
+
+	/* Record of the algorithms inputs, for offline replay. */
+	std::ofstream statsRecord_;
 };
 
 int IPARPi::init(const IPASettings &settings, ipa::RPi::SensorConfig *sensorConfig)
@@ -188,6 +232,26 @@ int IPARPi::init(const IPASettings &settings, ipa::RPi::SensorConfig *sensorConf
 	controller_.Read(settings.configurationFile.c_str());
 	controller_.Initialise();
 
+	/*
+	 * Record the inputs of the control algorithms if requested, to replay
+	 * them offline with the rpi-ipa-replay tool.
+	 */
+	const char *record = utils::secure_getenv("LIBCAMERA_RPI_STATS_RECORD");
+	if (record && !statsRecord_.is_open()) {
+		statsRecord_.open(record, std::ios::binary | std::ios::trunc);
+
+		struct stats_record_header header = {};
+		header.magic = STATS_RECORD_MAGIC;
+		header.version = STATS_RECORD_VERSION;
+		header.frame_size = sizeof(struct stats_record_frame);
+		statsRecord_.write(reinterpret_cast<const char *>(&header),
+				   sizeof(header));
+
+		if (!statsRecord_)
+			LOG(IPARPI, Error)
+				<< "Failed to open statistics record " << record;
+	}
+
 	return 0;
 }
 
@@ -208,7 +272,7 @@ void IPARPi::start(const ControlList &controls, ipa::RPi::StartConfig *startConf
 	agcStatus.shutter_time = 0.0;
 	agcStatus.analogue_gain = 0.0;
 
-	metadata.Get("agc.status", agcStatus);
+	metadata.Get(agcStatus);
 	if (agcStatus.shutter_time != 0.0 && agcStatus.analogue_gain != 0.0) {
 		ControlList ctrls(sensorCtrls_);
 		applyAGC(&agcStatus, ctrls);
@@ -362,6 +426,8 @@ int IPARPi::configure(const CameraSensorInfo &sensorInfo,
 		}
 	}
 
+	configureLsGrid();
+
 	/* Pass the camera mode to the CamHelper to setup algorithms. */
 	helper_->SetCameraMode(mode_);
 
@@ -442,30 +508,30 @@ void IPARPi::reportMetadata()
 	 * processed can be extracted and placed into the libcamera metadata
 	 * buffer, where an application could query it.
 	 */
-	DeviceStatus *deviceStatus = rpiMetadata_.GetLocked<DeviceStatus>("device.status");
+	DeviceStatus *deviceStatus = rpiMetadata_.GetLocked<DeviceStatus>();
 	if (deviceStatus) {
 		libcameraMetadata_.set(controls::ExposureTime, deviceStatus->shutter_speed);
 		libcameraMetadata_.set(controls::AnalogueGain, deviceStatus->analogue_gain);
 	}
 
-	AgcStatus *agcStatus = rpiMetadata_.GetLocked<AgcStatus>("agc.status");
+	AgcStatus *agcStatus = rpiMetadata_.GetLocked<AgcStatus>();
 	if (agcStatus) {
 		libcameraMetadata_.set(controls::AeLocked, agcStatus->locked);
 		libcameraMetadata_.set(controls::DigitalGain, agcStatus->digital_gain);
 	}
 
-	LuxStatus *luxStatus = rpiMetadata_.GetLocked<LuxStatus>("lux.status");
+	LuxStatus *luxStatus = rpiMetadata_.GetLocked<LuxStatus>();
 	if (luxStatus)
 		libcameraMetadata_.set(controls::Lux, luxStatus->lux);
 
-	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>("awb.status");
+	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>();
 	if (awbStatus) {
 		libcameraMetadata_.set(controls::ColourGains, { static_cast<float>(awbStatus->gain_r),
 								static_cast<float>(awbStatus->gain_b) });
 		libcameraMetadata_.set(controls::ColourTemperature, awbStatus->temperature_K);
 	}
 
-	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>("black_level.status");
+	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>();
 	if (blackLevelStatus)
 		libcameraMetadata_.set(controls::SensorBlackLevels,
 				       { static_cast<int32_t>(blackLevelStatus->black_level_r),
@@ -473,7 +539,7 @@ void IPARPi::reportMetadata()
 					 static_cast<int32_t>(blackLevelStatus->black_level_g),
 					 static_cast<int32_t>(blackLevelStatus->black_level_b) });
 
-	FocusStatus *focusStatus = rpiMetadata_.GetLocked<FocusStatus>("focus.status");
+	FocusStatus *focusStatus = rpiMetadata_.GetLocked<FocusStatus>();
 	if (focusStatus && focusStatus->num == 12) {
 		/*
 		 * We get a 4x3 grid of regions by default. Calculate the average
@@ -484,7 +550,7 @@ void IPARPi::reportMetadata()
 		libcameraMetadata_.set(controls::FocusFoM, focusFoM);
 	}
 
-	CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>("ccm.status");
+	CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>();
 	if (ccmStatus) {
 		float m[9];
 		for (unsigned int i = 0; i < 9; i++)
@@ -922,49 +988,49 @@ void IPARPi::prepareISP(const ipa::RPi::ISPConfig &data)
 	ControlList ctrls(ispCtrls_);
 
 	rpiMetadata_.Clear();
-	rpiMetadata_.Set("device.status", deviceStatus);
+	rpiMetadata_.Set(deviceStatus);
 	controller_.Prepare(&rpiMetadata_);
 
 	/* Lock the metadata buffer to avoid constant locks/unlocks. */
 	std::unique_lock<RPiController::Metadata> lock(rpiMetadata_);
 
-	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>("awb.status");
+	AwbStatus *awbStatus = rpiMetadata_.GetLocked<AwbStatus>();
 	if (awbStatus)
 		applyAWB(awbStatus, ctrls);
 
-	CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>("ccm.status");
+	CcmStatus *ccmStatus = rpiMetadata_.GetLocked<CcmStatus>();
 	if (ccmStatus)
 		applyCCM(ccmStatus, ctrls);
 
-	AgcStatus *dgStatus = rpiMetadata_.GetLocked<AgcStatus>("agc.status");
+	AgcStatus *dgStatus = rpiMetadata_.GetLocked<AgcStatus>();
 	if (dgStatus)
 		applyDG(dgStatus, ctrls);
 
-	AlscStatus *lsStatus = rpiMetadata_.GetLocked<AlscStatus>("alsc.status");
+	AlscStatus *lsStatus = rpiMetadata_.GetLocked<AlscStatus>();
 	if (lsStatus)
 		applyLS(lsStatus, ctrls);
 
-	ContrastStatus *contrastStatus = rpiMetadata_.GetLocked<ContrastStatus>("contrast.status");
+	ContrastStatus *contrastStatus = rpiMetadata_.GetLocked<ContrastStatus>();
 	if (contrastStatus)
 		applyGamma(contrastStatus, ctrls);
 
-	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>("black_level.status");
+	BlackLevelStatus *blackLevelStatus = rpiMetadata_.GetLocked<BlackLevelStatus>();
 	if (blackLevelStatus)
 		applyBlackLevel(blackLevelStatus, ctrls);
 
-	GeqStatus *geqStatus = rpiMetadata_.GetLocked<GeqStatus>("geq.status");
+	GeqStatus *geqStatus = rpiMetadata_.GetLocked<GeqStatus>();
 	if (geqStatus)
 		applyGEQ(geqStatus, ctrls);
 
-	DenoiseStatus *denoiseStatus = rpiMetadata_.GetLocked<DenoiseStatus>("denoise.status");
+	DenoiseStatus *denoiseStatus = rpiMetadata_.GetLocked<DenoiseStatus>();
 	if (denoiseStatus)
 		applyDenoise(denoiseStatus, ctrls);
 
-	SharpenStatus *sharpenStatus = rpiMetadata_.GetLocked<SharpenStatus>("sharpen.status");
+	SharpenStatus *sharpenStatus = rpiMetadata_.GetLocked<SharpenStatus>();
 	if (sharpenStatus)
 		applySharpen(sharpenStatus, ctrls);
 
-	DpcStatus *dpcStatus = rpiMetadata_.GetLocked<DpcStatus>("dpc.status");
+	DpcStatus *dpcStatus = rpiMetadata_.GetLocked<DpcStatus>();
 	if (dpcStatus)
 		applyDPC(dpcStatus, ctrls);
 
@@ -1027,10 +1093,14 @@ void IPARPi::processStats(unsigned int bufferId)
 	Span<uint8_t> mem = it->second.maps()[0];
 	bcm2835_isp_stats *stats = reinterpret_cast<bcm2835_isp_stats *>(mem.data());
 	RPiController::StatisticsPtr statistics = std::make_shared<bcm2835_isp_stats>(*stats);
+
+	if (statsRecord_.is_open())
+		recordStats(stats);
+
 	controller_.Process(statistics, &rpiMetadata_);
 
 	struct AgcStatus agcStatus;
-	if (rpiMetadata_.Get("agc.status", agcStatus) == 0) {
+	if (rpiMetadata_.Get(agcStatus) == 0) {
 		ControlList ctrls(sensorCtrls_);
 		applyAGC(&agcStatus, ctrls);
 
@@ -1038,6 +1108,20 @@ void IPARPi::processStats(unsigned int bufferId)
 	}
 }
 
+void IPARPi::recordStats(const bcm2835_isp_stats *stats)
+{
+	struct stats_record_frame frame = {};
+
+	rpiMetadata_.Get(frame.device_status);
+	frame.stats = *stats;
+
+	statsRecord_.write(reinterpret_cast<const char *>(&frame), sizeof(frame));
+	if (!statsRecord_) {
+		LOG(IPARPI, Error) << "Failed to record statistics";
+		statsRecord_.close();
+	}
+}
+
 void IPARPi::applyAWB(const struct AwbStatus *awbStatus, ControlList &ctrls)
 {
 	LOG(IPARPI, Debug) << "Applying WB R: " << awbStatus->gain_r << " B: "
@@ -1243,33 +1327,101 @@ void IPARPi::applyDPC(const struct DpcStatus *dpcStatus, ControlList &ctrls)
 	ctrls.set(V4L2_CID_USER_BCM2835_ISP_DPC, c);
 }
 
-void IPARPi::applyLS(const struct AlscStatus *lsStatus, ControlList &ctrls)
+void IPARPi::configureLsGrid()
 {
 	/*
-	 * Program lens shading tables into pipeline.
-	 * Choose smallest cell size that won't exceed 63x48 cells.
+	 * Choose smallest cell size that won't exceed 63x48 cells, and work out
+	 * once and for all how to sample the ALSC cells for each grid point.
 	 */
-	const int cellSizes[] = { 16, 32, 64, 128, 256 };
-	unsigned int numCells = std::size(cellSizes);
-	unsigned int i, w, h, cellSize;
-	for (i = 0; i < numCells; i++) {
-		cellSize = cellSizes[i];
+	const unsigned int cellSizes[] = { 16, 32, 64, 128, 256 };
+	unsigned int w, h;
+
+	lsCellSize_ = 0;
+	lsApplied_ = false;
+
+	for (unsigned int cellSize : cellSizes) {
 		w = (mode_.width + cellSize - 1) / cellSize;
 		h = (mode_.height + cellSize - 1) / cellSize;
-		if (w < 64 && h <= 48)
+		if (w < MaxLsGridWidth && h < MaxLsGridHeight) {
+			lsCellSize_ = cellSize;
 			break;
+		}
 	}
 
-	if (i == numCells) {
+	if (!lsCellSize_) {
 		LOG(IPARPI, Error) << "Cannot find cell size";
 		return;
 	}
 
-	/* We're going to supply corner sampled tables, 16 bit samples. */
-	w++, h++;
+	/*
+	 * We're going to supply corner sampled tables, resampled from the
+	 * centre sampled ALSC cells.
+	 */
+	lsWidth_ = w + 1;
+	lsHeight_ = h + 1;
+
+	auto sample = [](double pos, unsigned int size) {
+		int lo = floor(pos);
+		LsSample s;
+		s.weight = lround((pos - lo) * (1 << LsWeightBits));
+		s.hi = std::clamp<int>(lo + 1, 0, size - 1);
+		s.lo = std::clamp<int>(lo, 0, size - 1);
+		return s;
+	};
+
+	double xInc = static_cast<double>(ALSC_CELLS_X) / (lsWidth_ - 1);
+	for (unsigned int i = 0; i < lsWidth_; i++)
+		lsColumns_[i] = sample(i * xInc - 0.5, ALSC_CELLS_X);
+
+	double yInc = static_cast<double>(ALSC_CELLS_Y) / (lsHeight_ - 1);
+	for (unsigned int j = 0; j < lsHeight_; j++)
+		lsRows_[j] = sample(j * yInc - 0.5, ALSC_CELLS_Y);
+}
+
+void IPARPi::applyLS(const struct AlscStatus *lsStatus, ControlList &ctrls)
+{
+	if (!lsCellSize_)
+		return;
+
+	unsigned int w = lsWidth_, h = lsHeight_;
+	if (!lsTable_ || w * h * 4 * sizeof(uint16_t) > ipa::RPi::MaxLsGridSize) {
+		LOG(IPARPI, Error) << "Do not have a correctly allocate lens shading table!";
+		return;
+	}
+
+	/*
+	 * The ALSC gains change slowly once converged. Leave the pipeline with
+	 * the table it has when none has moved enough to make a difference.
+	 */
+	if (lsApplied_) {
+		const double *src = &lsStatus->r[0][0];
+		const double *applied = &lsStatus_.r[0][0];
+		unsigned int size = sizeof(AlscStatus) / sizeof(double);
+		unsigned int i;
+
+		for (i = 0; i < size; i++) {
+			if (fabs(src[i] - applied[i]) >= LsUpdateThreshold)
+				break;
+		}
+
+		if (i == size)
+			return;
+	}
+
+	/* Program lens shading tables into pipeline, format will be u4.10. */
+	uint16_t *grid = static_cast<uint16_t *>(lsTable_);
+
+	resampleTable(grid, lsStatus->r);
+	resampleTable(grid + w * h, lsStatus->g);
+	std::memcpy(grid + 2 * w * h, grid + w * h, w * h * sizeof(uint16_t));
+	resampleTable(grid + 3 * w * h, lsStatus->b);
+
+	lsStatus_ = *lsStatus;
+	lsApplied_ = true;
+
 	bcm2835_isp_lens_shading ls = {
 		.enabled = 1,
-		.grid_cell_size = cellSize,
+		.grid_cell_size = lsCellSize_,
 		.grid_width = w,
 		.grid_stride = w,
 		.grid_height = h,
@@ -1280,63 +1432,56 @@ void IPARPi::applyLS(const struct AlscStatus *lsStatus, ControlList &ctrls)
 		.gain_format = GAIN_FORMAT_U4P10
 	};
 
-	if (!lsTable_ || w * h * 4 * sizeof(uint16_t) > ipa::RPi::MaxLsGridSize) {
-		LOG(IPARPI, Error) << "Do not have a correctly allocate lens shading table!";
-		return;
-	}
-
-	if (lsStatus) {
-		/* Format will be u4.10 */
-		uint16_t *grid = static_cast<uint16_t *>(lsTable_);
-
-		resampleTable(grid, lsStatus->r, w, h);
-		resampleTable(grid + w * h, lsStatus->g, w, h);
-		std::memcpy(grid + 2 * w * h, grid + w * h, w * h * sizeof(uint16_t));
-		resampleTable(grid + 3 * w * h, lsStatus->b, w, h);
-	}
-
 	ControlValue c(Span<const uint8_t>{ reinterpret_cast<uint8_t *>(&ls),
 					    sizeof(ls) });
 	ctrls.set(V4L2_CID_USER_BCM2835_ISP_LENS_SHADING, c);
 }
 
 /*
- * Resamples a 16x12 table with central sampling to destW x destH with corner
+ * Resamples a 16x12 table with central sampling to the LS grid with corner
  * sampling.
  */
-void IPARPi::resampleTable(uint16_t dest[], double const src[12][16],
-			   int destW, int destH)
+void IPARPi::resampleTable(uint16_t dest[],
+			   double const src[ALSC_CELLS_Y][ALSC_CELLS_X])
 {
-	/*
-	 * Precalculate and cache the x sampling locations and phases to
-	 * save recomputing them on every row.
-	 */
-	assert(destW > 1 && destH > 1 && destW <= 64);
-	int xLo[64], xHi[64];
-	double xf[64];
-	double x = -0.5, xInc = 16.0 / (destW - 1);
-	for (int i = 0; i < destW; i++, x += xInc) {
-		xLo[i] = floor(x);
-		xf[i] = x - xLo[i];
-		xHi[i] = xLo[i] < 15 ? xLo[i] + 1 : 15;
-		xLo[i] = xLo[i] > 0 ? xLo[i] : 0;
+	constexpr int32_t one = 1 << LsWeightBits;
+
+	/* Interpolate the ALSC rows horizontally first, in fixed point. */
+	int32_t rows[ALSC_CELLS_Y][MaxLsGridWidth];
+	for (unsigned int y = 0; y < ALSC_CELLS_Y; y++) {
+		int32_t gains[ALSC_CELLS_X];
+		for (unsigned int x = 0; x < ALSC_CELLS_X; x++)
+			gains[x] = std::min<long>(lround(src[y][x] * (1 << LsGainBits)),
+						  (16 << LsGainBits) - 1);
+
+		for (unsigned int i = 0; i < lsWidth_; i++) {
+			const LsSample &s = lsColumns_[i];
+			rows[y][i] = (gains[s.lo] * (one - s.weight) +
+				      gains[s.hi] * s.weight + one / 2) >> LsWeightBits;
+		}
 	}
 
-	/* Now march over the output table generating the new values. */
-	double y = -0.5, yInc = 12.0 / (destH - 1);
-	for (int j = 0; j < destH; j++, y += yInc) {
-		int yLo = floor(y);
-		double yf = y - yLo;
-		int yHi = yLo < 11 ? yLo + 1 : 11;
-		yLo = yLo > 0 ? yLo : 0;
-		double const *rowAbove = src[yLo];
-		double const *rowBelow = src[yHi];
-		for (int i = 0; i < destW; i++) {
-			double above = rowAbove[xLo[i]] * (1 - xf[i]) + rowAbove[xHi[i]] * xf[i];
-			double below = rowBelow[xLo[i]] * (1 - xf[i]) + rowBelow[xHi[i]] * xf[i];
-			int result = floor(1024 * (above * (1 - yf) + below * yf) + .5);
-			*(dest++) = result > 16383 ? 16383 : result; /* want u4.10 */
+	/*
+	 * Then march over the output table blending the rows, which is where
+	 * most of the work is. The inner loop has no dependency between
+	 * iterations, which lets the compiler vectorise it.
+	 */
+	constexpr unsigned int shift = LsGainBits + LsWeightBits - LsOutputBits;
+	for (unsigned int j = 0; j < lsHeight_; j++) {
+		const LsSample &s = lsRows_[j];
+		const int32_t *above = rows[s.lo];
+		const int32_t *below = rows[s.hi];
+		int32_t weightAbove = one - s.weight;
+		int32_t weightBelow = s.weight;
+
+		for (unsigned int i = 0; i < lsWidth_; i++) {
+			int32_t result = (above[i] * weightAbove +
+					  below[i] * weightBelow +
+					  (1 << (shift - 1))) >> shift;
+			dest[i] = std::min(result, 16383); /* want u4.10 */
 		}
+
+		dest += lsWidth_;
 	}
 }
 
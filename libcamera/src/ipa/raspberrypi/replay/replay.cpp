@@ -0,0 +1,566 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * replay.cpp - Replay statistics through the Raspberry Pi control algorithms
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <linux/bcm2835-isp.h>
+
+#include "agc_status.h"
+#include "algorithm.hpp"
+#include "allocation_counter.h"
+#include "awb_status.h"
+#include "controller.hpp"
+#include "device_status.h"
+#include "metadata.hpp"
+#include "stats_record.h"
+
+using namespace RPiController;
+
+namespace {
+
+/* Delay, in frames, between setting the exposure and getting its stats. */
+constexpr unsigned int ExposureDelay = 2;
+
+/* The ISP pipeline is 13-bit wide. */
+constexpr double PipelineMax = (1 << 13) - 1;
+
+class Profiler : public AlgorithmProfiler
+{
+public:
+	struct Entry {
+		std::string name;
+		Stage stage;
+		uint64_t calls;
+		std::chrono::nanoseconds total;
+		std::chrono::nanoseconds max;
+		uint64_t allocations;
+	};
+
+	/*
+	 * The Controller may run several algorithms at once, on different
+	 * threads, but each thread runs one algorithm at a time.
+	 */
+	void Start([[maybe_unused]] Algorithm const *algorithm,
+		   [[maybe_unused]] Stage stage) override
+	{
+		allocations_ = AllocationCounter::threadAllocations();
+		start_ = std::chrono::steady_clock::now();
+	}
+
+	void Stop(Algorithm const *algorithm, Stage stage) override
+	{
+		std::chrono::nanoseconds duration =
+			std::chrono::steady_clock::now() - start_;
+		uint64_t allocations = AllocationCounter::threadAllocations() - allocations_;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		Entry &current = entry(algorithm, stage);
+		current.calls++;
+		current.total += duration;
+		current.max = std::max(current.max, duration);
+		current.allocations += allocations;
+	}
+
+	const std::vector<Entry> &entries() const { return entries_; }
+
+	const Entry *find(Algorithm const *algorithm, Stage stage) const
+	{
+		for (size_t i = 0; i < keys_.size(); ++i) {
+			if (keys_[i].first == algorithm && keys_[i].second == stage)
+				return &entries_[i];
+		}
+
+		return nullptr;
+	}
+
+private:
+	Entry &entry(Algorithm const *algorithm, Stage stage)
+	{
+		for (size_t i = 0; i < keys_.size(); ++i) {
+			if (keys_[i].first == algorithm && keys_[i].second == stage)
+				return entries_[i];
+		}
+
+		keys_.emplace_back(algorithm, stage);
+		entries_.push_back({ algorithm->Name(), stage, 0, {}, {}, 0 });
+		return entries_.back();
+	}
+
+	std::mutex mutex_;
+	std::vector<std::pair<Algorithm const *, Stage>> keys_;
+	std::vector<Entry> entries_;
+
+	static thread_local uint64_t allocations_;
+	static thread_local std::chrono::steady_clock::time_point start_;
+};
+
+thread_local uint64_t Profiler::allocations_;
+thread_local std::chrono::steady_clock::time_point Profiler::start_;
+
+/*
+ * A synthetic scene, made of grey patches of varying reflectance lit by an
+ * illuminant that gives the raw colour channels different sensitivities.
+ */
+class SyntheticScene
+{
+public:
+	SyntheticScene(double brightness)
+		: brightness_(brightness)
+	{
+	}
+
+	void generate(DeviceStatus const &deviceStatus, bcm2835_isp_stats &stats) const
+	{
+		static constexpr double channelGains[3] = { 0.55, 1.0, 0.65 };
+		constexpr uint32_t tiles = 1000;
+
+		stats = {};
+		stats.version = 1;
+		stats.size = sizeof(stats);
+
+		double exposure = deviceStatus.shutter_speed *
+				  deviceStatus.analogue_gain * brightness_;
+
+		for (unsigned int y = 0; y < DEFAULT_AWB_REGIONS_Y; ++y) {
+			for (unsigned int x = 0; x < DEFAULT_AWB_REGIONS_X; ++x) {
+				double reflectance = 0.05 + 0.85 *
+					(x + y * DEFAULT_AWB_REGIONS_X) / (AWB_REGIONS - 1);
+				double level[3];
+
+				for (unsigned int c = 0; c < 3; ++c)
+					level[c] = std::min(reflectance * channelGains[c] * exposure,
+							    1.0) * PipelineMax;
+
+				bcm2835_isp_stats_region &region =
+					stats.awb_stats[y * DEFAULT_AWB_REGIONS_X + x];
+				region.counted = tiles;
+				region.r_sum = level[0] * tiles;
+				region.g_sum = level[1] * tiles;
+				region.b_sum = level[2] * tiles;
+
+				/* Split the AWB grid in 4x4 blocks for AGC. */
+				bcm2835_isp_stats_region &agc =
+					stats.agc_stats[(y * 4 / DEFAULT_AWB_REGIONS_Y) * 4 +
+							x * 4 / DEFAULT_AWB_REGIONS_X];
+				agc.counted += tiles;
+				agc.r_sum += region.r_sum;
+				agc.g_sum += region.g_sum;
+				agc.b_sum += region.b_sum;
+
+				unsigned int bin = std::min<unsigned int>(level[1] / PipelineMax * NUM_HISTOGRAM_BINS,
+									  NUM_HISTOGRAM_BINS - 1);
+				stats.hist[0].r_hist[bin] += tiles;
+				stats.hist[0].g_hist[bin] += tiles;
+				stats.hist[0].b_hist[bin] += tiles;
+			}
+		}
+	}
+
+private:
+	double brightness_;
+};
+
+/* Track the number of frames needed for a value to settle. */
+class Convergence
+{
+public:
+	Convergence()
+		: frame_(-1), stable_(0), last_(0)
+	{
+	}
+
+	void update(unsigned int frame, double value)
+	{
+		if (last_ && std::abs(value - last_) <= Tolerance * last_) {
+			if (++stable_ == StableFrames && frame_ < 0)
+				frame_ = frame + 1 - StableFrames;
+		} else {
+			stable_ = 0;
+			frame_ = -1;
+		}
+
+		last_ = value;
+	}
+
+	int frame() const { return frame_; }
+	double value() const { return last_; }
+
+private:
+	static constexpr double Tolerance = 0.01;
+	static constexpr unsigned int StableFrames = 5;
+
+	int frame_;
+	unsigned int stable_;
+	double last_;
+};
+
+void usage(const char *argv0)
+{
+	std::cerr
+		<< "Usage: " << argv0 << " [options] -t <tuning-file>\n\n"
+		<< "Replay statistics through the Raspberry Pi control algorithms and\n"
+		<< "report their CPU usage and convergence.\n\n"
+		<< "  -t, --tuning-file FILE       Tuning file to load the algorithms from\n"
+		<< "  -i, --input FILE             Replay a statistics record, as produced with\n"
+		<< "                               LIBCAMERA_RPI_STATS_RECORD, instead of a\n"
+		<< "                               synthetic scene\n"
+		<< "  -o, --output FILE            Record the replayed statistics to FILE\n"
+		<< "  -f, --frames N               Number of synthetic frames (default 300)\n"
+		<< "  -b, --brightness VALUE       Synthetic scene brightness (default 5e-5)\n"
+		<< "  -s, --serial                 Run the algorithms one after the other,\n"
+		<< "                               instead of in parallel where possible\n"
+		<< "  -h, --help                   Print this help\n\n"
+		<< "The tuning file is compiled to the cache directory given by the\n"
+		<< "LIBCAMERA_RPI_TUNING_CACHE environment variable when it is set, and\n"
+		<< "parsed at every startup otherwise.\n";
+}
+
+/* Print the distribution of the frame latencies, sorted in increasing order. */
+void printLatencyHistogram(const std::vector<std::chrono::nanoseconds> &durations)
+{
+	constexpr unsigned int numBuckets = 10;
+	constexpr unsigned int barWidth = 40;
+
+	double width = std::max<double>(durations.back().count() / 1000.0 / numBuckets,
+					0.01);
+	std::vector<unsigned int> counts(numBuckets);
+	for (std::chrono::nanoseconds duration : durations) {
+		unsigned int bucket = duration.count() / 1000.0 / width;
+		counts[std::min(bucket, numBuckets - 1)]++;
+	}
+
+	unsigned int maxCount = *std::max_element(counts.begin(), counts.end());
+	for (unsigned int i = 0; i < numBuckets; ++i) {
+		std::cout << std::right << std::setw(10) << i * width << " - "
+			  << std::setw(10) << (i + 1) * width << " us "
+			  << std::setw(6) << counts[i] << " "
+			  << std::string(counts[i] * barWidth / maxCount, '#')
+			  << std::endl;
+	}
+}
+
+/*
+ * Print the critical path of the Process stage, the longest chain of
+ * algorithms that have to run one after the other, from their mean durations.
+ * It bounds the frame latency that parallel processing can achieve, while the
+ * sum of the durations is the latency of serial processing.
+ */
+void printCriticalPath(const Controller &controller, const Profiler &profiler)
+{
+	auto graph = controller.ProcessGraph();
+	std::vector<double> finish(graph.size());
+	std::vector<int> previous(graph.size(), -1);
+	double work = 0;
+	int last = -1;
+
+	for (size_t i = 0; i < graph.size(); ++i) {
+		const Profiler::Entry *entry =
+			profiler.find(graph[i].first, AlgorithmProfiler::Stage::Process);
+		double duration = entry ? entry->total.count() / 1000.0 / entry->calls : 0;
+		double start = 0;
+
+		for (size_t j = 0; j < i; ++j) {
+			if ((graph[i].second & (1u << j)) && finish[j] > start) {
+				start = finish[j];
+				previous[i] = j;
+			}
+		}
+
+		finish[i] = start + duration;
+		work += duration;
+
+		if (last < 0 || finish[i] > finish[last])
+			last = i;
+	}
+
+	if (last < 0)
+		return;
+
+	std::string path;
+	for (int i = last; i >= 0; i = previous[i])
+		path = graph[i].first->Name() + (path.empty() ? "" : " -> " + path);
+
+	std::cout << "Process: " << work << " us of work, critical path "
+		  << finish[last] << " us (" << path << ")" << std::endl;
+}
+
+CameraMode defaultMode()
+{
+	/* A 2x2 binned mode of a 12MP sensor, at 30 fps. */
+	CameraMode mode = {};
+	mode.bitdepth = 12;
+	mode.width = 2028;
+	mode.height = 1520;
+	mode.sensor_width = 4056;
+	mode.sensor_height = 3040;
+	mode.bin_x = 2;
+	mode.bin_y = 2;
+	mode.scale_x = 2.0;
+	mode.scale_y = 2.0;
+	mode.noise_factor = 2.0;
+	mode.line_length = 21000.0;
+	mode.transform = libcamera::Transform::Identity;
+	mode.min_frame_length = 1587;
+	mode.max_frame_length = 65535;
+	return mode;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "tuning-file", required_argument, nullptr, 't' },
+		{ "input", required_argument, nullptr, 'i' },
+		{ "output", required_argument, nullptr, 'o' },
+		{ "frames", required_argument, nullptr, 'f' },
+		{ "brightness", required_argument, nullptr, 'b' },
+		{ "serial", no_argument, nullptr, 's' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 },
+	};
+
+	std::string tuningFile;
+	std::string inputFile;
+	std::string outputFile;
+	unsigned int numFrames = 300;
+	double brightness = 5e-5;
+	bool serial = false;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "t:i:o:f:b:sh", options, nullptr)) != -1) {
+		switch (opt) {
+		case 't':
+			tuningFile = optarg;
+			break;
+		case 'i':
+			inputFile = optarg;
+			break;
+		case 'o':
+			outputFile = optarg;
+			break;
+		case 'f':
+			numFrames = strtoul(optarg, nullptr, 0);
+			break;
+		case 'b':
+			brightness = strtod(optarg, nullptr);
+			break;
+		case 's':
+			serial = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (tuningFile.empty()) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream input;
+	if (!inputFile.empty()) {
+		input.open(inputFile, std::ios::binary);
+
+		struct stats_record_header header = {};
+		input.read(reinterpret_cast<char *>(&header), sizeof(header));
+		if (!input || header.magic != STATS_RECORD_MAGIC ||
+		    header.version != STATS_RECORD_VERSION ||
+		    header.frame_size != sizeof(struct stats_record_frame)) {
+			std::cerr << "Invalid statistics record " << inputFile
+				  << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		numFrames = UINT32_MAX;
+	}
+
+	std::ofstream output;
+	if (!outputFile.empty()) {
+		output.open(outputFile, std::ios::binary | std::ios::trunc);
+
+		struct stats_record_header header = {};
+		header.magic = STATS_RECORD_MAGIC;
+		header.version = STATS_RECORD_VERSION;
+		header.frame_size = sizeof(struct stats_record_frame);
+		output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+		if (!output) {
+			std::cerr << "Failed to open " << outputFile << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Time the startup, from reading the tuning file to the first Prepare. */
+	auto startupBegin = std::chrono::steady_clock::now();
+
+	Controller controller;
+	Profiler profiler;
+
+	controller.Read(tuningFile.c_str());
+	controller.Initialise();
+	controller.SetProfiler(&profiler);
+	controller.SetParallelProcess(!serial);
+
+	Metadata metadata;
+	controller.SwitchMode(defaultMode(), &metadata);
+
+	std::chrono::nanoseconds startup = std::chrono::steady_clock::now() - startupBegin;
+
+	/*
+	 * In synthetic mode, the loop is closed: the exposure computed by the
+	 * AGC is applied to the sensor, and shows up in the statistics a few
+	 * frames later.
+	 */
+	SyntheticScene scene(brightness);
+	std::vector<DeviceStatus> pending(ExposureDelay, DeviceStatus{ 20000.0, 1.0, 0.0, 0.0, 0.0 });
+
+	Convergence agcConvergence;
+	Convergence awbRedConvergence;
+	Convergence awbBlueConvergence;
+
+	std::vector<std::chrono::nanoseconds> durations;
+	uint64_t allocations = AllocationCounter::processAllocations();
+	unsigned int frame;
+
+	for (frame = 0; frame < numFrames; ++frame) {
+		struct stats_record_frame record;
+
+		if (input.is_open()) {
+			input.read(reinterpret_cast<char *>(&record), sizeof(record));
+			if (!input)
+				break;
+		} else {
+			record.device_status = pending.front();
+			scene.generate(record.device_status, record.stats);
+		}
+
+		if (output.is_open())
+			output.write(reinterpret_cast<const char *>(&record), sizeof(record));
+
+		StatisticsPtr stats = std::make_shared<bcm2835_isp_stats>(record.stats);
+
+		auto start = std::chrono::steady_clock::now();
+
+		metadata.Clear();
+		metadata.Set(record.device_status);
+		controller.Prepare(&metadata);
+		if (!frame)
+			startup += std::chrono::steady_clock::now() - start;
+		controller.Process(stats, &metadata);
+
+		durations.push_back(std::chrono::steady_clock::now() - start);
+
+		AgcStatus agcStatus;
+		if (metadata.Get(agcStatus) == 0) {
+			agcConvergence.update(frame, agcStatus.shutter_time *
+						     agcStatus.analogue_gain);
+
+			if (agcStatus.shutter_time && agcStatus.analogue_gain) {
+				pending.erase(pending.begin());
+				pending.push_back({ agcStatus.shutter_time,
+						    agcStatus.analogue_gain,
+						    0.0, 0.0, 0.0 });
+			}
+		}
+
+		AwbStatus awbStatus;
+		if (metadata.Get(awbStatus) == 0) {
+			awbRedConvergence.update(frame, awbStatus.gain_r);
+			awbBlueConvergence.update(frame, awbStatus.gain_b);
+		}
+	}
+
+	allocations = AllocationCounter::processAllocations() - allocations;
+
+	if (!frame) {
+		std::cerr << "No frame replayed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Replayed " << frame << " frames with " << tuningFile
+		  << std::endl << std::endl;
+
+	std::cout << std::fixed << std::setprecision(2)
+		  << "Startup: " << startup.count() / 1000.0
+		  << " us to the first Prepare" << std::endl << std::endl;
+
+	std::cout << std::fixed << std::setprecision(2)
+		  << std::left << std::setw(20) << "Algorithm"
+		  << std::setw(10) << "Stage"
+		  << std::right << std::setw(12) << "Mean (us)"
+		  << std::setw(12) << "Max (us)"
+		  << std::setw(14) << "Allocs/call" << std::endl;
+
+	for (const Profiler::Entry &entry : profiler.entries()) {
+		std::cout << std::left << std::setw(20) << entry.name
+			  << std::setw(10)
+			  << (entry.stage == AlgorithmProfiler::Stage::Prepare ? "Prepare" : "Process")
+			  << std::right << std::setw(12)
+			  << entry.total.count() / 1000.0 / entry.calls
+			  << std::setw(12) << entry.max.count() / 1000.0
+			  << std::setw(14)
+			  << static_cast<double>(entry.allocations) / entry.calls
+			  << std::endl;
+	}
+
+	std::cout << std::endl;
+	printCriticalPath(controller, profiler);
+
+	std::chrono::nanoseconds total{};
+	for (std::chrono::nanoseconds duration : durations)
+		total += duration;
+	std::sort(durations.begin(), durations.end());
+
+	std::cout << std::endl
+		  << "Frame (" << (serial ? "serial" : "parallel") << "): mean "
+		  << total.count() / 1000.0 / frame
+		  << " us, median " << durations[frame / 2].count() / 1000.0
+		  << " us, 99th percentile " << durations[frame * 99 / 100].count() / 1000.0
+		  << " us, max " << durations.back().count() / 1000.0 << " us, "
+		  << static_cast<double>(allocations) / frame
+		  << " allocations (all threads)" << std::endl;
+
+	printLatencyHistogram(durations);
+	std::cout << std::endl;
+
+	int awbFrame = std::max(awbRedConvergence.frame(), awbBlueConvergence.frame());
+	if (awbRedConvergence.frame() < 0 || awbBlueConvergence.frame() < 0)
+		awbFrame = -1;
+
+	std::cout << "AGC: exposure " << agcConvergence.value() << ", ";
+	if (agcConvergence.frame() >= 0)
+		std::cout << "converged at frame " << agcConvergence.frame();
+	else
+		std::cout << "not converged";
+	std::cout << std::endl;
+
+	std::cout << "AWB: gains R " << awbRedConvergence.value()
+		  << " B " << awbBlueConvergence.value() << ", ";
+	if (awbFrame >= 0)
+		std::cout << "converged at frame " << awbFrame;
+	else
+		std::cout << "not converged";
+	std::cout << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * stats_record.h - Raspberry Pi statistics record file format
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include <linux/bcm2835-isp.h>
+
+#include "device_status.h"
+
+/*
+ * A statistics record file stores the inputs of the control algorithms for a
+ * sequence of frames, to replay them offline. It starts with a
+ * stats_record_header, followed by one stats_record_frame per frame. All
+ * fields are stored in native endianness.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATS_RECORD_MAGIC	0x53495052 /* "RPIS" */
+#define STATS_RECORD_VERSION	1
+
+struct stats_record_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frame_size;
+	uint32_t reserved;
+};
+
+struct stats_record_frame {
+	struct DeviceStatus device_status;
+	struct bcm2835_isp_stats stats;
+};
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,6 +8,7 @@
 #include <libcamera/bound_method.h>
 
 #include "libcamera/internal/message.h"
+#include "libcamera/internal/pool_allocator.h"
 #include "libcamera/internal/semaphore.h"
 #include "libcamera/internal/thread.h"
 
@@ -50,6 +51,32 @@ namespace libcamera {
  * blocks until the receiver signals the completion of the invocation.
  */
 
+/*
+ * Bound methods and their argument packs are allocated for every
+ * Object::invokeMethod() call and every signal emission to an object living
+ * in a different thread. Serve them from the pool allocator to avoid hitting
+ * the system allocator on those paths.
+ */
+void *BoundMethodPackBase::allocate(size_t size)
+{
+	return PoolAllocator::allocate(size);
+}
+
+void BoundMethodPackBase::deallocate(void *ptr, size_t size)
+{
+	PoolAllocator::deallocate(ptr, size);
+}
+
+void *BoundMethodBase::operator new(size_t size)
+{
+	return PoolAllocator::allocate(size);
+}
+
+void BoundMethodBase::operator delete(void *ptr, size_t size)
+{
+	PoolAllocator::deallocate(ptr, size);
+}
+
 /**
  * \brief Invoke the bound method with packed arguments
  * \param[in] pack Packed arguments
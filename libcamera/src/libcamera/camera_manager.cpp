@@ -7,8 +7,11 @@
 
 #include <libcamera/camera_manager.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <map>
+#include <sstream>
+#include <utility>
 
 #include <libcamera/camera.h>
 
@@ -67,6 +70,7 @@ private:
 	int status_;
 
 	std::unique_ptr<DeviceEnumerator> enumerator_;
+	std::vector<std::pair<std::string, std::chrono::duration<double, std::milli>>> matchTimes_;
 
 	IPAManager ipaManager_;
 	ProcessManager processManager_;
@@ -123,12 +127,36 @@ void CameraManager::Private::run()
 
 int CameraManager::Private::init()
 {
+	utils::time_point start = utils::clock::now();
+
 	enumerator_ = DeviceEnumerator::create();
 	if (!enumerator_ || enumerator_->enumerate())
 		return -ENODEV;
 
+	utils::time_point enumerated = utils::clock::now();
+
 	createPipelineHandlers();
 
+	/*
+	 * Report where the startup time went. Pipeline handlers that took less
+	 * than a millisecond to match, usually because their media devices
+	 * are absent, are left out.
+	 */
+	std::chrono::duration<double, std::milli> elapsed = utils::clock::now() - start;
+	std::chrono::duration<double, std::milli> enumeration = enumerated - start;
+
+	std::ostringstream profile;
+	profile << "Camera manager initialized in " << elapsed.count()
+		<< " ms: enumeration " << enumeration.count() << " ms";
+
+	for (const auto &matchTime : matchTimes_) {
+		if (matchTime.second.count() >= 1.0)
+			profile << ", " << matchTime.first << " "
+				<< matchTime.second.count() << " ms";
+	}
+
+	LOG(Camera, Info) << profile.str();
+
 	return 0;
 }
 
@@ -144,10 +172,15 @@ void CameraManager::Private::createPipelineHandlers()
 	std::vector<PipelineHandlerFactory *> &factories =
 		PipelineHandlerFactory::factories();
 
+	matchTimes_.clear();
+
 	for (PipelineHandlerFactory *factory : factories) {
 		LOG(Camera, Debug)
 			<< "Found registered pipeline handler '"
 			<< factory->name() << "'";
+
+		utils::time_point start = utils::clock::now();
+
 		/*
 		 * Try each pipeline handler until it exhaust
 		 * all pipelines it can provide.
@@ -161,6 +194,9 @@ void CameraManager::Private::createPipelineHandlers()
 				<< "Pipeline handler \"" << factory->name()
 				<< "\" matched";
 		}
+
+		matchTimes_.emplace_back(factory->name(),
+					 utils::clock::now() - start);
 	}
 
 	enumerator_->devicesAdded.connect(this, &Private::createPipelineHandlers);
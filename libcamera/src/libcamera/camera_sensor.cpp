@@ -9,12 +9,17 @@
 #include "libcamera/internal/media_device.h"
 
 #include <algorithm>
+#include <fcntl.h>
 #include <float.h>
+#include <fstream>
 #include <iomanip>
 #include <limits.h>
 #include <math.h>
 #include <regex>
+#include <sstream>
 #include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
 
 #include <libcamera/property_ids.h>
 
@@ -154,6 +159,17 @@ LOG_DEFINE_CATEGORY(CameraSensor)
  * The implementation is currently limited to sensors that expose a single V4L2
  * subdevice with a single pad. It will be extended to support more complex
  * devices as the needs arise.
+ *
+ * Enumerating the formats supported by a sensor takes one ioctl per media bus
+ * code and frame size, which adds up to a noticeable part of the camera
+ * manager startup time on sensors that support many modes. When the
+ * LIBCAMERA_SENSOR_CACHE environment variable is set, the enumerated formats
+ * are stored in the file it names, keyed by the driver, bus information and
+ * kernel version of the media device and by the name of the sensor entity, and
+ * read back from there the next time the sensor is initialized. The cache is
+ * disabled by default, as it can't detect changes to the sensor driver that
+ * don't come with a new kernel version. The sensor controls are always queried
+ * from the driver, as their limits depend on the current sensor configuration.
  */
 
 /**
@@ -217,10 +233,19 @@ int CameraSensor::init()
 		return ret;
 
 	/* Enumerate, sort and cache media bus codes and sizes. */
-	formats_ = subdev_->formats(pad_);
+	const char *cachePath = utils::secure_getenv("LIBCAMERA_SENSOR_CACHE");
+	if (cachePath && *cachePath)
+		loadCachedFormats(cachePath);
+
 	if (formats_.empty()) {
-		LOG(CameraSensor, Error) << "No image format found";
-		return -EINVAL;
+		formats_ = subdev_->formats(pad_);
+		if (formats_.empty()) {
+			LOG(CameraSensor, Error) << "No image format found";
+			return -EINVAL;
+		}
+
+		if (cachePath && *cachePath)
+			storeCachedFormats(cachePath);
 	}
 
 	mbusCodes_ = utils::map_keys(formats_);
@@ -273,6 +298,124 @@ int CameraSensor::init()
 	return 0;
 }
 
+std::string CameraSensor::formatCacheKey() const
+{
+	const MediaDevice *media = entity_->device();
+	std::ostringstream key;
+	key << media->driver() << "\t" << media->busInfo() << "\t"
+	    << utils::hex(media->version()) << "\t" << entity_->name() << "\t"
+	    << pad_;
+
+	return key.str();
+}
+
+bool CameraSensor::loadCachedFormats(const std::string &path)
+{
+	std::ifstream file(path);
+	std::string line;
+	if (!std::getline(file, line) || line != "libcamera-sensor-formats 1")
+		return false;
+
+	/*
+	 * Each line holds the cache key followed by a tab and by the formats,
+	 * separated by spaces, in the "code:minWxminH-maxWxmaxH" format, with
+	 * one entry per size range.
+	 */
+	const std::string key = formatCacheKey() + "\t";
+	while (std::getline(file, line)) {
+		if (line.compare(0, key.size(), key))
+			continue;
+
+		V4L2Subdevice::Formats formats;
+		std::istringstream entries(line.substr(key.size()));
+		std::string entry;
+		while (entries >> entry) {
+			unsigned int code;
+			SizeRange range;
+			char end;
+
+			if (sscanf(entry.c_str(), "%x:%ux%u-%ux%u%c", &code,
+				   &range.min.width, &range.min.height,
+				   &range.max.width, &range.max.height,
+				   &end) != 5)
+				return false;
+
+			formats[code].push_back(range);
+		}
+
+		if (formats.empty())
+			return false;
+
+		LOG(CameraSensor, Debug) << "Formats read from " << path;
+
+		formats_ = std::move(formats);
+		return true;
+	}
+
+	return false;
+}
+
+void CameraSensor::storeCachedFormats(const std::string &path) const
+{
+	const std::string key = formatCacheKey();
+	if (key.find('\n') != std::string::npos ||
+	    std::count(key.begin(), key.end(), '\t') != 4)
+		return;
+
+	/*
+	 * Cameras starting at the same time, in this process or in other ones,
+	 * update the cache concurrently. Serialize the updates with a lock on a
+	 * separate file, as the cache file itself is replaced on every update,
+	 * to avoid losing the entry of another sensor.
+	 */
+	const std::string lockPath = path + ".lock";
+	int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (lockFd < 0) {
+		LOG(CameraSensor, Debug)
+			<< "Can't open sensor cache lock " << lockPath << ": "
+			<< strerror(errno);
+		return;
+	}
+
+	if (flock(lockFd, LOCK_EX) < 0) {
+		LOG(CameraSensor, Debug)
+			<< "Can't lock sensor cache " << path << ": "
+			<< strerror(errno);
+		close(lockFd);
+		return;
+	}
+
+	std::ostringstream cache;
+	cache << "libcamera-sensor-formats 1\n";
+
+	/* Keep the entries of the other sensors. */
+	std::ifstream file(path);
+	std::string line;
+	if (std::getline(file, line) && line == "libcamera-sensor-formats 1") {
+		while (std::getline(file, line)) {
+			if (line.compare(0, key.size() + 1, key + "\t"))
+				cache << line << "\n";
+		}
+	}
+
+	cache << key << "\t";
+	for (const auto &format : formats_) {
+		for (const SizeRange &range : format.second)
+			cache << utils::hex(format.first) << ":"
+			      << range.min.toString() << "-"
+			      << range.max.toString() << " ";
+	}
+	cache << "\n";
+
+	int ret = utils::write_file_atomic(path, cache.str());
+	if (ret < 0)
+		LOG(CameraSensor, Warning)
+			<< "Failed to write sensor cache " << path << ": "
+			<< strerror(-ret);
+
+	close(lockFd);
+}
+
 int CameraSensor::validateSensorDriver()
 {
 	int err = 0;
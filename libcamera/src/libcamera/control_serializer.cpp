@@ -7,7 +7,6 @@
 
 #include "libcamera/internal/control_serializer.h"
 
-#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -66,16 +65,74 @@ LOG_DEFINE_CATEGORY(Serializer)
  * that constraint results in serialization or deserialization failure of the
  * ControlList.
  *
+ * Handles are allocated independently by the serializers on both sides of the
+ * IPC channel, as both the pipeline handler and the IPA module can create
+ * ControlInfoMap instances. To avoid collisions, each serializer is assigned a
+ * Role at construction time, and allocates handles from a disjoint space:
+ * even handles for the Proxy and odd handles for the Worker. The handle 0 is
+ * reserved for ControlList instances not associated with a ControlInfoMap.
+ *
+ * A ControlInfoMap is thus sent over IPC once, and all the ControlList
+ * instances that refer to it are then serialized with its handle only. To keep
+ * this true for ControlList instances that refer to a copy of a deserialized
+ * ControlInfoMap, which is a common pattern in IPA modules, the serializer
+ * associates copies with the handle of the identical map it has deserialized
+ * instead of serializing them again.
+ *
+ * The serializer identifies ControlInfoMap instances it hasn't created by their
+ * address, which may be reused by a different map once the original map is
+ * destroyed. To avoid associating a stale handle with a new map, the
+ * serializer records the ControlInfoMap::generation() of each map along with
+ * its handle, and only uses the handle if the generations match.
+ *
  * The serializer can be reset() to clear its internal state. This may be
  * performed when reconfiguring an IPA to avoid constant growth of the internal
  * state, especially if the contents of the ControlInfoMap instances change at
  * that time. A reset of the serializer invalidates all ControlList and
- * ControlInfoMap that have been previously deserialized. The caller shall thus
- * proceed with care to avoid stale references.
+ * ControlInfoMap that have been previously deserialized, and restarts the
+ * handle numbering. The serializers on both sides of the IPC channel shall
+ * thus be reset together, and the caller shall proceed with care to avoid
+ * stale references.
+ *
+ * The serializer counts the ControlInfoMap and ControlList instances it
+ * serializes, along with their size in bytes, to help monitoring the amount of
+ * data exchanged with IPA modules. The counters are reported by statistics().
+ */
+
+/**
+ * \enum ControlSerializer::Role
+ * \brief Define the role of the IPC component using the serializer
+ *
+ * \var ControlSerializer::Role::Proxy
+ * \brief The serializer is used by the IPA proxy, on the pipeline handler side
+ *
+ * \var ControlSerializer::Role::Worker
+ * \brief The serializer is used by the IPA proxy worker, on the IPA side
+ */
+
+/**
+ * \struct ControlSerializer::Statistics
+ * \brief Counters of the data serialized by a ControlSerializer
+ *
+ * \var ControlSerializer::Statistics::infoMaps
+ * \brief Number of ControlInfoMap instances serialized
+ *
+ * \var ControlSerializer::Statistics::infoMapBytes
+ * \brief Total size in bytes of the serialized ControlInfoMap instances
+ *
+ * \var ControlSerializer::Statistics::lists
+ * \brief Number of ControlList instances serialized
+ *
+ * \var ControlSerializer::Statistics::listBytes
+ * \brief Total size in bytes of the serialized ControlList instances
  */
 
-ControlSerializer::ControlSerializer()
-	: serial_(0)
+/**
+ * \brief Construct a new ControlSerializer
+ * \param[in] role The role of the IPC component using the serializer
+ */
+ControlSerializer::ControlSerializer(Role role)
+	: role_(role), serial_(role == Role::Proxy ? 0 : 1), stats_({})
 {
 }
 
@@ -87,8 +144,9 @@ ControlSerializer::ControlSerializer()
  */
 void ControlSerializer::reset()
 {
-	serial_ = 0;
+	serial_ = role_ == Role::Proxy ? 0 : 1;
 
+	handleInfoMaps_.clear();
 	infoMapHandles_.clear();
 	infoMaps_.clear();
 	controlIds_.clear();
@@ -187,9 +245,9 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 		valuesSize += binarySize(ctrl.second);
 
 	/* Prepare the packet header, assign a handle to the ControlInfoMap. */
-	struct ipa_controls_header hdr;
+	struct ipa_controls_header hdr = {};
 	hdr.version = IPA_CONTROLS_FORMAT_VERSION;
-	hdr.handle = ++serial_;
+	hdr.handle = serial_ += 2;
 	hdr.entries = infoMap.size();
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
@@ -207,7 +265,7 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 		const ControlId *id = ctrl.first;
 		const ControlInfo &info = ctrl.second;
 
-		struct ipa_control_info_entry entry;
+		struct ipa_control_info_entry entry = {};
 		entry.id = id->id();
 		entry.type = id->type();
 		entry.offset = values.offset();
@@ -223,7 +281,11 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 	 * Store the map to handle association, to be used to serialize and
 	 * deserialize control lists.
 	 */
-	infoMapHandles_[&infoMap] = hdr.handle;
+	infoMapHandles_[&infoMap] = { hdr.handle, infoMap.generation() };
+	handleInfoMaps_[hdr.handle] = &infoMap;
+
+	stats_.infoMaps++;
+	stats_.infoMapBytes += hdr.size;
 
 	return 0;
 }
@@ -249,14 +311,12 @@ int ControlSerializer::serialize(const ControlList &list,
 	 */
 	unsigned int infoMapHandle;
 	if (list.infoMap()) {
-		auto iter = infoMapHandles_.find(list.infoMap());
-		if (iter == infoMapHandles_.end()) {
+		infoMapHandle = findHandle(*list.infoMap());
+		if (!infoMapHandle) {
 			LOG(Serializer, Error)
 				<< "Can't serialize ControlList: unknown ControlInfoMap";
 			return -ENOENT;
 		}
-
-		infoMapHandle = iter->second;
 	} else {
 		infoMapHandle = 0;
 	}
@@ -267,7 +327,7 @@ int ControlSerializer::serialize(const ControlList &list,
 		valuesSize += binarySize(ctrl.second);
 
 	/* Prepare the packet header. */
-	struct ipa_controls_header hdr;
+	struct ipa_controls_header hdr = {};
 	hdr.version = IPA_CONTROLS_FORMAT_VERSION;
 	hdr.handle = infoMapHandle;
 	hdr.entries = list.size();
@@ -284,7 +344,7 @@ int ControlSerializer::serialize(const ControlList &list,
 		unsigned int id = ctrl.first;
 		const ControlValue &value = ctrl.second;
 
-		struct ipa_control_value_entry entry;
+		struct ipa_control_value_entry entry = {};
 		entry.id = id;
 		entry.type = value.type();
 		entry.is_array = value.isArray();
@@ -298,6 +358,9 @@ int ControlSerializer::serialize(const ControlList &list,
 	if (buffer.overflow())
 		return -ENOSPC;
 
+	stats_.lists++;
+	stats_.listBytes += hdr.size;
+
 	return 0;
 }
 
@@ -353,10 +416,10 @@ ControlInfoMap ControlSerializer::deserialize<ControlInfoMap>(ByteStreamBuffer &
 		return {};
 	}
 
-	auto iter = infoMaps_.find(hdr->handle);
-	if (iter != infoMaps_.end()) {
+	auto iter = handleInfoMaps_.find(hdr->handle);
+	if (iter != handleInfoMaps_.end()) {
 		LOG(Serializer, Debug) << "Use cached ControlInfoMap";
-		return iter->second;
+		return *iter->second;
 	}
 
 	if (hdr->version != IPA_CONTROLS_FORMAT_VERSION) {
@@ -366,6 +429,16 @@ ControlInfoMap ControlSerializer::deserialize<ControlInfoMap>(ByteStreamBuffer &
 		return {};
 	}
 
+	/*
+	 * The handle must have been allocated by the peer, a handle in our own
+	 * space indicates that both sides use the same role.
+	 */
+	if (!hdr->handle || (hdr->handle & 1) == (serial_ & 1)) {
+		LOG(Serializer, Error)
+			<< "Invalid ControlInfoMap handle " << hdr->handle;
+		return {};
+	}
+
 	ByteStreamBuffer entries = buffer.carveOut(hdr->data_offset - sizeof(*hdr));
 	ByteStreamBuffer values = buffer.carveOut(hdr->size - hdr->data_offset);
 
@@ -409,7 +482,8 @@ ControlInfoMap ControlSerializer::deserialize<ControlInfoMap>(ByteStreamBuffer &
 	 * association.
 	 */
 	ControlInfoMap &map = infoMaps_[hdr->handle] = std::move(ctrls);
-	infoMapHandles_[&map] = hdr->handle;
+	infoMapHandles_[&map] = { hdr->handle, map.generation() };
+	handleInfoMaps_[hdr->handle] = &map;
 
 	return map;
 }
@@ -456,17 +530,14 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 	 */
 	const ControlInfoMap *infoMap;
 	if (hdr->handle) {
-		auto iter = std::find_if(infoMapHandles_.begin(), infoMapHandles_.end(),
-					 [&](decltype(infoMapHandles_)::value_type &entry) {
-						 return entry.second == hdr->handle;
-					 });
-		if (iter == infoMapHandles_.end()) {
+		auto iter = handleInfoMaps_.find(hdr->handle);
+		if (iter == handleInfoMaps_.end()) {
 			LOG(Serializer, Error)
 				<< "Can't deserialize ControlList: unknown ControlInfoMap";
 			return {};
 		}
 
-		infoMap = iter->first;
+		infoMap = iter->second;
 	} else {
 		infoMap = nullptr;
 	}
@@ -508,7 +579,71 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
  */
 bool ControlSerializer::isCached(const ControlInfoMap &infoMap)
 {
-	return infoMapHandles_.count(&infoMap);
+	return findHandle(infoMap) != 0;
+}
+
+/**
+ * \fn ControlSerializer::statistics()
+ * \brief Retrieve the serialization counters
+ * \return The counters of the data serialized since construction or since the
+ * last call to resetStatistics()
+ */
+
+/**
+ * \fn ControlSerializer::resetStatistics()
+ * \brief Reset the serialization counters
+ */
+
+bool ControlSerializer::equal(const ControlInfoMap &a, const ControlInfoMap &b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (const auto &ctrl : a) {
+		auto it = b.find(ctrl.first);
+		if (it == b.end() || it->second != ctrl.second)
+			return false;
+	}
+
+	return true;
+}
+
+unsigned int ControlSerializer::findHandle(const ControlInfoMap &infoMap)
+{
+	auto iter = infoMapHandles_.find(&infoMap);
+	if (iter != infoMapHandles_.end()) {
+		if (iter->second.generation == infoMap.generation())
+			return iter->second.handle;
+
+		/*
+		 * The map has been destroyed and its address reused by a
+		 * different map, drop the stale association.
+		 */
+		auto handle = handleInfoMaps_.find(iter->second.handle);
+		if (handle != handleInfoMaps_.end() && handle->second == &infoMap)
+			handleInfoMaps_.erase(handle);
+
+		infoMapHandles_.erase(iter);
+	}
+
+	/*
+	 * The map may be a copy of a map we have deserialized, which shares its
+	 * generation, or have the same contents. Only the maps owned by the
+	 * serializer are considered, as the maps serialized by the caller may
+	 * have been destroyed. The association is recorded, so the maps are
+	 * compared once per map only.
+	 */
+	for (const auto &cached : infoMaps_) {
+		const ControlInfoMap &map = cached.second;
+		if (map.generation() != infoMap.generation() &&
+		    !equal(map, infoMap))
+			continue;
+
+		infoMapHandles_[&infoMap] = { cached.first, infoMap.generation() };
+		return cached.first;
+	}
+
+	return 0;
 }
 
 } /* namespace libcamera */
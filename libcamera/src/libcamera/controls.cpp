@@ -7,6 +7,7 @@
 
 #include <libcamera/controls.h>
 
+#include <atomic>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -650,6 +651,7 @@ ControlInfoMap::ControlInfoMap(Map &&info)
 ControlInfoMap &ControlInfoMap::operator=(std::initializer_list<Map::value_type> init)
 {
 	Map::operator=(init);
+	generation_ = nextGeneration();
 	generateIdmap();
 	return *this;
 }
@@ -666,6 +668,7 @@ ControlInfoMap &ControlInfoMap::operator=(std::initializer_list<Map::value_type>
 ControlInfoMap &ControlInfoMap::operator=(Map &&info)
 {
 	Map::operator=(std::move(info));
+	generation_ = nextGeneration();
 	generateIdmap();
 	return *this;
 }
@@ -746,6 +749,26 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
  * \return The ControlId map
  */
 
+/**
+ * \fn uint64_t ControlInfoMap::generation() const
+ * \brief Retrieve the generation of the map contents
+ *
+ * Every ControlInfoMap is assigned a new generation number when it is
+ * constructed and when its contents are replaced. Copies keep the generation
+ * of the map they are copied from. Two maps with the same generation thus have
+ * the same contents, and a map created at the address of a destroyed map can
+ * be told apart from it without comparing their contents.
+ *
+ * \return The generation of the map contents
+ */
+
+uint64_t ControlInfoMap::nextGeneration()
+{
+	static std::atomic<uint64_t> generation{ 0 };
+
+	return ++generation;
+}
+
 void ControlInfoMap::generateIdmap()
 {
 	idmap_.clear();
@@ -10,6 +10,7 @@
 #include <libcamera/controls.h>
 
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_device.h"
 
 /**
@@ -235,6 +236,8 @@ void DelayedControls::applyControls(uint32_t sequence)
 {
 	LOG(DelayedControls, Debug) << "frame " << sequence << " started";
 
+	LIBCAMERA_TRACEPOINT(delayed_controls_apply, sequence, writeCount_);
+
 	if (!running_) {
 		firstSequence_ = sequence;
 		running_ = true;
@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
@@ -31,6 +32,7 @@ int DeviceEnumeratorSysfs::init()
 
 int DeviceEnumeratorSysfs::enumerate()
 {
+	std::vector<std::string> deviceNodes;
 	struct dirent *ent;
 	DIR *dir;
 
@@ -72,7 +74,12 @@ int DeviceEnumeratorSysfs::enumerate()
 			continue;
 		}
 
-		std::unique_ptr<MediaDevice> media = createDevice(devnode);
+		deviceNodes.push_back(devnode);
+	}
+
+	closedir(dir);
+
+	for (std::unique_ptr<MediaDevice> &media : createDevices(deviceNodes)) {
 		if (!media)
 			continue;
 
@@ -87,8 +94,6 @@ int DeviceEnumeratorSysfs::enumerate()
 		addDevice(std::move(media));
 	}
 
-	closedir(dir);
-
 	return 0;
 }
 
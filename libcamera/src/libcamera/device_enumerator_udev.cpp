@@ -16,6 +16,7 @@
 #include <sys/ioctl.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
+#include <vector>
 
 #include "libcamera/internal/event_notifier.h"
 #include "libcamera/internal/log.h"
@@ -80,32 +81,7 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 		if (!media)
 			return -ENODEV;
 
-		DependencyMap deps;
-		int ret = populateMediaDevice(media.get(), &deps);
-		if (ret < 0) {
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to populate media device "
-				<< media->deviceNode()
-				<< " (" << media->driver() << "), skipping";
-			return ret;
-		}
-
-		if (!deps.empty()) {
-			LOG(DeviceEnumerator, Debug)
-				<< "Defer media device " << media->deviceNode()
-				<< " due to " << deps.size()
-				<< " missing dependencies";
-
-			pending_.emplace_back(std::move(media), std::move(deps));
-			MediaDeviceDeps *mediaDeps = &pending_.back();
-			for (const auto &dep : mediaDeps->deps_)
-				devMap_[dep.first] = mediaDeps;
-
-			return 0;
-		}
-
-		addDevice(std::move(media));
-		return 0;
+		return addMediaDevice(std::move(media));
 	}
 
 	if (!strcmp(subsystem, "video4linux")) {
@@ -116,10 +92,44 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 	return -ENODEV;
 }
 
+int DeviceEnumeratorUdev::addMediaDevice(std::unique_ptr<MediaDevice> media)
+{
+	DependencyMap deps;
+	int ret = populateMediaDevice(media.get(), &deps);
+	if (ret < 0) {
+		LOG(DeviceEnumerator, Warning)
+			<< "Failed to populate media device "
+			<< media->deviceNode()
+			<< " (" << media->driver() << "), skipping";
+		return ret;
+	}
+
+	if (!deps.empty()) {
+		LOG(DeviceEnumerator, Debug)
+			<< "Defer media device " << media->deviceNode()
+			<< " due to " << deps.size()
+			<< " missing dependencies";
+
+		pending_.emplace_back(std::move(media), std::move(deps));
+		MediaDeviceDeps *mediaDeps = &pending_.back();
+		for (const auto &dep : mediaDeps->deps_)
+			devMap_[dep.first] = mediaDeps;
+
+		return 0;
+	}
+
+	addDevice(std::move(media));
+	return 0;
+}
+
 int DeviceEnumeratorUdev::enumerate()
 {
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
+	std::vector<struct udev_device *> devices;
+	std::vector<std::string> mediaNodes;
+	std::vector<std::unique_ptr<MediaDevice>> media;
+	std::vector<std::unique_ptr<MediaDevice>>::iterator mediaIt;
 	int ret;
 
 	udev_enum = udev_enumerate_new(udev_);
@@ -146,9 +156,17 @@ int DeviceEnumeratorUdev::enumerate()
 	if (!ents)
 		goto done;
 
+	/*
+	 * Media devices are slow to populate, so first collect all devices,
+	 * create the media devices concurrently, and then add all devices in
+	 * the enumeration order to resolve the dependencies between media
+	 * devices and video device nodes exactly as if they were added one by
+	 * one.
+	 */
 	udev_list_entry_foreach(ent, ents) {
 		struct udev_device *dev;
 		const char *devnode;
+		const char *subsystem;
 		const char *syspath = udev_list_entry_get_name(ent);
 
 		dev = udev_device_new_from_syspath(udev_, syspath);
@@ -168,10 +186,31 @@ int DeviceEnumeratorUdev::enumerate()
 			continue;
 		}
 
-		if (addUdevDevice(dev) < 0)
+		subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media"))
+			mediaNodes.push_back(devnode);
+
+		devices.push_back(dev);
+	}
+
+	media = createDevices(mediaNodes);
+	mediaIt = media.begin();
+
+	for (struct udev_device *dev : devices) {
+		const char *subsystem = udev_device_get_subsystem(dev);
+		int err;
+
+		if (subsystem && !strcmp(subsystem, "media")) {
+			std::unique_ptr<MediaDevice> device = std::move(*mediaIt++);
+			err = device ? addMediaDevice(std::move(device)) : -ENODEV;
+		} else {
+			err = addUdevDevice(dev);
+		}
+
+		if (err < 0)
 			LOG(DeviceEnumerator, Warning)
 				<< "Failed to add device for '"
-				<< syspath << "', skipping";
+				<< udev_device_get_syspath(dev) << "', skipping";
 
 		udev_device_unref(dev);
 	}
@@ -147,27 +147,29 @@ void EventDispatcherPoll::processEvents()
 
 	Thread::current()->dispatchMessages();
 
-	/* Create the pollfd array. */
-	std::vector<struct pollfd> pollfds;
-	pollfds.reserve(notifiers_.size() + 1);
+	/*
+	 * Create the pollfd array. The array is reused to avoid allocating
+	 * memory every time the thread wakes up to process messages.
+	 */
+	pollfds_.clear();
 
 	for (auto notifier : notifiers_)
-		pollfds.push_back({ notifier.first, notifier.second.events(), 0 });
+		pollfds_.push_back({ notifier.first, notifier.second.events(), 0 });
 
-	pollfds.push_back({ eventfd_, POLLIN, 0 });
+	pollfds_.push_back({ eventfd_, POLLIN, 0 });
 
 	/* Wait for events and process notifiers and timers. */
 	do {
-		ret = poll(&pollfds);
+		ret = poll(&pollfds_);
 	} while (ret == -1 && errno == EINTR);
 
 	if (ret < 0) {
 		ret = -errno;
 		LOG(Event, Warning) << "poll() failed with " << strerror(-ret);
 	} else if (ret > 0) {
-		processInterrupt(pollfds.back());
-		pollfds.pop_back();
-		processNotifiers(pollfds);
+		processInterrupt(pollfds_.back());
+		pollfds_.pop_back();
+		processNotifiers(pollfds_);
 	}
 
 	processTimers();
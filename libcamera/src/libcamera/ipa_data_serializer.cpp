@@ -25,6 +25,15 @@ LOG_DEFINE_CATEGORY(IPADataSerializer)
  * Static template class that provides functions for serializing and
  * deserializing IPA data.
  *
+ * Serialization is performed in two passes. The binarySize() function first
+ * computes the size of the serialized data, which allows the caller to
+ * allocate a buffer of the right size, and the serialize() function then
+ * writes the data to the buffer. Nested objects are serialized directly into
+ * the buffer of their container, without intermediate copies.
+ *
+ * Data is serialized in host byte order, as the serialized data is only
+ * exchanged between processes running on the same system.
+ *
  * \todo Switch to Span instead of byte and fd vector
  *
  * \todo Harden the vector and map deserializer
@@ -37,7 +46,7 @@ namespace {
 
 /**
  * \fn template<typename T> void appendPOD(std::vector<uint8_t> &vec, T val)
- * \brief Append POD to end of byte vector, in little-endian order
+ * \brief Append POD to end of byte vector, in host byte order
  * \tparam T Type of POD to append
  * \param[in] vec Byte vector to append to
  * \param[in] val Value to append
@@ -46,10 +55,21 @@ namespace {
  * generated IPA proxies.
  */
 
+/**
+ * \fn template<typename T> void writePOD(ByteStreamBuffer &buffer, T val)
+ * \brief Write POD to a byte stream buffer, in host byte order
+ * \tparam T Type of POD to write
+ * \param[in] buffer Byte stream buffer to write to
+ * \param[in] val Value to write
+ *
+ * This function is meant to be used by the IPA data serializer, and the
+ * generated IPA proxies.
+ */
+
 /**
  * \fn template<typename T> T readPOD(std::vector<uint8_t>::iterator it, size_t pos,
  * 				      std::vector<uint8_t>::iterator end)
- * \brief Read POD from byte vector, in little-endian order
+ * \brief Read POD from byte vector, in host byte order
  * \tparam T Type of POD to read
  * \param[in] it Iterator of byte vector to read from
  * \param[in] pos Index in byte vector to read from
@@ -67,7 +87,7 @@ namespace {
 
 /**
  * \fn template<typename T> T readPOD(std::vector<uint8_t> &vec, size_t pos)
- * \brief Read POD from byte vector, in little-endian order
+ * \brief Read POD from byte vector, in host byte order
  * \tparam T Type of POD to read
  * \param[in] vec Byte vector to read from
  * \param[in] pos Index in vec to start reading from
@@ -82,11 +102,86 @@ namespace {
  * \return The POD read from \a vec at index \a pos
  */
 
+/**
+ * \fn template<typename T> int serializeElement(const T &data,
+ * 	ByteStreamBuffer &buffer, std::vector<int32_t> &fds,
+ * 	ControlSerializer *cs)
+ * \brief Serialize a container element along with its sizes
+ * \tparam T Type of the element to serialize
+ * \param[in] data Element to serialize
+ * \param[in] buffer Byte stream buffer to write to
+ * \param[inout] fds Fd vector to append the element's file descriptors to
+ * \param[in] cs ControlSerializer
+ *
+ * This function writes the size of the serialized element in bytes and its
+ * number of file descriptors, both as uint32_t, followed by the serialized
+ * element. The sizes are written once the element has been serialized.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+
+/**
+ * \fn template<typename T> serializeToVector(const T &data, ControlSerializer *cs)
+ * \brief Serialize an object into newly allocated byte vector and fd vector
+ * \tparam T Type of object to serialize
+ * \param[in] data Object to serialize
+ * \param[in] cs ControlSerializer
+ *
+ * This function implements the vector-based IPADataSerializer::serialize()
+ * on top of IPADataSerializer::binarySize() and the buffer-based
+ * IPADataSerializer::serialize(), with a single allocation for the data.
+ *
+ * \return Tuple of byte vector and fd vector, that is the serialized form
+ * of \a data
+ */
+
 } /* namespace */
 
+/**
+ * \fn template<typename T> IPADataSerializer<T>::binarySize(
+ * 	const T &data,
+ * 	ControlSerializer *cs = nullptr)
+ * \brief Compute the size of the serialized form of an object
+ * \tparam T Type of object to serialize
+ * \param[in] data Object to serialize
+ * \param[in] cs ControlSerializer
+ *
+ * The size is an upper bound: the ControlInfoMap associated with a ControlList
+ * is accounted for if it hasn't been serialized with \a cs yet, even if the
+ * object contains it multiple times and it will thus only be serialized once.
+ *
+ * \a cs is only necessary if the object type \a T or its members contain
+ * ControlList or ControlInfoMap.
+ *
+ * \return The size of the serialized data in bytes
+ */
+
+/**
+ * \fn template<typename T> IPADataSerializer<T>::serialize(
+ * 	const T &data,
+ * 	ByteStreamBuffer &buffer,
+ * 	std::vector<int32_t> &fds,
+ * 	ControlSerializer *cs = nullptr)
+ * \brief Serialize an object into a byte stream buffer and fd vector
+ * \tparam T Type of object to serialize
+ * \param[in] data Object to serialize
+ * \param[in] buffer Byte stream buffer to write the serialized data to
+ * \param[inout] fds Fd vector to append the file descriptors to
+ * \param[in] cs ControlSerializer
+ *
+ * The \a buffer shall have at least binarySize() bytes available. This
+ * function allows serializing multiple objects into a single buffer provided
+ * by the caller, possibly reused across messages.
+ *
+ * \a cs is only necessary if the object type \a T or its members contain
+ * ControlList or ControlInfoMap.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+
 /**
  * \fn template<typename T> IPADataSerializer<T>::serialize(
- * 	T data,
+ * 	const T &data,
  * 	ControlSerializer *cs = nullptr)
  * \brief Serialize an object into byte vector and fd vector
  * \tparam T Type of object to serialize
@@ -187,15 +282,19 @@ namespace {
 #define DEFINE_POD_SERIALIZER(type)					\
 									\
 template<>								\
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>			\
-IPADataSerializer<type>::serialize(const type &data,			\
-				  [[maybe_unused]] ControlSerializer *cs) \
+size_t IPADataSerializer<type>::binarySize([[maybe_unused]] const type &data, \
+					   [[maybe_unused]] ControlSerializer *cs) \
 {									\
-	std::vector<uint8_t> dataVec;					\
-	dataVec.reserve(sizeof(type));					\
-	appendPOD<type>(dataVec, data);					\
+	return sizeof(type);						\
+}									\
 									\
-	return { dataVec, {} };						\
+template<>								\
+int IPADataSerializer<type>::serialize(const type &data,		\
+				       ByteStreamBuffer &buffer,	\
+				       [[maybe_unused]] std::vector<int32_t> &fds, \
+				       [[maybe_unused]] ControlSerializer *cs) \
+{									\
+	return buffer.write(&data);					\
 }									\
 									\
 template<>								\
@@ -249,11 +348,22 @@ DEFINE_POD_SERIALIZER(double)
  * function parameter serdes).
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-IPADataSerializer<std::string>::serialize(const std::string &data,
-					  [[maybe_unused]] ControlSerializer *cs)
+size_t IPADataSerializer<std::string>::binarySize(const std::string &data,
+						  [[maybe_unused]] ControlSerializer *cs)
+{
+	return data.size();
+}
+
+template<>
+int IPADataSerializer<std::string>::serialize(const std::string &data,
+					      ByteStreamBuffer &buffer,
+					      [[maybe_unused]] std::vector<int32_t> &fds,
+					      [[maybe_unused]] ControlSerializer *cs)
 {
-	return { { data.cbegin(), data.end() }, {} };
+	if (data.empty())
+		return 0;
+
+	return buffer.write(Span<const char>(data.data(), data.size()));
 }
 
 template<>
@@ -305,51 +415,62 @@ IPADataSerializer<std::string>::deserialize(std::vector<uint8_t>::const_iterator
  * be used. The serialized ControlInfoMap will have zero length.
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerializer *cs)
+size_t IPADataSerializer<ControlList>::binarySize(const ControlList &data,
+						  ControlSerializer *cs)
+{
+	if (!cs)
+		LOG(IPADataSerializer, Fatal)
+			<< "ControlSerializer not provided for serialization of ControlList";
+
+	size_t size = 8 + cs->binarySize(data);
+	if (data.infoMap() && !cs->isCached(*data.infoMap()))
+		size += cs->binarySize(*data.infoMap());
+
+	return size;
+}
+
+template<>
+int IPADataSerializer<ControlList>::serialize(const ControlList &data,
+					      ByteStreamBuffer &buffer,
+					      [[maybe_unused]] std::vector<int32_t> &fds,
+					      ControlSerializer *cs)
 {
 	if (!cs)
 		LOG(IPADataSerializer, Fatal)
 			<< "ControlSerializer not provided for serialization of ControlList";
 
-	size_t size;
-	std::vector<uint8_t> infoData;
+	ByteStreamBuffer sizes = buffer.carveOut(8);
+	size_t infoSize = 0;
 	int ret;
 
 	/*
-	 * \todo Revisit this opportunistic serialization of the
-	 * ControlInfoMap, as it could be fragile
+	 * The ControlInfoMap is sent along with the first ControlList that
+	 * refers to it, subsequent lists carry its handle only.
 	 */
 	if (data.infoMap() && !cs->isCached(*data.infoMap())) {
-		size = cs->binarySize(*data.infoMap());
-		infoData.resize(size);
-		ByteStreamBuffer buffer(infoData.data(), infoData.size());
-		ret = cs->serialize(*data.infoMap(), buffer);
+		infoSize = cs->binarySize(*data.infoMap());
+		ByteStreamBuffer infoData = buffer.carveOut(infoSize);
+		ret = cs->serialize(*data.infoMap(), infoData);
 
-		if (ret < 0 || buffer.overflow()) {
+		if (ret < 0 || infoData.overflow()) {
 			LOG(IPADataSerializer, Error) << "Failed to serialize ControlList's ControlInfoMap";
-			return { {}, {} };
+			return ret < 0 ? ret : -ENOSPC;
 		}
 	}
 
-	size = cs->binarySize(data);
-	std::vector<uint8_t> listData(size);
-	ByteStreamBuffer buffer(listData.data(), listData.size());
-	ret = cs->serialize(data, buffer);
+	size_t listSize = cs->binarySize(data);
+	ByteStreamBuffer listData = buffer.carveOut(listSize);
+	ret = cs->serialize(data, listData);
 
-	if (ret < 0 || buffer.overflow()) {
+	if (ret < 0 || listData.overflow()) {
 		LOG(IPADataSerializer, Error) << "Failed to serialize ControlList";
-		return { {}, {} };
+		return ret < 0 ? ret : -ENOSPC;
 	}
 
-	std::vector<uint8_t> dataVec;
-	dataVec.reserve(8 + infoData.size() + listData.size());
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	appendPOD<uint32_t>(dataVec, listData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
-	dataVec.insert(dataVec.end(), listData.begin(), listData.end());
+	writePOD<uint32_t>(sizes, infoSize);
+	writePOD<uint32_t>(sizes, listSize);
 
-	return { dataVec, {} };
+	return buffer.overflow() ? -ENOSPC : 0;
 }
 
 template<>
@@ -429,29 +550,45 @@ IPADataSerializer<ControlList>::deserialize(std::vector<uint8_t>::const_iterator
  * X bytes - Serialized ControlInfoMap (using ControlSerializer)
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
-					     ControlSerializer *cs)
+size_t IPADataSerializer<ControlInfoMap>::binarySize(const ControlInfoMap &map,
+						     ControlSerializer *cs)
+{
+	if (!cs)
+		LOG(IPADataSerializer, Fatal)
+			<< "ControlSerializer not provided for serialization of ControlInfoMap";
+
+	return 4 + cs->binarySize(map);
+}
+
+template<>
+int IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
+						 ByteStreamBuffer &buffer,
+						 [[maybe_unused]] std::vector<int32_t> &fds,
+						 ControlSerializer *cs)
 {
 	if (!cs)
 		LOG(IPADataSerializer, Fatal)
 			<< "ControlSerializer not provided for serialization of ControlInfoMap";
 
 	size_t size = cs->binarySize(map);
-	std::vector<uint8_t> infoData(size);
-	ByteStreamBuffer buffer(infoData.data(), infoData.size());
-	int ret = cs->serialize(map, buffer);
+	writePOD<uint32_t>(buffer, size);
+
+	ByteStreamBuffer infoData = buffer.carveOut(size);
+	int ret = cs->serialize(map, infoData);
 
-	if (ret < 0 || buffer.overflow()) {
+	if (ret < 0 || infoData.overflow()) {
 		LOG(IPADataSerializer, Error) << "Failed to serialize ControlInfoMap";
-		return { {}, {} };
+		return ret < 0 ? ret : -ENOSPC;
 	}
 
-	std::vector<uint8_t> dataVec;
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
+	/*
+	 * The ControlSerializer skips maps that it has already serialized,
+	 * zero the data in that case.
+	 */
+	if (infoData.offset() < size)
+		infoData.skip(size - infoData.offset());
 
-	return { dataVec, {} };
+	return 0;
 }
 
 template<>
@@ -522,16 +659,27 @@ IPADataSerializer<ControlInfoMap>::deserialize(std::vector<uint8_t>::const_itera
  * 32-bit alignment of all serialized data
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-IPADataSerializer<FileDescriptor>::serialize(const FileDescriptor &data,
-					     [[maybe_unused]] ControlSerializer *cs)
+size_t IPADataSerializer<FileDescriptor>::binarySize([[maybe_unused]] const FileDescriptor &data,
+						     [[maybe_unused]] ControlSerializer *cs)
 {
-	std::vector<uint8_t> dataVec = { data.isValid() };
-	std::vector<int32_t> fdVec;
-	if (data.isValid())
-		fdVec.push_back(data.fd());
+	return 1;
+}
+
+template<>
+int IPADataSerializer<FileDescriptor>::serialize(const FileDescriptor &data,
+						 ByteStreamBuffer &buffer,
+						 std::vector<int32_t> &fds,
+						 [[maybe_unused]] ControlSerializer *cs)
+{
+	uint8_t valid = data.isValid();
+	int ret = buffer.write(&valid);
+	if (ret < 0)
+		return ret;
+
+	if (valid)
+		fds.push_back(data.fd());
 
-	return { dataVec, fdVec };
+	return 0;
 }
 
 template<>
@@ -565,23 +713,23 @@ FileDescriptor IPADataSerializer<FileDescriptor>::deserialize(const std::vector<
  * 4 bytes - uint32_t Length
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<int32_t>>
-IPADataSerializer<FrameBuffer::Plane>::serialize(const FrameBuffer::Plane &data,
-						 [[maybe_unused]] ControlSerializer *cs)
+size_t IPADataSerializer<FrameBuffer::Plane>::binarySize([[maybe_unused]] const FrameBuffer::Plane &data,
+							 [[maybe_unused]] ControlSerializer *cs)
 {
-	std::vector<uint8_t> dataVec;
-	std::vector<int32_t> fdsVec;
-
-	std::vector<uint8_t> fdBuf;
-	std::vector<int32_t> fdFds;
-	std::tie(fdBuf, fdFds) =
-		IPADataSerializer<FileDescriptor>::serialize(data.fd);
-	dataVec.insert(dataVec.end(), fdBuf.begin(), fdBuf.end());
-	fdsVec.insert(fdsVec.end(), fdFds.begin(), fdFds.end());
+	return 5;
+}
 
-	appendPOD<uint32_t>(dataVec, data.length);
+template<>
+int IPADataSerializer<FrameBuffer::Plane>::serialize(const FrameBuffer::Plane &data,
+						     ByteStreamBuffer &buffer,
+						     std::vector<int32_t> &fds,
+						     [[maybe_unused]] ControlSerializer *cs)
+{
+	int ret = IPADataSerializer<FileDescriptor>::serialize(data.fd, buffer, fds);
+	if (ret < 0)
+		return ret;
 
-	return { dataVec, fdsVec };
+	return IPADataSerializer<uint32_t>::serialize(data.length, buffer, fds);
 }
 
 template<>
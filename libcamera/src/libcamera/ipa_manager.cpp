@@ -9,7 +9,11 @@
 
 #include <algorithm>
 #include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include "libcamera/internal/file.h"
@@ -88,6 +92,17 @@ LOG_DEFINE_CATEGORY(IPAManager)
  * returned to the pipeline handler, and all interactions with the IPA context
  * go the same interface regardless of process isolation.
  *
+ * Modules are discovered the first time a pipeline handler creates an IPA
+ * context, and only the module that matches the pipeline handler is opened and
+ * has its signature verified. To avoid opening every module to find the
+ * matching one, the manager keeps an index of the module information, keyed by
+ * the path, modification time and size of the modules, in the file given by
+ * the LIBCAMERA_IPA_MODULE_INDEX environment variable. The index is disabled
+ * by default, as are the other caches of libcamera, and all modules are then
+ * opened at the first discovery. The index is only a hint: a module found through the
+ * index is still validated before being used, and the modules are all opened
+ * again if none matches. Signature verification results are never stored.
+ *
  * In all cases the data passed to the IPAInterface methods is serialized to
  * Plain Old Data, either for the purpose of passing it to the IPA context
  * plain C API, or to transmit the data to the isolated process through IPC.
@@ -102,11 +117,40 @@ IPAManager *IPAManager::self_ = nullptr;
  * CameraManager.
  */
 IPAManager::IPAManager()
+	: scanned_(false), indexDirty_(false)
 {
 	if (self_)
 		LOG(IPAManager, Fatal)
 			<< "Multiple IPAManager objects are not allowed";
 
+	self_ = this;
+}
+
+IPAManager::~IPAManager()
+{
+	self_ = nullptr;
+}
+
+/**
+ * \brief Discover the IPA modules in the search path
+ *
+ * The IPA modules are searched for in the directories listed in the
+ * LIBCAMERA_IPA_MODULE_PATH environment variable, in the build directory when
+ * libcamera is used before being installed, and in the system path. The
+ * modules are identified from the index when it has an up to date entry for
+ * them, and opened otherwise.
+ */
+void IPAManager::scanModules()
+{
+	if (scanned_)
+		return;
+
+	scanned_ = true;
+
+	utils::time_point start = utils::clock::now();
+
+	loadIndex();
+
 	unsigned int ipaCount = 0;
 
 	/* User-specified paths take precedence. */
@@ -147,15 +191,22 @@ IPAManager::IPAManager()
 		LOG(IPAManager, Warning)
 			<< "No IPA found in '" IPA_MODULE_DIR "'";
 
-	self_ = this;
-}
+	/* Drop the entries of the shared objects that have gone away. */
+	for (const auto &it : index_) {
+		if (!it.second.verified)
+			indexDirty_ = true;
+	}
+	index_.clear();
 
-IPAManager::~IPAManager()
-{
-	for (IPAModule *module : modules_)
-		delete module;
+	if (indexDirty_) {
+		saveIndex();
+		indexDirty_ = false;
+	}
 
-	self_ = nullptr;
+	std::chrono::duration<double, std::milli> elapsed = utils::clock::now() - start;
+	LOG(IPAManager, Debug)
+		<< "Found " << ipaCount << " IPA modules in "
+		<< elapsed.count() << " ms";
 }
 
 /**
@@ -229,21 +280,248 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
 
 	unsigned int count = 0;
 	for (const std::string &file : files) {
-		IPAModule *ipaModule = new IPAModule(file);
-		if (!ipaModule->isValid()) {
-			delete ipaModule;
+		struct stat st;
+		if (stat(file.c_str(), &st) < 0)
 			continue;
+
+		ModuleEntry entry{};
+		entry.path = file;
+		entry.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+			      st.st_mtim.tv_nsec;
+		entry.size = st.st_size;
+
+		/*
+		 * The verified flag of the index entries records which shared
+		 * objects are still present.
+		 */
+		auto iter = index_.find(file);
+		if (iter != index_.end() && iter->second.mtime == entry.mtime &&
+		    iter->second.size == entry.size) {
+			entry.valid = iter->second.valid;
+			entry.info = iter->second.info;
+			iter->second.verified = true;
+		} else {
+			verifyModule(entry);
+			indexDirty_ = true;
 		}
 
-		LOG(IPAManager, Debug) << "Loaded IPA module '" << file << "'";
+		if (entry.valid) {
+			LOG(IPAManager, Debug) << "Found IPA module '" << file << "'";
+			count++;
+		}
 
-		modules_.push_back(ipaModule);
-		count++;
+		modules_.push_back(std::move(entry));
 	}
 
 	return count;
 }
 
+/**
+ * \brief Open the IPA module of an entry and update the entry from the module
+ * \param[in] entry The entry of the module
+ *
+ * A valid module is kept open in the entry, to avoid opening it again when it
+ * gets used.
+ *
+ * \return True if the entry has changed, false otherwise
+ */
+bool IPAManager::verifyModule(ModuleEntry &entry)
+{
+	std::unique_ptr<IPAModule> module = std::make_unique<IPAModule>(entry.path);
+	bool valid = module->isValid();
+
+	bool changed = valid != entry.valid ||
+		       (valid && (module->info().pipelineVersion != entry.info.pipelineVersion ||
+				  strcmp(module->info().pipelineName, entry.info.pipelineName) ||
+				  strcmp(module->info().name, entry.info.name)));
+
+	entry.verified = true;
+	entry.valid = valid;
+	if (valid) {
+		entry.info = module->info();
+		entry.module = std::move(module);
+	} else {
+		entry.module.reset();
+	}
+
+	return changed;
+}
+
+/**
+ * \brief Load the IPA module index
+ *
+ * Invalid or outdated entries, and indexes written by another version of the
+ * IPA module API, are ignored.
+ */
+void IPAManager::loadIndex()
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_IPA_MODULE_INDEX");
+	if (path)
+		indexPath_ = path;
+
+	if (indexPath_.empty())
+		return;
+
+	std::ifstream file(indexPath_);
+	std::string line;
+	if (!std::getline(file, line) ||
+	    line != "libcamera-ipa-module-index " + std::to_string(IPA_MODULE_API_VERSION))
+		return;
+
+	/*
+	 * Each line holds the modification time, size, validity, pipeline
+	 * version, pipeline name, module name and path of a module, separated
+	 * by tabs.
+	 */
+	while (std::getline(file, line)) {
+		std::vector<std::string> fields;
+		for (const auto &field : utils::split(line, "\t"))
+			fields.push_back(field);
+		if (fields.size() != 7)
+			continue;
+
+		ModuleEntry entry{};
+		entry.path = fields[6];
+		entry.mtime = strtoll(fields[0].c_str(), nullptr, 10);
+		entry.size = strtoll(fields[1].c_str(), nullptr, 10);
+		entry.valid = fields[2] == "1";
+
+		if (entry.valid) {
+			if (fields[4].size() >= sizeof(entry.info.pipelineName) ||
+			    fields[5].size() >= sizeof(entry.info.name))
+				continue;
+
+			entry.info.moduleAPIVersion = IPA_MODULE_API_VERSION;
+			entry.info.pipelineVersion = strtoul(fields[3].c_str(), nullptr, 10);
+			strcpy(entry.info.pipelineName, fields[4].c_str());
+			strcpy(entry.info.name, fields[5].c_str());
+		}
+
+		index_[entry.path] = std::move(entry);
+	}
+}
+
+/**
+ * \brief Store the IPA module index
+ *
+ * The index is written to a temporary file first, and moved in place, so that
+ * concurrent readers never see a partial index. Failures to store the index
+ * are not fatal.
+ */
+void IPAManager::saveIndex() const
+{
+	if (indexPath_.empty())
+		return;
+
+	std::ostringstream index;
+	index << "libcamera-ipa-module-index " << IPA_MODULE_API_VERSION << "\n";
+
+	/* Shared objects that aren't IPA modules are indexed too. */
+	for (const ModuleEntry &entry : modules_) {
+		std::string name;
+		std::string pipelineName;
+		if (entry.valid) {
+			name = entry.info.name;
+			pipelineName = entry.info.pipelineName;
+		}
+
+		/* Skip the entries that the index format can't store. */
+		std::string fields = pipelineName + name + entry.path;
+		if (fields.find_first_of("\t\n") != std::string::npos)
+			continue;
+
+		index << entry.mtime << "\t" << entry.size << "\t"
+		      << entry.valid << "\t"
+		      << (entry.valid ? entry.info.pipelineVersion : 0) << "\t"
+		      << pipelineName << "\t" << name << "\t" << entry.path
+		      << "\n";
+	}
+
+	utils::mkdirs(utils::dirname(indexPath_));
+
+	int ret = utils::write_file_atomic(indexPath_, index.str());
+	if (ret < 0)
+		LOG(IPAManager, Warning)
+			<< "Failed to write IPA module index " << indexPath_
+			<< ": " << strerror(-ret);
+}
+
+/**
+ * \brief Find the first IPA module that matches a pipeline handler
+ * \param[in] pipe The pipeline handler
+ * \param[in] minVersion Minimum acceptable version of IPA module
+ * \param[in] maxVersion Maximum acceptable version of IPA module
+ *
+ * The modules that match the pipeline handler according to the index are
+ * opened and validated, in search path order, until one is found to really
+ * match.
+ *
+ * \return The IPA module, or nullptr if no module matches
+ */
+IPAModule *IPAManager::findModule(PipelineHandler *pipe, uint32_t minVersion,
+				  uint32_t maxVersion)
+{
+	for (ModuleEntry &entry : modules_) {
+		if (!entry.valid ||
+		    entry.info.pipelineVersion < minVersion ||
+		    entry.info.pipelineVersion > maxVersion ||
+		    strcmp(entry.info.pipelineName, pipe->name()))
+			continue;
+
+		if (!entry.verified) {
+			if (verifyModule(entry))
+				indexDirty_ = true;
+			if (!entry.valid ||
+			    !entry.module->match(pipe, minVersion, maxVersion))
+				continue;
+		}
+
+		return entry.module.get();
+	}
+
+	return nullptr;
+}
+
+/**
+ * \brief Retrieve the IPA module for a pipeline handler
+ * \param[in] pipe The pipeline handler
+ * \param[in] minVersion Minimum acceptable version of IPA module
+ * \param[in] maxVersion Maximum acceptable version of IPA module
+ *
+ * The IPA modules are discovered on the first call. When no module matches
+ * the pipeline handler, the modules that have only been checked against the
+ * index are opened, in case the index was wrong, and the search is repeated.
+ *
+ * \return The IPA module, or nullptr if no module matches
+ */
+IPAModule *IPAManager::module(PipelineHandler *pipe, uint32_t minVersion,
+			      uint32_t maxVersion)
+{
+	scanModules();
+
+	IPAModule *m = findModule(pipe, minVersion, maxVersion);
+	if (!m) {
+		bool verified = false;
+		for (ModuleEntry &entry : modules_) {
+			if (!entry.verified) {
+				if (verifyModule(entry))
+					indexDirty_ = true;
+				verified = true;
+			}
+		}
+
+		if (verified)
+			m = findModule(pipe, minVersion, maxVersion);
+	}
+
+	if (indexDirty_) {
+		saveIndex();
+		indexDirty_ = false;
+	}
+
+	return m;
+}
+
 /**
  * \fn IPAManager::createIPA()
  * \brief Create an IPA proxy that matches a given pipeline handler
@@ -255,9 +533,17 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
  * found or if the IPA proxy fails to initialize
  */
 
-bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
+bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa)
 {
 #if HAVE_IPA_PUBKEY
+	/* Verifying the signature is expensive, do it once per module. */
+	auto iter = signatures_.find(ipa);
+	if (iter != signatures_.end())
+		return iter->second;
+
+	bool &valid = signatures_[ipa];
+	valid = false;
+
 	File file{ ipa->path() };
 	if (!file.open(File::ReadOnly))
 		return false;
@@ -266,7 +552,7 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 	if (data.empty())
 		return false;
 
-	bool valid = pubKey_.verify(data, ipa->signature());
+	valid = pubKey_.verify(data, ipa->signature());
 
 	LOG(IPAManager, Debug)
 		<< "IPA module " << ipa->path() << " signature is "
@@ -7,7 +7,12 @@
 
 #include "libcamera/internal/ipc_pipe.h"
 
+#include <string.h>
+
+#include "libcamera/internal/ipc_pipe_shared_memory.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
 
 /**
  * \file ipc_pipe.h
@@ -215,4 +220,36 @@ IPCPipe::~IPCPipe()
  * connection.
  */
 
+/**
+ * \brief Create an IPC pipe to an isolated IPA module
+ * \param[in] ipaModulePath Path to the IPA module shared object
+ * \param[in] ipaProxyWorkerPath Path to the IPA proxy worker executable
+ *
+ * The IPC pipe starts the proxy worker, which loads the IPA module, and
+ * transports the messages to it over a Unix socket by default. Setting the
+ * LIBCAMERA_IPA_IPC_TRANSPORT environment variable to "sharedmemory" selects
+ * the shared memory transport instead, while other values fall back to the
+ * Unix socket with a warning.
+ *
+ * \return The IPC pipe, which isn't connected if the proxy worker failed to
+ * start
+ */
+std::unique_ptr<IPCPipe> createIPCPipe(const char *ipaModulePath,
+				       const char *ipaProxyWorkerPath)
+{
+	const char *transport = utils::secure_getenv("LIBCAMERA_IPA_IPC_TRANSPORT");
+
+	if (transport && !strcmp(transport, IPCPipeSharedMemory::name()))
+		return std::make_unique<IPCPipeSharedMemory>(ipaModulePath,
+							     ipaProxyWorkerPath);
+
+	if (transport && strcmp(transport, IPCPipeUnixSocket::name()))
+		LOG(IPCPipe, Warning)
+			<< "Unknown IPC transport '" << transport
+			<< "', using " << IPCPipeUnixSocket::name();
+
+	return std::make_unique<IPCPipeUnixSocket>(ipaModulePath,
+						   ipaProxyWorkerPath);
+}
+
 } /* namespace libcamera */
@@ -2,16 +2,16 @@
 /*
  * Copyright (C) 2020, Google Inc.
  *
- * ipc_pipe_unixsocket.cpp - Image Processing Algorithm IPC module using unix socket
+ * ipc_pipe_transport.cpp - Image Processing Algorithm IPC module over a transport
  */
 
-#include "libcamera/internal/ipc_pipe_unixsocket.h"
+#include "libcamera/internal/ipc_pipe_transport.h"
 
 #include <vector>
 
 #include "libcamera/internal/event_dispatcher.h"
-#include "libcamera/internal/ipc_pipe.h"
-#include "libcamera/internal/ipc_unixsocket.h"
+#include "libcamera/internal/ipc_pipe_shared_memory.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/process.h"
 #include "libcamera/internal/thread.h"
@@ -21,22 +21,41 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(IPCPipe)
 
-IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
-				     const char *ipaProxyWorkerPath)
+/*
+ * The name of the transport is passed to the proxy worker in argv[3], to
+ * create the matching endpoint.
+ */
+template<>
+const char *IPCPipeTransport<IPCUnixSocket>::name()
+{
+	return "unixsocket";
+}
+
+template<>
+const char *IPCPipeTransport<IPCSharedMemory>::name()
+{
+	return "sharedmemory";
+}
+
+template<typename Transport>
+IPCPipeTransport<Transport>::IPCPipeTransport(const char *ipaModulePath,
+					      const char *ipaProxyWorkerPath)
 	: IPCPipe()
 {
 	std::vector<int> fds;
 	std::vector<std::string> args;
 	args.push_back(ipaModulePath);
 
-	socket_ = std::make_unique<IPCUnixSocket>();
-	int fd = socket_->create();
+	transport_ = std::make_unique<Transport>();
+	int fd = transport_->create();
 	if (fd < 0) {
-		LOG(IPCPipe, Error) << "Failed to create socket";
+		LOG(IPCPipe, Error)
+			<< "Failed to create " << name() << " transport";
 		return;
 	}
-	socket_->readyRead.connect(this, &IPCPipeUnixSocket::readyRead);
+	transport_->readyRead.connect(this, &IPCPipeTransport::readyRead);
 	args.push_back(std::to_string(fd));
+	args.push_back(name());
 	fds.push_back(fd);
 
 	proc_ = std::make_unique<Process>();
@@ -50,13 +69,15 @@ IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
 	connected_ = true;
 }
 
-IPCPipeUnixSocket::~IPCPipeUnixSocket()
+template<typename Transport>
+IPCPipeTransport<Transport>::~IPCPipeTransport()
 {
 }
 
-int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
+template<typename Transport>
+int IPCPipeTransport<Transport>::sendSync(const IPCMessage &in, IPCMessage *out)
 {
-	IPCUnixSocket::Payload response;
+	typename Transport::Payload response;
 
 	int ret = call(in.payload(), &response, in.header().cookie);
 	if (ret) {
@@ -70,9 +91,10 @@ int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
 	return 0;
 }
 
-int IPCPipeUnixSocket::sendAsync(const IPCMessage &data)
+template<typename Transport>
+int IPCPipeTransport<Transport>::sendAsync(const IPCMessage &data)
 {
-	int ret = socket_->send(data.payload());
+	int ret = transport_->send(data.payload());
 	if (ret) {
 		LOG(IPCPipe, Error) << "Failed to call async";
 		return ret;
@@ -81,10 +103,11 @@ int IPCPipeUnixSocket::sendAsync(const IPCMessage &data)
 	return 0;
 }
 
-void IPCPipeUnixSocket::readyRead(IPCUnixSocket *socket)
+template<typename Transport>
+void IPCPipeTransport<Transport>::readyRead(Transport *transport)
 {
-	IPCUnixSocket::Payload payload;
-	int ret = socket->receive(&payload);
+	typename Transport::Payload payload;
+	int ret = transport->receive(&payload);
 	if (ret) {
 		LOG(IPCPipe, Error) << "Receive message failed" << ret;
 		return;
@@ -109,8 +132,10 @@ void IPCPipeUnixSocket::readyRead(IPCUnixSocket *socket)
 	recv.emit(ipcMessage);
 }
 
-int IPCPipeUnixSocket::call(const IPCUnixSocket::Payload &message,
-			    IPCUnixSocket::Payload *response, uint32_t cookie)
+template<typename Transport>
+int IPCPipeTransport<Transport>::call(const typename Transport::Payload &message,
+				      typename Transport::Payload *response,
+				      uint32_t cookie)
 {
 	Timer timeout;
 	int ret;
@@ -118,7 +143,7 @@ int IPCPipeUnixSocket::call(const IPCUnixSocket::Payload &message,
 	const auto result = callData_.insert({ cookie, { response, false } });
 	const auto &iter = result.first;
 
-	ret = socket_->send(message);
+	ret = transport_->send(message);
 	if (ret) {
 		callData_.erase(iter);
 		return ret;
@@ -141,4 +166,7 @@ int IPCPipeUnixSocket::call(const IPCUnixSocket::Payload &message,
 	return 0;
 }
 
+template class IPCPipeTransport<IPCUnixSocket>;
+template class IPCPipeTransport<IPCSharedMemory>;
+
 } /* namespace libcamera */
@@ -0,0 +1,794 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipc_shared_memory.cpp - IPC mechanism based on shared memory rings
+ */
+
+#include "libcamera/internal/ipc_shared_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "libcamera/internal/event_notifier.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+
+/**
+ * \file ipc_shared_memory.h
+ * \brief IPC mechanism based on shared memory rings
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPCSharedMemory)
+
+namespace {
+
+constexpr uint32_t handshakeMagic = 0x6c637368; /* "lcsh" */
+constexpr unsigned int maxFds = 253; /* SCM_MAX_FD */
+
+/* Time to wait for the handshake message when binding, in milliseconds. */
+constexpr int handshakeTimeout = 1000;
+
+struct Handshake {
+	uint32_t magic;
+	uint32_t ringSize;
+};
+
+struct EntryHeader {
+	uint32_t seq;
+	uint32_t size;
+};
+
+struct SocketHeader {
+	uint32_t seq;
+	uint32_t fds;
+};
+
+uint32_t entryLength(uint32_t size)
+{
+	return sizeof(EntryHeader) + utils::alignUp(size, sizeof(EntryHeader));
+}
+
+} /* namespace */
+
+/*
+ * Each ring is a single-producer single-consumer byte ring. The producer owns
+ * the head index and the consumer the tail index. Both indices increase
+ * monotonically and wrap naturally, the position in the ring is obtained by
+ * masking them with the ring size.
+ */
+struct IPCSharedMemory::Ring {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+};
+
+struct IPCSharedMemory::SharedArea {
+	Ring rings[2];
+};
+
+/**
+ * \class IPCSharedMemory
+ * \brief IPC mechanism based on shared memory rings
+ *
+ * The shared memory IPC allows bidirectional communication between two
+ * processes with the same semantics as the IPCUnixSocket, but transports
+ * payloads through a pair of ring buffers stored in a memfd shared between the
+ * two processes. The receiving side is woken up through an eventfd. Compared
+ * to Unix sockets, this avoids copying the payload data through the kernel and
+ * the syscalls needed to transport it, which benefits the large control lists
+ * and parameter buffers exchanged by IPA modules on every frame.
+ *
+ * A Unix socket is still used alongside the rings. It transports payloads that
+ * carry file descriptors, as those can only be passed through the kernel, as
+ * well as payloads that don't fit in the free space of the ring. All payloads
+ * are tagged with a sequence number, and the receiving side merges the two
+ * streams to guarantee ordering.
+ *
+ * As for the IPCUnixSocket, establishment of an IPC channel is asymmetrical.
+ * The side that initiates communication creates the channel with create(),
+ * which returns a file descriptor to be passed to the remote process. The
+ * remote side then binds to the channel by passing the file descriptor to
+ * bind(). The shared memory and eventfds are transferred over the socket when
+ * binding. The memfd is sealed to prevent the remote side from resizing it.
+ *
+ * The IPC design is asynchronous, a message is queued to a receiver which gets
+ * notified that a message is ready to be consumed by the \ref readyRead
+ * signal. The signal is emitted once per available message, and the receiver
+ * shall consume the message with receive() from the signal handler.
+ *
+ * \context This class is \threadbound.
+ */
+
+/**
+ * \typedef IPCSharedMemory::Payload
+ * \brief Container for an IPC payload
+ */
+
+/**
+ * \var IPCSharedMemory::defaultRingSize
+ * \brief The default size of each ring in bytes
+ */
+
+/**
+ * \brief Construct an IPC channel endpoint
+ * \param[in] ringSize The size of each ring in bytes, rounded up to a power of
+ * two
+ *
+ * The \a ringSize is only used by the side that creates the channel, the side
+ * that binds to it uses the size selected by the creator.
+ */
+IPCSharedMemory::IPCSharedMemory(size_t ringSize)
+	: ringSize_(4096), fd_(-1), eventfdTx_(-1), eventfdRx_(-1),
+	  area_(nullptr), areaSize_(0), tx_(nullptr), rx_(nullptr),
+	  txData_(nullptr), rxData_(nullptr), sendSeq_(0), recvSeq_(0),
+	  pendingValid_(false), pendingSeq_(0), error_(0),
+	  eventNotifier_(nullptr), socketNotifier_(nullptr)
+{
+	while (ringSize_ < ringSize)
+		ringSize_ <<= 1;
+}
+
+IPCSharedMemory::~IPCSharedMemory()
+{
+	close();
+}
+
+/**
+ * \brief Create an new IPC channel
+ *
+ * This method creates a new IPC channel. The instance is bound to the local
+ * side of the channel, and the method returns a file descriptor bound to the
+ * remote side. The caller is responsible for passing the file descriptor to
+ * the remote process, where it can be used with IPCSharedMemory::bind() to
+ * bind the remote side.
+ *
+ * \return A file descriptor on success, negative error code on failure
+ */
+int IPCSharedMemory::create()
+{
+	int sockets[2] = { -1, -1 };
+	int eventfds[2] = { -1, -1 };
+	int memfd = -1;
+	int ret;
+
+	if (isBound())
+		return -EINVAL;
+
+	ret = socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sockets);
+	if (ret) {
+		ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to create socket pair: " << strerror(-ret);
+		return ret;
+	}
+
+	memfd = memfd_create("libcamera-ipc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd < 0) {
+		ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to create memfd: " << strerror(-ret);
+		goto error;
+	}
+
+	areaSize_ = sizeof(SharedArea) + 2 * ringSize_;
+	if (ftruncate(memfd, areaSize_) < 0 ||
+	    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+		ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to size memfd: " << strerror(-ret);
+		goto error;
+	}
+
+	for (int &efd : eventfds) {
+		efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (efd < 0) {
+			ret = -errno;
+			LOG(IPCSharedMemory, Error)
+				<< "Failed to create eventfd: " << strerror(-ret);
+			goto error;
+		}
+	}
+
+	/*
+	 * Queue the handshake on the socket, the remote side will receive it
+	 * when binding.
+	 */
+	{
+		Payload handshake;
+		Handshake data = { handshakeMagic, static_cast<uint32_t>(ringSize_) };
+
+		handshake.data.resize(sizeof(data));
+		memcpy(handshake.data.data(), &data, sizeof(data));
+		handshake.fds = { memfd, eventfds[0], eventfds[1] };
+
+		fd_ = sockets[0];
+		ret = socketSend(handshake, 0);
+		fd_ = -1;
+		if (ret)
+			goto error;
+	}
+
+	ret = setup(sockets[0], memfd, eventfds[0], eventfds[1], true);
+	::close(memfd);
+	if (ret) {
+		::close(sockets[0]);
+		::close(sockets[1]);
+		return ret;
+	}
+
+	return sockets[1];
+
+error:
+	for (int fd : { sockets[0], sockets[1], eventfds[0], eventfds[1], memfd }) {
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Bind to an existing IPC channel
+ * \param[in] fd File descriptor
+ *
+ * This method binds the instance to an existing IPC channel identified by the
+ * file descriptor \a fd. The file descriptor is obtained from the
+ * IPCSharedMemory::create() method. It waits for the creator's handshake,
+ * which is normally already queued on the channel.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCSharedMemory::bind(int fd)
+{
+	if (isBound())
+		return -EINVAL;
+
+	fd_ = fd;
+
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	int ret = poll(&pfd, 1, handshakeTimeout);
+	if (ret <= 0) {
+		LOG(IPCSharedMemory, Error) << "No handshake received";
+		fd_ = -1;
+		return ret < 0 ? -errno : -ETIMEDOUT;
+	}
+
+	ret = socketReceive();
+	fd_ = -1;
+	if (ret)
+		return ret;
+
+	pendingValid_ = false;
+
+	Handshake handshake;
+	if (pending_.data.size() != sizeof(handshake) || pending_.fds.size() != 3) {
+		LOG(IPCSharedMemory, Error) << "Invalid handshake";
+		for (int32_t pendingFd : pending_.fds)
+			::close(pendingFd);
+		return -EINVAL;
+	}
+
+	memcpy(&handshake, pending_.data.data(), sizeof(handshake));
+	ringSize_ = handshake.ringSize;
+
+	int memfd = pending_.fds[0];
+	int eventfdRx = pending_.fds[1];
+	int eventfdTx = pending_.fds[2];
+	pending_ = {};
+
+	if (handshake.magic != handshakeMagic || ringSize_ < 4096 ||
+	    (ringSize_ & (ringSize_ - 1))) {
+		LOG(IPCSharedMemory, Error) << "Invalid handshake";
+		::close(memfd);
+		::close(eventfdRx);
+		::close(eventfdTx);
+		return -EINVAL;
+	}
+
+	areaSize_ = sizeof(SharedArea) + 2 * ringSize_;
+	ret = setup(fd, memfd, eventfdTx, eventfdRx, false);
+	::close(memfd);
+
+	return ret;
+}
+
+int IPCSharedMemory::setup(int fd, int memfd, int eventfdTx, int eventfdRx,
+			   bool creator)
+{
+	void *mem = mmap(nullptr, areaSize_, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 memfd, 0);
+	if (mem == MAP_FAILED) {
+		int ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to map shared memory: " << strerror(-ret);
+		::close(eventfdTx);
+		::close(eventfdRx);
+		return ret;
+	}
+
+	area_ = static_cast<SharedArea *>(mem);
+	uint8_t *data = static_cast<uint8_t *>(mem) + sizeof(SharedArea);
+
+	if (creator)
+		new (area_) SharedArea{};
+
+	/* The creator transmits on ring 0, the remote side on ring 1. */
+	tx_ = &area_->rings[creator ? 0 : 1];
+	rx_ = &area_->rings[creator ? 1 : 0];
+	txData_ = data + (creator ? 0 : ringSize_);
+	rxData_ = data + (creator ? ringSize_ : 0);
+
+	fd_ = fd;
+	eventfdTx_ = eventfdTx;
+	eventfdRx_ = eventfdRx;
+
+	eventNotifier_ = new EventNotifier(eventfdRx_, EventNotifier::Read);
+	eventNotifier_->activated.connect(this, &IPCSharedMemory::eventNotifier);
+	socketNotifier_ = new EventNotifier(fd_, EventNotifier::Read);
+	socketNotifier_->activated.connect(this, &IPCSharedMemory::socketNotifier);
+
+	return 0;
+}
+
+/**
+ * \brief Close the IPC channel
+ *
+ * No communication is possible after close() has been called.
+ */
+void IPCSharedMemory::close()
+{
+	if (!isBound())
+		return;
+
+	delete eventNotifier_;
+	eventNotifier_ = nullptr;
+	delete socketNotifier_;
+	socketNotifier_ = nullptr;
+
+	munmap(area_, areaSize_);
+	area_ = nullptr;
+	tx_ = nullptr;
+	rx_ = nullptr;
+	txData_ = nullptr;
+	rxData_ = nullptr;
+
+	::close(eventfdTx_);
+	::close(eventfdRx_);
+	::close(fd_);
+
+	eventfdTx_ = -1;
+	eventfdRx_ = -1;
+	fd_ = -1;
+
+	for (int32_t fd : pending_.fds)
+		::close(fd);
+	pending_ = {};
+	pendingValid_ = false;
+
+	sendSeq_ = 0;
+	recvSeq_ = 0;
+	error_ = 0;
+}
+
+/**
+ * \brief Check if the IPC channel is bound
+ * \return True if the IPC channel is bound, false otherwise
+ */
+bool IPCSharedMemory::isBound() const
+{
+	return area_ != nullptr;
+}
+
+/**
+ * \brief Send a message payload
+ * \param[in] payload Message payload to send
+ *
+ * This method queues the message payload for transmission to the other end of
+ * the IPC channel. It returns immediately, before the message is delivered to
+ * the remote side.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCSharedMemory::send(const Payload &payload)
+{
+	if (!isBound())
+		return -ENOTCONN;
+
+	if (payload.data.empty() && payload.fds.empty())
+		return -EINVAL;
+
+	uint32_t seq = sendSeq_;
+
+	if (payload.fds.empty() && ringWrite(payload, seq)) {
+		sendSeq_++;
+
+		uint64_t value = 1;
+		if (write(eventfdTx_, &value, sizeof(value)) < 0) {
+			int ret = -errno;
+			LOG(IPCSharedMemory, Error)
+				<< "Failed to signal eventfd: " << strerror(-ret);
+			return ret;
+		}
+
+		return 0;
+	}
+
+	int ret = socketSend(payload, seq);
+	if (ret)
+		return ret;
+
+	sendSeq_++;
+	return 0;
+}
+
+/**
+ * \brief Receive a message payload
+ * \param[out] payload Payload where to write the received message
+ *
+ * This method receives the next message payload from the IPC channel. It shall
+ * be called from the \ref readyRead signal handler, once per signal emission.
+ *
+ * If the remote side sends a corrupted ring entry or a message out of sequence,
+ * the stream can't be resynchronized. The error is reported by this method and
+ * all subsequent calls, and no further message is received.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EAGAIN No message is available
+ * \retval -ENOTCONN The channel is not bound
+ * \retval -EPROTO The stream has been corrupted by the remote side
+ */
+int IPCSharedMemory::receive(Payload *payload)
+{
+	if (!isBound())
+		return -ENOTCONN;
+
+	int ret = messageAvailable();
+	if (ret < 0)
+		return ret;
+	if (!ret)
+		return -EAGAIN;
+
+	if (pendingValid_ && pendingSeq_ == recvSeq_) {
+		*payload = std::move(pending_);
+		pending_ = {};
+		pendingValid_ = false;
+		socketNotifier_->setEnabled(true);
+	} else {
+		uint32_t seq;
+		uint32_t size;
+
+		ret = ringPeek(&seq, &size);
+		if (ret < 0)
+			return protocolError(ret);
+		if (seq != recvSeq_)
+			return protocolError(-EPROTO);
+
+		ringRead(size, payload);
+	}
+
+	recvSeq_++;
+
+	return 0;
+}
+
+/**
+ * \var IPCSharedMemory::readyRead
+ * \brief A Signal emitted when a message is ready to be read
+ */
+
+bool IPCSharedMemory::ringWrite(const Payload &payload, uint32_t seq)
+{
+	uint32_t size = payload.data.size();
+	if (size > ringSize_ - sizeof(EntryHeader))
+		return false;
+
+	uint32_t length = entryLength(size);
+	uint32_t head = tx_->head.load(std::memory_order_relaxed);
+	uint32_t tail = tx_->tail.load(std::memory_order_acquire);
+	if (length > ringSize_ - (head - tail))
+		return false;
+
+	/*
+	 * Entries are aligned to the header size, the header never wraps
+	 * around the end of the ring but the data may.
+	 */
+	uint32_t offset = head & (ringSize_ - 1);
+	EntryHeader header = { seq, size };
+	memcpy(txData_ + offset, &header, sizeof(header));
+
+	offset = (offset + sizeof(header)) & (ringSize_ - 1);
+	uint32_t contiguous = std::min<uint32_t>(size, ringSize_ - offset);
+	memcpy(txData_ + offset, payload.data.data(), contiguous);
+	memcpy(txData_, payload.data.data() + contiguous, size - contiguous);
+
+	tx_->head.store(head + length, std::memory_order_release);
+
+	return true;
+}
+
+/*
+ * Return 0 if an entry is available, -EAGAIN if the ring is empty, or -EPROTO
+ * if the entry is corrupted.
+ */
+int IPCSharedMemory::ringPeek(uint32_t *seq, uint32_t *size)
+{
+	uint32_t tail = rx_->tail.load(std::memory_order_relaxed);
+	uint32_t head = rx_->head.load(std::memory_order_acquire);
+	if (head == tail)
+		return -EAGAIN;
+
+	EntryHeader header;
+	memcpy(&header, rxData_ + (tail & (ringSize_ - 1)), sizeof(header));
+
+	/* Don't trust the remote side, validate the entry. */
+	if (head - tail > ringSize_ || (tail % sizeof(header)) ||
+	    header.size > ringSize_ - sizeof(header) ||
+	    entryLength(header.size) > head - tail) {
+		LOG(IPCSharedMemory, Error) << "Corrupted ring entry";
+		return -EPROTO;
+	}
+
+	*seq = header.seq;
+	*size = header.size;
+
+	return 0;
+}
+
+void IPCSharedMemory::ringRead(uint32_t size, Payload *payload)
+{
+	uint32_t tail = rx_->tail.load(std::memory_order_relaxed);
+	uint32_t offset = (tail + sizeof(EntryHeader)) & (ringSize_ - 1);
+	uint32_t contiguous = std::min<uint32_t>(size, ringSize_ - offset);
+
+	payload->data.resize(size);
+	memcpy(payload->data.data(), rxData_ + offset, contiguous);
+	memcpy(payload->data.data() + contiguous, rxData_, size - contiguous);
+	payload->fds.clear();
+
+	rx_->tail.store(tail + entryLength(size), std::memory_order_release);
+}
+
+int IPCSharedMemory::socketSend(const Payload &payload, uint32_t seq)
+{
+	unsigned int num = payload.fds.size();
+	if (num > maxFds)
+		return -EINVAL;
+
+	SocketHeader header = { seq, num };
+
+	struct iovec iov[2];
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = const_cast<uint8_t *>(payload.data.data());
+	iov[1].iov_len = payload.data.size();
+
+	char buf[CMSG_SPACE(maxFds * sizeof(int32_t))];
+	memset(buf, 0, sizeof(buf));
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	if (num) {
+		struct cmsghdr *cmsg = reinterpret_cast<struct cmsghdr *>(buf);
+		cmsg->cmsg_len = CMSG_LEN(num * sizeof(int32_t));
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		memcpy(CMSG_DATA(cmsg), payload.fds.data(), num * sizeof(int32_t));
+
+		msg.msg_control = cmsg;
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
+
+	if (sendmsg(fd_, &msg, 0) < 0) {
+		int ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to sendmsg: " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+int IPCSharedMemory::socketReceive()
+{
+	SocketHeader header;
+
+	ssize_t length = recv(fd_, &header, sizeof(header), MSG_PEEK | MSG_TRUNC);
+	if (length < 0) {
+		int ret = -errno;
+		if (ret != -EAGAIN)
+			LOG(IPCSharedMemory, Error)
+				<< "Failed to peek message: " << strerror(-ret);
+		return ret;
+	}
+
+	if (!length) {
+		LOG(IPCSharedMemory, Error) << "Remote side disconnected";
+		return -ECONNRESET;
+	}
+
+	if (static_cast<size_t>(length) < sizeof(header) || header.fds > maxFds) {
+		LOG(IPCSharedMemory, Error) << "Invalid message received";
+		recv(fd_, &header, sizeof(header), 0);
+		return -EINVAL;
+	}
+
+	pending_.data.resize(length - sizeof(header));
+
+	struct iovec iov[2];
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = pending_.data.data();
+	iov[1].iov_len = pending_.data.size();
+
+	char buf[CMSG_SPACE(maxFds * sizeof(int32_t))];
+	memset(buf, 0, sizeof(buf));
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	if (recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC) < 0) {
+		int ret = -errno;
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to recvmsg: " << strerror(-ret);
+		return ret;
+	}
+
+	pending_.fds.clear();
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+	    cmsg->cmsg_type == SCM_RIGHTS) {
+		unsigned int num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+		pending_.fds.resize(num);
+		memcpy(pending_.fds.data(), CMSG_DATA(cmsg), num * sizeof(int32_t));
+	}
+
+	if (pending_.fds.size() != header.fds) {
+		LOG(IPCSharedMemory, Error) << "File descriptors lost in transit";
+		for (int32_t fd : pending_.fds)
+			::close(fd);
+		pending_ = {};
+		return -EINVAL;
+	}
+
+	pendingSeq_ = header.seq;
+	pendingValid_ = true;
+
+	return 0;
+}
+
+/*
+ * Check if the next message in sequence is available, from the ring or the
+ * socket. Return 1 if it is available, 0 if it hasn't been received yet, or a
+ * negative error code if the stream is corrupted.
+ */
+int IPCSharedMemory::messageAvailable()
+{
+	if (error_)
+		return error_;
+
+	if (pendingValid_ && pendingSeq_ == recvSeq_)
+		return 1;
+
+	uint32_t seq;
+	uint32_t size;
+
+	int ret = ringPeek(&seq, &size);
+	if (!ret && seq == recvSeq_)
+		return 1;
+	if (ret && ret != -EAGAIN)
+		return protocolError(ret);
+
+	/*
+	 * Each stream delivers messages in order, an entry older than the next
+	 * expected message has been lost or replayed.
+	 */
+	bool ringAhead = !ret;
+	if (ringAhead && static_cast<int32_t>(seq - recvSeq_) < 0)
+		return protocolError(-EPROTO);
+
+	/*
+	 * The next message isn't in the ring, it has been sent through the
+	 * socket. Only one message can be pending at a time, disable the socket
+	 * notifier until it gets consumed.
+	 */
+	if (!pendingValid_) {
+		ret = socketReceive();
+		if (ret == -EAGAIN)
+			return 0;
+		if (ret < 0)
+			return protocolError(ret);
+
+		if (static_cast<int32_t>(pendingSeq_ - recvSeq_) < 0)
+			return protocolError(-EPROTO);
+
+		socketNotifier_->setEnabled(false);
+
+		if (pendingSeq_ == recvSeq_)
+			return 1;
+	}
+
+	/*
+	 * The message may have been written to the ring after it was checked
+	 * above, check again.
+	 */
+	if (!ringAhead) {
+		ret = ringPeek(&seq, &size);
+		if (ret == -EAGAIN)
+			return 0;
+		if (ret < 0)
+			return protocolError(ret);
+		if (seq == recvSeq_)
+			return 1;
+	}
+
+	/*
+	 * Both streams are ahead of the next expected message, which will thus
+	 * never be received.
+	 */
+	return protocolError(-EPROTO);
+}
+
+/*
+ * Record a protocol error. The stream can't be resynchronized, stop receiving
+ * messages and report the error from all subsequent receive() calls.
+ */
+int IPCSharedMemory::protocolError(int error)
+{
+	LOG(IPCSharedMemory, Error)
+		<< "IPC stream corrupted at message " << recvSeq_ << ": "
+		<< strerror(-error);
+
+	error_ = error;
+	eventNotifier_->setEnabled(false);
+	socketNotifier_->setEnabled(false);
+
+	return error;
+}
+
+void IPCSharedMemory::dispatch()
+{
+	while (isBound() && messageAvailable() > 0) {
+		uint32_t seq = recvSeq_;
+
+		readyRead.emit(this);
+
+		/* Stop if the message hasn't been consumed by the receiver. */
+		if (recvSeq_ == seq)
+			break;
+	}
+}
+
+void IPCSharedMemory::eventNotifier([[maybe_unused]] EventNotifier *notifier)
+{
+	uint64_t value;
+	if (read(eventfdRx_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+		LOG(IPCSharedMemory, Error)
+			<< "Failed to read eventfd: " << strerror(errno);
+		return;
+	}
+
+	dispatch();
+}
+
+void IPCSharedMemory::socketNotifier([[maybe_unused]] EventNotifier *notifier)
+{
+	dispatch();
+}
+
+} /* namespace libcamera */
@@ -230,6 +230,7 @@ int MediaDevice::populate()
 
 	driver_ = info.driver;
 	model_ = info.model;
+	busInfo_ = info.bus_info;
 	version_ = info.media_version;
 	hwRevision_ = info.hw_revision;
 
@@ -315,6 +316,16 @@ done:
  * \return The MediaDevice model name
  */
 
+/**
+ * \fn MediaDevice::busInfo()
+ * \brief Retrieve the media device bus information
+ *
+ * The bus information identifies the location of the device in the system
+ * (for instance "platform:vimc").
+ *
+ * \return The MediaDevice bus information
+ */
+
 /**
  * \fn MediaDevice::version()
  * \brief Retrieve the media device API version
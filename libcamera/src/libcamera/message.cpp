@@ -10,6 +10,7 @@
 #include <libcamera/signal.h>
 
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/pool_allocator.h"
 
 /**
  * \file message.h
@@ -60,7 +61,7 @@ std::atomic_uint Message::nextUserType_{ Message::UserMessage };
  * \param[in] type The message type
  */
 Message::Message(Message::Type type)
-	: type_(type)
+	: type_(type), receiver_(nullptr), next_(nullptr)
 {
 }
 
@@ -139,6 +140,20 @@ InvokeMessage::~InvokeMessage()
 		delete method_;
 }
 
+/*
+ * Invoke messages are posted for every cross-thread method invocation. Serve
+ * them from the pool allocator to avoid hitting the system allocator.
+ */
+void *InvokeMessage::operator new(size_t size)
+{
+	return PoolAllocator::allocate(size);
+}
+
+void InvokeMessage::operator delete(void *ptr, size_t size)
+{
+	PoolAllocator::deallocate(ptr, size);
+}
+
 /**
  * \fn InvokeMessage::semaphore()
  * \brief Retrieve the message semaphore passed to the constructor
@@ -88,8 +88,7 @@ Object::~Object()
 	for (SignalBase *signal : signals)
 		signal->disconnect(this);
 
-	if (pendingMessages_)
-		thread()->removeMessages(this);
+	thread()->removeMessages(this);
 
 	if (parent_) {
 		auto it = std::find(parent_->children_.begin(),
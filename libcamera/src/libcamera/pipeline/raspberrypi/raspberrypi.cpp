@@ -35,6 +35,7 @@
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_controls.h"
 #include "libcamera/internal/v4l2_videodevice.h"
@@ -1310,6 +1311,8 @@ void RPiCameraData::statsMetadataComplete(uint32_t bufferId, const ControlList &
 
 	FrameBuffer *buffer = isp_[Isp::Stats].getBuffers().at(bufferId);
 
+	LIBCAMERA_TRACEPOINT_IPA_ASYNC_END(rpi, signalStatReady, buffer);
+
 	handleStreamBuffer(buffer, &isp_[Isp::Stats]);
 
 	/* Fill the Request metadata buffer with what the IPA has provided */
@@ -1343,9 +1346,13 @@ void RPiCameraData::runIsp(uint32_t bufferId)
 
 	FrameBuffer *buffer = unicam_[Unicam::Image].getBuffers().at(bufferId);
 
+	LIBCAMERA_TRACEPOINT_IPA_ASYNC_END(rpi, signalIspPrepare, buffer);
+
 	LOG(RPI, Debug) << "Input re-queue to ISP, buffer id " << bufferId
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	LIBCAMERA_TRACEPOINT_PIPELINE_STAGE(rpi, isp_queue, buffer);
+
 	isp_[Isp::Input].queueBuffer(buffer);
 	ispOutputCount_ = 0;
 	handleState();
@@ -1431,6 +1438,8 @@ void RPiCameraData::ispInputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << unicam_[Unicam::Image].getBufferId(buffer)
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	LIBCAMERA_TRACEPOINT_PIPELINE_STAGE(rpi, isp_input_done, buffer);
+
 	/* The ISP input buffer gets re-queued into Unicam. */
 	handleStreamBuffer(buffer, &unicam_[Unicam::Image]);
 	handleState();
@@ -1459,11 +1468,14 @@ void RPiCameraData::ispOutputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << index
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	LIBCAMERA_TRACEPOINT_PIPELINE_STAGE(rpi, isp_output_done, buffer);
+
 	/*
 	 * ISP statistics buffer must not be re-queued or sent back to the
 	 * application until after the IPA signals so.
 	 */
 	if (stream == &isp_[Isp::Stats]) {
+		LIBCAMERA_TRACEPOINT_IPA_ASYNC_BEGIN(rpi, signalStatReady, buffer);
 		ipa_->signalStatReady(ipa::RPi::MaskStats | static_cast<unsigned int>(index));
 	} else {
 		/* Any other ISP output can be handed back to the application now. */
@@ -1678,6 +1690,8 @@ void RPiCameraData::tryRunPipeline()
 	if (!findMatchingBuffers(bayerFrame, embeddedBuffer))
 		return;
 
+	LIBCAMERA_TRACEPOINT_PIPELINE_STAGE(rpi, buffers_matched, bayerFrame.buffer);
+
 	/* Take the first request from the queue and action the IPA. */
 	Request *request = requestQueue_.front();
 
@@ -1713,6 +1727,7 @@ void RPiCameraData::tryRunPipeline()
 				<< " Bayer buffer id: " << embeddedId;
 	}
 
+	LIBCAMERA_TRACEPOINT_IPA_ASYNC_BEGIN(rpi, signalIspPrepare, bayerFrame.buffer);
 	ipa_->signalIspPrepare(ispPrepare);
 }
 
@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * pool_allocator.cpp - Thread-caching pool for small short-lived allocations
+ */
+
+#include "libcamera/internal/pool_allocator.h"
+
+#include <atomic>
+#include <new>
+
+#include "libcamera/internal/thread.h"
+
+/**
+ * \file pool_allocator.h
+ * \brief Thread-caching pool for small short-lived allocations
+ */
+
+namespace libcamera {
+
+namespace {
+
+constexpr unsigned int numClasses = PoolAllocator::maxSize / PoolAllocator::granularity;
+
+/*
+ * Number of blocks cached per size class in each thread, and number of blocks
+ * exchanged with the shared depot when the thread cache overflows or runs
+ * empty.
+ */
+constexpr unsigned int threadCacheSize = 64;
+constexpr unsigned int batchSize = threadCacheSize / 2;
+
+/* Maximum number of blocks kept per size class in the shared depot. */
+constexpr unsigned int depotSize = 1024;
+
+struct FreeBlock {
+	FreeBlock *next;
+};
+
+struct FreeList {
+	FreeBlock *head;
+	unsigned int count;
+
+	FreeBlock *pop()
+	{
+		FreeBlock *block = head;
+		head = block->next;
+		count--;
+		return block;
+	}
+
+	void push(FreeBlock *block)
+	{
+		block->next = head;
+		head = block;
+		count++;
+	}
+};
+
+/*
+ * The depot is shared by all threads and protected by a mutex. It is allocated
+ * dynamically and never freed, as blocks may be returned to the pool from
+ * destructors of static objects after the depot would otherwise have been
+ * destroyed.
+ */
+struct Depot {
+	Mutex mutex_;
+	FreeList lists_[numClasses];
+};
+
+Depot &depot()
+{
+	static Depot *depot = new Depot{};
+	return *depot;
+}
+
+/*
+ * The thread cache is trivially destructible to remain usable during thread
+ * teardown. Its content is returned to the depot by the CacheCleaner when the
+ * thread exits, after which all allocations bypass the cache.
+ */
+struct ThreadCache {
+	FreeList lists_[numClasses];
+	bool active_;
+	bool finished_;
+};
+
+thread_local ThreadCache threadCache;
+
+/* Number of blocks obtained from the system allocator for the pool. */
+std::atomic_uint poolMisses;
+
+void drain(FreeList &list, unsigned int index, unsigned int count)
+{
+	Depot &d = depot();
+	FreeBlock *excess = nullptr;
+
+	{
+		MutexLocker locker(d.mutex_);
+
+		while (count-- && list.count) {
+			FreeBlock *block = list.pop();
+
+			if (d.lists_[index].count < depotSize) {
+				d.lists_[index].push(block);
+			} else {
+				block->next = excess;
+				excess = block;
+			}
+		}
+	}
+
+	while (excess) {
+		FreeBlock *block = excess;
+		excess = block->next;
+		::operator delete(block);
+	}
+}
+
+void refill(FreeList &list, unsigned int index)
+{
+	Depot &d = depot();
+	MutexLocker locker(d.mutex_);
+
+	for (unsigned int i = 0; i < batchSize && d.lists_[index].count; ++i)
+		list.push(d.lists_[index].pop());
+}
+
+struct CacheCleaner {
+	~CacheCleaner()
+	{
+		for (unsigned int i = 0; i < numClasses; ++i)
+			drain(threadCache.lists_[i], i, threadCache.lists_[i].count);
+
+		threadCache.finished_ = true;
+	}
+};
+
+ThreadCache *currentCache()
+{
+	ThreadCache *cache = &threadCache;
+	if (cache->active_)
+		return cache;
+
+	if (cache->finished_)
+		return nullptr;
+
+	static thread_local CacheCleaner cleaner;
+	cache->active_ = true;
+
+	return cache;
+}
+
+} /* namespace */
+
+/**
+ * \class PoolAllocator
+ * \brief Memory pool for small, frequently allocated objects
+ *
+ * The PoolAllocator serves memory for small objects that are allocated and
+ * freed at a high rate, such as the messages used for cross-thread method
+ * invocation. Freed blocks are kept in per-thread
+ * free lists grouped by size class, and are reused by subsequent allocations
+ * of the same size class without going through the system allocator.
+ *
+ * Objects are commonly allocated in one thread and freed in another. To avoid
+ * blocks accumulating in the thread that frees them, per-thread caches are
+ * bounded, and exchange batches of blocks with a shared depot when they
+ * overflow or run empty. In steady state, the number of system allocations is
+ * thus independent of the number of allocations served.
+ *
+ * Requests larger than maxSize bytes are forwarded to the system allocator.
+ * All blocks are aligned to the default new alignment.
+ *
+ * \context This class is \threadsafe.
+ */
+
+/**
+ * \var PoolAllocator::granularity
+ * \brief The size class granularity in bytes
+ */
+
+/**
+ * \var PoolAllocator::maxSize
+ * \brief The largest size served from the pool, in bytes
+ */
+
+/**
+ * \brief Allocate a block of memory
+ * \param[in] size The block size in bytes
+ *
+ * The returned memory shall be freed with deallocate(), passing the same \a
+ * size.
+ *
+ * \return A pointer to the allocated memory
+ */
+void *PoolAllocator::allocate(size_t size)
+{
+	if (!size || size > maxSize)
+		return ::operator new(size);
+
+	unsigned int index = (size - 1) / granularity;
+	ThreadCache *cache = currentCache();
+	if (cache) {
+		FreeList &list = cache->lists_[index];
+
+		if (!list.count)
+			refill(list, index);
+		if (list.count)
+			return list.pop();
+	}
+
+	poolMisses.fetch_add(1, std::memory_order_relaxed);
+
+	return ::operator new((index + 1) * granularity);
+}
+
+/**
+ * \brief Free a block of memory allocated with allocate()
+ * \param[in] ptr The block
+ * \param[in] size The size that was passed to allocate() for \a ptr
+ */
+void PoolAllocator::deallocate(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+
+	if (!size || size > maxSize) {
+		::operator delete(ptr);
+		return;
+	}
+
+	unsigned int index = (size - 1) / granularity;
+	FreeBlock *block = static_cast<FreeBlock *>(ptr);
+	ThreadCache *cache = currentCache();
+	if (!cache) {
+		FreeList list{ nullptr, 0 };
+		list.push(block);
+		drain(list, index, 1);
+		return;
+	}
+
+	FreeList &list = cache->lists_[index];
+	list.push(block);
+
+	if (list.count > threadCacheSize)
+		drain(list, index, batchSize);
+}
+
+/**
+ * \brief Retrieve the number of blocks allocated from the system allocator
+ *
+ * Blocks are allocated from the system allocator when the pool has no free
+ * block of the requested size class. The count excludes requests larger than
+ * maxSize, which are never served from the pool. It can be used to verify that
+ * the pool reaches a steady state.
+ *
+ * \return The number of blocks allocated from the system allocator
+ */
+unsigned int PoolAllocator::systemAllocations()
+{
+	return poolMisses.load(std::memory_order_relaxed);
+}
+
+} /* namespace libcamera */
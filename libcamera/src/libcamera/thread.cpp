@@ -9,7 +9,6 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <list>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -122,20 +121,189 @@ class ThreadMain;
 
 /**
  * \brief A queue of posted messages
+ *
+ * Messages can be posted from any thread, and are consumed by the thread that
+ * owns the queue. Posting is lock-free: messages are linked into an intrusive
+ * stack with an atomic compare-and-swap, without any memory allocation. The
+ * consumer collects the posted messages in batches, restores their posting
+ * order and appends them to the intrusive list of pending messages, which is
+ * protected by a mutex. As the mutex is only taken by consumer-side
+ * operations, senders never contend with message delivery.
+ *
+ * The number of pending messages for each receiver is accounted for by
+ * Thread::collectMessages() when the messages are collected, with the mutex
+ * held. A message that is still being posted is thus not accounted for by any
+ * receiver until the next collection.
  */
 class MessageQueue
 {
 public:
 	/**
-	 * \brief List of queued Message instances
+	 * \brief Position of a message dispatch loop in the pending list
+	 *
+	 * Dispatching a message releases the mutex, during which messages can
+	 * be removed from the list. Cursors are registered with the queue to be
+	 * updated when the message they point to is unlinked, letting dispatch
+	 * resume where it stopped instead of restarting from the head.
 	 */
-	std::list<std::unique_ptr<Message>> list_;
+	struct Cursor {
+		/**
+		 * \brief The last message skipped by the dispatch loop, or
+		 * nullptr to start from the head of the list
+		 */
+		Message *prev;
+		/**
+		 * \brief The cursor of the enclosing dispatch loop
+		 */
+		Cursor *outer;
+	};
+
+	MessageQueue()
+		: posted_(nullptr), head_(nullptr), tail_(nullptr),
+		  cursors_(nullptr)
+	{
+	}
+
+	~MessageQueue()
+	{
+		collect();
+
+		while (head_) {
+			Message *msg = head_;
+			head_ = msg->next_;
+			delete msg;
+		}
+	}
+
+	void post(Message *msg);
+	Message *collect();
+
+	void append(Message *msg);
+	Message *unlink(Message *prev, Message *msg);
+
+	/**
+	 * \brief Stack of posted messages not collected yet, most recent first
+	 */
+	std::atomic<Message *> posted_;
+	/**
+	 * \brief First message in the list of pending messages
+	 */
+	Message *head_;
 	/**
-	 * \brief Protects the \ref list_
+	 * \brief Last message in the list of pending messages
+	 */
+	Message *tail_;
+	/**
+	 * \brief Cursors of the active dispatch loops, innermost first
+	 */
+	Cursor *cursors_;
+	/**
+	 * \brief Protects the \ref head_ and \ref tail_ list, the \ref
+	 * cursors_ and the pending messages count of the receivers
 	 */
 	Mutex mutex_;
 };
 
+/**
+ * \brief Post a message to the queue
+ * \param[in] msg The message
+ *
+ * This function may be called from any thread without holding the mutex_.
+ */
+void MessageQueue::post(Message *msg)
+{
+	Message *head = posted_.load(std::memory_order_relaxed);
+
+	do {
+		msg->next_ = head;
+	} while (!posted_.compare_exchange_weak(head, msg,
+						std::memory_order_release,
+						std::memory_order_relaxed));
+}
+
+/**
+ * \brief Move all posted messages to the list of pending messages
+ *
+ * The caller shall hold the mutex_.
+ *
+ * \return The first collected message, or nullptr if no message was posted
+ */
+Message *MessageQueue::collect()
+{
+	Message *msg = posted_.exchange(nullptr, std::memory_order_acquire);
+	if (!msg)
+		return nullptr;
+
+	/* Reverse the stack to restore the posting order. */
+	Message *first = nullptr;
+	Message *last = msg;
+
+	while (msg) {
+		Message *next = msg->next_;
+		msg->next_ = first;
+		first = msg;
+		msg = next;
+	}
+
+	if (tail_)
+		tail_->next_ = first;
+	else
+		head_ = first;
+
+	tail_ = last;
+
+	return first;
+}
+
+/**
+ * \brief Append a message to the list of pending messages
+ * \param[in] msg The message
+ *
+ * The caller shall hold the mutex_.
+ */
+void MessageQueue::append(Message *msg)
+{
+	msg->next_ = nullptr;
+
+	if (tail_)
+		tail_->next_ = msg;
+	else
+		head_ = msg;
+
+	tail_ = msg;
+}
+
+/**
+ * \brief Remove a message from the list of pending messages
+ * \param[in] prev The message preceding \a msg in the list, or nullptr
+ * \param[in] msg The message
+ *
+ * The caller shall hold the mutex_.
+ *
+ * \return The message that followed \a msg in the list
+ */
+Message *MessageQueue::unlink(Message *prev, Message *msg)
+{
+	Message *next = msg->next_;
+
+	if (prev)
+		prev->next_ = next;
+	else
+		head_ = next;
+
+	if (tail_ == msg)
+		tail_ = prev;
+
+	for (Cursor *cursor = cursors_; cursor; cursor = cursor->outer) {
+		if (cursor->prev == msg)
+			cursor->prev = prev;
+	}
+
+	msg->next_ = nullptr;
+
+	return next;
+}
+
 /**
  * \brief Thread-local internal data
  */
@@ -479,6 +647,9 @@ EventDispatcher *Thread::eventDispatcher()
  * running its event loop the message will not be delivered until the event
  * loop gets started.
  *
+ * Posting a message is lock-free and doesn't allocate memory, it never blocks
+ * on message delivery in the receiving thread.
+ *
  * If the \a receiver is not bound to this thread the behaviour is undefined.
  *
  * \sa exec()
@@ -489,10 +660,7 @@ void Thread::postMessage(std::unique_ptr<Message> msg, Object *receiver)
 
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
-	data_->messages_.list_.push_back(std::move(msg));
-	receiver->pendingMessages_++;
-	locker.unlock();
+	data_->messages_.post(msg.release());
 
 	EventDispatcher *dispatcher =
 		data_->dispatcher_.load(std::memory_order_acquire);
@@ -510,31 +678,48 @@ void Thread::removeMessages(Object *receiver)
 {
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
+	MessageQueue &queue = data_->messages_;
+	MutexLocker locker(queue.mutex_);
+
+	/*
+	 * Collect the posted messages first to account for all messages
+	 * posted before this call. Messages posted concurrently with this call
+	 * may not be removed, it is the responsibility of the caller to ensure
+	 * that no message is posted to a receiver that is being destroyed.
+	 */
+	collectMessages(queue);
 	if (!receiver->pendingMessages_)
 		return;
 
-	std::vector<std::unique_ptr<Message>> toDelete;
-	for (std::unique_ptr<Message> &msg : data_->messages_.list_) {
-		if (!msg)
-			continue;
-		if (msg->receiver_ != receiver)
+	/*
+	 * Move the messages to a pending deletion list to delete them after
+	 * releasing the lock.
+	 */
+	Message *toDelete = nullptr;
+	Message *prev = nullptr;
+
+	for (Message *msg = queue.head_; msg; ) {
+		if (msg->receiver_ != receiver) {
+			prev = msg;
+			msg = msg->next_;
 			continue;
+		}
 
-		/*
-		 * Move the message to the pending deletion list to delete it
-		 * after releasing the lock. The messages list element will
-		 * contain a null pointer, and will be removed when dispatching
-		 * messages.
-		 */
-		toDelete.push_back(std::move(msg));
+		Message *next = queue.unlink(prev, msg);
+		msg->next_ = toDelete;
+		toDelete = msg;
 		receiver->pendingMessages_--;
+		msg = next;
 	}
 
 	ASSERT(!receiver->pendingMessages_);
 	locker.unlock();
 
-	toDelete.clear();
+	while (toDelete) {
+		Message *msg = toDelete;
+		toDelete = msg->next_;
+		delete msg;
+	}
 }
 
 /**
@@ -547,25 +732,33 @@ void Thread::removeMessages(Object *receiver)
  */
 void Thread::dispatchMessages(Message::Type type)
 {
-	MutexLocker locker(data_->messages_.mutex_);
+	MessageQueue &queue = data_->messages_;
+	MutexLocker locker(queue.mutex_);
+
+	/*
+	 * Messages are removed from the list before being delivered, so the
+	 * list can be freely modified while the lock is released. The cursor
+	 * tracks the last skipped message, and is updated by the queue if that
+	 * message gets removed, to resume from the same position.
+	 */
+	MessageQueue::Cursor cursor{ nullptr, queue.cursors_ };
+	queue.cursors_ = &cursor;
 
-	std::list<std::unique_ptr<Message>> &messages = data_->messages_.list_;
+	while (true) {
+		collectMessages(queue);
 
-	for (auto iter = messages.begin(); iter != messages.end(); ) {
-		std::unique_ptr<Message> &msg = *iter;
+		Message *msg = cursor.prev ? cursor.prev->next_ : queue.head_;
 
-		if (!msg) {
-			iter = data_->messages_.list_.erase(iter);
-			continue;
+		while (msg && type != Message::Type::None && msg->type() != type) {
+			cursor.prev = msg;
+			msg = msg->next_;
 		}
 
-		if (type != Message::Type::None && msg->type() != type) {
-			++iter;
-			continue;
-		}
+		if (!msg)
+			break;
 
-		std::unique_ptr<Message> message = std::move(msg);
-		iter = data_->messages_.list_.erase(iter);
+		queue.unlink(cursor.prev, msg);
+		std::unique_ptr<Message> message(msg);
 
 		Object *receiver = message->receiver_;
 		ASSERT(data_ == receiver->thread()->data_);
@@ -576,6 +769,22 @@ void Thread::dispatchMessages(Message::Type type)
 		message.reset();
 		locker.lock();
 	}
+
+	queue.cursors_ = cursor.outer;
+}
+
+/**
+ * \brief Collect the messages posted to a queue
+ * \param[in] queue The message queue
+ *
+ * Move the messages posted to the \a queue to its list of pending messages,
+ * and account for them in the pending messages count of their receivers. The
+ * caller shall hold the queue mutex.
+ */
+void Thread::collectMessages(MessageQueue &queue)
+{
+	for (Message *msg = queue.collect(); msg; msg = msg->next_)
+		msg->receiver_->pendingMessages_++;
 }
 
 /**
@@ -597,18 +806,32 @@ void Thread::moveObject(Object *object)
 void Thread::moveObject(Object *object, ThreadData *currentData,
 			ThreadData *targetData)
 {
+	MessageQueue &source = currentData->messages_;
+	MessageQueue &target = targetData->messages_;
+
+	/*
+	 * Account for all the messages posted so far before checking if the
+	 * object has pending messages.
+	 */
+	collectMessages(source);
+	collectMessages(target);
+
 	/* Move pending messages to the message queue of the new thread. */
 	if (object->pendingMessages_) {
 		unsigned int movedMessages = 0;
 
-		for (std::unique_ptr<Message> &msg : currentData->messages_.list_) {
-			if (!msg)
-				continue;
-			if (msg->receiver_ != object)
+		Message *prev = nullptr;
+		for (Message *msg = source.head_; msg; ) {
+			if (msg->receiver_ != object) {
+				prev = msg;
+				msg = msg->next_;
 				continue;
+			}
 
-			targetData->messages_.list_.push_back(std::move(msg));
+			Message *next = source.unlink(prev, msg);
+			target.append(msg);
 			movedMessages++;
+			msg = next;
 		}
 
 		if (movedMessages) {
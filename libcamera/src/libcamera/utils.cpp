@@ -8,11 +8,13 @@
 #include "libcamera/internal/utils.h"
 
 #include <dlfcn.h>
+#include <errno.h>
 #include <elf.h>
 #include <iomanip>
 #include <limits.h>
 #include <link.h>
 #include <sstream>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -122,6 +124,87 @@ std::string dirname(const std::string &path)
 	return path.substr(0, pos + 1);
 }
 
+/**
+ * \brief Create a directory and its missing parents
+ * \param[in] path The path of the directory to create
+ * \param[in] mode The permissions of the directories that are created
+ *
+ * This function behaves as the \c mkdir \c -p command. Directories that
+ * already exist along the \a path are left untouched.
+ *
+ * \return 0 on success or if the directory already exists, or a negative error
+ * code otherwise
+ */
+int mkdirs(const std::string &path, mode_t mode)
+{
+	if (path.empty())
+		return -EINVAL;
+
+	size_t pos = 0;
+	do {
+		pos = path.find('/', pos + 1);
+		std::string dir = path.substr(0, pos);
+
+		if (mkdir(dir.c_str(), mode) < 0 && errno != EEXIST)
+			return -errno;
+	} while (pos != std::string::npos);
+
+	struct stat st;
+	if (stat(path.c_str(), &st) < 0)
+		return -errno;
+
+	return S_ISDIR(st.st_mode) ? 0 : -ENOTDIR;
+}
+
+/**
+ * \brief Replace the contents of a file atomically
+ * \param[in] path The path of the file
+ * \param[in] data The new contents of the file
+ *
+ * The \a data is written to a temporary file created next to \a path, named
+ * after it with a random six characters suffix, and the temporary file is then
+ * renamed to \a path. Readers of \a path, in this process or in another one,
+ * thus see either the previous or the new contents, never a partial file. The
+ * temporary file is removed if any of the steps fail.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int write_file_atomic(const std::string &path, const std::string &data)
+{
+	std::string tmp = path + ".XXXXXX";
+	int fd = mkstemp(&tmp[0]);
+	if (fd < 0)
+		return -errno;
+
+	int ret = 0;
+	const char *pos = data.data();
+	size_t remaining = data.size();
+
+	while (remaining) {
+		ssize_t written = write(fd, pos, remaining);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ret = -errno;
+			break;
+		}
+
+		pos += written;
+		remaining -= written;
+	}
+
+	close(fd);
+
+	if (!ret && rename(tmp.c_str(), path.c_str()) < 0)
+		ret = -errno;
+
+	if (ret)
+		unlink(tmp.c_str());
+
+	return ret;
+}
+
 /**
  * \fn std::vector<typename T::key_type> map_keys(const T &map)
  * \brief Retrieve the keys of a std::map<>
@@ -27,6 +27,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/tracepoints.h"
 
 /**
  * \file v4l2_videodevice.h
@@ -1449,6 +1450,9 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 
 	LOG(V4L2, Debug) << "Queueing buffer " << buf.index;
 
+	LIBCAMERA_TRACEPOINT(v4l2_videodevice_queue, deviceNode().c_str(),
+			     buffer, buf.index);
+
 	ret = ioctl(VIDIOC_QBUF, &buf);
 	if (ret < 0) {
 		LOG(V4L2, Error)
@@ -1542,6 +1546,9 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 		buffer->metadata_.planes.push_back({ buf.bytesused });
 	}
 
+	LIBCAMERA_TRACEPOINT(v4l2_videodevice_dequeue, deviceNode().c_str(),
+			     buffer, buf.index);
+
 	return buffer;
 }
 
@@ -8,17 +8,31 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <tiffio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 
+#include "raw_packer.h"
+
 using namespace libcamera;
 
+/*
+ * Number of rows in a strip of the raw image. Strips are packed concurrently,
+ * and must be a multiple of the 16 rows of the thumbnail subsampling.
+ */
+static constexpr unsigned int kStripRows = 64;
+
 enum CFAPatternColour : uint8_t {
 	CFAPatternRed = 0,
 	CFAPatternGreen = 1,
@@ -26,13 +40,7 @@ enum CFAPatternColour : uint8_t {
 };
 
 struct FormatInfo {
-	uint8_t bitsPerSample;
 	CFAPatternColour pattern[4];
-	void (*packScanline)(void *output, const void *input,
-			     unsigned int width);
-	void (*thumbScanline)(const FormatInfo &info, void *output,
-			      const void *input, unsigned int width,
-			      unsigned int stride);
 };
 
 struct Matrix3d {
@@ -126,256 +134,187 @@ struct Matrix3d {
 	float m[9];
 };
 
-void packScanlineSBGGR10P(void *output, const void *input, unsigned int width)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint8_t *out = static_cast<uint8_t *>(output);
-
-	/* \todo Can this be made more efficient? */
-	for (unsigned int x = 0; x < width; x += 4) {
-		*out++ = in[0];
-		*out++ = (in[4] & 0x03) << 6 | in[1] >> 2;
-		*out++ = (in[1] & 0x03) << 6 | (in[4] & 0x0c) << 2 | in[2] >> 4;
-		*out++ = (in[2] & 0x0f) << 4 | (in[4] & 0x30) >> 2 | in[3] >> 6;
-		*out++ = (in[3] & 0x3f) << 2 | (in[4] & 0xc0) >> 6;
-		in += 5;
-	}
-}
-
-void packScanlineSBGGR12P(void *output, const void *input, unsigned int width)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint8_t *out = static_cast<uint8_t *>(output);
-
-	/* \todo Can this be made more efficient? */
-	for (unsigned int i = 0; i < width; i += 2) {
-		*out++ = in[0];
-		*out++ = (in[2] & 0x0f) << 4 | in[1] >> 4;
-		*out++ = (in[1] & 0x0f) << 4 | in[2] >> 4;
-		in += 3;
-	}
-}
-
-void thumbScanlineSBGGRxxP(const FormatInfo &info, void *output,
-			   const void *input, unsigned int width,
-			   unsigned int stride)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint8_t *out = static_cast<uint8_t *>(output);
-
-	/* Number of bytes corresponding to 16 pixels. */
-	unsigned int skip = info.bitsPerSample * 16 / 8;
-
-	for (unsigned int x = 0; x < width; x++) {
-		uint8_t value = (in[0] + in[1] + in[stride] + in[stride + 1]) >> 2;
-		*out++ = value;
-		*out++ = value;
-		*out++ = value;
-		in += skip;
-	}
-}
-
-void packScanlineIPU3(void *output, const void *input, unsigned int width)
+/*
+ * Pack the rows of a strip of the raw image for TIFF, and compute the
+ * thumbnail rows that fall in the strip by averaging the top-left 2x2 pixels
+ * of each 16x16 block, from the unpacked samples.
+ */
+static void packStrip(const RawPacker &packer, const uint8_t *data,
+		      unsigned int stride, unsigned int firstRow,
+		      unsigned int lastRow, uint8_t *packed,
+		      uint8_t *thumbnail, unsigned int thumbWidth,
+		      unsigned int thumbHeight, std::vector<uint16_t> *samples)
 {
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint16_t *out = static_cast<uint16_t *>(output);
+	const unsigned int packedStride = packer.packedStride();
+	const unsigned int shift = packer.bitsPerSample() - 6;
 
-	/*
-	 * Upscale the 10-bit format to 16-bit as it's not trivial to pack it
-	 * as 10-bit without gaps.
-	 *
-	 * \todo Improve packing to keep the 10-bit sample size.
-	 */
-	unsigned int x = 0;
-	while (true) {
-		for (unsigned int i = 0; i < 6; i++) {
-			*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
-			if (++x >= width)
-				return;
-
-			in += 5;
-		}
+	for (unsigned int y = firstRow; y < lastRow; y++) {
+		std::vector<uint16_t> &row = samples[y % 16 == 1 ? 1 : 0];
 
-		*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
-		if (++x >= width)
-			return;
+		packer.unpack(data + y * stride, row.data());
+		packer.pack(row.data(), packed + (y - firstRow) * packedStride);
 
-		in += 2;
-	}
-}
+		if (y % 16 != 1 || y / 16 >= thumbHeight)
+			continue;
 
-void thumbScanlineIPU3([[maybe_unused]] const FormatInfo &info, void *output,
-		       const void *input, unsigned int width,
-		       unsigned int stride)
-{
-	uint8_t *out = static_cast<uint8_t *>(output);
+		const uint16_t *top = samples[0].data();
+		const uint16_t *bottom = samples[1].data();
+		uint8_t *out = thumbnail + y / 16 * thumbWidth * 3;
 
-	for (unsigned int x = 0; x < width; x++) {
-		unsigned int pixel = x * 16;
-		unsigned int block = pixel / 25;
-		unsigned int pixelInBlock = pixel - block * 25;
+		for (unsigned int x = 0; x < thumbWidth; x++) {
+			unsigned int sum = top[x * 16] + top[x * 16 + 1]
+					 + bottom[x * 16] + bottom[x * 16 + 1];
+			uint8_t value = sum >> shift;
 
-		/*
-		 * If the pixel is the last in the block cheat a little and
-		 * move one pixel backward to avoid reading between two blocks
-		 * and having to deal with the padding bits.
-		 */
-		if (pixelInBlock == 24)
-			pixelInBlock--;
-
-		const uint8_t *in = static_cast<const uint8_t *>(input)
-				  + block * 32 + (pixelInBlock / 4) * 5;
-
-		uint16_t val1, val2, val3, val4;
-		switch (pixelInBlock % 4) {
-		case 0:
-			val1 = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
-			val2 = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
-			val3 = (in[stride + 1] & 0x03) << 14 | (in[stride + 0] & 0xff) << 6;
-			val4 = (in[stride + 2] & 0x0f) << 12 | (in[stride + 1] & 0xfc) << 4;
-			break;
-		case 1:
-			val1 = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
-			val2 = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
-			val3 = (in[stride + 2] & 0x0f) << 12 | (in[stride + 1] & 0xfc) << 4;
-			val4 = (in[stride + 3] & 0x3f) << 10 | (in[stride + 2] & 0xf0) << 2;
-			break;
-		case 2:
-			val1 = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
-			val2 = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
-			val3 = (in[stride + 3] & 0x3f) << 10 | (in[stride + 2] & 0xf0) << 2;
-			val4 = (in[stride + 4] & 0xff) <<  8 | (in[stride + 3] & 0xc0) << 0;
-			break;
-		case 3:
-			val1 = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
-			val2 = (in[6] & 0x03) << 14 | (in[5] & 0xff) << 6;
-			val3 = (in[stride + 4] & 0xff) <<  8 | (in[stride + 3] & 0xc0) << 0;
-			val4 = (in[stride + 6] & 0x03) << 14 | (in[stride + 5] & 0xff) << 6;
-			break;
+			*out++ = value;
+			*out++ = value;
+			*out++ = value;
 		}
-
-		uint8_t value = (val1 + val2 + val3 + val4) >> 10;
-		*out++ = value;
-		*out++ = value;
-		*out++ = value;
 	}
 }
 
 static const std::map<PixelFormat, FormatInfo> formatInfo = {
 	{ formats::SBGGR10_CSI2P, {
-		.bitsPerSample = 10,
 		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
-		.packScanline = packScanlineSBGGR10P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SGBRG10_CSI2P, {
-		.bitsPerSample = 10,
 		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
-		.packScanline = packScanlineSBGGR10P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SGRBG10_CSI2P, {
-		.bitsPerSample = 10,
 		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
-		.packScanline = packScanlineSBGGR10P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SRGGB10_CSI2P, {
-		.bitsPerSample = 10,
 		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
-		.packScanline = packScanlineSBGGR10P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SBGGR12_CSI2P, {
-		.bitsPerSample = 12,
 		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
-		.packScanline = packScanlineSBGGR12P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SGBRG12_CSI2P, {
-		.bitsPerSample = 12,
 		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
-		.packScanline = packScanlineSBGGR12P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SGRBG12_CSI2P, {
-		.bitsPerSample = 12,
 		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
-		.packScanline = packScanlineSBGGR12P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SRGGB12_CSI2P, {
-		.bitsPerSample = 12,
 		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
-		.packScanline = packScanlineSBGGR12P,
-		.thumbScanline = thumbScanlineSBGGRxxP,
 	} },
 	{ formats::SBGGR10_IPU3, {
-		.bitsPerSample = 16,
 		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
-		.packScanline = packScanlineIPU3,
-		.thumbScanline = thumbScanlineIPU3,
 	} },
 	{ formats::SGBRG10_IPU3, {
-		.bitsPerSample = 16,
 		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
-		.packScanline = packScanlineIPU3,
-		.thumbScanline = thumbScanlineIPU3,
 	} },
 	{ formats::SGRBG10_IPU3, {
-		.bitsPerSample = 16,
 		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
-		.packScanline = packScanlineIPU3,
-		.thumbScanline = thumbScanlineIPU3,
 	} },
 	{ formats::SRGGB10_IPU3, {
-		.bitsPerSample = 16,
 		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
-		.packScanline = packScanlineIPU3,
-		.thumbScanline = thumbScanlineIPU3,
 	} },
 };
 
 int DNGWriter::write(const char *filename, const Camera *camera,
 		     const StreamConfiguration &config,
 		     const ControlList &metadata,
-		     [[maybe_unused]] const FrameBuffer *buffer,
-		     const void *data)
+		     const FrameBuffer *buffer, const void *data,
+		     Compression compression)
 {
-	const ControlList &cameraProperties = camera->properties();
+	return write(filename, camera->properties(), config, metadata, buffer,
+		     data, compression);
+}
 
+int DNGWriter::write(const char *filename, const ControlList &cameraProperties,
+		     const StreamConfiguration &config,
+		     const ControlList &metadata,
+		     [[maybe_unused]] const FrameBuffer *buffer,
+		     const void *data, Compression compression)
+{
 	const auto it = formatInfo.find(config.pixelFormat);
-	if (it == formatInfo.cend()) {
+	RawPacker packer;
+	if (it == formatInfo.cend() ||
+	    packer.configure(config.pixelFormat, config.size.width)) {
 		std::cerr << "Unsupported pixel format" << std::endl;
 		return -EINVAL;
 	}
 	const FormatInfo *info = &it->second;
 
+#ifndef HAVE_ZLIB
+	if (compression == Compression::Deflate) {
+		std::cerr << "Deflate compression not supported" << std::endl;
+		return -ENOTSUP;
+	}
+#endif
+
+	const unsigned int bitsPerSample = packer.bitsPerSample();
+	const unsigned int packedStride = packer.packedStride();
+	const unsigned int thumbWidth = config.size.width / 16;
+	const unsigned int thumbHeight = config.size.height / 16;
+	const unsigned int numStrips = (config.size.height + kStripRows - 1) / kStripRows;
+
+	/*
+	 * Pack the raw image and compute the thumbnail in a single pass,
+	 * with strips distributed to all CPUs. Compressed strips are
+	 * compressed by the thread that packs them.
+	 */
+	std::vector<uint8_t> thumbnail(thumbWidth * thumbHeight * 3);
+	std::vector<uint8_t> packed(packedStride * config.size.height);
+	std::vector<std::vector<uint8_t>> compressed(numStrips);
+	std::atomic<unsigned int> nextStrip{ 0 };
+	std::atomic<bool> failed{ false };
+
+	auto packStrips = [&]() {
+		std::vector<uint16_t> samples[2] = {
+			std::vector<uint16_t>(config.size.width),
+			std::vector<uint16_t>(config.size.width),
+		};
+
+		for (unsigned int strip; (strip = nextStrip++) < numStrips;) {
+			unsigned int firstRow = strip * kStripRows;
+			unsigned int lastRow = std::min(firstRow + kStripRows,
+							config.size.height);
+			uint8_t *stripData = packed.data() + firstRow * packedStride;
+
+			packStrip(packer, static_cast<const uint8_t *>(data),
+				  config.stride, firstRow, lastRow, stripData,
+				  thumbnail.data(), thumbWidth, thumbHeight,
+				  samples);
+
+#ifdef HAVE_ZLIB
+			if (compression == Compression::Deflate) {
+				uLong size = (lastRow - firstRow) * packedStride;
+				uLongf compressedSize = compressBound(size);
+
+				compressed[strip].resize(compressedSize);
+				if (compress2(compressed[strip].data(), &compressedSize,
+					      stripData, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+					failed = true;
+				compressed[strip].resize(compressedSize);
+			}
+#endif
+		}
+	};
+
+	unsigned int numThreads = std::min(std::max(std::thread::hardware_concurrency(), 1U),
+					   numStrips);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; i++)
+		threads.emplace_back(packStrips);
+
+	packStrips();
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	if (failed) {
+		std::cerr << "Failed to compress RAW data" << std::endl;
+		return -EINVAL;
+	}
+
 	TIFF *tif = TIFFOpen(filename, "w");
 	if (!tif) {
 		std::cerr << "Failed to open tiff file" << std::endl;
 		return -EINVAL;
 	}
 
-	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
-	 */
-	uint8_t scanline[(config.size.width * info->bitsPerSample + 7) / 8];
-
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
 
@@ -384,7 +323,11 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	 * readers, as required by the TIFF/EP specification. Tags that apply to
 	 * the whole file are stored here.
 	 */
-	const uint8_t version[] = { 1, 2, 0, 0 };
+	uint8_t version[] = { 1, 2, 0, 0 };
+
+	/* Deflate compression of integer samples requires DNG 1.4. */
+	if (compression == Compression::Deflate)
+		version[1] = 4;
 
 	TIFFSetField(tif, TIFFTAG_DNGVERSION, version);
 	TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, version);
@@ -406,8 +349,8 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	 * but doesn't seem well supported by RawTherapee.
 	 */
 	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
-	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width / 16);
-	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height / 16);
+	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, thumbWidth);
+	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, thumbHeight);
 	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
 	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
 	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
@@ -470,20 +413,18 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
 	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
 
-	/* Write the thumbnail. */
-	const uint8_t *row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height / 16; y++) {
-		info->thumbScanline(*info, &scanline, row,
-				    config.size.width / 16, config.stride);
-
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
+	/*
+	 * Write the thumbnail. It uses the default strip size, as libtiff
+	 * splits a single uncompressed strip when IFD 0 is read back to
+	 * update its offsets.
+	 */
+	for (unsigned int y = 0; y < thumbHeight; y++) {
+		if (TIFFWriteScanline(tif, &thumbnail[y * thumbWidth * 3], y, 0) != 1) {
 			std::cerr << "Failed to write thumbnail scanline"
 				  << std::endl;
 			TIFFClose(tif);
 			return -EINVAL;
 		}
-
-		row += config.stride * 16;
 	}
 
 	TIFFWriteDirectory(tif);
@@ -499,20 +440,27 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height);
-	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, info->bitsPerSample);
-	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, kStripRows);
+	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitsPerSample);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION,
+		     compression == Compression::Deflate
+		     ? COMPRESSION_ADOBE_DEFLATE : COMPRESSION_NONE);
 	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
 	TIFFSetField(tif, TIFFTAG_CFAREPEATPATTERNDIM, cfaRepeatPatternDim);
+#if TIFFLIB_VERSION >= 20201219
+	TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, info->pattern);
+#else
 	TIFFSetField(tif, TIFFTAG_CFAPATTERN, info->pattern);
+#endif
 	TIFFSetField(tif, TIFFTAG_CFAPLANECOLOR, 3, cfaPlaneColor);
 	TIFFSetField(tif, TIFFTAG_CFALAYOUT, 1);
 
 	const uint16_t blackLevelRepeatDim[] = { 2, 2 };
 	float blackLevel[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	uint32_t whiteLevel = (1 << info->bitsPerSample) - 1;
+	uint32_t whiteLevel = (1 << bitsPerSample) - 1;
 
 	if (metadata.contains(controls::SensorBlackLevels)) {
 		Span<const int32_t> levels = metadata.get(controls::SensorBlackLevels);
@@ -544,7 +492,7 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 			}
 
 			/* Map the 16-bit value to the bits per sample range. */
-			blackLevel[i] = level >> (16 - info->bitsPerSample);
+			blackLevel[i] = level >> (16 - bitsPerSample);
 		}
 	}
 
@@ -552,19 +500,27 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_BLACKLEVEL, 4, &blackLevel);
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
-	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(&scanline, row, config.size.width);
+	/* Write RAW content, as packed or compressed strips. */
+	for (unsigned int strip = 0; strip < numStrips; strip++) {
+		uint8_t *stripData;
+		tmsize_t size;
+
+		if (compression == Compression::Deflate) {
+			stripData = compressed[strip].data();
+			size = compressed[strip].size();
+		} else {
+			unsigned int firstRow = strip * kStripRows;
+			unsigned int rows = std::min(kStripRows,
+						     config.size.height - firstRow);
+			stripData = packed.data() + firstRow * packedStride;
+			size = rows * packedStride;
+		}
 
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
+		if (TIFFWriteRawStrip(tif, strip, stripData, size) != size) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
 			TIFFClose(tif);
 			return -EINVAL;
 		}
-
-		row += config.stride;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
@@ -20,10 +20,22 @@ using namespace libcamera;
 class DNGWriter
 {
 public:
+	enum class Compression {
+		None,
+		Deflate,
+	};
+
 	static int write(const char *filename, const Camera *camera,
 			 const StreamConfiguration &config,
 			 const ControlList &metadata,
-			 const FrameBuffer *buffer, const void *data);
+			 const FrameBuffer *buffer, const void *data,
+			 Compression compression = Compression::None);
+	static int write(const char *filename,
+			 const ControlList &cameraProperties,
+			 const StreamConfiguration &config,
+			 const ControlList &metadata,
+			 const FrameBuffer *buffer, const void *data,
+			 Compression compression = Compression::None);
 };
 
 #endif /* HAVE_TIFF */
@@ -13,6 +13,8 @@
 
 #include <libcamera/pixel_format.h>
 
+#include "color_converter.h"
+
 class QImage;
 
 class FormatConverter
@@ -25,14 +27,11 @@ public:
 private:
 	enum FormatFamily {
 		MJPEG,
-		NV,
 		RGB,
 		YUV,
 	};
 
-	void convertNV(const unsigned char *src, unsigned char *dst);
 	void convertRGB(const unsigned char *src, unsigned char *dst);
-	void convertYUV(const unsigned char *src, unsigned char *dst);
 
 	libcamera::PixelFormat format_;
 	unsigned int width_;
@@ -40,20 +39,14 @@ private:
 
 	enum FormatFamily formatFamily_;
 
-	/* NV parameters */
-	unsigned int horzSubSample_;
-	unsigned int vertSubSample_;
-	bool nvSwap_;
-
 	/* RGB parameters */
 	unsigned int bpp_;
 	unsigned int r_pos_;
 	unsigned int g_pos_;
 	unsigned int b_pos_;
 
-	/* YUV parameters */
-	unsigned int y_pos_;
-	unsigned int cb_pos_;
+	/* YUV conversion */
+	ColorConverter yuvConverter_;
 };
 
 #endif /* __QCAM_FORMAT_CONVERTER_H__ */
@@ -669,14 +669,27 @@ void MainWindow::processRaw(FrameBuffer *buffer,
 {
 #ifdef HAVE_DNG
 	QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::PicturesLocation);
+	QString filter = "DNG Files (*.dng)";
+#ifdef HAVE_ZLIB
+	/* Deflate compressed files are smaller, but much slower to write. */
+	const QString deflateFilter = "Compressed DNG Files (*.dng)";
+	filter += ";;" + deflateFilter;
+#endif
+	QString selectedFilter;
 	QString filename = QFileDialog::getSaveFileName(this, "Save DNG", defaultPath,
-							"DNG Files (*.dng)");
+							filter, &selectedFilter);
 
 	if (!filename.isEmpty()) {
+		DNGWriter::Compression compression = DNGWriter::Compression::None;
+#ifdef HAVE_ZLIB
+		if (selectedFilter == deflateFilter)
+			compression = DNGWriter::Compression::Deflate;
+#endif
+
 		const MappedBuffer &mapped = mappedBuffers_[buffer];
 		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
 				 rawStream_->configuration(), metadata, buffer,
-				 mapped.memory);
+				 mapped.memory, compression);
 	}
 #endif
 
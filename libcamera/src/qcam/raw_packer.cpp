@@ -0,0 +1,571 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * raw_packer.cpp - qcam - Repack CSI-2 and IPU3 raw Bayer rows for DNG
+ */
+
+#include "raw_packer.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <libcamera/formats.h>
+
+/**
+ * \class RawPacker
+ * \brief Repack raw Bayer rows to the TIFF sample layout
+ *
+ * TIFF stores samples as a big-endian bit stream without padding, while the
+ * CSI-2 packed formats store the most significant bits of each sample in a
+ * byte and group the least significant bits in a separate byte, and the IPU3
+ * format packs 25 samples in 32 bytes as a little-endian bit stream.
+ *
+ * Rows are first unpacked to 16-bit samples, which the DNG writer also uses to
+ * compute the thumbnail, and then packed to the TIFF layout at the native bit
+ * depth. Both steps run a kernel for the best instruction set supported by
+ * the CPU on the bulk of the row, and the scalar reference on the rest.
+ */
+
+/**
+ * \brief Retrieve the instruction sets supported by the CPU
+ * \return The supported instruction sets, the fastest last
+ */
+std::vector<RawPacker::Isa> RawPacker::supportedIsas()
+{
+	std::vector<Isa> isas{ Scalar };
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("ssse3"))
+		isas.push_back(SSSE3);
+#endif
+#if defined(__ARM_NEON)
+	isas.push_back(NEON);
+#endif
+
+	return isas;
+}
+
+const char *RawPacker::isaName(Isa isa)
+{
+	switch (isa) {
+	case Scalar:
+		return "scalar";
+	case SSSE3:
+		return "SSSE3";
+	case NEON:
+		return "NEON";
+	}
+
+	return "unknown";
+}
+
+RawPacker::RawPacker()
+	: packing_(CSI2P10), bitsPerSample_(0), width_(0),
+	  unpackKernel_(nullptr), packKernel_(nullptr)
+{
+}
+
+/**
+ * \brief Configure the packer for a raw format and row width
+ * \param[in] format The raw Bayer pixel format
+ * \param[in] width The row width in pixels
+ * \return 0 on success, or -EINVAL if the format isn't supported
+ */
+int RawPacker::configure(const libcamera::PixelFormat &format, unsigned int width)
+{
+	/*
+	 * The CSI-2 and IPU3 formats only differ by their modifier, which a
+	 * switch on the pixel format would ignore.
+	 */
+	static const std::map<libcamera::PixelFormat, std::pair<Packing, unsigned int>> packings = {
+		{ libcamera::formats::SBGGR10_CSI2P, { CSI2P10, 10 } },
+		{ libcamera::formats::SGBRG10_CSI2P, { CSI2P10, 10 } },
+		{ libcamera::formats::SGRBG10_CSI2P, { CSI2P10, 10 } },
+		{ libcamera::formats::SRGGB10_CSI2P, { CSI2P10, 10 } },
+		{ libcamera::formats::SBGGR12_CSI2P, { CSI2P12, 12 } },
+		{ libcamera::formats::SGBRG12_CSI2P, { CSI2P12, 12 } },
+		{ libcamera::formats::SGRBG12_CSI2P, { CSI2P12, 12 } },
+		{ libcamera::formats::SRGGB12_CSI2P, { CSI2P12, 12 } },
+		{ libcamera::formats::SBGGR10_IPU3, { IPU3, 10 } },
+		{ libcamera::formats::SGBRG10_IPU3, { IPU3, 10 } },
+		{ libcamera::formats::SGRBG10_IPU3, { IPU3, 10 } },
+		{ libcamera::formats::SRGGB10_IPU3, { IPU3, 10 } },
+	};
+
+	const auto it = packings.find(format);
+	if (it == packings.end())
+		return -EINVAL;
+
+	packing_ = it->second.first;
+	bitsPerSample_ = it->second.second;
+	width_ = width;
+
+	return setIsa(supportedIsas().back());
+}
+
+/**
+ * \brief Select the instruction set of the kernels
+ * \param[in] isa The instruction set
+ * \return 0 on success, or -ENOTSUP if the CPU doesn't support \a isa
+ */
+int RawPacker::setIsa(Isa isa)
+{
+	std::vector<Isa> isas = supportedIsas();
+	if (std::find(isas.begin(), isas.end(), isa) == isas.end())
+		return -ENOTSUP;
+
+	unpackKernel_ = nullptr;
+	packKernel_ = nullptr;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (isa == SSSE3) {
+		switch (packing_) {
+		case CSI2P10:
+			unpackKernel_ = unpackCSI2P10SSSE3;
+			break;
+		case CSI2P12:
+			unpackKernel_ = unpackCSI2P12SSSE3;
+			break;
+		case IPU3:
+			unpackKernel_ = unpackIPU3SSSE3;
+			break;
+		}
+
+		packKernel_ = bitsPerSample_ == 12 ? pack12SSSE3 : pack10SSSE3;
+	}
+#endif
+#if defined(__ARM_NEON)
+	if (isa == NEON) {
+		switch (packing_) {
+		case CSI2P10:
+			unpackKernel_ = unpackCSI2P10NEON;
+			break;
+		case CSI2P12:
+			unpackKernel_ = unpackCSI2P12NEON;
+			break;
+		case IPU3:
+			unpackKernel_ = unpackIPU3NEON;
+			break;
+		}
+
+		packKernel_ = bitsPerSample_ == 12 ? pack12NEON : pack10NEON;
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the size in bytes of a row packed for TIFF
+ */
+unsigned int RawPacker::packedStride() const
+{
+	return (width_ * bitsPerSample_ + 7) / 8;
+}
+
+/**
+ * \brief Unpack a row to 16-bit samples
+ * \param[in] input The row in the raw format
+ * \param[out] output The row samples
+ */
+void RawPacker::unpack(const uint8_t *input, uint16_t *output) const
+{
+	unsigned int start = unpackKernel_ ? unpackKernel_(input, output, width_) : 0;
+	unpackScalar(packing_, input, output, start, width_);
+}
+
+/**
+ * \brief Pack a row of 16-bit samples to the TIFF layout
+ * \param[in] input The row samples
+ * \param[out] output The packed row, of packedStride() bytes
+ */
+void RawPacker::pack(const uint16_t *input, uint8_t *output) const
+{
+	unsigned int start = packKernel_ ? packKernel_(input, output, width_) : 0;
+	packScalar(bitsPerSample_, input, output, start, width_);
+}
+
+void RawPacker::unpackScalar(Packing packing, const uint8_t *input,
+			     uint16_t *output, unsigned int start,
+			     unsigned int width)
+{
+	for (unsigned int x = start; x < width; x++) {
+		switch (packing) {
+		case CSI2P10: {
+			const uint8_t *in = input + x / 4 * 5;
+			unsigned int i = x % 4;
+			output[x] = in[i] << 2 | ((in[4] >> (2 * i)) & 0x03);
+			break;
+		}
+
+		case CSI2P12: {
+			const uint8_t *in = input + x / 2 * 3;
+			unsigned int i = x % 2;
+			output[x] = in[i] << 4 | ((in[2] >> (4 * i)) & 0x0f);
+			break;
+		}
+
+		case IPU3: {
+			/* 25 samples in a little-endian stream of 32 bytes. */
+			unsigned int bit = x % 25 * 10;
+			const uint8_t *in = input + x / 25 * 32 + bit / 8;
+			output[x] = ((in[0] | in[1] << 8) >> (bit % 8)) & 0x3ff;
+			break;
+		}
+		}
+	}
+}
+
+void RawPacker::packScalar(unsigned int bitsPerSample, const uint16_t *input,
+			   uint8_t *output, unsigned int start,
+			   unsigned int width)
+{
+	/* The kernels stop on a byte boundary. */
+	uint8_t *out = output + start * bitsPerSample / 8;
+	uint32_t bits = 0;
+	unsigned int count = 0;
+
+	for (unsigned int x = start; x < width; x++) {
+		bits = bits << bitsPerSample | input[x];
+		count += bitsPerSample;
+
+		while (count >= 8) {
+			count -= 8;
+			*out++ = bits >> count;
+		}
+
+		bits &= (1 << count) - 1;
+	}
+
+	if (count)
+		*out = bits << (8 - count);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * The unpack kernels gather the bytes holding each sample in 16-bit lanes,
+ * and shift the sample bits in place with per-lane multiplications. They
+ * load 16 bytes at a time, and leave the end of the row, where the loads
+ * would overrun it, to the scalar code.
+ */
+__attribute__((target("ssse3")))
+unsigned int RawPacker::unpackCSI2P10SSSE3(const uint8_t *input, uint16_t *output,
+					   unsigned int width)
+{
+	const unsigned int rowSize = (width + 3) / 4 * 5;
+
+	/* Most significant bits in the high byte, LSBs in the low byte. */
+	const __m128i msbShuffle = _mm_setr_epi8(-1, 0, -1, 1, -1, 2, -1, 3,
+						 -1, 5, -1, 6, -1, 7, -1, 8);
+	const __m128i lsbShuffle = _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1,
+						 9, -1, 9, -1, 9, -1, 9, -1);
+	const __m128i lsbShift = _mm_setr_epi16(256, 64, 16, 4, 256, 64, 16, 4);
+	const __m128i lsbMask = _mm_set1_epi16(0x03);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 4 * 5 + 16 <= rowSize; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + x / 4 * 5));
+
+		__m128i msb = _mm_srli_epi16(_mm_shuffle_epi8(in, msbShuffle), 6);
+		__m128i lsb = _mm_mullo_epi16(_mm_shuffle_epi8(in, lsbShuffle), lsbShift);
+		lsb = _mm_and_si128(_mm_srli_epi16(lsb, 8), lsbMask);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x),
+				 _mm_or_si128(msb, lsb));
+	}
+
+	return x;
+}
+
+__attribute__((target("ssse3")))
+unsigned int RawPacker::unpackCSI2P12SSSE3(const uint8_t *input, uint16_t *output,
+					   unsigned int width)
+{
+	const unsigned int rowSize = (width + 1) / 2 * 3;
+
+	const __m128i msbShuffle = _mm_setr_epi8(-1, 0, -1, 1, -1, 3, -1, 4,
+						 -1, 6, -1, 7, -1, 9, -1, 10);
+	const __m128i lsbShuffle = _mm_setr_epi8(2, -1, 2, -1, 5, -1, 5, -1,
+						 8, -1, 8, -1, 11, -1, 11, -1);
+	const __m128i lsbShift = _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+	const __m128i lsbMask = _mm_set1_epi16(0x0f);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 2 * 3 + 16 <= rowSize; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + x / 2 * 3));
+
+		__m128i msb = _mm_srli_epi16(_mm_shuffle_epi8(in, msbShuffle), 4);
+		__m128i lsb = _mm_mullo_epi16(_mm_shuffle_epi8(in, lsbShuffle), lsbShift);
+		lsb = _mm_and_si128(_mm_srli_epi16(lsb, 4), lsbMask);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x),
+				 _mm_or_si128(msb, lsb));
+	}
+
+	return x;
+}
+
+__attribute__((target("ssse3")))
+unsigned int RawPacker::unpackIPU3SSSE3(const uint8_t *input, uint16_t *output,
+					unsigned int width)
+{
+	const unsigned int rowSize = (width + 24) / 25 * 32;
+
+	/*
+	 * Gather the two bytes holding each sample of two groups of 4 samples
+	 * in 5 bytes, and shift the sample to the top of the lane, truncating
+	 * the bits of the next sample.
+	 */
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4,
+					      5, 6, 6, 7, 7, 8, 8, 9);
+	const __m128i shift = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+
+	unsigned int x = 0;
+	for (; x + 25 <= width && x / 25 * 32 + 36 <= rowSize; x += 25) {
+		const uint8_t *block = input + x / 25 * 32;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i * 10));
+			__m128i samples = _mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle), shift);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x + i * 8),
+					 _mm_srli_epi16(samples, 6));
+		}
+
+		output[x + 24] = (block[30] | block[31] << 8) & 0x3ff;
+	}
+
+	return x;
+}
+
+/*
+ * The pack kernels combine pairs of samples with multiply-add, assemble the
+ * bit stream of each group of samples in 32-bit or 64-bit lanes, and reorder
+ * its bytes to big-endian. They store 16 bytes at a time, and leave the end
+ * of the row, where the stores would overrun it, to the scalar code.
+ */
+__attribute__((target("ssse3")))
+unsigned int RawPacker::pack10SSSE3(const uint16_t *input, uint8_t *output,
+				    unsigned int width)
+{
+	const unsigned int rowSize = (width * 10 + 7) / 8;
+
+	const __m128i pairs = _mm_setr_epi16(1024, 1, 1024, 1, 1024, 1, 1024, 1);
+	const __m128i low = _mm_set_epi32(0, -1, 0, -1);
+	const __m128i shuffle = _mm_setr_epi8(4, 3, 2, 1, 0, 12, 11, 10, 9, 8,
+					      -1, -1, -1, -1, -1, -1);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 8 * 10 + 16 <= rowSize; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + x));
+
+		/* 20-bit pairs, combined in 40-bit groups of 4 samples. */
+		__m128i pair = _mm_madd_epi16(in, pairs);
+		__m128i group = _mm_or_si128(_mm_slli_epi64(_mm_and_si128(pair, low), 20),
+					     _mm_srli_epi64(pair, 32));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x / 8 * 10),
+				 _mm_shuffle_epi8(group, shuffle));
+	}
+
+	return x;
+}
+
+__attribute__((target("ssse3")))
+unsigned int RawPacker::pack12SSSE3(const uint16_t *input, uint8_t *output,
+				    unsigned int width)
+{
+	const unsigned int rowSize = (width * 12 + 7) / 8;
+
+	const __m128i pairs = _mm_setr_epi16(4096, 1, 4096, 1, 4096, 1, 4096, 1);
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+					      14, 13, 12, -1, -1, -1, -1);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 8 * 12 + 16 <= rowSize; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + x));
+
+		/* 24-bit pairs of samples. */
+		__m128i pair = _mm_madd_epi16(in, pairs);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + x / 8 * 12),
+				 _mm_shuffle_epi8(pair, shuffle));
+	}
+
+	return x;
+}
+
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+#if defined(__ARM_NEON)
+
+namespace {
+
+/* Shuffle the bytes of \a in, indices out of range producing zeros. */
+inline uint8x16_t shuffleNEON(uint8x16_t in, const uint8_t *indices)
+{
+	uint8x16_t index = vld1q_u8(indices);
+
+#if defined(__aarch64__)
+	return vqtbl1q_u8(in, index);
+#else
+	uint8x8x2_t table = { { vget_low_u8(in), vget_high_u8(in) } };
+	return vcombine_u8(vtbl2_u8(table, vget_low_u8(index)),
+			   vtbl2_u8(table, vget_high_u8(index)));
+#endif
+}
+
+} /* namespace */
+
+/*
+ * The NEON kernels follow the SSSE3 kernels. The unpack kernels gather the
+ * most significant bytes of 8 samples in the low half of a vector and the
+ * bytes holding their remaining bits in the high half, and shift the bits in
+ * place with per-lane shifts. The pack kernels assemble the bit stream in
+ * 32-bit or 64-bit lanes, and reorder its bytes to big-endian.
+ */
+unsigned int RawPacker::unpackCSI2P10NEON(const uint8_t *input, uint16_t *output,
+					  unsigned int width)
+{
+	const unsigned int rowSize = (width + 3) / 4 * 5;
+
+	static const uint8_t shuffle[16] = { 0, 1, 2, 3, 5, 6, 7, 8,
+					     4, 4, 4, 4, 9, 9, 9, 9 };
+	static const int16_t shift[8] = { 0, -2, -4, -6, 0, -2, -4, -6 };
+	const int16x8_t lsbShift = vld1q_s16(shift);
+	const uint16x8_t lsbMask = vdupq_n_u16(0x03);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 4 * 5 + 16 <= rowSize; x += 8) {
+		uint8x16_t in = shuffleNEON(vld1q_u8(input + x / 4 * 5), shuffle);
+
+		uint16x8_t msb = vshll_n_u8(vget_low_u8(in), 2);
+		uint16x8_t lsb = vshlq_u16(vmovl_u8(vget_high_u8(in)), lsbShift);
+
+		vst1q_u16(output + x, vorrq_u16(msb, vandq_u16(lsb, lsbMask)));
+	}
+
+	return x;
+}
+
+unsigned int RawPacker::unpackCSI2P12NEON(const uint8_t *input, uint16_t *output,
+					  unsigned int width)
+{
+	const unsigned int rowSize = (width + 1) / 2 * 3;
+
+	static const uint8_t shuffle[16] = { 0, 1, 3, 4, 6, 7, 9, 10,
+					     2, 2, 5, 5, 8, 8, 11, 11 };
+	static const int16_t shift[8] = { 0, -4, 0, -4, 0, -4, 0, -4 };
+	const int16x8_t lsbShift = vld1q_s16(shift);
+	const uint16x8_t lsbMask = vdupq_n_u16(0x0f);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 2 * 3 + 16 <= rowSize; x += 8) {
+		uint8x16_t in = shuffleNEON(vld1q_u8(input + x / 2 * 3), shuffle);
+
+		uint16x8_t msb = vshll_n_u8(vget_low_u8(in), 4);
+		uint16x8_t lsb = vshlq_u16(vmovl_u8(vget_high_u8(in)), lsbShift);
+
+		vst1q_u16(output + x, vorrq_u16(msb, vandq_u16(lsb, lsbMask)));
+	}
+
+	return x;
+}
+
+unsigned int RawPacker::unpackIPU3NEON(const uint8_t *input, uint16_t *output,
+				       unsigned int width)
+{
+	const unsigned int rowSize = (width + 24) / 25 * 32;
+
+	/*
+	 * Gather the low and high bytes holding each sample of two groups of
+	 * 4 samples in 5 bytes, and shift the sample to the bottom of the lane.
+	 */
+	static const uint8_t shuffle[16] = { 0, 1, 2, 3, 5, 6, 7, 8,
+					     1, 2, 3, 4, 6, 7, 8, 9 };
+	static const int16_t shift[8] = { 0, -2, -4, -6, 0, -2, -4, -6 };
+	const int16x8_t sampleShift = vld1q_s16(shift);
+	const uint16x8_t sampleMask = vdupq_n_u16(0x3ff);
+
+	unsigned int x = 0;
+	for (; x + 25 <= width && x / 25 * 32 + 36 <= rowSize; x += 25) {
+		const uint8_t *block = input + x / 25 * 32;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			uint8x16_t in = shuffleNEON(vld1q_u8(block + i * 10), shuffle);
+			uint16x8_t samples = vorrq_u16(vmovl_u8(vget_low_u8(in)),
+						       vshll_n_u8(vget_high_u8(in), 8));
+			samples = vshlq_u16(samples, sampleShift);
+
+			vst1q_u16(output + x + i * 8, vandq_u16(samples, sampleMask));
+		}
+
+		output[x + 24] = (block[30] | block[31] << 8) & 0x3ff;
+	}
+
+	return x;
+}
+
+unsigned int RawPacker::pack10NEON(const uint16_t *input, uint8_t *output,
+				   unsigned int width)
+{
+	const unsigned int rowSize = (width * 10 + 7) / 8;
+
+	static const uint8_t shuffle[16] = { 4, 3, 2, 1, 0, 12, 11, 10, 9, 8,
+					     0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	const uint32x4_t low16 = vdupq_n_u32(0xffff);
+	const uint64x2_t low32 = vdupq_n_u64(0xffffffff);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 8 * 10 + 16 <= rowSize; x += 8) {
+		uint32x4_t in = vreinterpretq_u32_u16(vld1q_u16(input + x));
+
+		/* 20-bit pairs, combined in 40-bit groups of 4 samples. */
+		uint32x4_t pair = vorrq_u32(vshlq_n_u32(vandq_u32(in, low16), 10),
+					    vshrq_n_u32(in, 16));
+		uint64x2_t pairs = vreinterpretq_u64_u32(pair);
+		uint64x2_t group = vorrq_u64(vshlq_n_u64(vandq_u64(pairs, low32), 20),
+					     vshrq_n_u64(pairs, 32));
+
+		vst1q_u8(output + x / 8 * 10,
+			 shuffleNEON(vreinterpretq_u8_u64(group), shuffle));
+	}
+
+	return x;
+}
+
+unsigned int RawPacker::pack12NEON(const uint16_t *input, uint8_t *output,
+				   unsigned int width)
+{
+	const unsigned int rowSize = (width * 12 + 7) / 8;
+
+	static const uint8_t shuffle[16] = { 2, 1, 0, 6, 5, 4, 10, 9, 8,
+					     14, 13, 12, 0xff, 0xff, 0xff, 0xff };
+	const uint32x4_t low16 = vdupq_n_u32(0xffff);
+
+	unsigned int x = 0;
+	for (; x + 8 <= width && x / 8 * 12 + 16 <= rowSize; x += 8) {
+		uint32x4_t in = vreinterpretq_u32_u16(vld1q_u16(input + x));
+
+		/* 24-bit pairs of samples. */
+		uint32x4_t pair = vorrq_u32(vshlq_n_u32(vandq_u32(in, low16), 12),
+					    vshrq_n_u32(in, 16));
+
+		vst1q_u8(output + x / 8 * 12,
+			 shuffleNEON(vreinterpretq_u8_u32(pair), shuffle));
+	}
+
+	return x;
+}
+
+#endif /* defined(__ARM_NEON) */
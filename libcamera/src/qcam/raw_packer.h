@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * raw_packer.h - qcam - Repack CSI-2 and IPU3 raw Bayer rows for DNG
+ */
+#ifndef __QCAM_RAW_PACKER_H__
+#define __QCAM_RAW_PACKER_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/pixel_format.h>
+
+class RawPacker
+{
+public:
+	enum Isa {
+		Scalar,
+		SSSE3,
+		NEON,
+	};
+
+	static std::vector<Isa> supportedIsas();
+	static const char *isaName(Isa isa);
+
+	RawPacker();
+
+	int configure(const libcamera::PixelFormat &format, unsigned int width);
+	int setIsa(Isa isa);
+
+	unsigned int bitsPerSample() const { return bitsPerSample_; }
+	unsigned int packedStride() const;
+
+	void unpack(const uint8_t *input, uint16_t *output) const;
+	void pack(const uint16_t *input, uint8_t *output) const;
+
+private:
+	enum Packing {
+		CSI2P10,
+		CSI2P12,
+		IPU3,
+	};
+
+	using UnpackKernel = unsigned int (*)(const uint8_t *input, uint16_t *output,
+					      unsigned int width);
+	using PackKernel = unsigned int (*)(const uint16_t *input, uint8_t *output,
+					    unsigned int width);
+
+	static void unpackScalar(Packing packing, const uint8_t *input,
+				 uint16_t *output, unsigned int start,
+				 unsigned int width);
+	static void packScalar(unsigned int bitsPerSample, const uint16_t *input,
+			       uint8_t *output, unsigned int start,
+			       unsigned int width);
+
+#if defined(__x86_64__) || defined(__i386__)
+	static unsigned int unpackCSI2P10SSSE3(const uint8_t *input, uint16_t *output,
+					       unsigned int width);
+	static unsigned int unpackCSI2P12SSSE3(const uint8_t *input, uint16_t *output,
+					       unsigned int width);
+	static unsigned int unpackIPU3SSSE3(const uint8_t *input, uint16_t *output,
+					    unsigned int width);
+	static unsigned int pack10SSSE3(const uint16_t *input, uint8_t *output,
+					unsigned int width);
+	static unsigned int pack12SSSE3(const uint16_t *input, uint8_t *output,
+					unsigned int width);
+#endif
+#if defined(__ARM_NEON)
+	static unsigned int unpackCSI2P10NEON(const uint8_t *input, uint16_t *output,
+					      unsigned int width);
+	static unsigned int unpackCSI2P12NEON(const uint8_t *input, uint16_t *output,
+					      unsigned int width);
+	static unsigned int unpackIPU3NEON(const uint8_t *input, uint16_t *output,
+					   unsigned int width);
+	static unsigned int pack10NEON(const uint16_t *input, uint8_t *output,
+				       unsigned int width);
+	static unsigned int pack12NEON(const uint16_t *input, uint8_t *output,
+				       unsigned int width);
+#endif
+
+	Packing packing_;
+	unsigned int bitsPerSample_;
+	unsigned int width_;
+
+	UnpackKernel unpackKernel_;
+	PackKernel packKernel_;
+};
+
+#endif /* __QCAM_RAW_PACKER_H__ */
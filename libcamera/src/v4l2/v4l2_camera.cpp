@@ -8,6 +8,7 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "libcamera/internal/log.h"
@@ -157,14 +158,8 @@ int V4L2Camera::validateConfiguration(const PixelFormat &pixelFormat,
 	return 0;
 }
 
-int V4L2Camera::allocBuffers(unsigned int count)
+int V4L2Camera::createRequests(unsigned int count)
 {
-	Stream *stream = config_->at(0).stream();
-
-	int ret = bufferAllocator_->allocate(stream);
-	if (ret < 0)
-		return ret;
-
 	for (unsigned int i = 0; i < count; i++) {
 		std::unique_ptr<Request> request = camera_->createRequest(i);
 		if (!request) {
@@ -174,6 +169,36 @@ int V4L2Camera::allocBuffers(unsigned int count)
 		requestPool_.push_back(std::move(request));
 	}
 
+	return 0;
+}
+
+int V4L2Camera::allocBuffers(unsigned int count)
+{
+	Stream *stream = config_->at(0).stream();
+
+	int ret = bufferAllocator_->allocate(stream);
+	if (ret < 0)
+		return ret;
+
+	int err = createRequests(count);
+	if (err < 0)
+		return err;
+
+	return ret;
+}
+
+/*
+ * Prepare \a count buffer slots for dmabufs provided by the application. The
+ * buffers are set with setBuffer() when queued.
+ */
+int V4L2Camera::importBuffers(unsigned int count)
+{
+	externalBuffers_.resize(count);
+
+	int ret = createRequests(count);
+	if (ret < 0)
+		externalBuffers_.clear();
+
 	return ret;
 }
 
@@ -182,6 +207,11 @@ void V4L2Camera::freeBuffers()
 	pendingRequests_.clear();
 	requestPool_.clear();
 
+	if (!externalBuffers_.empty()) {
+		externalBuffers_.clear();
+		return;
+	}
+
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
@@ -198,6 +228,38 @@ FileDescriptor V4L2Camera::getBufferFd(unsigned int index)
 	return buffers[index]->planes()[0].fd;
 }
 
+/*
+ * Wrap the dmabuf \a fd in the FrameBuffer used for buffer \a index. The
+ * FrameBuffer is kept when the application queues the same dmabuf again, to
+ * let the pipeline handler reuse its mapping of the buffer.
+ */
+int V4L2Camera::setBuffer(unsigned int index, int fd, unsigned int length)
+{
+	if (index >= externalBuffers_.size())
+		return -EINVAL;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	ExternalBuffer &external = externalBuffers_[index];
+	if (external.buffer && external.inode == st.st_ino &&
+	    external.buffer->planes()[0].length == length)
+		return 0;
+
+	FrameBuffer::Plane plane;
+	plane.fd = FileDescriptor(fd);
+	plane.length = length;
+	if (!plane.fd.isValid())
+		return -EBADF;
+
+	external.buffer = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane },
+							index);
+	external.inode = st.st_ino;
+
+	return 0;
+}
+
 int V4L2Camera::streamOn()
 {
 	if (isRunning_)
@@ -254,7 +316,14 @@ int V4L2Camera::qbuf(unsigned int index)
 	Request *request = requestPool_[index].get();
 
 	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
+	FrameBuffer *buffer = externalBuffers_.empty()
+			    ? bufferAllocator_->buffers(stream)[index].get()
+			    : externalBuffers_[index].buffer.get();
+	if (!buffer) {
+		LOG(V4L2Compat, Error) << "No buffer set for index " << index;
+		return -EINVAL;
+	}
+
 	int ret = request->addBuffer(stream, buffer);
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
@@ -10,6 +10,7 @@
 
 #include <deque>
 #include <mutex>
+#include <sys/types.h>
 #include <utility>
 
 #include <libcamera/buffer.h>
@@ -52,8 +53,10 @@ public:
 				  StreamConfiguration *streamConfigOut);
 
 	int allocBuffers(unsigned int count);
+	int importBuffers(unsigned int count);
 	void freeBuffers();
 	FileDescriptor getBufferFd(unsigned int index);
+	int setBuffer(unsigned int index, int fd, unsigned int length);
 
 	int streamOn();
 	int streamOff();
@@ -66,6 +69,12 @@ public:
 	bool isRunning();
 
 private:
+	struct ExternalBuffer {
+		std::unique_ptr<FrameBuffer> buffer;
+		ino_t inode;
+	};
+
+	int createRequests(unsigned int count);
 	void requestComplete(Request *request);
 
 	std::shared_ptr<Camera> camera_;
@@ -77,6 +86,7 @@ private:
 	FrameBufferAllocator *bufferAllocator_;
 
 	std::vector<std::unique_ptr<Request>> requestPool_;
+	std::vector<ExternalBuffer> externalBuffers_;
 
 	std::deque<Request *> pendingRequests_;
 	std::deque<std::unique_ptr<Buffer>> completedBuffers_;
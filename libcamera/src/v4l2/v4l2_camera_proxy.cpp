@@ -34,11 +34,57 @@ using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat)
 
+namespace {
+
+/* Default number of buffers cycled for read() I/O. */
+constexpr unsigned int kDefaultReadBuffers = 4;
+
+/*
+ * Formats with non-contiguous planes, mapped to the contiguous format that
+ * libcamera produces. The planes are exposed at offsets within a single
+ * buffer.
+ */
+const std::map<uint32_t, uint32_t> noncontiguousFormats = {
+	{ V4L2_PIX_FMT_NV12M, V4L2_PIX_FMT_NV12 },
+	{ V4L2_PIX_FMT_NV21M, V4L2_PIX_FMT_NV21 },
+	{ V4L2_PIX_FMT_NV16M, V4L2_PIX_FMT_NV16 },
+	{ V4L2_PIX_FMT_NV61M, V4L2_PIX_FMT_NV61 },
+	{ V4L2_PIX_FMT_YUV420M, V4L2_PIX_FMT_YUV420 },
+	{ V4L2_PIX_FMT_YVU420M, V4L2_PIX_FMT_YVU420 },
+	{ V4L2_PIX_FMT_YUV422M, V4L2_PIX_FMT_YUV422P },
+};
+
+uint32_t contiguousFormat(uint32_t fourcc)
+{
+	auto iter = noncontiguousFormats.find(fourcc);
+	return iter != noncontiguousFormats.end() ? iter->second : fourcc;
+}
+
+uint32_t noncontiguousFormat(uint32_t fourcc)
+{
+	for (const auto &[noncontiguous, contiguous] : noncontiguousFormats) {
+		if (contiguous == fourcc)
+			return noncontiguous;
+	}
+
+	return 0;
+}
+
+} /* namespace */
+
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
 	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
+	  noncontiguous_(false), memory_(V4L2_MEMORY_MMAP), reading_(false),
 	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
 {
+	const char *mplane = utils::secure_getenv("LIBCAMERA_V4L2_COMPAT_MPLANE");
+	multiPlanar_ = mplane && *mplane && strcmp(mplane, "0");
+
+	const char *readBuffers = utils::secure_getenv("LIBCAMERA_V4L2_COMPAT_READ_BUFFERS");
+	readBufferCount_ = readBuffers ? std::max(atoi(readBuffers), 1)
+				       : kDefaultReadBuffers;
+
 	querycap(camera);
 }
 
@@ -84,6 +130,9 @@ void V4L2CameraProxy::close(V4L2CameraFile *file)
 
 	files_.erase(file);
 
+	if (reading_ && hasOwnership(file))
+		readStop();
+
 	release(file);
 
 	if (--refcount_ > 0)
@@ -100,14 +149,27 @@ void *V4L2CameraProxy::mmap(void *addr, size_t length, int prot, int flags,
 	MutexLocker locker(proxyMutex_);
 
 	/* \todo Validate prot and flags properly. */
-	if (prot != (PROT_READ | PROT_WRITE)) {
+	if (memory_ != V4L2_MEMORY_MMAP || reading_ ||
+	    prot != (PROT_READ | PROT_WRITE)) {
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
 
+	/*
+	 * The offset selects a buffer, and a plane within the buffer for
+	 * non-contiguous formats. Planes are mapped with the whole buffer.
+	 */
 	unsigned int index = offset / sizeimage_;
-	if (static_cast<off_t>(index * sizeimage_) != offset ||
-	    length != sizeimage_) {
+	unsigned int planeOffset = offset % sizeimage_;
+	unsigned int plane;
+
+	for (plane = 0; plane < numPlanes(); plane++) {
+		if (planeOffsets_[plane] == planeOffset)
+			break;
+	}
+
+	if (plane == numPlanes() || length != planeSize(plane) ||
+	    (planeOffset && (flags & MAP_FIXED))) {
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
@@ -118,13 +180,15 @@ void *V4L2CameraProxy::mmap(void *addr, size_t length, int prot, int flags,
 		return MAP_FAILED;
 	}
 
-	void *map = V4L2CompatManager::instance()->fops().mmap(addr, length, prot,
-							       flags, fd.fd(), 0);
-	if (map == MAP_FAILED)
-		return map;
+	void *base = V4L2CompatManager::instance()->fops().mmap(addr, sizeimage_, prot,
+								flags, fd.fd(), 0);
+	if (base == MAP_FAILED)
+		return base;
+
+	void *map = static_cast<uint8_t *>(base) + planeOffset;
 
 	buffers_[index].flags |= V4L2_BUF_FLAG_MAPPED;
-	mmaps_[map] = index;
+	mmaps_[map] = { index, base, length };
 
 	return map;
 }
@@ -136,16 +200,17 @@ int V4L2CameraProxy::munmap(void *addr, size_t length)
 	MutexLocker locker(proxyMutex_);
 
 	auto iter = mmaps_.find(addr);
-	if (iter == mmaps_.end() || length != sizeimage_) {
+	if (iter == mmaps_.end() || length != iter->second.length) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (V4L2CompatManager::instance()->fops().munmap(addr, length))
+	const Mapping &mapping = iter->second;
+	if (V4L2CompatManager::instance()->fops().munmap(mapping.base, sizeimage_))
 		LOG(V4L2Compat, Error) << "Failed to unmap " << addr
 				       << " with length " << length;
 
-	buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
+	buffers_[mapping.index].flags &= ~V4L2_BUF_FLAG_MAPPED;
 	mmaps_.erase(iter);
 
 	return 0;
@@ -153,12 +218,50 @@ int V4L2CameraProxy::munmap(void *addr, size_t length)
 
 bool V4L2CameraProxy::validateBufferType(uint32_t type)
 {
-	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	return type == (multiPlanar_ ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+				     : V4L2_BUF_TYPE_VIDEO_CAPTURE);
 }
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == V4L2_MEMORY_MMAP || memory == V4L2_MEMORY_USERPTR ||
+	       memory == V4L2_MEMORY_DMABUF;
+}
+
+/*
+ * Multi-planar buffers carry an array of planes, which must be large enough for
+ * the planes of the format.
+ */
+bool V4L2CameraProxy::validatePlanes(const struct v4l2_buffer *arg)
+{
+	if (!multiPlanar_)
+		return true;
+
+	return arg->m.planes && arg->length >= numPlanes();
+}
+
+/*
+ * libcamera can't capture to arbitrary user memory. USERPTR buffers are thus
+ * backed by buffers allocated by the camera, which are copied to the user
+ * memory when dequeued. The same mappings serve read() I/O.
+ */
+int V4L2CameraProxy::mapBuffers()
+{
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		FileDescriptor fd = vcam_->getBufferFd(i);
+		if (!fd.isValid())
+			return -EINVAL;
+
+		void *map = V4L2CompatManager::instance()->fops().mmap(nullptr, sizeimage_,
+								       PROT_READ, MAP_SHARED,
+								       fd.fd(), 0);
+		if (map == MAP_FAILED)
+			return -errno;
+
+		bufferMaps_.emplace_back(map, sizeimage_);
+	}
+
+	return 0;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -179,6 +282,57 @@ void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
 	v4l2PixFormat_.xfer_func    = V4L2_XFER_FUNC_DEFAULT;
 
 	sizeimage_ = streamConfig.frameSize;
+
+	setMplaneFormat(&v4l2PixFormatMplane_, streamConfig, noncontiguous_);
+
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < numPlanes(); i++) {
+		planeOffsets_[i] = offset;
+		offset += planeSize(i);
+	}
+}
+
+/*
+ * Fill the multi-planar format \a pix for \a streamConfig, with one plane for
+ * each colour component when \a noncontiguous is set and the format has a
+ * non-contiguous variant.
+ */
+void V4L2CameraProxy::setMplaneFormat(struct v4l2_pix_format_mplane *pix,
+				      const StreamConfiguration &streamConfig,
+				      bool noncontiguous)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(streamConfig.pixelFormat);
+	uint32_t fourcc = noncontiguous ? noncontiguousFormat(info.v4l2Format) : 0;
+
+	memset(pix, 0, sizeof(*pix));
+
+	pix->width        = streamConfig.size.width;
+	pix->height       = streamConfig.size.height;
+	pix->pixelformat  = fourcc ? fourcc : static_cast<uint32_t>(info.v4l2Format);
+	pix->field        = V4L2_FIELD_NONE;
+	pix->colorspace   = V4L2_COLORSPACE_SRGB;
+	pix->ycbcr_enc    = V4L2_YCBCR_ENC_DEFAULT;
+	pix->quantization = V4L2_QUANTIZATION_DEFAULT;
+	pix->xfer_func    = V4L2_XFER_FUNC_DEFAULT;
+
+	if (!fourcc) {
+		pix->num_planes = 1;
+		pix->plane_fmt[0].bytesperline = streamConfig.stride;
+		pix->plane_fmt[0].sizeimage = streamConfig.frameSize;
+		return;
+	}
+
+	/* The planes of contiguous formats are laid out back to back. */
+	pix->num_planes = info.numPlanes();
+	for (unsigned int i = 0; i < pix->num_planes; i++) {
+		const PixelFormatPlaneInfo &plane = info.planes[i];
+		unsigned int stride = streamConfig.stride * plane.bytesPerGroup
+				    / info.planes[0].bytesPerGroup;
+
+		pix->plane_fmt[i].bytesperline = stride;
+		pix->plane_fmt[i].sizeimage = stride * streamConfig.size.height
+					    / plane.verticalSubSampling;
+	}
 }
 
 void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
@@ -194,7 +348,9 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 		       sizeof(capabilities_.bus_info));
 	/* \todo Put this in a header/config somewhere. */
 	capabilities_.version = KERNEL_VERSION(5, 2, 0);
-	capabilities_.device_caps = V4L2_CAP_VIDEO_CAPTURE
+	capabilities_.device_caps = (multiPlanar_ ? V4L2_CAP_VIDEO_CAPTURE_MPLANE
+						  : V4L2_CAP_VIDEO_CAPTURE)
+				  | V4L2_CAP_READWRITE
 				  | V4L2_CAP_STREAMING
 				  | V4L2_CAP_EXT_PIX_FORMAT;
 	capabilities_.capabilities = capabilities_.device_caps
@@ -212,6 +368,17 @@ void V4L2CameraProxy::updateBuffers()
 		switch (fmd.status) {
 		case FrameMetadata::FrameSuccess:
 			buf.bytesused = fmd.planes[0].bytesused;
+
+			/* Split the payload over non-contiguous planes. */
+			for (unsigned int i = 0; multiPlanar_ && i < numPlanes(); i++) {
+				unsigned int offset = planeOffsets_[i];
+				unsigned int bytesused = buf.bytesused > offset
+						       ? buf.bytesused - offset : 0;
+
+				bufferPlanes_[buffer.index_][i].bytesused =
+					std::min(bytesused, planeSize(i));
+			}
+
 			buf.field = V4L2_FIELD_NONE;
 			buf.timestamp.tv_sec = fmd.timestamp / 1000000000;
 			buf.timestamp.tv_usec = fmd.timestamp % 1000000;
@@ -241,7 +408,7 @@ int V4L2CameraProxy::vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_fr
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_enum_framesizes fd = " << file->efd();
 
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->pixel_format);
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(contiguousFormat(arg->pixel_format));
 	PixelFormat format = PixelFormatInfo::info(v4l2Format).format;
 	/*
 	 * \todo This might need to be expanded as few pipeline handlers
@@ -264,18 +431,31 @@ int V4L2CameraProxy::vidioc_enum_fmt(V4L2CameraFile *file, struct v4l2_fmtdesc *
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_enum_fmt fd = " << file->efd();
 
-	if (!validateBufferType(arg->type) ||
-	    arg->index >= streamConfig_.formats().pixelformats().size())
+	if (!validateBufferType(arg->type))
 		return -EINVAL;
 
-	PixelFormat format = streamConfig_.formats().pixelformats()[arg->index];
+	/*
+	 * The multi-planar API lists the non-contiguous variant of each format
+	 * after the format itself.
+	 */
+	std::vector<uint32_t> fourccs;
+	for (const PixelFormat &format : streamConfig_.formats().pixelformats()) {
+		uint32_t fourcc = PixelFormatInfo::info(format).v4l2Format;
+		fourccs.push_back(fourcc);
+
+		if (multiPlanar_ && noncontiguousFormat(fourcc))
+			fourccs.push_back(noncontiguousFormat(fourcc));
+	}
+
+	if (arg->index >= fourccs.size())
+		return -EINVAL;
 
 	/* \todo Set V4L2_FMT_FLAG_COMPRESSED for compressed formats. */
 	arg->flags = 0;
 	/* \todo Add map from format to description. */
 	utils::strlcpy(reinterpret_cast<char *>(arg->description),
 		       "Video Format Description", sizeof(arg->description));
-	arg->pixelformat = PixelFormatInfo::info(format).v4l2Format;
+	arg->pixelformat = fourccs[arg->index];
 
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
@@ -290,16 +470,23 @@ int V4L2CameraProxy::vidioc_g_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 		return -EINVAL;
 
 	memset(&arg->fmt, 0, sizeof(arg->fmt));
-	arg->fmt.pix = v4l2PixFormat_;
+	if (multiPlanar_)
+		arg->fmt.pix_mp = v4l2PixFormatMplane_;
+	else
+		arg->fmt.pix = v4l2PixFormat_;
 
 	return 0;
 }
 
 int V4L2CameraProxy::tryFormat(struct v4l2_format *arg)
 {
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->fmt.pix.pixelformat);
+	uint32_t fourcc = multiPlanar_ ? arg->fmt.pix_mp.pixelformat
+				       : arg->fmt.pix.pixelformat;
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(contiguousFormat(fourcc));
 	PixelFormat format = PixelFormatInfo::info(v4l2Format).format;
-	Size size(arg->fmt.pix.width, arg->fmt.pix.height);
+	Size size = multiPlanar_
+		  ? Size(arg->fmt.pix_mp.width, arg->fmt.pix_mp.height)
+		  : Size(arg->fmt.pix.width, arg->fmt.pix.height);
 
 	StreamConfiguration config;
 	int ret = vcam_->validateConfiguration(format, size, &config);
@@ -310,6 +497,12 @@ int V4L2CameraProxy::tryFormat(struct v4l2_format *arg)
 		return -EINVAL;
 	}
 
+	if (multiPlanar_) {
+		setMplaneFormat(&arg->fmt.pix_mp, config,
+				contiguousFormat(fourcc) != fourcc);
+		return 0;
+	}
+
 	const PixelFormatInfo &info = PixelFormatInfo::info(config.pixelFormat);
 
 	arg->fmt.pix.width        = config.size.width;
@@ -345,14 +538,21 @@ int V4L2CameraProxy::vidioc_s_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 	if (ret < 0)
 		return ret;
 
+	uint32_t fourcc = arg->fmt.pix.pixelformat;
 	Size size(arg->fmt.pix.width, arg->fmt.pix.height);
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->fmt.pix.pixelformat);
+	if (multiPlanar_) {
+		fourcc = arg->fmt.pix_mp.pixelformat;
+		size = Size(arg->fmt.pix_mp.width, arg->fmt.pix_mp.height);
+	}
+
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(contiguousFormat(fourcc));
 	ret = vcam_->configure(&streamConfig_, size,
 			       PixelFormatInfo::info(v4l2Format).format,
 			       bufferCount_);
 	if (ret < 0)
 		return -EINVAL;
 
+	noncontiguous_ = contiguousFormat(fourcc) != fourcc;
 	setFmtFromConfig(streamConfig_);
 
 	return 0;
@@ -446,11 +646,161 @@ void V4L2CameraProxy::freeBuffers()
 {
 	LOG(V4L2Compat, Debug) << "Freeing libcamera bufs";
 
+	for (const auto &[map, length] : bufferMaps_)
+		V4L2CompatManager::instance()->fops().munmap(map, length);
+	bufferMaps_.clear();
+
 	vcam_->freeBuffers();
 	buffers_.clear();
+	bufferPlanes_.clear();
 	bufferCount_ = 0;
 }
 
+/*
+ * Configure the camera for \a count buffers of the \a memory type, and
+ * allocate them. Return the number of buffers, or a negative error code.
+ */
+int V4L2CameraProxy::allocBuffers(unsigned int count, uint32_t memory)
+{
+	if (bufferCount_ > 0)
+		freeBuffers();
+
+	Size size(v4l2PixFormat_.width, v4l2PixFormat_.height);
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(v4l2PixFormat_.pixelformat);
+	int ret = vcam_->configure(&streamConfig_, size,
+				   PixelFormatInfo::info(v4l2Format).format,
+				   count);
+	if (ret < 0)
+		return -EINVAL;
+
+	setFmtFromConfig(streamConfig_);
+
+	count = streamConfig_.bufferCount;
+	memory_ = memory;
+
+	/* DMABUF buffers are provided by the application when queued. */
+	if (memory_ == V4L2_MEMORY_DMABUF)
+		ret = vcam_->importBuffers(count);
+	else
+		ret = vcam_->allocBuffers(count);
+	if (ret < 0)
+		return ret;
+
+	bufferCount_ = count;
+
+	if (memory_ == V4L2_MEMORY_USERPTR || reading_) {
+		ret = mapBuffers();
+		if (ret < 0) {
+			freeBuffers();
+			return ret;
+		}
+	}
+
+	buffers_.resize(count);
+	bufferPlanes_.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		struct v4l2_buffer buf = {};
+		buf.type = multiPlanar_ ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+					: V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.length = multiPlanar_ ? numPlanes() : sizeimage_;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP && !multiPlanar_)
+			buf.m.offset = i * sizeimage_;
+		buf.index = i;
+		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+		buffers_[i] = buf;
+
+		for (unsigned int j = 0; multiPlanar_ && j < numPlanes(); j++) {
+			struct v4l2_plane &plane = bufferPlanes_[i][j];
+			plane = {};
+			plane.length = planeSize(j);
+			if (memory_ == V4L2_MEMORY_MMAP)
+				plane.m.mem_offset = i * sizeimage_ + planeOffsets_[j];
+		}
+	}
+
+	return count;
+}
+
+/* Copy buffer \a index to \a arg, including the planes of multi-planar buffers. */
+void V4L2CameraProxy::fillBuffer(unsigned int index, struct v4l2_buffer *arg)
+{
+	struct v4l2_plane *planes = arg->m.planes;
+
+	*arg = buffers_[index];
+
+	if (multiPlanar_) {
+		arg->m.planes = planes;
+		std::copy(bufferPlanes_[index].begin(),
+			  bufferPlanes_[index].begin() + numPlanes(), planes);
+	}
+}
+
+int V4L2CameraProxy::queueBuffer(unsigned int index)
+{
+	int ret = vcam_->qbuf(index);
+	if (ret < 0)
+		return ret;
+
+	buffers_[index].flags |= V4L2_BUF_FLAG_QUEUED;
+
+	return 0;
+}
+
+/*
+ * Dequeue the next completed buffer, once the camera reported one as
+ * available. Buffers complete in the order they have been queued.
+ */
+unsigned int V4L2CameraProxy::dequeueBuffer(V4L2CameraFile *file)
+{
+	updateBuffers();
+
+	unsigned int index = currentBuf_;
+	struct v4l2_buffer &buf = buffers_[index];
+
+	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
+
+	if (memory_ == V4L2_MEMORY_MMAP && !multiPlanar_)
+		buf.length = sizeimage_;
+	else if (memory_ == V4L2_MEMORY_USERPTR &&
+		 !(buf.flags & V4L2_BUF_FLAG_ERROR))
+		copyToUser(index);
+
+	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
+
+	uint64_t data;
+	int ret = V4L2CompatManager::instance()->fops().read(file->efd(), &data,
+							     sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+
+	return index;
+}
+
+void V4L2CameraProxy::copyToUser(unsigned int index)
+{
+	const auto &[map, length] = bufferMaps_[index];
+	const uint8_t *data = static_cast<const uint8_t *>(map);
+
+	if (!multiPlanar_) {
+		const struct v4l2_buffer &buf = buffers_[index];
+		memcpy(reinterpret_cast<void *>(buf.m.userptr), data,
+		       std::min<size_t>(buf.bytesused, length));
+		return;
+	}
+
+	for (unsigned int i = 0; i < numPlanes(); i++) {
+		const struct v4l2_plane &plane = bufferPlanes_[index][i];
+		if (planeOffsets_[i] >= length)
+			break;
+
+		memcpy(reinterpret_cast<void *>(plane.m.userptr),
+		       data + planeOffsets_[i],
+		       std::min<size_t>(plane.bytesused, length - planeOffsets_[i]));
+	}
+}
+
 int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg)
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_reqbufs fd = " << file->efd();
@@ -467,7 +817,9 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_USERPTR
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
 	if (arg->count == 0) {
@@ -484,40 +836,13 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 		return 0;
 	}
 
-	if (bufferCount_ > 0)
-		freeBuffers();
-
-	Size size(v4l2PixFormat_.width, v4l2PixFormat_.height);
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(v4l2PixFormat_.pixelformat);
-	int ret = vcam_->configure(&streamConfig_, size,
-				   PixelFormatInfo::info(v4l2Format).format,
-				   arg->count);
-	if (ret < 0)
-		return -EINVAL;
-
-	setFmtFromConfig(streamConfig_);
-
-	arg->count = streamConfig_.bufferCount;
-	bufferCount_ = arg->count;
-
-	ret = vcam_->allocBuffers(arg->count);
+	int ret = allocBuffers(arg->count, arg->memory);
 	if (ret < 0) {
 		arg->count = 0;
 		return ret;
 	}
 
-	buffers_.resize(arg->count);
-	for (unsigned int i = 0; i < arg->count; i++) {
-		struct v4l2_buffer buf = {};
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
-		buf.index = i;
-		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
-
-		buffers_[i] = buf;
-	}
+	arg->count = ret;
 
 	LOG(V4L2Compat, Debug) << "Allocated " << arg->count << " buffers";
 
@@ -534,12 +859,13 @@ int V4L2CameraProxy::vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *a
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
+	    !validatePlanes(arg) ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
 	updateBuffers();
 
-	*arg = buffers_[arg->index];
+	fillBuffer(arg->index, arg);
 
 	return 0;
 }
@@ -559,16 +885,83 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 		return -EBUSY;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
+	    !validatePlanes(arg) ||
+	    arg->memory != memory_ ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
+	struct v4l2_buffer &buf = buffers_[arg->index];
+	int ret;
+
+	switch (memory_) {
+	case V4L2_MEMORY_USERPTR:
+		if (multiPlanar_) {
+			for (unsigned int i = 0; i < numPlanes(); i++) {
+				const struct v4l2_plane &plane = arg->m.planes[i];
+				if (!plane.m.userptr || plane.length < planeSize(i))
+					return -EINVAL;
+			}
+
+			for (unsigned int i = 0; i < numPlanes(); i++) {
+				bufferPlanes_[arg->index][i].m.userptr = arg->m.planes[i].m.userptr;
+				bufferPlanes_[arg->index][i].length = arg->m.planes[i].length;
+			}
+			break;
+		}
+
+		if (!arg->m.userptr || arg->length < sizeimage_)
+			return -EINVAL;
+
+		buf.m.userptr = arg->m.userptr;
+		buf.length = arg->length;
+		break;
+
+	case V4L2_MEMORY_DMABUF: {
+		/*
+		 * The planes of non-contiguous formats would each need their
+		 * own dmabuf, which the camera can't capture to.
+		 */
+		if (multiPlanar_ && numPlanes() > 1)
+			return -EINVAL;
+
+		int fd = multiPlanar_ ? arg->m.planes[0].m.fd : arg->m.fd;
+		off_t length = multiPlanar_ ? arg->m.planes[0].length : arg->length;
+
+		/*
+		 * A zero length selects the size of the dmabuf. The fd belongs
+		 * to the application, restore its offset after measuring it.
+		 */
+		if (!length) {
+			off_t offset = lseek(fd, 0, SEEK_CUR);
+			length = lseek(fd, 0, SEEK_END);
+			if (offset >= 0)
+				lseek(fd, offset, SEEK_SET);
+		}
+		if (length < static_cast<off_t>(sizeimage_))
+			return -EINVAL;
+
+		ret = vcam_->setBuffer(arg->index, fd, length);
+		if (ret < 0)
+			return ret;
+
+		if (multiPlanar_) {
+			bufferPlanes_[arg->index][0].m.fd = fd;
+			bufferPlanes_[arg->index][0].length = length;
+		} else {
+			buf.m.fd = fd;
+			buf.length = length;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	ret = queueBuffer(arg->index);
 	if (ret < 0)
 		return ret;
 
-	buffers_[arg->index].flags |= V4L2_BUF_FLAG_QUEUED;
-
 	arg->flags = buffers_[arg->index].flags;
 
 	return ret;
@@ -589,7 +982,8 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    !validatePlanes(arg) ||
+	    arg->memory != memory_)
 		return -EINVAL;
 
 	if (!file->nonBlocking()) {
@@ -606,20 +1000,8 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 	if (!vcam_->isRunning())
 		return -EINVAL;
 
-	updateBuffers();
-
-	struct v4l2_buffer &buf = buffers_[currentBuf_];
-
-	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
-	buf.length = sizeimage_;
-	*arg = buf;
-
-	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
-
-	uint64_t data;
-	int ret = ::read(file->efd(), &data, sizeof(data));
-	if (ret != sizeof(data))
-		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+	unsigned int index = dequeueBuffer(file);
+	fillBuffer(index, arg);
 
 	return 0;
 }
@@ -669,6 +1051,156 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 	return ret;
 }
 
+/*
+ * Start capturing for read() I/O, to buffers that are queued back as soon as
+ * they are read.
+ */
+int V4L2CameraProxy::readStart(V4L2CameraFile *file)
+{
+	if (bufferCount_ > 0 || vcam_->isRunning())
+		return -EBUSY;
+
+	if (file->priority() < maxPriority())
+		return -EBUSY;
+
+	int ret = acquire(file);
+	if (ret < 0)
+		return ret;
+
+	reading_ = true;
+
+	ret = allocBuffers(readBufferCount_, V4L2_MEMORY_MMAP);
+	if (ret < 0) {
+		reading_ = false;
+		release(file);
+		return ret;
+	}
+
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		ret = queueBuffer(i);
+		if (ret < 0)
+			break;
+	}
+
+	currentBuf_ = 0;
+
+	if (!ret)
+		ret = vcam_->streamOn();
+
+	if (ret < 0) {
+		readStop();
+		release(file);
+		return ret;
+	}
+
+	LOG(V4L2Compat, Debug) << "Started read() capture with "
+			       << bufferCount_ << " buffers";
+
+	return 0;
+}
+
+void V4L2CameraProxy::readStop()
+{
+	vcam_->streamOff();
+	freeBuffers();
+	reading_ = false;
+}
+
+/*
+ * Copy the most recent frame to \a buf, and queue older completed frames back
+ * to the camera without copying them.
+ */
+ssize_t V4L2CameraProxy::readFrame(V4L2CameraFile *file, void *buf, size_t count,
+				   MutexLocker *locker)
+{
+	if (!reading_) {
+		int ret = readStart(file);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (!hasOwnership(file))
+		return -EBUSY;
+
+	if (!file->nonBlocking()) {
+		locker->unlock();
+		vcam_->waitForBufferAvailable();
+		locker->lock();
+	} else if (!vcam_->isBufferAvailable())
+		return -EAGAIN;
+
+	/* The file may have been closed while we were blocked. */
+	if (!reading_ || !vcam_->isRunning())
+		return -EINVAL;
+
+	unsigned int index = dequeueBuffer(file);
+	while (vcam_->isBufferAvailable()) {
+		int ret = queueBuffer(index);
+		if (ret < 0)
+			return ret;
+
+		index = dequeueBuffer(file);
+	}
+
+	const struct v4l2_buffer &vbuf = buffers_[index];
+	bool error = vbuf.flags & V4L2_BUF_FLAG_ERROR;
+	size_t length = std::min<size_t>({ count, vbuf.bytesused,
+					   bufferMaps_[index].second });
+
+	if (!error)
+		memcpy(buf, bufferMaps_[index].first, length);
+
+	int ret = queueBuffer(index);
+	if (ret < 0)
+		return ret;
+
+	return error ? -EIO : length;
+}
+
+ssize_t V4L2CameraProxy::read(V4L2CameraFile *file, void *buf, size_t count)
+{
+	LOG(V4L2Compat, Debug) << "Servicing read fd = " << file->efd();
+
+	MutexLocker locker(proxyMutex_);
+
+	ssize_t ret = readFrame(file, buf, count, &locker);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Start capturing for read() I/O when \a file is polled for input, as the
+ * kernel does, unless capture has been set up already with either I/O method.
+ * Failures are reported by the read() call that follows.
+ */
+void V4L2CameraProxy::pollStart(V4L2CameraFile *file)
+{
+	MutexLocker locker(proxyMutex_);
+
+	if (reading_ || bufferCount_ > 0 || vcam_->isRunning())
+		return;
+
+	int ret = readStart(file);
+	if (ret < 0)
+		LOG(V4L2Compat, Debug)
+			<< "Can't start read() capture on poll: "
+			<< strerror(-ret);
+}
+
+/* Streaming I/O ioctls, which are unavailable while capturing for read(). */
+const std::set<unsigned long> V4L2CameraProxy::streamingIoctls_ = {
+	VIDIOC_S_FMT,
+	VIDIOC_REQBUFS,
+	VIDIOC_QBUF,
+	VIDIOC_DQBUF,
+	VIDIOC_STREAMON,
+	VIDIOC_STREAMOFF,
+};
+
 const std::set<unsigned long> V4L2CameraProxy::supportedIoctls_ = {
 	VIDIOC_QUERYCAP,
 	VIDIOC_ENUM_FRAMESIZES,
@@ -703,6 +1235,11 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *ar
 		return -1;
 	}
 
+	if (reading_ && streamingIoctls_.count(request)) {
+		errno = EBUSY;
+		return -1;
+	}
+
 	if (!arg && (_IOC_DIR(request) & _IOC_READ)) {
 		errno = EFAULT;
 		return -1;
@@ -8,12 +8,14 @@
 #ifndef __V4L2_CAMERA_PROXY_H__
 #define __V4L2_CAMERA_PROXY_H__
 
+#include <array>
 #include <linux/videodev2.h>
 #include <map>
 #include <memory>
 #include <set>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <utility>
 #include <vector>
 
 #include <libcamera/camera.h>
@@ -35,16 +37,45 @@ public:
 	int munmap(void *addr, size_t length);
 
 	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg);
+	ssize_t read(V4L2CameraFile *file, void *buf, size_t count);
+	void pollStart(V4L2CameraFile *file);
 
 private:
+	struct Mapping {
+		unsigned int index;
+		void *base;
+		size_t length;
+	};
+
 	bool validateBufferType(uint32_t type);
 	bool validateMemoryType(uint32_t memory);
+	bool validatePlanes(const struct v4l2_buffer *arg);
+	int mapBuffers();
 	void setFmtFromConfig(const StreamConfiguration &streamConfig);
+	static void setMplaneFormat(struct v4l2_pix_format_mplane *pix,
+				    const StreamConfiguration &streamConfig,
+				    bool noncontiguous);
 	void querycap(std::shared_ptr<Camera> camera);
 	int tryFormat(struct v4l2_format *arg);
 	enum v4l2_priority maxPriority();
 	void updateBuffers();
+	int allocBuffers(unsigned int count, uint32_t memory);
 	void freeBuffers();
+	void fillBuffer(unsigned int index, struct v4l2_buffer *arg);
+	int queueBuffer(unsigned int index);
+	unsigned int dequeueBuffer(V4L2CameraFile *file);
+	void copyToUser(unsigned int index);
+
+	unsigned int numPlanes() const { return v4l2PixFormatMplane_.num_planes; }
+	unsigned int planeSize(unsigned int plane) const
+	{
+		return v4l2PixFormatMplane_.plane_fmt[plane].sizeimage;
+	}
+
+	int readStart(V4L2CameraFile *file);
+	void readStop();
+	ssize_t readFrame(V4L2CameraFile *file, void *buf, size_t count,
+			  MutexLocker *locker);
 
 	int vidioc_querycap(struct v4l2_capability *arg);
 	int vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_frmsizeenum *arg);
@@ -69,6 +100,7 @@ private:
 	void release(V4L2CameraFile *file);
 
 	static const std::set<unsigned long> supportedIoctls_;
+	static const std::set<unsigned long> streamingIoctls_;
 
 	unsigned int refcount_;
 	unsigned int index_;
@@ -81,8 +113,26 @@ private:
 	struct v4l2_capability capabilities_;
 	struct v4l2_pix_format v4l2PixFormat_;
 
+	/*
+	 * The multi-planar API, selected with an environment variable, and
+	 * the planes of its format within the buffers.
+	 */
+	bool multiPlanar_;
+	bool noncontiguous_;
+	struct v4l2_pix_format_mplane v4l2PixFormatMplane_;
+	std::array<unsigned int, 3> planeOffsets_;
+
 	std::vector<struct v4l2_buffer> buffers_;
-	std::map<void *, unsigned int> mmaps_;
+	std::vector<std::array<struct v4l2_plane, 3>> bufferPlanes_;
+	std::map<void *, Mapping> mmaps_;
+
+	/* Memory type of the buffers, and mappings to fill USERPTR buffers. */
+	uint32_t memory_;
+	std::vector<std::pair<void *, size_t>> bufferMaps_;
+
+	/* Capture for read() I/O. */
+	bool reading_;
+	unsigned int readBufferCount_;
 
 	std::set<V4L2CameraFile *> files_;
 
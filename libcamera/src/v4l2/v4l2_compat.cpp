@@ -9,8 +9,13 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -123,6 +128,75 @@ LIBCAMERA_PUBLIC int munmap(void *addr, size_t length)
 	return V4L2CompatManager::instance()->munmap(addr, length);
 }
 
+LIBCAMERA_PUBLIC ssize_t read(int fd, void *buf, size_t count)
+{
+	return V4L2CompatManager::instance()->read(fd, buf, count);
+}
+
+/* _FORTIFY_SOURCE redirects read() to __read_chk(). */
+LIBCAMERA_PUBLIC ssize_t __read_chk(int fd, void *buf, size_t nbytes,
+				    size_t buflen)
+{
+	if (nbytes > buflen)
+		abort();
+
+	return V4L2CompatManager::instance()->read(fd, buf, nbytes);
+}
+
+LIBCAMERA_PUBLIC int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	return V4L2CompatManager::instance()->poll(fds, nfds, timeout);
+}
+
+/* _FORTIFY_SOURCE redirects poll() to __poll_chk(). */
+LIBCAMERA_PUBLIC int __poll_chk(struct pollfd *fds, nfds_t nfds, int timeout,
+				size_t fdslen)
+{
+	if (fdslen / sizeof(*fds) < nfds)
+		abort();
+
+	return V4L2CompatManager::instance()->poll(fds, nfds, timeout);
+}
+
+LIBCAMERA_PUBLIC int ppoll(struct pollfd *fds, nfds_t nfds,
+			   const struct timespec *timeout,
+			   const sigset_t *sigmask)
+{
+	return V4L2CompatManager::instance()->ppoll(fds, nfds, timeout, sigmask);
+}
+
+/* _FORTIFY_SOURCE redirects ppoll() to __ppoll_chk(). */
+LIBCAMERA_PUBLIC int __ppoll_chk(struct pollfd *fds, nfds_t nfds,
+				 const struct timespec *timeout,
+				 const sigset_t *sigmask, size_t fdslen)
+{
+	if (fdslen / sizeof(*fds) < nfds)
+		abort();
+
+	return V4L2CompatManager::instance()->ppoll(fds, nfds, timeout, sigmask);
+}
+
+LIBCAMERA_PUBLIC int select(int nfds, fd_set *readfds, fd_set *writefds,
+			    fd_set *exceptfds, struct timeval *timeout)
+{
+	return V4L2CompatManager::instance()->select(nfds, readfds, writefds,
+						     exceptfds, timeout);
+}
+
+LIBCAMERA_PUBLIC int pselect(int nfds, fd_set *readfds, fd_set *writefds,
+			     fd_set *exceptfds, const struct timespec *timeout,
+			     const sigset_t *sigmask)
+{
+	return V4L2CompatManager::instance()->pselect(nfds, readfds, writefds,
+						      exceptfds, timeout, sigmask);
+}
+
+LIBCAMERA_PUBLIC int epoll_ctl(int epfd, int op, int fd,
+			       struct epoll_event *event)
+{
+	return V4L2CompatManager::instance()->epoll_ctl(epfd, op, fd, event);
+}
+
 LIBCAMERA_PUBLIC int ioctl(int fd, unsigned long request, ...)
 {
 	void *arg;
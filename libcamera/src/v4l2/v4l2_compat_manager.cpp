@@ -47,6 +47,12 @@ V4L2CompatManager::V4L2CompatManager()
 	get_symbol(fops_.ioctl, "ioctl");
 	get_symbol(fops_.mmap, "mmap64");
 	get_symbol(fops_.munmap, "munmap");
+	get_symbol(fops_.read, "read");
+	get_symbol(fops_.poll, "poll");
+	get_symbol(fops_.ppoll, "ppoll");
+	get_symbol(fops_.select, "select");
+	get_symbol(fops_.pselect, "pselect");
+	get_symbol(fops_.epoll_ctl, "epoll_ctl");
 }
 
 V4L2CompatManager::~V4L2CompatManager()
@@ -229,3 +235,90 @@ int V4L2CompatManager::ioctl(int fd, unsigned long request, void *arg)
 
 	return file->proxy()->ioctl(file.get(), request, arg);
 }
+
+ssize_t V4L2CompatManager::read(int fd, void *buf, size_t count)
+{
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(fd);
+	if (!file)
+		return fops_.read(fd, buf, count);
+
+	return file->proxy()->read(file.get(), buf, count);
+}
+
+/*
+ * Waiting for input on a V4L2 device starts capturing for read() I/O, as the
+ * first read() does, unless the application has set up streaming I/O. This
+ * matches the kernel, and allows applications to poll() before they read().
+ */
+void V4L2CompatManager::pollStart(int fd)
+{
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(fd);
+	if (file)
+		file->proxy()->pollStart(file.get());
+}
+
+void V4L2CompatManager::pollStart(const struct pollfd *fds, nfds_t nfds)
+{
+	if (files_.empty())
+		return;
+
+	for (nfds_t i = 0; i < nfds; i++) {
+		if (fds[i].events & (POLLIN | POLLRDNORM))
+			pollStart(fds[i].fd);
+	}
+}
+
+void V4L2CompatManager::pollStart(int nfds, const fd_set *readfds)
+{
+	if (files_.empty() || !readfds)
+		return;
+
+	for (const auto &file : files_) {
+		if (file.first < nfds && FD_ISSET(file.first, readfds))
+			pollStart(file.first);
+	}
+}
+
+int V4L2CompatManager::poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	pollStart(fds, nfds);
+
+	return fops_.poll(fds, nfds, timeout);
+}
+
+int V4L2CompatManager::ppoll(struct pollfd *fds, nfds_t nfds,
+			     const struct timespec *timeout,
+			     const sigset_t *sigmask)
+{
+	pollStart(fds, nfds);
+
+	return fops_.ppoll(fds, nfds, timeout, sigmask);
+}
+
+int V4L2CompatManager::select(int nfds, fd_set *readfds, fd_set *writefds,
+			      fd_set *exceptfds, struct timeval *timeout)
+{
+	pollStart(nfds, readfds);
+
+	return fops_.select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int V4L2CompatManager::pselect(int nfds, fd_set *readfds, fd_set *writefds,
+			       fd_set *exceptfds, const struct timespec *timeout,
+			       const sigset_t *sigmask)
+{
+	pollStart(nfds, readfds);
+
+	return fops_.pselect(nfds, readfds, writefds, exceptfds, timeout,
+			     sigmask);
+}
+
+int V4L2CompatManager::epoll_ctl(int epfd, int op, int fd,
+				 struct epoll_event *event)
+{
+	if ((op == EPOLL_CTL_ADD || op == EPOLL_CTL_MOD) && event &&
+	    event->events & (EPOLLIN | EPOLLRDNORM))
+		pollStart(fd);
+
+	return fops_.epoll_ctl(epfd, op, fd, event);
+}
@@ -11,7 +11,11 @@
 #include <fcntl.h>
 #include <map>
 #include <memory>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/select.h>
 #include <sys/types.h>
 #include <vector>
 
@@ -33,6 +37,21 @@ public:
 		using mmap_func_t = void *(*)(void *addr, size_t length, int prot,
 					      int flags, int fd, off64_t offset);
 		using munmap_func_t = int (*)(void *addr, size_t length);
+		using read_func_t = ssize_t (*)(int fd, void *buf, size_t count);
+		using poll_func_t = int (*)(struct pollfd *fds, nfds_t nfds,
+					    int timeout);
+		using ppoll_func_t = int (*)(struct pollfd *fds, nfds_t nfds,
+					     const struct timespec *timeout,
+					     const sigset_t *sigmask);
+		using select_func_t = int (*)(int nfds, fd_set *readfds,
+					      fd_set *writefds, fd_set *exceptfds,
+					      struct timeval *timeout);
+		using pselect_func_t = int (*)(int nfds, fd_set *readfds,
+					       fd_set *writefds, fd_set *exceptfds,
+					       const struct timespec *timeout,
+					       const sigset_t *sigmask);
+		using epoll_ctl_func_t = int (*)(int epfd, int op, int fd,
+						 struct epoll_event *event);
 
 		openat_func_t openat;
 		dup_func_t dup;
@@ -40,6 +59,12 @@ public:
 		ioctl_func_t ioctl;
 		mmap_func_t mmap;
 		munmap_func_t munmap;
+		read_func_t read;
+		poll_func_t poll;
+		ppoll_func_t ppoll;
+		select_func_t select;
+		pselect_func_t pselect;
+		epoll_ctl_func_t epoll_ctl;
 	};
 
 	static V4L2CompatManager *instance();
@@ -54,6 +79,16 @@ public:
 		   int fd, off64_t offset);
 	int munmap(void *addr, size_t length);
 	int ioctl(int fd, unsigned long request, void *arg);
+	ssize_t read(int fd, void *buf, size_t count);
+	int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+	int ppoll(struct pollfd *fds, nfds_t nfds,
+		  const struct timespec *timeout, const sigset_t *sigmask);
+	int select(int nfds, fd_set *readfds, fd_set *writefds,
+		   fd_set *exceptfds, struct timeval *timeout);
+	int pselect(int nfds, fd_set *readfds, fd_set *writefds,
+		    fd_set *exceptfds, const struct timespec *timeout,
+		    const sigset_t *sigmask);
+	int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
 
 private:
 	V4L2CompatManager();
@@ -62,6 +97,9 @@ private:
 	int start();
 	int getCameraIndex(int fd);
 	std::shared_ptr<V4L2CameraFile> cameraFile(int fd);
+	void pollStart(int fd);
+	void pollStart(const struct pollfd *fds, nfds_t nfds);
+	void pollStart(int nfds, const fd_set *readfds);
 
 	FileOperations fops_;
 
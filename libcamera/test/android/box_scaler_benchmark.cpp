@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * box_scaler_benchmark.cpp - Benchmark the thumbnail scaling of the Android HAL
+ */
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "box_scaler.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+constexpr unsigned int sw = 4032;
+constexpr unsigned int sh = 3024;
+constexpr unsigned int tw = 320;
+constexpr unsigned int th = 240;
+
+/* The nearest-neighbour sampling the thumbnailer used before. */
+static void scaleNearest(const uint8_t *src, uint8_t *dst)
+{
+	const uint8_t *srcC = src + sh * sw;
+	uint8_t *dstC = dst + th * tw;
+
+	for (unsigned int y = 0; y < th; y += 2) {
+		unsigned int sourceY = (sh * y + th / 2) / th;
+
+		uint8_t *dstY = dst + y * tw;
+		const uint8_t *srcY = src + sw * sourceY;
+		const uint8_t *srcCb = srcC + (sourceY / 2) * sw + 0;
+		const uint8_t *srcCr = srcC + (sourceY / 2) * sw + 1;
+
+		for (unsigned int x = 0; x < tw; x += 2) {
+			unsigned int sourceX = (sw * x + tw / 2) / tw;
+
+			dstY[x] = srcY[sourceX];
+			dstY[tw + x] = srcY[sw + sourceX];
+			dstY[x + 1] = srcY[sourceX + 1];
+			dstY[tw + x + 1] = srcY[sw + sourceX + 1];
+
+			dstC[(y / 2) * tw + x + 0] = srcCb[(sourceX / 2) * 2];
+			dstC[(y / 2) * tw + x + 1] = srcCr[(sourceX / 2) * 2];
+		}
+	}
+}
+
+/* Weights of the source samples covered by each destination sample. */
+static vector<vector<pair<unsigned int, double>>> areaWeights(unsigned int source,
+							      unsigned int destination)
+{
+	vector<vector<pair<unsigned int, double>>> weights(destination);
+	const double scale = static_cast<double>(source) / destination;
+
+	for (unsigned int i = 0; i < destination; i++) {
+		double start = i * scale;
+		double end = (i + 1) * scale;
+
+		for (unsigned int j = floor(start); j < end && j < source; j++) {
+			double overlap = min<double>(end, j + 1) - max<double>(start, j);
+			weights[i].push_back({ j, overlap / scale });
+		}
+	}
+
+	return weights;
+}
+
+class BoxScalerBenchmark : public Test
+{
+protected:
+	int init()
+	{
+		/*
+		 * A zone plate, whose frequency increases up to the Nyquist
+		 * frequency of the source at the edges, shows aliasing.
+		 */
+		frame_.resize(sw * sh * 3 / 2, 128);
+		for (unsigned int y = 0; y < sh; y++) {
+			for (unsigned int x = 0; x < sw; x++) {
+				double dx = x - sw / 2.0;
+				double dy = y - sh / 2.0;
+				double phase = M_PI * (dx * dx + dy * dy) / (2.0 * sw);
+				frame_[y * sw + x] = lround(127.5 + 127.5 * cos(phase));
+			}
+		}
+
+		/* Area-average the luma in floating point as the reference. */
+		auto cols = areaWeights(sw, tw);
+		auto rows = areaWeights(sh, th);
+
+		vector<double> columns(sh * tw);
+		for (unsigned int y = 0; y < sh; y++) {
+			for (unsigned int x = 0; x < tw; x++) {
+				for (const auto &[i, weight] : cols[x])
+					columns[y * tw + x] += frame_[y * sw + i] * weight;
+			}
+		}
+
+		reference_.assign(th * tw, 0.0);
+		for (unsigned int y = 0; y < th; y++) {
+			for (const auto &[j, weight] : rows[y]) {
+				for (unsigned int x = 0; x < tw; x++)
+					reference_[y * tw + x] += columns[j * tw + x] * weight;
+			}
+		}
+
+		return TestPass;
+	}
+
+	double psnr(const vector<uint8_t> &thumbnail)
+	{
+		double error = 0.0;
+		for (unsigned int i = 0; i < tw * th; i++) {
+			double diff = thumbnail[i] - reference_[i];
+			error += diff * diff;
+		}
+
+		return 10.0 * log10(255.0 * 255.0 * tw * th / error);
+	}
+
+	template<typename Func>
+	double measure(Func func)
+	{
+		constexpr unsigned int numRuns = 5;
+
+		auto start = chrono::steady_clock::now();
+		for (unsigned int run = 0; run < numRuns; run++)
+			func();
+		chrono::duration<double, milli> duration =
+			chrono::steady_clock::now() - start;
+
+		return duration.count() / numRuns;
+	}
+
+	int run()
+	{
+		vector<uint8_t> nearest(tw * th * 3 / 2);
+		vector<uint8_t> box(tw * th * 3 / 2);
+
+		double nearestTime = measure([&]() {
+			scaleNearest(frame_.data(), nearest.data());
+		});
+
+		BoxScaler scaler;
+		scaler.configure({ sw, sh }, { tw, th });
+
+		double boxTime = measure([&]() {
+			scaler.scale(frame_.data(), sw, frame_.data() + sw * sh, sw,
+				     box.data(), tw, box.data() + tw * th, tw);
+		});
+
+		cout << fixed << setprecision(2)
+		     << "4032x3024 to 320x240: nearest " << nearestTime << " ms "
+		     << psnr(nearest) << " dB, box " << boxTime << " ms "
+		     << psnr(box) << " dB" << endl;
+
+		return TestPass;
+	}
+
+private:
+	vector<uint8_t> frame_;
+	vector<double> reference_;
+};
+
+TEST_REGISTER(BoxScalerBenchmark)
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * box_scaler_test.cpp - Check the NV12 box scaler of the Android HAL
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "box_scaler.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/* The source tap at the start of a destination sample. */
+static unsigned int tap(unsigned int source, unsigned int destination,
+			unsigned int i)
+{
+	return min<uint64_t>(static_cast<uint64_t>(i) * source / destination,
+			     source - 1);
+}
+
+/* Average the taps at the corners of the area of a destination sample. */
+static unsigned int cornerAverage(const uint8_t *src, unsigned int stride,
+				  unsigned int components, unsigned int component,
+				  unsigned int sw, unsigned int sh,
+				  unsigned int dw, unsigned int dh,
+				  unsigned int x, unsigned int y)
+{
+	unsigned int sum = 0;
+
+	for (unsigned int j : { tap(sh, dh, y), tap(sh, dh, y + 1) }) {
+		for (unsigned int i : { tap(sw, dw, x), tap(sw, dw, x + 1) })
+			sum += src[j * stride + i * components + component];
+	}
+
+	return (sum + 2) / 4;
+}
+
+class BoxScalerTest : public Test
+{
+protected:
+	int check(const Size &source, const Size &destination, mt19937 &gen)
+	{
+		/* Use padded strides to catch stride handling issues. */
+		const unsigned int sw = source.width;
+		const unsigned int sh = source.height;
+		const unsigned int dw = destination.width;
+		const unsigned int dh = destination.height;
+		const unsigned int srcStride = sw + 6;
+		const unsigned int dstStride = dw + 10;
+		const unsigned int scw = (sw + 1) / 2;
+		const unsigned int sch = (sh + 1) / 2;
+		const unsigned int dcw = (dw + 1) / 2;
+		const unsigned int dch = (dh + 1) / 2;
+
+		vector<uint8_t> srcY(srcStride * sh);
+		vector<uint8_t> srcUV(srcStride * sch);
+		for (uint8_t &value : srcY)
+			value = gen();
+		for (uint8_t &value : srcUV)
+			value = gen();
+
+		vector<uint8_t> dstY(dstStride * dh);
+		vector<uint8_t> dstUV(dstStride * dch);
+
+		BoxScaler scaler;
+		scaler.configure(source, destination);
+		scaler.scale(srcY.data(), srcStride, srcUV.data(), srcStride,
+			     dstY.data(), dstStride, dstUV.data(), dstStride);
+
+		for (unsigned int y = 0; y < dh; y++) {
+			for (unsigned int x = 0; x < dw; x++) {
+				unsigned int expected =
+					cornerAverage(srcY.data(), srcStride, 1, 0,
+						   sw, sh, dw, dh, x, y);
+				if (dstY[y * dstStride + x] != expected) {
+					cerr << source.toString() << " to "
+					     << destination.toString()
+					     << ": wrong luma at " << x << "," << y
+					     << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		for (unsigned int y = 0; y < dch; y++) {
+			for (unsigned int x = 0; x < dcw * 2; x++) {
+				unsigned int expected =
+					cornerAverage(srcUV.data(), srcStride, 2, x % 2,
+						   scw, sch, dcw, dch, x / 2, y);
+				if (dstUV[y * dstStride + x] != expected) {
+					cerr << source.toString() << " to "
+					     << destination.toString()
+					     << ": wrong chroma at " << x << "," << y
+					     << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/*
+		 * Cover integer and fractional ratios, odd heights, upscaling,
+		 * and large ratios.
+		 */
+		static const pair<Size, Size> sizes[] = {
+			{ { 640, 480 }, { 320, 240 } },
+			{ { 642, 482 }, { 320, 240 } },
+			{ { 4032, 152 }, { 320, 12 } },
+			{ { 130, 98 }, { 38, 30 } },
+			{ { 33, 17 }, { 33, 17 } },
+			{ { 34, 18 }, { 60, 40 } },
+			{ { 20, 1200 }, { 2, 2 } },
+			{ { 64, 50 }, { 8, 5 } },
+		};
+		mt19937 gen(0);
+
+		for (const auto &[source, destination] : sizes) {
+			if (check(source, destination, gen))
+				return TestFail;
+		}
+
+		/* A flat image must stay flat. */
+		vector<uint8_t> flat(320 * 240 * 3 / 2, 255);
+		vector<uint8_t> dst(64 * 48 * 3 / 2);
+
+		BoxScaler scaler;
+		scaler.configure({ 320, 240 }, { 64, 48 });
+		scaler.scale(flat.data(), 320, flat.data() + 320 * 240, 320,
+			     dst.data(), 64, dst.data() + 64 * 48, 64);
+
+		for (uint8_t value : dst) {
+			if (value != 255) {
+				cerr << "Flat image isn't flat" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(BoxScalerTest)
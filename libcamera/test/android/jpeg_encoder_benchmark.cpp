@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * jpeg_encoder_benchmark.cpp - Benchmark the JPEG encoding of the Android HAL
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/log.h"
+
+#include "encoder_libjpeg.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(JPEG)
+
+class JpegEncoderBenchmark : public Test
+{
+protected:
+	/* Measure the encoding time of a 12MP NV12 frame in ms. */
+	double measure(unsigned int threads)
+	{
+		constexpr unsigned int width = 4000;
+		constexpr unsigned int height = 3000;
+		constexpr unsigned int numRuns = 5;
+
+		StreamConfiguration cfg;
+		cfg.size = { width, height };
+		cfg.pixelFormat = formats::NV12;
+
+		EncoderLibJpeg encoder;
+		if (encoder.configure(cfg))
+			return 0.0;
+
+		encoder.setThreads(threads);
+
+		/* A gradient with some texture to keep the encoder busy. */
+		vector<uint8_t> frame(width * height * 3 / 2);
+		for (size_t i = 0; i < frame.size(); i++)
+			frame[i] = i * 7 / 3 + (i % width) / 16;
+		vector<uint8_t> jpeg(frame.size());
+
+		auto start = chrono::steady_clock::now();
+		for (unsigned int run = 0; run < numRuns; run++) {
+			if (encoder.encode(frame, jpeg, {}, 95) < 0)
+				return 0.0;
+		}
+		chrono::duration<double, milli> duration =
+			chrono::steady_clock::now() - start;
+
+		return duration.count() / numRuns;
+	}
+
+	int run()
+	{
+		unsigned int threads = thread::hardware_concurrency();
+
+		cout << "4000x3000 NV12: " << fixed << setprecision(1)
+		     << "single stripe " << measure(1) << " ms, "
+		     << threads << " stripes " << measure(threads) << " ms"
+		     << endl;
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(JpegEncoderBenchmark)
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * jpeg_encoder_test.cpp - Check the striped JPEG encoding of the Android HAL
+ */
+
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/log.h"
+
+#include "encoder_libjpeg.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(JPEG)
+
+/* Decode a JPEG image to YCbCr, and return the number of APP1 markers. */
+static int decode(const vector<uint8_t> &jpeg, vector<uint8_t> *image)
+{
+	struct jpeg_decompress_struct decompress;
+	struct jpeg_error_mgr jerr;
+
+	decompress.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&decompress);
+	jpeg_save_markers(&decompress, JPEG_APP0 + 1, 0xffff);
+	jpeg_mem_src(&decompress, jpeg.data(), jpeg.size());
+
+	jpeg_read_header(&decompress, TRUE);
+	decompress.out_color_space = JCS_YCbCr;
+	jpeg_start_decompress(&decompress);
+
+	unsigned int stride = decompress.output_width * decompress.output_components;
+	image->resize(stride * decompress.output_height);
+
+	while (decompress.output_scanline < decompress.output_height) {
+		JSAMPROW row = image->data() + decompress.output_scanline * stride;
+		jpeg_read_scanlines(&decompress, &row, 1);
+	}
+
+	int app1 = 0;
+	for (jpeg_saved_marker_ptr marker = decompress.marker_list; marker;
+	     marker = marker->next)
+		app1++;
+
+	jpeg_finish_decompress(&decompress);
+	jpeg_destroy_decompress(&decompress);
+
+	return app1;
+}
+
+/*
+ * Encode an NV12 frame by upsampling the chroma to YCbCr 4:4:4 scanlines, as
+ * the encoder did before passing raw data to libjpeg.
+ */
+static vector<uint8_t> encodeScanlines(const vector<uint8_t> &frame,
+				       unsigned int width, unsigned int height)
+{
+	struct jpeg_compress_struct compress;
+	struct jpeg_error_mgr jerr;
+	unsigned char *data = nullptr;
+	unsigned long size = 0;
+
+	compress.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&compress);
+
+	compress.image_width = width;
+	compress.image_height = height;
+	compress.in_color_space = JCS_YCbCr;
+	compress.input_components = 3;
+	jpeg_set_defaults(&compress);
+	jpeg_set_quality(&compress, 95, TRUE);
+	jpeg_mem_dest(&compress, &data, &size);
+	jpeg_start_compress(&compress, TRUE);
+
+	vector<uint8_t> row(width * 3);
+	const uint8_t *chroma = frame.data() + width * height;
+
+	for (unsigned int y = 0; y < height; y++) {
+		const uint8_t *src_y = frame.data() + y * width;
+		const uint8_t *src_c = chroma + y / 2 * width;
+
+		for (unsigned int x = 0; x < width; x++) {
+			row[x * 3] = src_y[x];
+			row[x * 3 + 1] = src_c[x / 2 * 2];
+			row[x * 3 + 2] = src_c[x / 2 * 2 + 1];
+		}
+
+		JSAMPROW rowPtr = row.data();
+		jpeg_write_scanlines(&compress, &rowPtr, 1);
+	}
+
+	jpeg_finish_compress(&compress);
+	jpeg_destroy_compress(&compress);
+
+	vector<uint8_t> jpeg(data, data + size);
+	free(data);
+
+	return jpeg;
+}
+
+class JpegEncoderTest : public Test
+{
+protected:
+	int encode(const vector<uint8_t> &frame, unsigned int width,
+		   unsigned int height, unsigned int threads,
+		   const vector<uint8_t> &exif, vector<uint8_t> *jpeg)
+	{
+		StreamConfiguration cfg;
+		cfg.size = { width, height };
+		cfg.pixelFormat = formats::NV12;
+
+		EncoderLibJpeg encoder;
+		if (encoder.configure(cfg)) {
+			cerr << "Failed to configure the encoder" << endl;
+			return TestFail;
+		}
+
+		encoder.setThreads(threads);
+
+		jpeg->resize(frame.size() * 2);
+		int size = encoder.encode(frame, *jpeg, exif, 95);
+		if (size < 0) {
+			cerr << "Failed to encode " << width << "x" << height
+			     << " in " << threads << " stripes" << endl;
+			return TestFail;
+		}
+
+		jpeg->resize(size);
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* Cover sizes that aren't multiples of the MCU size. */
+		static const Size sizes[] = {
+			{ 640, 480 }, { 642, 482 }, { 98, 170 },
+		};
+		mt19937 gen(0);
+
+		for (const Size &size : sizes) {
+			vector<uint8_t> frame(size.width * size.height * 3 / 2);
+			for (size_t i = 0; i < frame.size(); i++)
+				frame[i] = (i * 3 / 5) + gen() % 16;
+
+			vector<uint8_t> expected;
+			decode(encodeScanlines(frame, size.width, size.height),
+			       &expected);
+
+			vector<uint8_t> exif(100, 0x42);
+			vector<uint8_t> reference;
+
+			for (unsigned int threads : { 1, 2, 3, 7 }) {
+				vector<uint8_t> jpeg, image;
+				if (encode(frame, size.width, size.height, threads,
+					   exif, &jpeg))
+					return TestFail;
+
+				/* The output doesn't depend on the stripes. */
+				if (threads == 1) {
+					reference = jpeg;
+				} else if (jpeg != reference) {
+					cerr << size.toString() << " JPEG in "
+					     << threads << " stripes isn't bit-identical"
+					     << endl;
+					return TestFail;
+				}
+
+				if (decode(jpeg, &image) != 1) {
+					cerr << "Exif data missing from "
+					     << threads << " stripes" << endl;
+					return TestFail;
+				}
+
+				if (image != expected) {
+					cerr << size.toString() << " image in "
+					     << threads << " stripes differs"
+					     << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* Stripes must not overrun the output buffer. */
+		StreamConfiguration cfg;
+		cfg.size = { 640, 480 };
+		cfg.pixelFormat = formats::NV12;
+
+		EncoderLibJpeg encoder;
+		encoder.configure(cfg);
+		encoder.setThreads(4);
+
+		vector<uint8_t> frame(640 * 480 * 3 / 2, 128);
+		vector<uint8_t> jpeg(64);
+		if (encoder.encode(frame, jpeg, {}, 95) != -ENOSPC) {
+			cerr << "Striped encoding overran the buffer" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(JpegEncoderTest)
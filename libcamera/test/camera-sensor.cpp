@@ -7,6 +7,8 @@
 
 #include <algorithm>
 #include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <linux/media-bus-format.h>
 
@@ -103,7 +105,35 @@ protected:
 			return TestFail;
 		}
 
-		return TestPass;
+		/* The formats must survive a round trip through the cache. */
+		char cache[] = "/tmp/libcamera.sensor.XXXXXX";
+		int fd = mkstemp(cache);
+		if (fd < 0) {
+			cerr << "Failed to create the sensor cache" << endl;
+			return TestFail;
+		}
+		close(fd);
+
+		setenv("LIBCAMERA_SENSOR_CACHE", cache, 1);
+
+		int ret = TestPass;
+		for (const char *pass : { "storing", "loading" }) {
+			CameraSensor sensor(media_->getEntityByName("Sensor A"));
+			if (sensor.init() < 0 ||
+			    sensor.mbusCodes() != sensor_->mbusCodes() ||
+			    sensor.sizes() != sensor_->sizes()) {
+				cerr << "Wrong sensor formats after " << pass
+				     << " the cache" << endl;
+				ret = TestFail;
+				break;
+			}
+		}
+
+		unsetenv("LIBCAMERA_SENSOR_CACHE");
+		unlink(cache);
+		unlink((string(cache) + ".lock").c_str());
+
+		return ret;
 	}
 
 	void cleanup()
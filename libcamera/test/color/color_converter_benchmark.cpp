@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * color_converter_benchmark.cpp - Benchmark the color converter
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "color_converter.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class ColorConverterBenchmark : public Test
+{
+protected:
+	/* Measure the conversion throughput in MPix/s. */
+	double measure(const PixelFormat &input, const PixelFormat &output,
+		       ColorConverter::Isa isa, unsigned int threads)
+	{
+		constexpr unsigned int width = 1280;
+		constexpr unsigned int height = 720;
+		constexpr unsigned int numRuns = 5;
+
+		ColorConverter converter;
+		if (converter.configure(input, output, width, height) ||
+		    converter.setIsa(isa))
+			return 0.0;
+
+		converter.setThreads(threads);
+
+		/* Large enough for all formats, filled with a gradient. */
+		vector<uint8_t> src(width * height * 4);
+		for (size_t i = 0; i < src.size(); i++)
+			src[i] = i * 7 / 3;
+		vector<uint8_t> dst(width * height * 4);
+
+		converter.convert(src.data(), dst.data());
+
+		auto start = chrono::steady_clock::now();
+		for (unsigned int run = 0; run < numRuns; run++)
+			converter.convert(src.data(), dst.data());
+		chrono::duration<double, micro> duration =
+			chrono::steady_clock::now() - start;
+
+		return width * height * numRuns / duration.count();
+	}
+
+	void report(const PixelFormat &input, const PixelFormat &output)
+	{
+		cout << setw(8) << input.toString() << " to "
+		     << setw(8) << output.toString() << ":";
+
+		for (ColorConverter::Isa isa : ColorConverter::supportedIsas())
+			cout << " " << ColorConverter::isaName(isa) << " "
+			     << fixed << setprecision(1)
+			     << measure(input, output, isa, 1);
+
+		cout << ", threaded "
+		     << measure(input, output, ColorConverter::supportedIsas().back(),
+				thread::hardware_concurrency())
+		     << " MPix/s" << endl;
+	}
+
+	int run()
+	{
+		static const PixelFormat yuvFormats[] = {
+			formats::NV12, formats::NV21, formats::NV16,
+			formats::YUYV, formats::UYVY, formats::YUV420,
+		};
+
+		for (const PixelFormat &input : yuvFormats) {
+			report(input, formats::XRGB8888);
+			report(input, formats::RGB888);
+			report(input, formats::BGR888);
+		}
+
+		report(formats::RGB888, formats::YUV420);
+		report(formats::XRGB8888, formats::YUV420);
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ColorConverterBenchmark)
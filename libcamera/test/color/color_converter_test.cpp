@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * color_converter_test.cpp - Check the color converter kernels
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "color_converter.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+static const PixelFormat yuvFormats[] = {
+	formats::NV12, formats::NV21, formats::NV16, formats::NV61,
+	formats::NV24, formats::NV42, formats::YUYV, formats::YVYU,
+	formats::UYVY, formats::VYUY, formats::YUV420, formats::YVU420,
+};
+
+static const PixelFormat rgbFormats[] = {
+	formats::XRGB8888, formats::RGB888, formats::BGR888,
+};
+
+/* Frame sizes in bytes, for contiguous planes. */
+static size_t frameSize(const PixelFormat &format, unsigned int width,
+			unsigned int height)
+{
+	switch (format) {
+	case formats::NV12:
+	case formats::NV21:
+	case formats::YUV420:
+	case formats::YVU420:
+		return width * height * 3 / 2;
+	case formats::NV24:
+	case formats::NV42:
+		return width * height * 3;
+	case formats::RGB888:
+	case formats::BGR888:
+		return width * height * 3;
+	case formats::XRGB8888:
+		return width * height * 4;
+	default:
+		return width * height * 2;
+	}
+}
+
+class ColorConverterTest : public Test
+{
+protected:
+	int convert(const PixelFormat &input, const PixelFormat &output,
+		    unsigned int width, unsigned int height,
+		    ColorConverter::Isa isa, unsigned int threads,
+		    const vector<uint8_t> &src, vector<uint8_t> &dst)
+	{
+		ColorConverter converter;
+		if (converter.configure(input, output, width, height) ||
+		    converter.setIsa(isa)) {
+			cerr << "Failed to configure " << input.toString()
+			     << " to " << output.toString() << endl;
+			return TestFail;
+		}
+
+		converter.setThreads(threads);
+
+		dst.assign(frameSize(output, width, height), 0);
+		converter.convert(src.data(), dst.data());
+
+		return TestPass;
+	}
+
+	int checkKernels(const PixelFormat &input, const PixelFormat &output)
+	{
+		/* Cover the SIMD loops and all lengths of the scalar tails. */
+		static const unsigned int widths[] = { 2, 4, 6, 8, 10, 12, 14, 16,
+						       18, 20, 22, 24, 26, 62, 642 };
+		mt19937 gen(0);
+
+		for (unsigned int width : widths) {
+			const unsigned int height = 4;
+
+			vector<uint8_t> src(frameSize(input, width, height));
+			for (uint8_t &value : src)
+				value = gen();
+
+			vector<uint8_t> expected;
+			if (convert(input, output, width, height,
+				    ColorConverter::Scalar, 1, src, expected))
+				return TestFail;
+
+			for (ColorConverter::Isa isa : ColorConverter::supportedIsas()) {
+				vector<uint8_t> dst;
+				if (convert(input, output, width, height, isa,
+					    1, src, dst))
+					return TestFail;
+
+				if (dst != expected) {
+					cerr << ColorConverter::isaName(isa)
+					     << " " << input.toString() << " to "
+					     << output.toString() << " "
+					     << width << "x" << height
+					     << " differs from scalar" << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		for (const PixelFormat &input : yuvFormats) {
+			for (const PixelFormat &output : rgbFormats) {
+				if (checkKernels(input, output))
+					return TestFail;
+			}
+		}
+
+		for (const PixelFormat &input : rgbFormats) {
+			if (checkKernels(input, formats::YUV420))
+				return TestFail;
+		}
+
+		/* Bands of rows converted concurrently must match. */
+		mt19937 gen(1);
+		vector<uint8_t> src(frameSize(formats::NV12, 640, 482));
+		for (uint8_t &value : src)
+			value = gen();
+
+		vector<uint8_t> expected, dst;
+		if (convert(formats::NV12, formats::XRGB8888, 640, 482,
+			    ColorConverter::Scalar, 1, src, expected) ||
+		    convert(formats::NV12, formats::XRGB8888, 640, 482,
+			    ColorConverter::supportedIsas().back(), 3, src, dst))
+			return TestFail;
+
+		if (dst != expected) {
+			cerr << "Threaded conversion differs" << endl;
+			return TestFail;
+		}
+
+		src.resize(frameSize(formats::RGB888, 640, 482));
+		for (uint8_t &value : src)
+			value = gen();
+
+		if (convert(formats::RGB888, formats::YUV420, 640, 482,
+			    ColorConverter::Scalar, 1, src, expected) ||
+		    convert(formats::RGB888, formats::YUV420, 640, 482,
+			    ColorConverter::supportedIsas().back(), 5, src, dst))
+			return TestFail;
+
+		if (dst != expected) {
+			cerr << "Threaded conversion to YUV differs" << endl;
+			return TestFail;
+		}
+
+		/* Check the coefficients on white and black. */
+		vector<uint8_t> yuyv = { 235, 128, 16, 128 };
+		if (convert(formats::YUYV, formats::BGR888, 2, 1,
+			    ColorConverter::Scalar, 1, yuyv, dst))
+			return TestFail;
+
+		if (dst != vector<uint8_t>{ 255, 255, 255, 0, 0, 0 }) {
+			cerr << "Wrong RGB values" << endl;
+			return TestFail;
+		}
+
+		vector<uint8_t> white(2 * 2 * 3, 255);
+		if (convert(formats::RGB888, formats::YUV420, 2, 2,
+			    ColorConverter::Scalar, 1, white, dst))
+			return TestFail;
+
+		if (dst != vector<uint8_t>{ 235, 235, 235, 235, 128, 128 }) {
+			cerr << "Wrong YUV values" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ColorConverterTest)
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * gstreamer_hold_buffers_test.cpp - Stream to a sink that holds buffers
+ */
+
+#include <atomic>
+#include <deque>
+#include <iostream>
+
+#include <gst/gst.h>
+
+#include <libcamera/camera_manager.h>
+
+#include "libcamera/internal/utils.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * The sink behaves like an encoder that keeps kHeldBuffers buffers as
+ * references, and reports it in the allocation query.
+ */
+static constexpr unsigned int kHeldBuffers = 4;
+static constexpr unsigned int kFrames = 30;
+static constexpr GstClockTime kTimeout = 10 * GST_SECOND;
+
+class GstreamerHoldBuffersTest : public Test
+{
+protected:
+	int init() override
+	{
+		/* Look for the vimc camera before libcamerasrc needs it. */
+		CameraManager cm;
+		if (cm.start()) {
+			cerr << "Failed to start camera manager" << endl;
+			return TestFail;
+		}
+
+		bool found = !!cm.get(cameraName_);
+		cm.stop();
+
+		if (!found) {
+			cerr << "Can not find '" << cameraName_ << "' camera" << endl;
+			return TestSkip;
+		}
+
+		gst_init(nullptr, nullptr);
+
+		/*
+		 * Use the plugin from the build directory, not an installed
+		 * one.
+		 */
+		GstRegistry *registry = gst_registry_get();
+		GstPlugin *plugin = gst_registry_find_plugin(registry, "libcamera");
+		if (plugin) {
+			gst_registry_remove_plugin(registry, plugin);
+			gst_object_unref(plugin);
+		}
+
+		string path = utils::libcameraBuildPath() + "src/gstreamer";
+		if (!gst_registry_scan_path(registry, path.c_str())) {
+			cerr << "Failed to load the libcamera plugin" << endl;
+			return TestFail;
+		}
+
+		string description = "libcamerasrc name=source camera-name=\"" +
+				     cameraName_ + "\" ! fakesink name=sink " +
+				     "sync=false signal-handoffs=true";
+		GError *error = nullptr;
+		pipeline_ = gst_parse_launch(description.c_str(), &error);
+		if (!pipeline_) {
+			cerr << "Failed to create the pipeline: "
+			     << error->message << endl;
+			g_error_free(error);
+			return TestFail;
+		}
+
+		GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline_), "sink");
+		g_signal_connect(sink, "handoff", G_CALLBACK(handoff), this);
+
+		GstPad *pad = gst_element_get_static_pad(sink, "sink");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+				  allocationQuery, nullptr, nullptr);
+		gst_object_unref(pad);
+		gst_object_unref(sink);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (gst_element_set_state(pipeline_, GST_STATE_PLAYING) ==
+		    GST_STATE_CHANGE_FAILURE) {
+			cerr << "Failed to start the pipeline" << endl;
+			return TestFail;
+		}
+
+		/* Wait for the frames, stopping on errors. */
+		GstBus *bus = gst_element_get_bus(pipeline_);
+		GstClockTime elapsed = 0;
+		int ret = TestPass;
+
+		while (frames_ < kFrames) {
+			if (elapsed >= kTimeout) {
+				cerr << "Capture stalled after " << frames_
+				     << " frames" << endl;
+				ret = TestFail;
+				break;
+			}
+
+			GstMessage *msg =
+				gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
+							   static_cast<GstMessageType>(GST_MESSAGE_ERROR |
+										       GST_MESSAGE_EOS));
+			elapsed += 100 * GST_MSECOND;
+			if (!msg)
+				continue;
+
+			if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+				GError *error;
+				gst_message_parse_error(msg, &error, nullptr);
+				cerr << "Pipeline error: " << error->message << endl;
+				g_error_free(error);
+			} else {
+				cerr << "Unexpected end of stream" << endl;
+			}
+
+			gst_message_unref(msg);
+			ret = TestFail;
+			break;
+		}
+
+		gst_object_unref(bus);
+
+		if (ret == TestPass)
+			ret = checkStats();
+
+		gst_element_set_state(pipeline_, GST_STATE_NULL);
+		releaseBuffers();
+
+		return ret;
+	}
+
+	void cleanup() override
+	{
+		if (pipeline_)
+			gst_object_unref(pipeline_);
+	}
+
+private:
+	static void handoff([[maybe_unused]] GstElement *sink, GstBuffer *buffer,
+			    [[maybe_unused]] GstPad *pad, gpointer data)
+	{
+		auto *self = static_cast<GstreamerHoldBuffersTest *>(data);
+
+		self->held_.push_back(gst_buffer_ref(buffer));
+		if (self->held_.size() > kHeldBuffers) {
+			gst_buffer_unref(self->held_.front());
+			self->held_.pop_front();
+		}
+
+		self->frames_++;
+	}
+
+	static GstPadProbeReturn allocationQuery([[maybe_unused]] GstPad *pad,
+						 GstPadProbeInfo *info,
+						 [[maybe_unused]] gpointer data)
+	{
+		GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+		if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION)
+			return GST_PAD_PROBE_OK;
+
+		gst_query_add_allocation_pool(query, nullptr, 0, kHeldBuffers, 0);
+		return GST_PAD_PROBE_HANDLED;
+	}
+
+	/* The pool must cover the held buffers, and never run dry. */
+	int checkStats()
+	{
+		GstElement *source = gst_bin_get_by_name(GST_BIN(pipeline_), "source");
+		GstPad *pad = gst_element_get_static_pad(source, "src");
+		GstStructure *stats = nullptr;
+		g_object_get(pad, "stats", &stats, nullptr);
+		gst_object_unref(pad);
+		gst_object_unref(source);
+
+		if (!stats) {
+			cerr << "No pool statistics" << endl;
+			return TestFail;
+		}
+
+		guint buffers = 0, starved = 0;
+		gst_structure_get_uint(stats, "buffers", &buffers);
+		gst_structure_get_uint(stats, "starved", &starved);
+		gst_structure_free(stats);
+
+		if (buffers <= kHeldBuffers) {
+			cerr << "Pool of " << buffers << " buffers too small" << endl;
+			return TestFail;
+		}
+
+		if (starved) {
+			cerr << "Pool starved " << starved << " times" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void releaseBuffers()
+	{
+		for (GstBuffer *buffer : held_)
+			gst_buffer_unref(buffer);
+		held_.clear();
+	}
+
+	const string cameraName_ = "platform/vimc.0 Sensor B";
+
+	GstElement *pipeline_ = nullptr;
+	deque<GstBuffer *> held_;
+	atomic<unsigned int> frames_ = 0;
+};
+
+TEST_REGISTER(GstreamerHoldBuffersTest)
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipa_manager_test.cpp - Test the IPA module index of the IPA manager
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libcamera/ipa/vimc_ipa_proxy.h>
+
+#include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/process.h"
+#include "libcamera/internal/utils.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class IPAManagerTest : public Test
+{
+protected:
+	int init() override
+	{
+		char dir[] = "/tmp/libcamera.ipa.index.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		index_ = dir_ + "/cache/ipa-modules";
+
+		std::vector<PipelineHandlerFactory *> &factories =
+			PipelineHandlerFactory::factories();
+		for (PipelineHandlerFactory *factory : factories) {
+			if (factory->name() == "PipelineHandlerVimc") {
+				pipe_ = factory->create(nullptr);
+				break;
+			}
+		}
+
+		if (!pipe_) {
+			cerr << "Vimc pipeline not found" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	/* Create the vimc IPA with a new IPA manager, and time it. */
+	int createIPA(const char *name)
+	{
+		auto start = chrono::steady_clock::now();
+
+		IPAManager manager;
+		auto ipa = IPAManager::createIPA<ipa::vimc::IPAProxyVimc>(pipe_.get(), 0, 0);
+
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+		if (!ipa) {
+			cerr << "Failed to create the vimc IPA " << name << endl;
+			return TestFail;
+		}
+
+		cout << "IPA created " << name << " in " << elapsed.count()
+		     << " ms" << endl;
+
+		return TestPass;
+	}
+
+	/* Retrieve the index line of the vimc IPA module. */
+	string vimcEntry()
+	{
+		ifstream index(index_);
+		string line;
+		while (getline(index, line)) {
+			if (line.find("/ipa_vimc.so") != string::npos)
+				return line;
+		}
+
+		return string();
+	}
+
+	int tamperIndex(const string &from, const string &to)
+	{
+		ifstream index(index_);
+		ostringstream contents;
+		contents << index.rdbuf();
+
+		string data = contents.str();
+		size_t pos = data.find(from);
+		if (pos == string::npos) {
+			cerr << "Failed to find '" << from << "' in the index" << endl;
+			return TestFail;
+		}
+
+		data.replace(pos, from.size(), to);
+		ofstream(index_, ios::trunc) << data;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* The index is disabled by default, and nothing is written. */
+		setenv("HOME", dir_.c_str(), 1);
+		setenv("XDG_CACHE_HOME", (dir_ + "/xdg").c_str(), 1);
+		unsetenv("LIBCAMERA_IPA_MODULE_INDEX");
+
+		if (createIPA("without index variable") != TestPass)
+			return TestFail;
+
+		struct stat st;
+		if (!stat((dir_ + "/.cache").c_str(), &st) ||
+		    !stat((dir_ + "/xdg").c_str(), &st)) {
+			cerr << "IPA module index written by default" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The first manager opens all modules, and indexes them,
+		 * creating the directory of the index.
+		 */
+		setenv("LIBCAMERA_IPA_MODULE_INDEX", index_.c_str(), 1);
+
+		if (createIPA("without index") != TestPass)
+			return TestFail;
+
+		string entry = vimcEntry();
+		if (entry.find("\tPipelineHandlerVimc\tvimc\t") == string::npos) {
+			cerr << "vimc IPA module not indexed" << endl;
+			return TestFail;
+		}
+
+		if (createIPA("with index") != TestPass)
+			return TestFail;
+
+		/* A wrong index must not prevent finding the module. */
+		if (tamperIndex("\tPipelineHandlerVimc\t", "\tPipelineHandlerNone\t") != TestPass ||
+		    createIPA("with a wrong index") != TestPass)
+			return TestFail;
+
+		if (vimcEntry() != entry) {
+			cerr << "Wrong index entry not fixed" << endl;
+			return TestFail;
+		}
+
+		/* Neither must an index that claims the module is invalid. */
+		string invalid = entry;
+		invalid.replace(invalid.find("\t1\t"), 3, "\t0\t");
+		if (tamperIndex(entry, invalid) != TestPass ||
+		    createIPA("with an invalid entry") != TestPass)
+			return TestFail;
+
+		if (vimcEntry() != entry) {
+			cerr << "Invalid index entry not fixed" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		unlink(index_.c_str());
+		rmdir(utils::dirname(index_).c_str());
+		rmdir(dir_.c_str());
+	}
+
+private:
+	ProcessManager processManager_;
+
+	std::shared_ptr<PipelineHandler> pipe_;
+	string dir_;
+	string index_;
+};
+
+TEST_REGISTER(IPAManagerTest)
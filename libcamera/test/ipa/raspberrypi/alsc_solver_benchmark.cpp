@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * alsc_solver_benchmark.cpp - Benchmark the ALSC solvers
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "rpi/alsc_solver.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+class AlscSolverBenchmark : public Test
+{
+protected:
+	/*
+	 * Generate the colour ratios seen by successive runs of the algorithm
+	 * while a coloured object moves across a scene with a residual colour
+	 * cast in the corners.
+	 */
+	void generateScene(unsigned int run, double C[ALSC_CELLS])
+	{
+		unsigned int objectX = run / 10 % (ALSC_CELLS_X - 4);
+
+		for (unsigned int y = 0; y < ALSC_CELLS_Y; y++) {
+			for (unsigned int x = 0; x < ALSC_CELLS_X; x++) {
+				double dx = (x - ALSC_CELLS_X / 2.0) / ALSC_CELLS_X;
+				double dy = (y - ALSC_CELLS_Y / 2.0) / ALSC_CELLS_Y;
+				double &c = C[y * ALSC_CELLS_X + x];
+
+				c = 0.5 * (1 + 0.05 * (dx * dx + dy * dy));
+				if (x >= objectX && x < objectX + 4 && y >= 4 && y < 8)
+					c *= 1.5;
+				if (y == 0 && x == run % ALSC_CELLS_X)
+					c = ALSC_INSUFFICIENT_DATA;
+			}
+		}
+	}
+
+	int measure(AlscSolver solver, const char *name)
+	{
+		constexpr unsigned int numRuns = 2000;
+		double lambda[ALSC_CELLS];
+		fill(lambda, lambda + ALSC_CELLS, 1.0);
+
+		unsigned int iterations = 0;
+		chrono::nanoseconds duration{ 0 };
+
+		for (unsigned int run = 0; run < numRuns; run++) {
+			double C[ALSC_CELLS], W[ALSC_CELLS][4], M[ALSC_CELLS][4];
+			generateScene(run, C);
+			alsc_compute_W(C, 0.01, W);
+			alsc_construct_M(C, W, M);
+
+			/*
+			 * Start from the lambdas of the previous run, as the
+			 * algorithm does, with the default tuning parameters.
+			 */
+			auto start = chrono::steady_clock::now();
+			iterations += alsc_solve(solver, M, 1.3, 100, 1e-3, lambda);
+			duration += chrono::steady_clock::now() - start;
+
+			double min = *min_element(lambda, lambda + ALSC_CELLS);
+			for (unsigned int i = 0; i < ALSC_CELLS; i++)
+				lambda[i] /= min;
+		}
+
+		cout << fixed << setprecision(2) << name << ": "
+		     << static_cast<double>(duration.count()) / numRuns / 1000
+		     << " us, " << static_cast<double>(iterations) / numRuns
+		     << " iterations per run" << endl;
+
+		return *max_element(lambda, lambda + ALSC_CELLS) < 2.0
+		       ? TestPass : TestFail;
+	}
+
+	int run()
+	{
+		if (measure(AlscSolver::GaussSeidel, "Gauss-Seidel") != TestPass)
+			return TestFail;
+
+		return measure(AlscSolver::RedBlack, "Red-black");
+	}
+};
+
+TEST_REGISTER(AlscSolverBenchmark)
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * alsc_solver_test.cpp - Check the ALSC solvers against each other
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <random>
+
+#include "rpi/alsc_solver.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+class AlscSolverTest : public Test
+{
+protected:
+	/*
+	 * Generate the colour ratios of a scene lit with a colour cast that
+	 * varies smoothly across the image, as left over by a mismatched
+	 * calibration table. An object of a different colour and a few cells
+	 * without enough statistics are thrown in.
+	 */
+	void generateScene(unsigned int seed, double C[ALSC_CELLS])
+	{
+		mt19937 gen(seed);
+		double gain = 0.1 * (gen() % 1000) / 1000;
+		double centreX = ALSC_CELLS_X / 2 + gen() % 5 - 2.0;
+		double centreY = ALSC_CELLS_Y / 2 + gen() % 5 - 2.0;
+		unsigned int objectX = gen() % (ALSC_CELLS_X - 4);
+		unsigned int objectY = gen() % (ALSC_CELLS_Y - 4);
+
+		for (unsigned int y = 0; y < ALSC_CELLS_Y; y++) {
+			for (unsigned int x = 0; x < ALSC_CELLS_X; x++) {
+				double dx = (x - centreX) / ALSC_CELLS_X;
+				double dy = (y - centreY) / ALSC_CELLS_Y;
+				double noise = 0.002 * ((gen() % 1000) / 1000.0 - 0.5);
+				double &c = C[y * ALSC_CELLS_X + x];
+
+				c = 0.5 * (1 + gain * (dx * dx + dy * dy)) + noise;
+				if (x >= objectX && x < objectX + 4 &&
+				    y >= objectY && y < objectY + 4)
+					c *= 1.5;
+				if (gen() % 20 == 0)
+					c = ALSC_INSUFFICIENT_DATA;
+			}
+		}
+	}
+
+	/* Run a solver the way the ALSC algorithm does. */
+	int solve(AlscSolver solver, double const M[ALSC_CELLS][4],
+		  unsigned int nIter, double threshold, double lambda[ALSC_CELLS])
+	{
+		int iterations = alsc_solve(solver, M, 1.3, nIter, threshold, lambda);
+
+		double min = *min_element(lambda, lambda + ALSC_CELLS);
+		for (unsigned int i = 0; i < ALSC_CELLS; i++)
+			lambda[i] /= min;
+
+		return iterations;
+	}
+
+	static double maxError(double const a[ALSC_CELLS],
+			       double const b[ALSC_CELLS])
+	{
+		double error = 0;
+		for (unsigned int i = 0; i < ALSC_CELLS; i++)
+			error = max(error, fabs(a[i] - b[i]) / b[i]);
+		return error;
+	}
+
+	int run()
+	{
+		constexpr unsigned int numScenes = 10;
+		double worstGaussSeidel = 0;
+		double worstRedBlack = 0;
+
+		for (unsigned int seed = 0; seed < numScenes; seed++) {
+			double C[ALSC_CELLS], W[ALSC_CELLS][4], M[ALSC_CELLS][4];
+			generateScene(seed, C);
+			alsc_compute_W(C, 0.01, W);
+			alsc_construct_M(C, W, M);
+
+			/*
+			 * Iterate well past the default termination threshold,
+			 * for reference.
+			 */
+			double reference[ALSC_CELLS];
+			fill(reference, reference + ALSC_CELLS, 1.0);
+			solve(AlscSolver::GaussSeidel, M, 5000, 1e-9, reference);
+
+			/* Solve with the default parameters of the algorithm. */
+			double gaussSeidel[ALSC_CELLS];
+			fill(gaussSeidel, gaussSeidel + ALSC_CELLS, 1.0);
+			solve(AlscSolver::GaussSeidel, M, 100, 1e-3, gaussSeidel);
+
+			double redBlack[ALSC_CELLS];
+			fill(redBlack, redBlack + ALSC_CELLS, 1.0);
+			solve(AlscSolver::RedBlack, M, 100, 1e-3, redBlack);
+
+			worstGaussSeidel = max(worstGaussSeidel,
+					       maxError(gaussSeidel, reference));
+			worstRedBlack = max(worstRedBlack,
+					    maxError(redBlack, reference));
+
+			/* Both solvers must reach the same solution. */
+			double exact[ALSC_CELLS];
+			fill(exact, exact + ALSC_CELLS, 1.0);
+			solve(AlscSolver::RedBlack, M, 5000, 1e-7, exact);
+			if (maxError(exact, reference) > 1e-3) {
+				cerr << "Red-black solver diverges from Gauss-Seidel for scene "
+				     << seed << ": " << maxError(exact, reference)
+				     << endl;
+				return TestFail;
+			}
+
+			/* Restarting from the solution must stop straight away. */
+			int iterations = solve(AlscSolver::RedBlack, M, 100,
+					       1e-3, exact);
+			if (iterations != 1) {
+				cerr << "Red-black solver warm start took "
+				     << iterations << " iterations" << endl;
+				return TestFail;
+			}
+		}
+
+		cout << "Largest relative error after early termination: Gauss-Seidel "
+		     << worstGaussSeidel << ", red-black " << worstRedBlack
+		     << endl;
+
+		/*
+		 * Given the same termination threshold, the red-black solver
+		 * must not be significantly less accurate than the
+		 * Gauss-Seidel solver.
+		 */
+		if (worstRedBlack > 1.5 * worstGaussSeidel) {
+			cerr << "Red-black solver not accurate enough" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(AlscSolverTest)
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * awb_search_test.cpp - Check the narrowed AWB search against the full search
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "awb_status.h"
+#include "lux_status.h"
+#include "metadata.hpp"
+#include "pwl.hpp"
+#include "rpi/awb.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+/* The AWB parameters of the imx477 tuning file. */
+static const char *awbTuning = R"({
+	"priors": [
+		{ "lux": 0, "prior": [ 2000, 1.0, 3000, 0.0, 13000, 0.0 ] },
+		{ "lux": 800, "prior": [ 2000, 0.0, 6000, 2.0, 13000, 2.0 ] },
+		{ "lux": 1500, "prior": [ 2000, 0.0, 4000, 1.0, 6000, 6.0,
+					  6500, 7.0, 7000, 1.0, 13000, 1.0 ] }
+	],
+	"modes": {
+		"auto": { "lo": 2500, "hi": 8000 }
+	},
+	"bayes": 1,
+	"ct_curve": [
+		2360.0, 0.6009, 0.3093, 2870.0, 0.5047, 0.3936,
+		2970.0, 0.4782, 0.4221, 3700.0, 0.4212, 0.4923,
+		3870.0, 0.4037, 0.5166, 4000.0, 0.3965, 0.5271,
+		4400.0, 0.3703, 0.5666, 4715.0, 0.3411, 0.6147,
+		5920.0, 0.3108, 0.6687, 9050.0, 0.2524, 0.7856
+	],
+	"sensitivity_r": 1.05,
+	"sensitivity_b": 1.05,
+	"transverse_pos": 0.0238,
+	"transverse_neg": 0.04429,
+	"startup_frames": 1000
+})";
+
+class AwbSearchTest : public Test
+{
+protected:
+	int init()
+	{
+		istringstream tuning(awbTuning);
+		boost::property_tree::read_json(tuning, params_);
+
+		/* The CT curve, to light the scene. */
+		auto &curve = params_.get_child("ct_curve");
+		for (auto it = curve.begin(); it != curve.end();) {
+			double ct = (it++)->second.get_value<double>();
+			ctR_.Append(ct, (it++)->second.get_value<double>());
+			ctB_.Append(ct, (it++)->second.get_value<double>());
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Generate the statistics of a scene made mostly of grey zones, with
+	 * some coloured ones, lit by an illuminant of the given temperature.
+	 */
+	StatisticsPtr generateStats(unsigned int seed, double ct)
+	{
+		StatisticsPtr stats = make_shared<bcm2835_isp_stats>();
+		mt19937 gen(seed);
+
+		double r = ctR_.Eval(ct) / 1.05;
+		double b = ctB_.Eval(ct) / 1.05;
+
+		for (unsigned int i = 0; i < AWB_REGIONS; i++) {
+			bcm2835_isp_stats_region &region = stats->awb_stats[i];
+			double g = 200 + gen() % 400;
+			double red = 1.0, blue = 1.0;
+
+			if (gen() % 10 < 3) {
+				red = 0.5 + (gen() % 1000) / 1000.0;
+				blue = 0.5 + (gen() % 1000) / 1000.0;
+			}
+
+			region.counted = 1000;
+			region.g_sum = g * region.counted;
+			region.r_sum = g * r * red * region.counted;
+			region.b_sum = g * b * blue * region.counted;
+		}
+
+		return stats;
+	}
+
+	struct Result {
+		AwbStatus status;
+		AwbSearchStats stats;
+	};
+
+	/* Run the AWB over a sequence of scenes, waiting for each result. */
+	int runSequence(double searchRange, vector<Result> &results)
+	{
+		boost::property_tree::ptree params = params_;
+		params.put("search_range", searchRange);
+
+		Awb awb;
+		awb.Read(params);
+		awb.Initialise();
+
+		for (unsigned int i = 0; i < scenes_.size(); i++) {
+			Metadata metadata;
+			LuxStatus luxStatus = {};
+			luxStatus.lux = scenes_[i].lux;
+			metadata.Set(luxStatus);
+
+			StatisticsPtr stats = generateStats(i, scenes_[i].ct);
+			awb.Process(stats, &metadata);
+
+			auto timeout = chrono::steady_clock::now() + chrono::seconds(5);
+			AwbSearchStats searchStats;
+			while ((searchStats = awb.GetSearchStats()).runs != i + 1) {
+				if (chrono::steady_clock::now() > timeout) {
+					cerr << "AWB calculation timed out" << endl;
+					return TestFail;
+				}
+				this_thread::sleep_for(chrono::microseconds(100));
+			}
+
+			awb.Prepare(&metadata);
+
+			Result result;
+			if (metadata.Get(result.status)) {
+				cerr << "No AWB status" << endl;
+				return TestFail;
+			}
+			result.stats = searchStats;
+			results.push_back(result);
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/*
+		 * Let the illuminant drift from warm to cold, with the lux level
+		 * crossing the priors, and switch lights abruptly a few times.
+		 */
+		for (unsigned int i = 0; i < 100; i++) {
+			double ct = 2800 * pow(1.01, i % 70);
+			double lux = 100 + 20 * i;
+			scenes_.push_back({ ct, lux });
+		}
+		scenes_[40].ct = 7500;
+		scenes_[41].ct = 2600;
+
+		vector<Result> full, narrowed;
+		if (runSequence(0.0, full) != TestPass ||
+		    runSequence(0.1, narrowed) != TestPass)
+			return TestFail;
+
+		unsigned int fullEvaluations = 0;
+		unsigned int narrowedEvaluations = 0;
+		unsigned int fullSearches = narrowed.back().stats.full_searches;
+
+		for (unsigned int i = 0; i < scenes_.size(); i++) {
+			const AwbStatus &expected = full[i].status;
+			const AwbStatus &status = narrowed[i].status;
+
+			fullEvaluations += full[i].stats.evaluations;
+			narrowedEvaluations += narrowed[i].stats.evaluations;
+
+			if (fabs(status.temperature_K - expected.temperature_K) >
+				    0.01 * expected.temperature_K ||
+			    fabs(status.gain_r - expected.gain_r) > 0.005 * expected.gain_r ||
+			    fabs(status.gain_b - expected.gain_b) > 0.005 * expected.gain_b) {
+				cerr << "Scene " << i << ": narrowed search found "
+				     << status.temperature_K << "K, gains "
+				     << status.gain_r << " " << status.gain_b
+				     << ", full search " << expected.temperature_K
+				     << "K, gains " << expected.gain_r << " "
+				     << expected.gain_b << endl;
+				return TestFail;
+			}
+		}
+
+		cout << fixed << setprecision(1)
+		     << "Evaluations per run: full search "
+		     << static_cast<double>(fullEvaluations) / scenes_.size()
+		     << ", narrowed search "
+		     << static_cast<double>(narrowedEvaluations) / scenes_.size()
+		     << " (" << fullSearches << " full searches)" << endl;
+
+		if (narrowedEvaluations >= fullEvaluations) {
+			cerr << "Narrowing the search saved no evaluation" << endl;
+			return TestFail;
+		}
+
+		/* The first run, and the abrupt changes, need full searches. */
+		if (fullSearches < 3 || fullSearches > 10) {
+			cerr << "Unexpected number of full searches: "
+			     << fullSearches << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	struct Scene {
+		double ct;
+		double lux;
+	};
+
+	boost::property_tree::ptree params_;
+	Pwl ctR_;
+	Pwl ctB_;
+	vector<Scene> scenes_;
+};
+
+TEST_REGISTER(AwbSearchTest)
@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * controller_test.cpp - Check the scheduling of the algorithms by the Controller
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "algorithm.hpp"
+#include "controller.hpp"
+#include "metadata.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+/* Record when Process starts and ends, in a sequence shared by all. */
+class FakeAlgorithm : public Algorithm
+{
+public:
+	FakeAlgorithm(Controller *controller, atomic_uint &clock,
+		      uint32_t reads, uint32_t writes)
+		: Algorithm(controller), start(0), end(0), fail(false),
+		  clock_(clock), reads_(reads), writes_(writes)
+	{
+	}
+
+	char const *Name() const override { return "fake"; }
+	uint32_t ProcessReads() const override { return reads_; }
+	uint32_t ProcessWrites() const override { return writes_; }
+
+	void Process([[maybe_unused]] StatisticsPtr &stats,
+		     [[maybe_unused]] Metadata *image_metadata) override
+	{
+		start = ++clock_;
+		this_thread::sleep_for(chrono::microseconds(200));
+		end = ++clock_;
+		if (fail)
+			throw runtime_error("fake algorithm failed");
+	}
+
+	unsigned int start;
+	unsigned int end;
+	bool fail;
+
+private:
+	atomic_uint &clock_;
+	uint32_t reads_;
+	uint32_t writes_;
+};
+
+class TestController : public Controller
+{
+public:
+	FakeAlgorithm *add(uint32_t reads, uint32_t writes)
+	{
+		FakeAlgorithm *algo = new FakeAlgorithm(this, clock_, reads, writes);
+		algorithms_.push_back(AlgorithmPtr(algo));
+		return algo;
+	}
+
+private:
+	atomic_uint clock_;
+};
+
+class ControllerTest : public Test
+{
+protected:
+	int run()
+	{
+		uint32_t lux = Metadata::Tag<LuxStatus>();
+		uint32_t agc = Metadata::Tag<AgcStatus>();
+		uint32_t histogram = Metadata::Tag<Histogram>();
+		uint32_t focus = Metadata::Tag<FocusStatus>();
+
+		/* Mirror the metadata accesses of the default tuning files. */
+		TestController controller;
+		vector<FakeAlgorithm *> algos = {
+			controller.add(0, lux),
+			controller.add(lux, 0),
+			controller.add(lux | histogram, agc),
+			controller.add(0, 0),
+			controller.add(histogram, 0),
+			controller.add(0, focus),
+			controller.add(agc, 0),
+			controller.add(Metadata::ALL_TAGS, Metadata::ALL_TAGS),
+		};
+
+		/* Which algorithms must finish before each one starts. */
+		const vector<vector<unsigned int>> depends = {
+			{}, { 0 }, { 0 }, {}, {}, {}, { 2 }, { 0, 1, 2, 3, 4, 5, 6 },
+		};
+
+		controller.Initialise();
+		controller.SetParallelProcess(true);
+
+		Metadata metadata;
+		controller.SwitchMode(CameraMode{}, &metadata);
+
+		StatisticsPtr stats = make_shared<bcm2835_isp_stats>();
+		*stats = {};
+
+		for (unsigned int frame = 0; frame < 50; frame++) {
+			metadata.Clear();
+			controller.Process(stats, &metadata);
+
+			for (unsigned int i = 0; i < algos.size(); i++) {
+				if (!algos[i]->end) {
+					cerr << "Algorithm " << i << " did not run"
+					     << endl;
+					return TestFail;
+				}
+
+				for (unsigned int j : depends[i]) {
+					if (algos[i]->start < algos[j]->end) {
+						cerr << "Algorithm " << i
+						     << " started before algorithm "
+						     << j << " finished" << endl;
+						return TestFail;
+					}
+				}
+			}
+
+			for (FakeAlgorithm *algo : algos)
+				algo->start = algo->end = 0;
+		}
+
+		/* Errors must reach the caller, even from other threads. */
+		algos[4]->fail = true;
+		try {
+			controller.Process(stats, &metadata);
+			cerr << "Algorithm failure not reported" << endl;
+			return TestFail;
+		} catch (runtime_error const &) {
+		}
+		algos[4]->fail = false;
+
+		/* Paused algorithms are skipped, without holding others up. */
+		algos[0]->Pause();
+		algos[0]->start = algos[0]->end = 0;
+		controller.Process(stats, &metadata);
+		if (algos[0]->end || !algos[1]->end || !algos[7]->end) {
+			cerr << "Paused algorithm not skipped" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ControllerTest)
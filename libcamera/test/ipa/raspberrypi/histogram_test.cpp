@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * histogram_test.cpp - Check the histogram prefix sums and batched quantiles
+ */
+
+#include <iostream>
+#include <random>
+
+#include "histogram.hpp"
+#include "metadata.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+class HistogramTest : public Test
+{
+protected:
+	int run()
+	{
+		mt19937 gen(0);
+
+		for (unsigned int seed = 0; seed < 100; seed++) {
+			/* Leave some bins empty, as dark scenes do. */
+			uint32_t bins[NUM_HISTOGRAM_BINS];
+			for (unsigned int i = 0; i < NUM_HISTOGRAM_BINS; i++)
+				bins[i] = gen() % 4 ? gen() % 10000 : 0;
+
+			/* Go through the metadata, as the algorithms do. */
+			Metadata metadata;
+			metadata.Set(Histogram(bins, NUM_HISTOGRAM_BINS));
+
+			Histogram histogram;
+			if (metadata.Get(histogram)) {
+				cerr << "No histogram in the metadata" << endl;
+				return TestFail;
+			}
+
+			if (histogram.Bins() != NUM_HISTOGRAM_BINS) {
+				cerr << "Histogram has " << histogram.Bins()
+				     << " bins" << endl;
+				return TestFail;
+			}
+
+			/* Check the vectorised prefix sum. */
+			uint64_t cumulative = 0;
+			for (unsigned int i = 0; i < NUM_HISTOGRAM_BINS; i++) {
+				if (histogram.CumulativeFreq(i) != cumulative) {
+					cerr << "Cumulative frequency of bin " << i
+					     << " of histogram " << seed << " is "
+					     << histogram.CumulativeFreq(i)
+					     << ", expected " << cumulative << endl;
+					return TestFail;
+				}
+				cumulative += bins[i];
+			}
+
+			if (histogram.Total() != cumulative) {
+				cerr << "Histogram " << seed << " total is "
+				     << histogram.Total() << ", expected "
+				     << cumulative << endl;
+				return TestFail;
+			}
+
+			/* A number of bins that isn't a multiple of 4. */
+			Histogram partial(bins, 7);
+			if (partial.Total() != histogram.CumulativeFreq(7)) {
+				cerr << "Partial histogram " << seed
+				     << " total is wrong" << endl;
+				return TestFail;
+			}
+
+			/*
+			 * Mix increasing and decreasing quantiles, which must
+			 * give the same results as looking them up one by one.
+			 */
+			double q[6] = { 0.01, 0.5, 0.99, 0.2, 0.2, 1.0 };
+			q[3] = (gen() % 1000) / 1000.0;
+			double results[6];
+			histogram.Quantiles(q, results, 6);
+
+			for (unsigned int i = 0; i < 6; i++) {
+				double expected = histogram.Quantile(q[i]);
+				if (results[i] != expected) {
+					cerr << "Quantile " << q[i] << " of histogram "
+					     << seed << " is " << results[i]
+					     << ", expected " << expected << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(HistogramTest)
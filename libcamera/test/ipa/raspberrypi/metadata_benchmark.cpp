@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * metadata_benchmark.cpp - Benchmark the Raspberry Pi controller metadata
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#include "metadata.hpp"
+
+#include "allocation_counter.h"
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+class MetadataBenchmark : public Test
+{
+protected:
+	/*
+	 * Replay the metadata accesses performed for one frame by the IPA and
+	 * the algorithms of the default Raspberry Pi tuning files, in the
+	 * order in which they run.
+	 */
+	void prepare(Metadata &metadata, unsigned int frame)
+	{
+		DeviceStatus deviceStatus = {};
+		deviceStatus.shutter_speed = 10000 + frame % 100;
+		deviceStatus.analogue_gain = 2.0;
+
+		metadata.Clear();
+		metadata.Set(deviceStatus);
+
+		/* rpi.black_level, rpi.dpc */
+		metadata.Set(BlackLevelStatus{ 4096, 4096, 4096 });
+		metadata.Set(DpcStatus{ 1 });
+
+		/* rpi.lux */
+		metadata.Set(lux_);
+
+		/* rpi.noise */
+		metadata.Get(deviceStatus);
+		metadata.Set(NoiseStatus{ 1.0, 0.0 });
+
+		/* rpi.geq */
+		LuxStatus luxStatus;
+		metadata.Get(luxStatus);
+		metadata.Get(deviceStatus);
+		metadata.Set(GeqStatus{ 4, 0.8 });
+
+		/* rpi.sdn */
+		NoiseStatus noiseStatus;
+		metadata.Get(noiseStatus);
+		metadata.Set(DenoiseStatus{ 0.75, 3.0, 1.0, 2 });
+
+		/* rpi.awb */
+		metadata.Set(awb_);
+
+		/* rpi.agc */
+		metadata.Get(deviceStatus);
+		metadata.Set(agc_);
+
+		/* rpi.alsc */
+		metadata.Set(alsc_);
+
+		/* rpi.contrast */
+		metadata.Set(contrast_);
+
+		/* rpi.ccm */
+		{
+			std::lock_guard<Metadata> lock(metadata);
+			metadata.GetLocked<AwbStatus>();
+			metadata.GetLocked<LuxStatus>();
+		}
+		metadata.Set(ccm_);
+
+		/* rpi.sharpen */
+		metadata.Set(SharpenStatus{ 1.0, 1.0, 1.0, 1.0 });
+
+		/* IPARPi::prepareISP() */
+		std::unique_lock<Metadata> lock(metadata);
+		sum_ += metadata.GetLocked<AwbStatus>()->gain_r;
+		sum_ += metadata.GetLocked<CcmStatus>()->matrix[0];
+		sum_ += metadata.GetLocked<AgcStatus>()->digital_gain;
+		sum_ += metadata.GetLocked<AlscStatus>()->r[0][0];
+		sum_ += metadata.GetLocked<ContrastStatus>()->brightness;
+		sum_ += metadata.GetLocked<BlackLevelStatus>()->black_level_r;
+		sum_ += metadata.GetLocked<GeqStatus>()->offset;
+		sum_ += metadata.GetLocked<DenoiseStatus>()->strength;
+		sum_ += metadata.GetLocked<SharpenStatus>()->strength;
+		sum_ += metadata.GetLocked<DpcStatus>()->strength;
+	}
+
+	void process(Metadata &metadata)
+	{
+		/* IPARPi::reportMetadata() */
+		{
+			std::unique_lock<Metadata> lock(metadata);
+			sum_ += metadata.GetLocked<DeviceStatus>()->shutter_speed;
+			sum_ += metadata.GetLocked<AgcStatus>()->digital_gain;
+			sum_ += metadata.GetLocked<LuxStatus>()->lux;
+			sum_ += metadata.GetLocked<AwbStatus>()->gain_b;
+			sum_ += metadata.GetLocked<BlackLevelStatus>()->black_level_g;
+			metadata.GetLocked<FocusStatus>();
+			sum_ += metadata.GetLocked<CcmStatus>()->matrix[4];
+		}
+
+		/* rpi.lux */
+		DeviceStatus deviceStatus;
+		metadata.Get(deviceStatus);
+		metadata.Set(lux_);
+
+		/* rpi.awb */
+		LuxStatus luxStatus;
+		metadata.Get(luxStatus);
+
+		/* rpi.agc */
+		{
+			std::unique_lock<Metadata> lock(metadata);
+			metadata.GetLocked<DeviceStatus>();
+			metadata.GetLocked<AgcStatus>();
+		}
+		AwbStatus awbStatus;
+		metadata.Get(awbStatus);
+		metadata.Get(luxStatus);
+		metadata.Set(agc_);
+
+		/* rpi.alsc */
+		metadata.Get(awbStatus);
+		AlscStatus alscStatus;
+		metadata.Get(alscStatus);
+
+		/* IPARPi::processStats() */
+		AgcStatus agcStatus;
+		if (metadata.Get(agcStatus) == 0)
+			sum_ += agcStatus.shutter_time;
+	}
+
+	int run()
+	{
+		constexpr unsigned int numFrames = 100000;
+		Metadata metadata;
+
+		lux_ = {};
+		lux_.lux = 400;
+		awb_ = {};
+		awb_.temperature_K = 4500;
+		awb_.gain_r = 1.5;
+		awb_.gain_g = 1.0;
+		awb_.gain_b = 2.0;
+		agc_ = {};
+		agc_.shutter_time = 10000;
+		agc_.digital_gain = 1.0;
+		alsc_ = {};
+		contrast_ = {};
+		ccm_ = {};
+		sum_ = 0;
+
+		for (unsigned int i = 0; i < 100; ++i) {
+			prepare(metadata, i);
+			process(metadata);
+		}
+
+		uint64_t count = AllocationCounter::processAllocations();
+		auto start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < numFrames; ++i) {
+			prepare(metadata, i);
+			process(metadata);
+		}
+
+		chrono::nanoseconds duration = chrono::steady_clock::now() - start;
+		count = AllocationCounter::processAllocations() - count;
+
+		cout << fixed << setprecision(2)
+		     << "Metadata accesses per frame: "
+		     << static_cast<double>(duration.count()) / numFrames
+		     << " ns, " << static_cast<double>(count) / numFrames
+		     << " allocations" << endl;
+
+		/* The exposure is set in process(), check it made it through. */
+		AgcStatus agcStatus;
+		if (metadata.Get(agcStatus) != 0 || agcStatus.shutter_time != 10000) {
+			cerr << "Invalid metadata contents" << endl;
+			return TestFail;
+		}
+
+		metadata.Clear();
+		if (metadata.Get(agcStatus) == 0) {
+			cerr << "Metadata not cleared" << endl;
+			return TestFail;
+		}
+
+		return sum_ > 0 ? TestPass : TestFail;
+	}
+
+private:
+	LuxStatus lux_;
+	AwbStatus awb_;
+	AgcStatus agc_;
+	AlscStatus alsc_;
+	ContrastStatus contrast_;
+	CcmStatus ccm_;
+
+	double sum_;
+};
+
+TEST_REGISTER(MetadataBenchmark)
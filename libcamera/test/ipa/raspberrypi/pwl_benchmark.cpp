@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * pwl_benchmark.cpp - Benchmark the evaluation of piecewise linear functions
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "pwl.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+class PwlBenchmark : public Test
+{
+protected:
+	int init()
+	{
+		/*
+		 * A gamma curve with the point density of the default tuning
+		 * files, denser in the shadows.
+		 */
+		for (unsigned int i = 0; i <= 48; i++) {
+			double x = 65535 * pow(i / 48.0, 2);
+			gamma_.Append(x, 65535 * pow(x / 65535, 1 / 2.2));
+		}
+
+		baked_ = gamma_;
+		baked_.Bake();
+
+		/* Evaluate in random order, over and slightly past the domain. */
+		mt19937 gen(0);
+		for (unsigned int i = 0; i < 4096; i++)
+			x_.push_back(gen() % 70000 - 2000.0);
+
+		return TestPass;
+	}
+
+	template<typename Func>
+	double measure(const char *name, vector<double> &y, Func func)
+	{
+		constexpr unsigned int numRuns = 500;
+
+		auto start = chrono::steady_clock::now();
+		for (unsigned int run = 0; run < numRuns; run++)
+			func(y);
+		chrono::nanoseconds duration = chrono::steady_clock::now() - start;
+
+		double ns = static_cast<double>(duration.count()) /
+			    (numRuns * x_.size());
+		cout << fixed << setprecision(2) << name << ": " << ns
+		     << " ns per point" << endl;
+		return ns;
+	}
+
+	int run()
+	{
+		vector<double> expected(x_.size()), y(x_.size());
+
+		measure("Eval(), unbaked", expected, [&](vector<double> &out) {
+			for (unsigned int i = 0; i < x_.size(); i++)
+				out[i] = gamma_.Eval(x_[i]);
+		});
+
+		measure("Eval(), baked", y, [&](vector<double> &out) {
+			for (unsigned int i = 0; i < x_.size(); i++)
+				out[i] = baked_.Eval(x_[i]);
+		});
+		if (y != expected) {
+			cerr << "Baked Pwl gives different results" << endl;
+			return TestFail;
+		}
+
+		measure("Batch Eval(), baked", y, [&](vector<double> &out) {
+			baked_.Eval(x_.data(), out.data(), x_.size());
+		});
+		if (y != expected) {
+			cerr << "Batch evaluation gives different results" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	Pwl gamma_;
+	Pwl baked_;
+	vector<double> x_;
+};
+
+TEST_REGISTER(PwlBenchmark)
@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * tuning_cache_test.cpp - Check the compiled tuning file cache
+ */
+
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include "tuning_cache.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPiController;
+
+static const char *tuning = R"({
+	"rpi.black_level": { "black_level": 4096 },
+	"rpi.lux": {
+		"reference_shutter_speed": 27242,
+		"reference_Y": 12311
+	},
+	"rpi.contrast": {
+		"ce_enable": 1,
+		"gamma_curve": [ 0, 0, 1024, 5040, 2048, 9338, 65535, 65535 ]
+	},
+	"rpi.alsc": {
+		"calibrations_Cr": [
+			{ "ct": 2960, "table": [ 2.088, 2.086, 2.082 ] },
+			{ "ct": 4850, "table": [ 2.767, 2.759, 2.753 ] }
+		],
+		"name": "escaped \"quotes\" and \\backslashes\\",
+		"empty": ""
+	}
+})";
+
+class TuningCacheTest : public Test
+{
+protected:
+	int init()
+	{
+		char dir[] = "/tmp/libcamera.rpi.tuning.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		cacheDir_ = dir_ + "/cache/rpi";
+		file_ = dir_ + "/tuning.json";
+
+		return TestPass;
+	}
+
+	void writeTuning(const string &json, const string &file = "")
+	{
+		ofstream(file.empty() ? file_ : file) << json;
+	}
+
+	/* Move the modification time of a file to the past. */
+	void age(time_t seconds, const string &file = "")
+	{
+		const string &path = file.empty() ? file_ : file;
+		struct stat st;
+		stat(path.c_str(), &st);
+		struct timespec times[2] = { st.st_atim, st.st_mtim };
+		times[0].tv_sec -= seconds;
+		times[1].tv_sec -= seconds;
+		utimensat(AT_FDCWD, path.c_str(), times, 0);
+	}
+
+	/* The algorithm names contain dots, which ptree paths can't. */
+	static int blackLevel(const boost::property_tree::ptree &root)
+	{
+		return root.find("rpi.black_level")->second.get<int>("black_level");
+	}
+
+	unsigned int countCacheFiles()
+	{
+		unsigned int count = 0;
+		DIR *dir = opendir(cacheDir_.c_str());
+		if (!dir)
+			return 0;
+		while (struct dirent *entry = readdir(dir)) {
+			if (string(entry->d_name).rfind("rpi-tuning-", 0) == 0)
+				count++;
+		}
+		closedir(dir);
+		return count;
+	}
+
+	int run()
+	{
+		writeTuning(tuning);
+
+		/* Without a cache, the JSON is parsed every time. */
+		boost::property_tree::ptree reference;
+		if (tuning_read(file_.c_str(), "", reference) || countCacheFiles()) {
+			cerr << "Tuning file cached without a cache directory" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The first read creates the cache directory and compiles the
+		 * cache, the second one uses it.
+		 */
+		boost::property_tree::ptree root;
+		if (tuning_read(file_.c_str(), cacheDir_, root) || root != reference ||
+		    countCacheFiles() != 1) {
+			cerr << "Failed to compile the tuning cache" << endl;
+			return TestFail;
+		}
+
+		root.clear();
+		if (!tuning_read(file_.c_str(), cacheDir_, root)) {
+			cerr << "Tuning cache not used" << endl;
+			return TestFail;
+		}
+
+		if (root != reference) {
+			cerr << "Tuning cache doesn't match the JSON" << endl;
+			return TestFail;
+		}
+
+		if (root.find("rpi.alsc")->second.get<string>("name") !=
+		    "escaped \"quotes\" and \\backslashes\\") {
+			cerr << "Tuning cache mangles strings" << endl;
+			return TestFail;
+		}
+
+		/* Images from another JSON, or damaged ones, must be rejected. */
+		uint64_t hash = tuning_hash(tuning);
+		string image = tuning_compile(reference, hash);
+
+		if (tuning_load(image.data(), image.size(), hash + 1, root)) {
+			cerr << "Tuning cache loaded for the wrong hash" << endl;
+			return TestFail;
+		}
+
+		for (size_t size = 0; size < image.size(); size++) {
+			if (tuning_load(image.data(), size, hash, root)) {
+				cerr << "Truncated tuning cache loaded" << endl;
+				return TestFail;
+			}
+		}
+
+		for (size_t i = 0; i < image.size(); i++) {
+			string damaged = image;
+			damaged[i] ^= 0x80;
+			/* Damaged strings may still load, but must not crash. */
+			tuning_load(damaged.data(), damaged.size(), hash, root);
+		}
+
+		/* Editing the tuning file must not pick up the stale cache. */
+		string edited = tuning;
+		edited.replace(edited.find("4096"), 4, "4000");
+		writeTuning(edited);
+
+		root.clear();
+		if (tuning_read(file_.c_str(), cacheDir_, root) ||
+		    blackLevel(root) != 4000) {
+			cerr << "Stale tuning cache used" << endl;
+			return TestFail;
+		}
+
+		root.clear();
+		if (!tuning_read(file_.c_str(), cacheDir_, root) ||
+		    blackLevel(root) != 4000 || countCacheFiles() != 1) {
+			cerr << "Tuning cache not replaced after an edit" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Once the tuning file is old enough for its timestamp to be
+		 * trusted, the image is used without reading the JSON. Check
+		 * it by changing the JSON behind the back of the cache, keeping
+		 * the size and timestamp of the file.
+		 */
+		age(3600);
+		root.clear();
+		if (!tuning_read(file_.c_str(), cacheDir_, root)) {
+			cerr << "Tuning cache not used for an old file" << endl;
+			return TestFail;
+		}
+
+		struct stat st;
+		stat(file_.c_str(), &st);
+		struct timespec times[2] = { st.st_atim, st.st_mtim };
+		edited.replace(edited.find("4000"), 4, "4001");
+		writeTuning(edited);
+		utimensat(AT_FDCWD, file_.c_str(), times, 0);
+
+		root.clear();
+		if (!tuning_read(file_.c_str(), cacheDir_, root) ||
+		    blackLevel(root) != 4000) {
+			cerr << "JSON read although the tuning file is unchanged"
+			     << endl;
+			return TestFail;
+		}
+
+		/* Touching the file makes the cache check the JSON again. */
+		age(1800);
+		root.clear();
+		if (tuning_read(file_.c_str(), cacheDir_, root) ||
+		    blackLevel(root) != 4001) {
+			cerr << "Stale tuning cache used after a touch" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The images of deleted tuning files, and the leftovers of
+		 * interrupted writes, are removed when writing a new image. The
+		 * temporary files of writes that may still be in progress in
+		 * another process are kept.
+		 */
+		string other = dir_ + "/other.json";
+		writeTuning(tuning, other);
+		if (tuning_read(other.c_str(), cacheDir_, root) ||
+		    countCacheFiles() != 2) {
+			cerr << "Failed to cache a second tuning file" << endl;
+			return TestFail;
+		}
+
+		unlink(other.c_str());
+		string leftover = cacheDir_ + "/rpi-tuning-0123456789abcdef.bin.a1b2c3";
+		ofstream{ leftover };
+		age(2 * 3600, leftover);
+		string inProgress = cacheDir_ + "/rpi-tuning-0123456789abcdef.bin.d4e5f6";
+		ofstream{ inProgress };
+
+		writeTuning(tuning);
+		root.clear();
+		if (tuning_read(file_.c_str(), cacheDir_, root) ||
+		    countCacheFiles() != 2) {
+			cerr << "Stale tuning cache files not removed" << endl;
+			return TestFail;
+		}
+
+		if (access(inProgress.c_str(), F_OK)) {
+			cerr << "Temporary file of a write in progress removed"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	static void removeDir(const string &path)
+	{
+		DIR *dir = opendir(path.c_str());
+		if (!dir)
+			return;
+		while (struct dirent *entry = readdir(dir)) {
+			string name = entry->d_name;
+			if (name == "." || name == "..")
+				continue;
+			if (entry->d_type == DT_DIR)
+				removeDir(path + "/" + name);
+			else
+				unlink((path + "/" + name).c_str());
+		}
+		closedir(dir);
+		rmdir(path.c_str());
+	}
+
+	void cleanup()
+	{
+		if (!dir_.empty())
+			removeDir(dir_);
+	}
+
+private:
+	string dir_;
+	string cacheDir_;
+	string file_;
+};
+
+TEST_REGISTER(TuningCacheTest)
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipc_benchmark.cpp - IPC transports round-trip latency benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "libcamera/internal/event_dispatcher.h"
+#include "libcamera/internal/ipc_pipe.h"
+#include "libcamera/internal/ipc_pipe_shared_memory.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
+#include "libcamera/internal/process.h"
+#include "libcamera/internal/thread.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+enum {
+	CmdExit = 0,
+	CmdEchoSync = 1,
+};
+
+template<typename Socket>
+class IPCBenchmarkSlave
+{
+public:
+	IPCBenchmarkSlave()
+		: exit_(false)
+	{
+		dispatcher_ = Thread::current()->eventDispatcher();
+		ipc_.readyRead.connect(this, &IPCBenchmarkSlave::readyRead);
+	}
+
+	int run(int fd)
+	{
+		if (ipc_.bind(fd)) {
+			cerr << "Failed to connect to IPC channel" << endl;
+			return EXIT_FAILURE;
+		}
+
+		while (!exit_)
+			dispatcher_->processEvents();
+
+		ipc_.close();
+
+		return EXIT_SUCCESS;
+	}
+
+private:
+	void readyRead(Socket *ipc)
+	{
+		typename Socket::Payload message;
+
+		if (ipc->receive(&message))
+			return;
+
+		IPCMessage ipcMessage(message);
+		uint32_t cmd = ipcMessage.header().cmd;
+
+		switch (cmd) {
+		case CmdExit:
+			exit_ = true;
+			break;
+
+		case CmdEchoSync: {
+			IPCMessage::Header header = { cmd, ipcMessage.header().cookie };
+			IPCMessage response(header);
+			response.data() = ipcMessage.data();
+
+			if (ipc_.send(response.payload()) < 0)
+				exit_ = true;
+			break;
+		}
+		}
+	}
+
+	Socket ipc_;
+	EventDispatcher *dispatcher_;
+	bool exit_;
+};
+
+class IPCBenchmark : public Test
+{
+protected:
+	int run()
+	{
+		ProcessManager processManager;
+
+		cout << fixed << setprecision(2);
+
+		IPCPipeUnixSocket unixSocket("", "/proc/self/exe");
+		if (measure("IPCPipeUnixSocket", &unixSocket))
+			return TestFail;
+
+		IPCPipeSharedMemory sharedMemory("", "/proc/self/exe");
+		if (measure("IPCPipeSharedMemory", &sharedMemory))
+			return TestFail;
+
+		return TestPass;
+	}
+
+private:
+	int measure(const char *name, IPCPipe *ipc)
+	{
+		constexpr unsigned int numCalls = 5000;
+
+		if (!ipc->isConnected()) {
+			cerr << "Failed to create " << name << endl;
+			return -ENOTCONN;
+		}
+
+		for (size_t size : { 64, 4096, 65536 }) {
+			IPCMessage msg(CmdEchoSync);
+			IPCMessage response;
+
+			msg.data().resize(size);
+
+			for (unsigned int i = 0; i < 100; ++i)
+				ipc->sendSync(msg, &response);
+
+			vector<chrono::nanoseconds> latencies;
+			latencies.reserve(numCalls);
+
+			for (unsigned int i = 0; i < numCalls; ++i) {
+				auto start = chrono::steady_clock::now();
+				int ret = ipc->sendSync(msg, &response);
+				latencies.push_back(chrono::steady_clock::now() - start);
+
+				if (ret < 0 || response.data().size() != size) {
+					cerr << name << ": call failed" << endl;
+					return -EIO;
+				}
+			}
+
+			sort(latencies.begin(), latencies.end());
+
+			cout << name << ", " << setw(5) << size << " bytes: p50 "
+			     << latencies[numCalls / 2].count() / 1000.0 << " us, p99 "
+			     << latencies[numCalls * 99 / 100].count() / 1000.0
+			     << " us" << endl;
+		}
+
+		ipc->sendAsync(IPCMessage(CmdExit));
+
+		return 0;
+	}
+};
+
+/*
+ * Can't use TEST_REGISTER() as single binary needs to act as both client and
+ * server
+ */
+int main(int argc, char **argv)
+{
+	/* The IPC pipes pass the transport name in argv[3] */
+	if (argc == 4) {
+		int ipcfd = std::stoi(argv[2]);
+
+		if (!strcmp(argv[3], IPCPipeSharedMemory::name())) {
+			IPCBenchmarkSlave<IPCSharedMemory> slave;
+			return slave.run(ipcfd);
+		} else {
+			IPCBenchmarkSlave<IPCUnixSocket> slave;
+			return slave.run(ipcfd);
+		}
+	}
+
+	return IPCBenchmark().execute();
+}
@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * shared_memory_ipc.cpp - Shared memory IPC test
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libcamera/internal/event_dispatcher.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+#include "libcamera/internal/ipc_pipe.h"
+#include "libcamera/internal/ipc_pipe_shared_memory.h"
+#include "libcamera/internal/ipc_shared_memory.h"
+#include "libcamera/internal/process.h"
+#include "libcamera/internal/thread.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+enum {
+	CmdExit = 0,
+	CmdGetSync = 1,
+	CmdSetAsync = 2,
+	CmdAccumulateAsync = 3,
+	CmdAccumulateFdAsync = 4,
+	CmdEchoSync = 5,
+};
+
+const int32_t kInitialValue = 1337;
+const int32_t kChangedValue = 9001;
+
+/*
+ * Order-sensitive accumulation of values, used to verify that messages sent
+ * through the ring and the socket are received in order.
+ */
+static int32_t accumulate(int32_t acc, int32_t value)
+{
+	return static_cast<uint32_t>(acc) * 31 + static_cast<uint32_t>(value);
+}
+
+class SharedMemoryTestIPCSlave
+{
+public:
+	SharedMemoryTestIPCSlave()
+		: value_(kInitialValue), exitCode_(EXIT_FAILURE), exit_(false)
+	{
+		dispatcher_ = Thread::current()->eventDispatcher();
+		ipc_.readyRead.connect(this, &SharedMemoryTestIPCSlave::readyRead);
+	}
+
+	int run(int fd)
+	{
+		if (ipc_.bind(fd)) {
+			cerr << "Failed to connect to IPC channel" << endl;
+			return EXIT_FAILURE;
+		}
+
+		while (!exit_)
+			dispatcher_->processEvents();
+
+		ipc_.close();
+
+		return exitCode_;
+	}
+
+private:
+	void readyRead(IPCSharedMemory *ipc)
+	{
+		IPCSharedMemory::Payload message;
+		int ret;
+
+		ret = ipc->receive(&message);
+		if (ret) {
+			cerr << "Receive message failed: " << ret << endl;
+			return;
+		}
+
+		IPCMessage ipcMessage(message);
+		uint32_t cmd = ipcMessage.header().cmd;
+		IPCMessage::Header header = { cmd, ipcMessage.header().cookie };
+
+		switch (cmd) {
+		case CmdExit: {
+			exitCode_ = EXIT_SUCCESS;
+			exit_ = true;
+			break;
+		}
+
+		case CmdGetSync: {
+			IPCMessage response(header);
+
+			tie(response.data(), ignore) =
+				IPADataSerializer<int32_t>::serialize(value_);
+
+			reply(response);
+			break;
+		}
+
+		case CmdSetAsync: {
+			value_ = IPADataSerializer<int32_t>::deserialize(ipcMessage.data());
+			break;
+		}
+
+		case CmdAccumulateAsync: {
+			int32_t value = IPADataSerializer<int32_t>::deserialize(ipcMessage.data());
+			value_ = accumulate(value_, value);
+			break;
+		}
+
+		case CmdAccumulateFdAsync: {
+			if (ipcMessage.fds().size() != 1) {
+				cerr << "Expected one file descriptor" << endl;
+				stop(EXIT_FAILURE);
+				break;
+			}
+
+			int fd = ipcMessage.fds()[0];
+			int32_t value;
+			ssize_t n = read(fd, &value, sizeof(value));
+			close(fd);
+
+			if (n != sizeof(value)) {
+				cerr << "Failed to read from file descriptor" << endl;
+				stop(EXIT_FAILURE);
+				break;
+			}
+
+			value_ = accumulate(value_, value);
+			break;
+		}
+
+		case CmdEchoSync: {
+			IPCMessage response(header);
+			response.data() = ipcMessage.data();
+
+			reply(response);
+			break;
+		}
+		}
+	}
+
+	void reply(const IPCMessage &response)
+	{
+		int ret = ipc_.send(response.payload());
+		if (ret < 0) {
+			cerr << "Reply failed" << endl;
+			stop(ret);
+		}
+	}
+
+	void stop(int code)
+	{
+		exitCode_ = code;
+		exit_ = true;
+	}
+
+	int32_t value_;
+
+	IPCSharedMemory ipc_;
+	EventDispatcher *dispatcher_;
+	int exitCode_;
+	bool exit_;
+};
+
+class SharedMemoryTestIPC : public Test
+{
+protected:
+	int init()
+	{
+		return 0;
+	}
+
+	int setValue(uint32_t cmd, int32_t val)
+	{
+		IPCMessage msg(cmd);
+		tie(msg.data(), ignore) = IPADataSerializer<int32_t>::serialize(val);
+
+		int ret = ipc_->sendAsync(msg);
+		if (ret < 0) {
+			cerr << "Failed to call set value" << endl;
+			return ret;
+		}
+
+		return 0;
+	}
+
+	int setValueFd(int32_t val)
+	{
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC) < 0)
+			return -errno;
+
+		ssize_t n = write(fds[1], &val, sizeof(val));
+		close(fds[1]);
+		if (n != sizeof(val)) {
+			close(fds[0]);
+			return -EIO;
+		}
+
+		IPCMessage msg(CmdAccumulateFdAsync);
+		msg.fds().push_back(fds[0]);
+
+		int ret = ipc_->sendAsync(msg);
+		close(fds[0]);
+		if (ret < 0) {
+			cerr << "Failed to call set value with fd" << endl;
+			return ret;
+		}
+
+		return 0;
+	}
+
+	int getValue()
+	{
+		IPCMessage msg(CmdGetSync);
+		IPCMessage buf;
+
+		int ret = ipc_->sendSync(msg, &buf);
+		if (ret < 0) {
+			cerr << "Failed to call get value" << endl;
+			return ret;
+		}
+
+		return IPADataSerializer<int32_t>::deserialize(buf.data());
+	}
+
+	int echo(size_t size, unsigned int seed)
+	{
+		IPCMessage msg(CmdEchoSync);
+		IPCMessage buf;
+
+		msg.data().resize(size);
+		for (size_t i = 0; i < size; ++i)
+			msg.data()[i] = (i + seed) * 7;
+
+		int ret = ipc_->sendSync(msg, &buf);
+		if (ret < 0) {
+			cerr << "Failed to call echo" << endl;
+			return ret;
+		}
+
+		if (buf.data() != msg.data()) {
+			cerr << "Echoed data mismatch for " << size << " bytes" << endl;
+			return -EINVAL;
+		}
+
+		return 0;
+	}
+
+	int exit()
+	{
+		IPCMessage msg(CmdExit);
+
+		int ret = ipc_->sendAsync(msg);
+		if (ret < 0) {
+			cerr << "Failed to call exit" << endl;
+			return ret;
+		}
+
+		return 0;
+	}
+
+	int run()
+	{
+		ipc_ = std::make_unique<IPCPipeSharedMemory>("", "/proc/self/exe");
+		if (!ipc_->isConnected()) {
+			cerr << "Failed to create IPCPipe" << endl;
+			return TestFail;
+		}
+
+		int ret = getValue();
+		if (ret != kInitialValue) {
+			cerr << "Wrong initial value, expected "
+			     << kInitialValue << ", got " << ret << endl;
+			return TestFail;
+		}
+
+		ret = setValue(CmdSetAsync, kChangedValue);
+		if (ret < 0) {
+			cerr << "Failed to set value: " << strerror(-ret) << endl;
+			return TestFail;
+		}
+
+		ret = getValue();
+		if (ret != kChangedValue) {
+			cerr << "Wrong set value, expected " << kChangedValue
+			     << ", got " << ret << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Interleave messages transported through the ring with
+		 * messages carrying file descriptors, which are transported
+		 * through the socket, and verify they are received in order.
+		 */
+		int32_t expected = kChangedValue;
+		for (int32_t i = 0; i < 256; ++i) {
+			if (i % 3 == 0)
+				ret = setValueFd(i);
+			else
+				ret = setValue(CmdAccumulateAsync, i);
+			if (ret < 0) {
+				cerr << "Failed to accumulate value: "
+				     << strerror(-ret) << endl;
+				return TestFail;
+			}
+
+			expected = accumulate(expected, i);
+		}
+
+		ret = getValue();
+		if (ret != expected) {
+			cerr << "Messages received out of order, expected "
+			     << expected << ", got " << ret << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Exchange payloads of increasing sizes, up to the size of the
+		 * ring, to exercise wrap-around of the ring indices.
+		 */
+		for (unsigned int i = 0; i < 32; ++i) {
+			size_t size = (i * 37 * 1024) % (IPCSharedMemory::defaultRingSize / 2) + 1;
+			if (echo(size, i) < 0)
+				return TestFail;
+		}
+
+		if (echo(IPCSharedMemory::defaultRingSize * 3 / 4, 0) < 0)
+			return TestFail;
+
+		ret = exit();
+		if (ret < 0) {
+			cerr << "Failed to exit: " << strerror(-ret) << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	ProcessManager processManager_;
+
+	unique_ptr<IPCPipeSharedMemory> ipc_;
+};
+
+/*
+ * Can't use TEST_REGISTER() as single binary needs to act as both client and
+ * server
+ */
+int main(int argc, char **argv)
+{
+	/*
+	 * IPCPipeSharedMemory passes the IPA module path in argv[1], the fd in
+	 * argv[2] and the transport name in argv[3]
+	 */
+	if (argc == 4) {
+		int ipcfd = std::stoi(argv[2]);
+		SharedMemoryTestIPCSlave slave;
+		return slave.run(ipcfd);
+	}
+
+	return SharedMemoryTestIPC().execute();
+}
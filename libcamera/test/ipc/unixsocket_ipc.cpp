@@ -220,8 +220,11 @@ private:
  */
 int main(int argc, char **argv)
 {
-	/* IPCPipeUnixSocket passes IPA module path in argv[1] */
-	if (argc == 3) {
+	/*
+	 * IPCPipeUnixSocket passes the IPA module path in argv[1], the fd in
+	 * argv[2] and the transport name in argv[3]
+	 */
+	if (argc == 4) {
 		int ipcfd = std::stoi(argv[2]);
 		UnixSocketTestIPCSlave slave;
 		return slave.run(ipcfd);
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * allocation_counter.cpp - Count the memory allocations of the process
+ */
+
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> processCount;
+static thread_local uint64_t threadCount;
+
+void *operator new(size_t size)
+{
+	processCount.fetch_add(1, std::memory_order_relaxed);
+	threadCount++;
+
+	void *ptr = malloc(size);
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, [[maybe_unused]] size_t size) noexcept
+{
+	free(ptr);
+}
+
+uint64_t AllocationCounter::processAllocations()
+{
+	return processCount.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::threadAllocations()
+{
+	return threadCount;
+}
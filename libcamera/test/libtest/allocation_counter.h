@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * allocation_counter.h - Count the memory allocations of the process
+ */
+#ifndef __LIBCAMERA_ALLOCATION_COUNTER_TEST_H__
+#define __LIBCAMERA_ALLOCATION_COUNTER_TEST_H__
+
+#include <stdint.h>
+
+/*
+ * Linking this helper replaces the global operator new of the program with one
+ * that counts the allocations, by the whole process and by the current thread.
+ */
+class AllocationCounter
+{
+public:
+	static uint64_t processAllocations();
+	static uint64_t threadAllocations();
+};
+
+#endif /* __LIBCAMERA_ALLOCATION_COUNTER_TEST_H__ */
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * message-queue.cpp - Cross-thread message queue and pool allocator test
+ */
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <libcamera/object.h>
+
+#include "libcamera/internal/pool_allocator.h"
+#include "libcamera/internal/thread.h"
+
+#include "allocation_counter.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class RecordingObject : public Object
+{
+public:
+	static constexpr unsigned int numProducers = 4;
+
+	RecordingObject()
+		: received_(0), errors_(0), sequences_{}
+	{
+	}
+
+	void record(unsigned int producer, unsigned int sequence)
+	{
+		if (Thread::current() != thread())
+			errors_++;
+
+		/* Messages from a given producer must be delivered in order. */
+		if (sequence != sequences_[producer])
+			errors_++;
+
+		sequences_[producer] = sequence + 1;
+		received_++;
+	}
+
+	void sync()
+	{
+	}
+
+	unsigned int received() const { return received_; }
+	unsigned int errors() const { return errors_; }
+
+private:
+	unsigned int received_;
+	unsigned int errors_;
+	unsigned int sequences_[numProducers];
+};
+
+class MessageQueueTest : public Test
+{
+protected:
+	int init()
+	{
+		object_.moveToThread(&thread_);
+		thread_.start();
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		constexpr unsigned int numMessages = 10000;
+
+		/*
+		 * Post messages concurrently from multiple threads, and verify
+		 * that they are all delivered, in order for each sender.
+		 */
+		vector<std::thread> producers;
+
+		for (unsigned int i = 0; i < RecordingObject::numProducers; ++i) {
+			producers.emplace_back([this, i]() {
+				for (unsigned int j = 0; j < numMessages; ++j)
+					object_.invokeMethod(&RecordingObject::record,
+							     ConnectionTypeQueued, i, j);
+			});
+		}
+
+		for (std::thread &producer : producers)
+			producer.join();
+
+		object_.invokeMethod(&RecordingObject::sync, ConnectionTypeBlocking);
+
+		if (object_.received() != RecordingObject::numProducers * numMessages) {
+			cerr << "Received " << object_.received() << " messages, expected "
+			     << RecordingObject::numProducers * numMessages << endl;
+			return TestFail;
+		}
+
+		if (object_.errors()) {
+			cerr << object_.errors() << " messages delivered out of order"
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Once the pool is warm, queued and blocking invocations must
+		 * not allocate memory at all. The bound method, the argument
+		 * pack and the message all come from the pool.
+		 */
+		uint64_t count = AllocationCounter::processAllocations();
+
+		for (unsigned int i = 0; i < numMessages; ++i) {
+			object_.invokeMethod(&RecordingObject::record,
+					     ConnectionTypeQueued, 0U, numMessages + i);
+			if (i % 100 == 99)
+				object_.invokeMethod(&RecordingObject::sync,
+						     ConnectionTypeBlocking);
+		}
+
+		object_.invokeMethod(&RecordingObject::sync, ConnectionTypeBlocking);
+
+		count = AllocationCounter::processAllocations() - count;
+		if (count) {
+			cerr << count << " allocations for " << numMessages
+			     << " method invocations" << endl;
+			return TestFail;
+		}
+
+		if (object_.errors()) {
+			cerr << "Messages delivered out of order" << endl;
+			return TestFail;
+		}
+
+		/* Memory blocks of all sizes must be reusable. */
+		for (size_t size = 1; size <= PoolAllocator::maxSize; ++size) {
+			void *ptr = PoolAllocator::allocate(size);
+			PoolAllocator::deallocate(ptr, size);
+
+			if (PoolAllocator::allocate(size) != ptr) {
+				cerr << "Block of size " << size << " not reused"
+				     << endl;
+				return TestFail;
+			}
+
+			PoolAllocator::deallocate(ptr, size);
+		}
+
+		/*
+		 * Blocks allocated in one thread and freed in another must be
+		 * recycled through the depot.
+		 */
+		constexpr size_t blockSize = 64;
+		constexpr unsigned int numBlocks = 256;
+		vector<void *> blocks(numBlocks);
+
+		unsigned int misses = PoolAllocator::systemAllocations();
+
+		for (unsigned int round = 0; round < 100; ++round) {
+			for (void *&block : blocks)
+				block = PoolAllocator::allocate(blockSize);
+
+			std::thread([&blocks]() {
+				for (void *block : blocks)
+					PoolAllocator::deallocate(block, blockSize);
+			}).join();
+		}
+
+		misses = PoolAllocator::systemAllocations() - misses;
+		if (misses > numBlocks) {
+			cerr << misses << " pool misses for " << numBlocks
+			     << " blocks freed across threads" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		thread_.exit(0);
+		thread_.wait();
+	}
+
+private:
+	Thread thread_;
+	RecordingObject object_;
+};
+
+TEST_REGISTER(MessageQueueTest)
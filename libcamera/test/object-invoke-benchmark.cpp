@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * object-invoke-benchmark.cpp - Cross-thread method invocation benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <libcamera/object.h>
+
+#include "libcamera/internal/thread.h"
+
+#include "allocation_counter.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+struct Payload {
+	unsigned int sequence;
+	uint64_t timestamp;
+	uint32_t buffers[4];
+};
+
+class BenchmarkObject : public Object
+{
+public:
+	void queued([[maybe_unused]] const Payload &payload)
+	{
+	}
+
+	int blocking(const Payload &payload)
+	{
+		return payload.sequence;
+	}
+};
+
+class ObjectInvokeBenchmark : public Test
+{
+protected:
+	int init()
+	{
+		object_.moveToThread(&thread_);
+		thread_.start();
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		constexpr unsigned int numInvocations = 100000;
+		Payload payload{};
+
+		/* Warm up the message pools. */
+		for (unsigned int i = 0; i < 1000; ++i)
+			object_.invokeMethod(&BenchmarkObject::blocking,
+					     ConnectionTypeBlocking, payload);
+
+		/* Round-trip latency of blocking invocations. */
+		vector<chrono::nanoseconds> latencies;
+		latencies.reserve(numInvocations);
+
+		uint64_t count = AllocationCounter::processAllocations();
+
+		for (unsigned int i = 0; i < numInvocations; ++i) {
+			payload.sequence = i;
+
+			auto start = chrono::steady_clock::now();
+			object_.invokeMethod(&BenchmarkObject::blocking,
+					     ConnectionTypeBlocking, payload);
+			latencies.push_back(chrono::steady_clock::now() - start);
+		}
+
+		count = AllocationCounter::processAllocations() - count;
+
+		sort(latencies.begin(), latencies.end());
+
+		cout << fixed << setprecision(2)
+		     << "Blocking invocation: p50 "
+		     << latencies[numInvocations / 2].count() / 1000.0 << " us, p99 "
+		     << latencies[numInvocations * 99 / 100].count() / 1000.0
+		     << " us, " << static_cast<double>(count) / numInvocations
+		     << " allocations per invocation" << endl;
+
+		/*
+		 * Throughput of queued invocations, synchronizing with the
+		 * receiver after every batch to bound the queue depth, as a
+		 * pipeline handler does with per-frame events.
+		 */
+		constexpr unsigned int batchSize = 8;
+
+		count = AllocationCounter::processAllocations();
+		auto start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < numInvocations; ++i) {
+			payload.sequence = i;
+			object_.invokeMethod(&BenchmarkObject::queued,
+					     ConnectionTypeQueued, payload);
+
+			if (i % batchSize == batchSize - 1)
+				object_.invokeMethod(&BenchmarkObject::blocking,
+						     ConnectionTypeBlocking, payload);
+		}
+
+		chrono::nanoseconds duration = chrono::steady_clock::now() - start;
+		count = AllocationCounter::processAllocations() - count;
+
+		cout << "Queued invocation: "
+		     << static_cast<double>(duration.count()) / numInvocations
+		     << " ns per invocation, "
+		     << static_cast<double>(count) / numInvocations
+		     << " allocations per invocation" << endl;
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		thread_.exit(0);
+		thread_.wait();
+	}
+
+private:
+	Thread thread_;
+	BenchmarkObject object_;
+};
+
+TEST_REGISTER(ObjectInvokeBenchmark)
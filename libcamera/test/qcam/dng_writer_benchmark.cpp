@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * dng_writer_benchmark.cpp - Benchmark the qcam DNG writer
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/formats.h>
+#include <libcamera/property_ids.h>
+
+#include "dng_writer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class DNGWriterBenchmark : public Test
+{
+protected:
+	int init()
+	{
+		/* Write to tmpfs to measure the writer, not the storage. */
+		const char *dir = access("/dev/shm", W_OK) ? "/tmp" : "/dev/shm";
+		filename_ = string(dir) + "/libcamera-dng-writer-benchmark-"
+			  + to_string(getpid()) + ".dng";
+
+		return TestPass;
+	}
+
+	/* Measure the time to write a 12MP raw frame in ms. */
+	double measure(const PixelFormat &format, unsigned int stride,
+		       DNGWriter::Compression compression, off_t *size)
+	{
+		constexpr unsigned int numRuns = 3;
+
+		StreamConfiguration config;
+		config.size = { 4000, 3000 };
+		config.pixelFormat = format;
+		config.stride = stride;
+
+		/* A gradient with some noise, as a sensor would produce. */
+		vector<uint8_t> frame(stride * config.size.height);
+		for (size_t i = 0; i < frame.size(); i++)
+			frame[i] = (i % stride) * 255 / stride + (i * 7919) % 13;
+
+		ControlList properties(properties::properties);
+		ControlList metadata(controls::controls);
+
+		auto start = chrono::steady_clock::now();
+		for (unsigned int run = 0; run < numRuns; run++) {
+			if (DNGWriter::write(filename_.c_str(), properties, config,
+					     metadata, nullptr, frame.data(),
+					     compression))
+				return 0.0;
+		}
+		chrono::duration<double, milli> duration =
+			chrono::steady_clock::now() - start;
+
+		struct stat st;
+		*size = stat(filename_.c_str(), &st) ? 0 : st.st_size;
+
+		return duration.count() / numRuns;
+	}
+
+	void report(const PixelFormat &format, unsigned int stride)
+	{
+		off_t size;
+
+		cout << setw(14) << format.toString() << ": " << fixed
+		     << setprecision(1) << "uncompressed "
+		     << measure(format, stride, DNGWriter::Compression::None, &size)
+		     << " ms " << size / 1000000.0 << " MB";
+
+#ifdef HAVE_ZLIB
+		cout << ", deflate "
+		     << measure(format, stride, DNGWriter::Compression::Deflate, &size)
+		     << " ms " << size / 1000000.0 << " MB";
+#endif
+
+		cout << endl;
+	}
+
+	int run()
+	{
+		report(formats::SRGGB10_CSI2P, 5000);
+		report(formats::SRGGB12_CSI2P, 6000);
+		report(formats::SRGGB10_IPU3, 5120);
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		unlink(filename_.c_str());
+	}
+
+private:
+	string filename_;
+};
+
+TEST_REGISTER(DNGWriterBenchmark)
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * raw_packer_test.cpp - Check the qcam raw Bayer packer kernels
+ */
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "raw_packer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/* Row sizes in bytes of the raw formats. */
+static size_t rowSize(const PixelFormat &format, unsigned int width)
+{
+	if (format == formats::SBGGR10_CSI2P)
+		return (width + 3) / 4 * 5;
+	else if (format == formats::SBGGR12_CSI2P)
+		return (width + 1) / 2 * 3;
+	else
+		return (width + 24) / 25 * 32;
+}
+
+/* Extract a sample from a raw row, as documented by the formats. */
+static uint16_t referenceSample(const PixelFormat &format, const uint8_t *in,
+				unsigned int x)
+{
+	if (format == formats::SBGGR10_CSI2P) {
+		in += x / 4 * 5;
+		return in[x % 4] << 2 | ((in[4] >> (x % 4 * 2)) & 3);
+	}
+
+	if (format == formats::SBGGR12_CSI2P) {
+		in += x / 2 * 3;
+		return x % 2 ? in[1] << 4 | in[2] >> 4 : in[0] << 4 | (in[2] & 0xf);
+	}
+
+	/* IPU3 packs 25 samples in a little-endian stream of 32 bytes. */
+	unsigned int bit = x % 25 * 10;
+	in += x / 25 * 32;
+
+	unsigned int value = 0;
+	for (unsigned int i = 0; i < 10; i++, bit++)
+		value |= ((in[bit / 8] >> (bit % 8)) & 1) << i;
+	return value;
+}
+
+class RawPackerTest : public Test
+{
+protected:
+	int check(const PixelFormat &format, unsigned int width, mt19937 &gen)
+	{
+		vector<uint8_t> input(rowSize(format, width));
+		for (uint8_t &value : input)
+			value = gen();
+
+		RawPacker packer;
+		if (packer.configure(format, width)) {
+			cerr << "Failed to configure " << format.toString() << endl;
+			return TestFail;
+		}
+
+		const unsigned int bits = packer.bitsPerSample();
+
+		/* The packed stream, a bit at a time, most significant first. */
+		vector<uint8_t> expected(packer.packedStride(), 0);
+		for (unsigned int x = 0; x < width; x++) {
+			uint16_t sample = referenceSample(format, input.data(), x);
+			for (unsigned int i = 0; i < bits; i++) {
+				unsigned int bit = x * bits + i;
+				if (sample & (1 << (bits - 1 - i)))
+					expected[bit / 8] |= 0x80 >> (bit % 8);
+			}
+		}
+
+		for (RawPacker::Isa isa : RawPacker::supportedIsas()) {
+			packer.setIsa(isa);
+
+			vector<uint16_t> samples(width);
+			vector<uint8_t> output(packer.packedStride(), 0);
+			packer.unpack(input.data(), samples.data());
+			packer.pack(samples.data(), output.data());
+
+			for (unsigned int x = 0; x < width; x++) {
+				if (samples[x] != referenceSample(format, input.data(), x)) {
+					cerr << RawPacker::isaName(isa) << " "
+					     << format.toString() << " width " << width
+					     << ": wrong sample " << x << endl;
+					return TestFail;
+				}
+			}
+
+			if (output != expected) {
+				cerr << RawPacker::isaName(isa) << " "
+				     << format.toString() << " width " << width
+				     << ": wrong packing" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		static const PixelFormat rawFormats[] = {
+			formats::SBGGR10_CSI2P, formats::SBGGR12_CSI2P,
+			formats::SBGGR10_IPU3,
+		};
+
+		/* Cover the SIMD loops and the scalar tails of all lengths. */
+		mt19937 gen(0);
+		for (const PixelFormat &format : rawFormats) {
+			for (unsigned int width = 2; width <= 120; width += 2) {
+				if (check(format, width, gen))
+					return TestFail;
+			}
+
+			if (check(format, 4056, gen))
+				return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(RawPackerTest)
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * control_info_map_handles.cpp - ControlInfoMap handles negotiation between
+ * the proxy and worker serializers
+ */
+
+#include <iostream>
+#include <new>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class ControlInfoMapHandlesTest : public Test
+{
+public:
+	ControlInfoMapHandlesTest()
+		: proxy_(ControlSerializer::Role::Proxy),
+		  worker_(ControlSerializer::Role::Worker)
+	{
+	}
+
+protected:
+	/* Send a ControlInfoMap or ControlList from one serializer to the other. */
+	template<typename T>
+	T transfer(const T &data, ControlSerializer *from, ControlSerializer *to,
+		   size_t *bytes = nullptr)
+	{
+		vector<uint8_t> buf;
+		tie(buf, ignore) = IPADataSerializer<T>::serialize(data, from);
+
+		if (bytes)
+			*bytes = buf.size();
+
+		return IPADataSerializer<T>::deserialize(buf, to);
+	}
+
+	int run()
+	{
+		/* The pipeline handler side map, e.g. the sensor controls. */
+		const ControlInfoMap sensorControls = {
+			{ &controls::ExposureTime, ControlInfo(0, 999999) },
+			{ &controls::AnalogueGain, ControlInfo(1.0f, 16.0f) },
+			{ &controls::Brightness, ControlInfo(-1.0f, 1.0f) },
+			{ &controls::Contrast, ControlInfo(0.0f, 32.0f) },
+		};
+
+		/*
+		 * Send the map to the IPA, which keeps a copy of it to create
+		 * the lists it sends back.
+		 */
+		size_t mapBytes;
+		ControlInfoMap ipaSensorControls =
+			transfer(sensorControls, &proxy_, &worker_, &mapBytes);
+		if (ipaSensorControls.size() != sensorControls.size()) {
+			cerr << "Failed to transfer the ControlInfoMap" << endl;
+			return TestFail;
+		}
+
+		ControlList sensorList(sensorControls);
+		sensorList.set(controls::ExposureTime, 10000);
+		sensorList.set(controls::AnalogueGain, 2.0f);
+
+		ControlList list = transfer(sensorList, &proxy_, &worker_);
+		if (list.size() != 2 || list.get(controls::ExposureTime) != 10000) {
+			cerr << "Failed to transfer a list to the IPA" << endl;
+			return TestFail;
+		}
+
+		/* Lists referring to the copy must not send the map back. */
+		ControlList delayedList(ipaSensorControls);
+		delayedList.set(controls::ExposureTime, 20000);
+		delayedList.set(controls::AnalogueGain, 4.0f);
+
+		list = transfer(delayedList, &worker_, &proxy_);
+		if (list.size() != 2 || list.get(controls::ExposureTime) != 20000) {
+			cerr << "Failed to transfer a list from the IPA" << endl;
+			return TestFail;
+		}
+
+		if (worker_.statistics().infoMaps != 0) {
+			cerr << "The copy of the ControlInfoMap has been sent back"
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Maps created on both sides must use distinct handles. Create
+		 * a map in the worker and one in the proxy, and make sure each
+		 * side receives the right map.
+		 */
+		const ControlInfoMap ispControls = {
+			{ &controls::Saturation, ControlInfo(0.0f, 32.0f) },
+		};
+		const ControlInfoMap lensControls = {
+			{ &controls::Sharpness, ControlInfo(0.0f, 16.0f) },
+		};
+
+		ControlInfoMap map = transfer(ispControls, &worker_, &proxy_);
+		if (map.size() != 1 || !map.count(controls::Saturation.id())) {
+			cerr << "Handle collision on the proxy side" << endl;
+			return TestFail;
+		}
+
+		map = transfer(lensControls, &proxy_, &worker_);
+		if (map.size() != 1 || !map.count(controls::Sharpness.id())) {
+			cerr << "Handle collision on the worker side" << endl;
+			return TestFail;
+		}
+
+		/* In steady state, only the lists are transferred. */
+		proxy_.resetStatistics();
+		worker_.resetStatistics();
+
+		constexpr unsigned int numFrames = 100;
+		size_t proxyBytes = 0;
+		size_t workerBytes = 0;
+
+		for (unsigned int i = 0; i < numFrames; ++i) {
+			size_t bytes;
+
+			sensorList.set(controls::ExposureTime, i);
+			transfer(sensorList, &proxy_, &worker_, &bytes);
+			proxyBytes += bytes;
+
+			delayedList.set(controls::ExposureTime, i);
+			transfer(delayedList, &worker_, &proxy_, &bytes);
+			workerBytes += bytes;
+		}
+
+		if (proxy_.statistics().infoMaps || worker_.statistics().infoMaps) {
+			cerr << "ControlInfoMap sent in steady state" << endl;
+			return TestFail;
+		}
+
+		cout << "ControlInfoMap: " << mapBytes << " bytes, ControlList: "
+		     << proxyBytes / numFrames << " bytes/frame to the IPA, "
+		     << workerBytes / numFrames << " bytes/frame from the IPA"
+		     << endl;
+
+		/*
+		 * A map destroyed by the caller may have its address reused by
+		 * a different map, which must not be associated with the handle
+		 * of the destroyed map.
+		 */
+		alignas(ControlInfoMap) uint8_t storage[sizeof(ControlInfoMap)];
+
+		ControlInfoMap *lensMap = new (storage) ControlInfoMap(lensControls);
+		ControlList lensList(*lensMap);
+		lensList.set(controls::Sharpness, 1.0f);
+
+		list = transfer(lensList, &proxy_, &worker_);
+		if (list.size() != 1) {
+			cerr << "Failed to transfer a list of a copied map" << endl;
+			return TestFail;
+		}
+
+		lensMap->~ControlInfoMap();
+
+		ControlInfoMap *otherMap = new (storage) ControlInfoMap({
+			{ &controls::Sharpness, ControlInfo(0.0f, 8.0f) },
+		});
+
+		bool cached = proxy_.isCached(*otherMap);
+		otherMap->~ControlInfoMap();
+
+		if (cached) {
+			cerr << "Stale handle used for a reused map address" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * After a reset of both sides, the handle numbering restarts
+		 * and maps must be sent again.
+		 */
+		proxy_.reset();
+		worker_.reset();
+
+		const ControlInfoMap newSensorControls = {
+			{ &controls::ExposureTime, ControlInfo(0, 33333) },
+		};
+
+		map = transfer(newSensorControls, &proxy_, &worker_);
+		if (map.size() != 1 ||
+		    map.at(controls::ExposureTime.id()).max().get<int32_t>() != 33333) {
+			cerr << "Failed to transfer a ControlInfoMap after reset"
+			     << endl;
+			return TestFail;
+		}
+
+		ControlList newList(newSensorControls);
+		newList.set(controls::ExposureTime, 1000);
+
+		list = transfer(newList, &proxy_, &worker_);
+		if (list.size() != 1 || list.get(controls::ExposureTime) != 1000) {
+			cerr << "Failed to transfer a ControlList after reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	ControlSerializer proxy_;
+	ControlSerializer worker_;
+};
+
+TEST_REGISTER(ControlInfoMapHandlesTest)
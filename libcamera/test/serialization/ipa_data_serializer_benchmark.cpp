@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2021, Google Inc.
+ *
+ * ipa_data_serializer_benchmark.cpp - Benchmark the IPADataSerializer with the
+ * Raspberry Pi IPA structures
+ */
+
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/ipa/raspberrypi_ipa_serializer.h>
+
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include "allocation_counter.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+static const ControlInfoMap SensorControls = {
+	{ &controls::ExposureTime, ControlInfo(0, 999999) },
+	{ &controls::AnalogueGain, ControlInfo(1.0f, 32.0f) },
+	{ &controls::ColourGains, ControlInfo(0.0f, 32.0f) },
+	{ &controls::Brightness, ControlInfo(-1.0f, 1.0f) },
+	{ &controls::Contrast, ControlInfo(0.0f, 32.0f) },
+	{ &controls::FrameDurations, ControlInfo(INT64_C(1000), INT64_C(1000000000)) },
+};
+
+class IPADataSerializerBenchmark : public Test
+{
+public:
+	IPADataSerializerBenchmark()
+		: cs_(ControlSerializer::Role::Proxy)
+	{
+	}
+
+protected:
+	int init()
+	{
+		fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		if (fd_ < 0)
+			return TestFail;
+
+		ControlList controls(SensorControls);
+		controls.set(controls::ExposureTime, 20000);
+		controls.set(controls::AnalogueGain, 4.0f);
+		controls.set(controls::ColourGains, { 1.5f, 2.0f });
+		controls.set(controls::Brightness, 0.25f);
+		controls.set(controls::Contrast, 1.25f);
+		controls.set(controls::FrameDurations, { INT64_C(33333), INT64_C(33333) });
+
+		ispConfig_.embeddedBufferId = 0x20001;
+		ispConfig_.bayerBufferId = 0x40003;
+		ispConfig_.embeddedBufferPresent = true;
+		ispConfig_.controls = controls;
+
+		startConfig_.controls = controls;
+		startConfig_.dropFrameCount = 2;
+
+		delayedControls_ = controls;
+
+		for (unsigned int i = 0; i < 8; ++i) {
+			IPABuffer buffer;
+			buffer.id = ipa::RPi::MaskBayerData | i;
+
+			for (unsigned int j = 0; j < 3; ++j) {
+				FrameBuffer::Plane plane;
+				plane.fd = FileDescriptor(fd_);
+				plane.length = 4056 * 3040 / (j ? 4 : 1);
+				buffer.planes.push_back(plane);
+			}
+
+			buffers_.push_back(buffer);
+		}
+
+		sensorInfo_.model = "imx477";
+		sensorInfo_.bitsPerPixel = 12;
+		sensorInfo_.activeAreaSize = { 4056, 3040 };
+		sensorInfo_.analogCrop = { 0, 0, 4056, 3040 };
+		sensorInfo_.outputSize = { 2028, 1520 };
+		sensorInfo_.pixelRate = 840000000;
+		sensorInfo_.lineLength = 15000;
+		sensorInfo_.minFrameLength = 1520;
+		sensorInfo_.maxFrameLength = 65535;
+
+		return TestPass;
+	}
+
+	template<typename T>
+	int measure(const char *name, const T &data)
+	{
+		constexpr unsigned int numIterations = 20000;
+		std::vector<uint8_t> dataVec;
+		std::vector<int32_t> fdsVec;
+
+		/* Warm up, and serialize the ControlInfoMap once. */
+		std::tie(dataVec, fdsVec) = IPADataSerializer<T>::serialize(data, &cs_);
+
+		std::vector<uint8_t> reference;
+		std::tie(reference, fdsVec) = IPADataSerializer<T>::serialize(data, &cs_);
+
+		/* Serialize to newly allocated vectors. */
+		uint64_t count = AllocationCounter::processAllocations();
+		auto start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < numIterations; ++i)
+			std::tie(dataVec, fdsVec) = IPADataSerializer<T>::serialize(data, &cs_);
+
+		chrono::nanoseconds duration = chrono::steady_clock::now() - start;
+		count = AllocationCounter::processAllocations() - count;
+
+		cout << name << ": " << reference.size() << " bytes, vector "
+		     << static_cast<double>(duration.count()) / numIterations
+		     << " ns " << static_cast<double>(count) / numIterations
+		     << " allocations";
+
+		/* Serialize to a reused buffer. */
+		std::vector<uint8_t> buf(IPADataSerializer<T>::binarySize(data, &cs_));
+		std::vector<int32_t> fds;
+		fds.reserve(fdsVec.size());
+
+		count = AllocationCounter::processAllocations();
+		start = chrono::steady_clock::now();
+
+		for (unsigned int i = 0; i < numIterations; ++i) {
+			ByteStreamBuffer buffer(buf.data(), buf.size());
+			fds.clear();
+
+			if (IPADataSerializer<T>::serialize(data, buffer, fds, &cs_) < 0) {
+				cerr << name << ": serialization failed" << endl;
+				return TestFail;
+			}
+		}
+
+		duration = chrono::steady_clock::now() - start;
+		count = AllocationCounter::processAllocations() - count;
+
+		cout << ", buffer "
+		     << static_cast<double>(duration.count()) / numIterations
+		     << " ns " << static_cast<double>(count) / numIterations
+		     << " allocations" << endl;
+
+		if (buf != reference || fds != fdsVec) {
+			cerr << name << ": serialized data mismatch" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		cout << fixed << setprecision(2);
+
+		if (measure("ISPConfig", ispConfig_) != TestPass)
+			return TestFail;
+
+		if (measure("StartConfig", startConfig_) != TestPass)
+			return TestFail;
+
+		if (measure("ControlList", delayedControls_) != TestPass)
+			return TestFail;
+
+		if (measure("CameraSensorInfo", sensorInfo_) != TestPass)
+			return TestFail;
+
+		if (measure("vector<IPABuffer>", buffers_) != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+private:
+	int fd_;
+
+	ControlSerializer cs_;
+
+	ipa::RPi::ISPConfig ispConfig_;
+	ipa::RPi::StartConfig startConfig_;
+	ControlList delayedControls_;
+	CameraSensorInfo sensorInfo_;
+	std::vector<IPABuffer> buffers_;
+};
+
+TEST_REGISTER(IPADataSerializerBenchmark)
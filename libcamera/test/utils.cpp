@@ -5,10 +5,17 @@
  * utils.cpp - Miscellaneous utility tests
  */
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <sstream>
+#include <stdlib.h>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
 #include <libcamera/geometry.h>
@@ -73,6 +80,89 @@ protected:
 		return TestPass;
 	}
 
+	int testMkdirs()
+	{
+		char base[] = "/tmp/libcamera.utils.XXXXXX";
+		if (!mkdtemp(base)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		std::string dir = std::string(base) + "/a/b/";
+		int ret = utils::mkdirs(dir);
+		int again = utils::mkdirs(dir);
+
+		struct stat st;
+		bool created = stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+
+		std::string file = std::string(base) + "/a/b/file";
+		close(creat(file.c_str(), 0644));
+		int notDir = utils::mkdirs(file + "/c");
+
+		unlink(file.c_str());
+		rmdir((std::string(base) + "/a/b").c_str());
+		rmdir((std::string(base) + "/a").c_str());
+		rmdir(base);
+
+		if (ret || again || !created) {
+			cerr << "utils::mkdirs() failed to create " << dir << endl;
+			return TestFail;
+		}
+
+		if (notDir != -ENOTDIR) {
+			cerr << "utils::mkdirs() created a directory under a file"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testWriteFileAtomic()
+	{
+		char base[] = "/tmp/libcamera.utils.XXXXXX";
+		if (!mkdtemp(base)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		std::string file = std::string(base) + "/file";
+		int first = utils::write_file_atomic(file, "first");
+		int second = utils::write_file_atomic(file, "second");
+
+		std::string contents;
+		std::getline(std::ifstream(file), contents);
+
+		int noDir = utils::write_file_atomic(std::string(base) + "/a/file",
+						     "data");
+
+		/* Only the file itself must be left, without temporary files. */
+		unsigned int entries = 0;
+		DIR *dir = opendir(base);
+		while (struct dirent *entry = readdir(dir)) {
+			if (entry->d_name[0] != '.')
+				entries++;
+		}
+		closedir(dir);
+
+		unlink(file.c_str());
+		rmdir(base);
+
+		if (first || second || contents != "second") {
+			cerr << "utils::write_file_atomic() failed to replace "
+			     << file << endl;
+			return TestFail;
+		}
+
+		if (noDir != -ENOENT || entries != 1) {
+			cerr << "utils::write_file_atomic() failure not reported or cleaned up"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
 	int run()
 	{
 		/* utils::hex() test. */
@@ -145,6 +235,14 @@ protected:
 		if (TestPass != testDirname())
 			return TestFail;
 
+		/* utils::mkdirs() test. */
+		if (TestPass != testMkdirs())
+			return TestFail;
+
+		/* utils::write_file_atomic() test. */
+		if (TestPass != testWriteFileAtomic())
+			return TestFail;
+
 
 		/* utils::map_keys() test. */
 		const std::map<std::string, unsigned int> map{
@@ -57,12 +57,26 @@ def extract_result(result):
     return ret
 
 
-def test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, base_driver):
-    ret, output = run_with_stdout(v4l2_compliance, '-s', '-d', device, env={'LD_PRELOAD': v4l2_compat})
+def test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, base_driver,
+                         exporter=None, env={}):
+    args = [v4l2_compliance, '-s', '-d', device]
+    if exporter:
+        args += ['-e', exporter]
+    ret, output = run_with_stdout(*args, env={'LD_PRELOAD': v4l2_compat, **env})
     if ret < 0:
         output.append(f'Test for {device} terminated due to signal {signal.Signals(-ret).name}')
         return TestFail, output
 
+    # The streaming tests cover read() I/O, make sure it isn't skipped
+    if not grep(r'test read/write: OK\s*$', output):
+        output.append(f'read() I/O on {device} not tested')
+        return TestFail, output
+
+    # The same goes for DMABUF I/O when an exporter is given
+    if exporter and not grep(r'test DMABUF: OK\s*$', output):
+        output.append(f'DMABUF I/O on {device} not tested with {exporter}')
+        return TestFail, output
+
     result = extract_result(output[-2])
     if result['failed'] == 0:
         return TestPass, None
@@ -78,6 +92,63 @@ def test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, base_driver):
     return TestFail, output
 
 
+# Capture to USERPTR buffers, which are filled by copies in the compat layer
+def test_v4l2_ctl_userptr(v4l2_ctl, v4l2_compat, device):
+    ret, output = run_with_stdout(v4l2_ctl, '-d', device, '--stream-user',
+                                  '--stream-count=8', env={'LD_PRELOAD': v4l2_compat})
+    if ret != 0:
+        output.append(f'USERPTR capture on {device} failed with {ret}')
+        return TestFail, output
+
+    return TestPass, None
+
+
+# Wait for a frame with poll() or select() before the first read(), which must
+# start capturing as the kernel does
+poll_read_script = '''
+import os
+import select
+import sys
+
+fd = os.open(sys.argv[1], os.O_RDWR | os.O_NONBLOCK)
+if sys.argv[2] == 'poll':
+    poller = select.poll()
+    poller.register(fd, select.POLLIN)
+    ready = poller.poll(5000)
+else:
+    ready = select.select([fd], [], [], 5)[0]
+if not ready:
+    sys.exit(1)
+if not os.read(fd, 1 << 26):
+    sys.exit(2)
+'''
+
+
+def test_poll_read(v4l2_compat, device):
+    for method in ['poll', 'select']:
+        ret, output = run_with_stdout(sys.executable, '-c', poll_read_script,
+                                      device, method, env={'LD_PRELOAD': v4l2_compat})
+        if ret != 0:
+            output.append(f'{method}() before read() on {device} failed with {ret}')
+            return TestFail, output
+
+    return TestPass, None
+
+
+# Find a video node of the driver that isn't claimed by the compatibility layer,
+# to export the dmabufs imported by the camera
+def find_exporter(v4l2_ctl, v4l2_compat, dev_nodes, base_driver):
+    for device in dev_nodes:
+        ret, out = run_with_stdout(v4l2_ctl, '-D', '-d', device, env={'LD_PRELOAD': v4l2_compat})
+        if ret != 0:
+            continue
+        driver = grep('Driver name', out)
+        if driver and driver[0].split(':')[-1].strip() == base_driver:
+            return device
+
+    return None
+
+
 def main(argv):
     parser = argparse.ArgumentParser()
     parser.add_argument('-a', '--all', action='store_true',
@@ -139,6 +210,20 @@ def main(argv):
 
         print(f'Testing {device} with {driver} driver... ', end='')
         ret, msg = test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, driver)
+        if ret == TestPass:
+            ret, msg = test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, driver,
+                                            env={'LIBCAMERA_V4L2_COMPAT_MPLANE': '1'})
+        if ret == TestPass:
+            exporter = find_exporter(v4l2_ctl, v4l2_compat, dev_nodes, driver)
+            if exporter:
+                ret, msg = test_v4l2_compliance(v4l2_compliance, v4l2_compat, device, driver,
+                                                exporter=exporter)
+            else:
+                print(f'no {driver} node to export dmabufs, DMABUF I/O not tested... ', end='')
+        if ret == TestPass:
+            ret, msg = test_v4l2_ctl_userptr(v4l2_ctl, v4l2_compat, device)
+        if ret == TestPass:
+            ret, msg = test_poll_read(v4l2_compat, device)
         if ret == TestFail:
             failed.append(device)
             print('failed')
@@ -11,15 +11,179 @@ import bt2
 import statistics as stats
 import sys
 
-# pipeline -> {function -> stack(timestamps)}
+# pipeline -> {function -> queue(timestamps)}
 timestamps = {}
 
+# (pipeline, function, buffer) -> timestamp of the asynchronous call
+async_timestamps = {}
+
 # pipeline:function -> samples[]
 samples = {}
 
+# buffer -> timestamp of the frame last dequeued in the buffer
+buffer_frames = {}
+
+# sequence -> timestamp of the frame, for the device that captured it
+sequence_frames = {}
+
+# sequence -> time at which the delayed controls were applied
+control_applies = {}
+
+# frame timestamp -> {stage -> time}
+frames = {}
+
+
+def event_time(msg):
+    # Frame timestamps are expressed in the monotonic clock, use the raw clock
+    # value instead of the time from origin to compare them with events.
+    snapshot = msg.default_clock_snapshot
+    return snapshot.value * 1000000000 // snapshot.clock_class.frequency
+
+
+def frame_stage(frame, stage, time):
+    if frame not in frames:
+        frames[frame] = {}
+
+    # Only record the first occurrence of a stage for a frame.
+    frames[frame].setdefault(stage, time)
+
+
+def add_sample(pipeline, func, duration):
+    key = f'{pipeline}:{func}'
+    if key not in samples:
+        samples[key] = []
+    samples[key].append(duration)
+
+
+def process_ipa_call(msg, pipeline, timestamp_ns):
+    event = msg.event.name
+    func = str(msg.event.payload_field['function_name'])
+
+    if event == 'libcamera:ipa_call_begin':
+        if pipeline not in timestamps:
+            timestamps[pipeline] = {}
+        if func not in timestamps[pipeline]:
+            timestamps[pipeline][func] = []
+        timestamps[pipeline][func].append(timestamp_ns)
+
+    # The IPA completes the calls in the order they were made.
+    if event == 'libcamera:ipa_call_end':
+        if not timestamps.get(pipeline, {}).get(func):
+            return
+        ts = timestamps[pipeline][func].pop(0)
+        add_sample(pipeline, func, timestamp_ns - ts)
+
+    # Asynchronous calls are matched through the buffer they process. A call
+    # that doesn't complete, when the camera stops, is replaced by the next
+    # call for the same buffer.
+    if event == 'libcamera:ipa_async_call_begin':
+        key = (pipeline, func, int(msg.event.payload_field['buffer']))
+        async_timestamps[key] = timestamp_ns
+
+    if event == 'libcamera:ipa_async_call_end':
+        key = (pipeline, func, int(msg.event.payload_field['buffer']))
+        ts = async_timestamps.pop(key, None)
+        if ts is not None:
+            add_sample(pipeline, func, timestamp_ns - ts)
+
+
+def process_frame_event(msg, time):
+    event = msg.event.name
+    payload = msg.event.payload_field
+
+    if event == 'libcamera:v4l2_videodevice_dequeue':
+        device = str(payload['device'])
+        buffer = int(payload['buffer'])
+        frame = int(payload['timestamp'])
+
+        # The first device to produce a timestamp captured the frame, other
+        # devices (such as memory-to-memory ISPs) copy the timestamp.
+        if frame not in frames:
+            sequence_frames[int(payload['sequence'])] = frame
+
+        buffer_frames[buffer] = frame
+        frame_stage(frame, f'dequeue:{device}', time)
+
+    elif event == 'libcamera:pipeline_stage':
+        stage = str(payload['stage_name'])
+        frame_stage(int(payload['timestamp']), stage, time)
+
+    elif event == 'libcamera:delayed_controls_apply':
+        # Controls are applied when the frame starts, before the frame is
+        # dequeued, match them to frames once the whole trace is processed.
+        control_applies.setdefault(int(payload['sequence']), time)
+
+    elif event == 'libcamera:request_complete_buffer':
+        frame = buffer_frames.get(int(payload['buffer']))
+        if frame is not None:
+            frame_stage(frame, 'request_complete', time)
+
+
+def percentile(values, p):
+    return values[min(int(p * len(values)), len(values) - 1)]
+
+
+def print_table(rows):
+    # Get maximum string width for every column
+    widths = []
+    for i in range(len(rows[0])):
+        widths.append(max([len(row[i]) for row in rows]))
+
+    # Print stats table
+    for row in rows:
+        fmt = [row[i].rjust(widths[i]) for i in range(1, len(row))]
+        print(' '.join([row[0].ljust(widths[0])] + fmt))
+
+
+def sample_row(name, values):
+    values = sorted(values)
+    mean = int(stats.mean(values))
+    stddev = int(stats.stdev(values)) if len(values) > 1 else 0
+
+    return [name, str(len(values)), str(values[0]), str(values[-1]),
+            str(mean), str(stddev), str(percentile(values, 0.50)),
+            str(percentile(values, 0.90)), str(percentile(values, 0.99))]
+
+
+def print_ipa_stats():
+    rows = []
+    rows.append(['pipeline:function', 'count', 'min', 'max', 'mean', 'stddev',
+                 'p50', 'p90', 'p99'])
+    for k, v in samples.items():
+        rows.append(sample_row(k, v))
+
+    print_table(rows)
+
+
+def print_frame_stats():
+    # Stage -> latencies from the start of the frame
+    latencies = {}
+
+    for frame, stages in frames.items():
+        for stage, time in stages.items():
+            # Skip events recorded before the timestamp of the frame, such
+            # as stale buffer metadata.
+            if time < frame:
+                continue
+            latencies.setdefault(stage, []).append(time - frame)
+
+    # Order the stages by their median latency, which follows the order of
+    # the processing steps.
+    order = sorted(latencies.keys(),
+                   key=lambda stage: percentile(sorted(latencies[stage]), 0.50))
+
+    rows = []
+    rows.append(['stage (ns from frame start)', 'count', 'min', 'max', 'mean',
+                 'stddev', 'p50', 'p90', 'p99'])
+    for stage in order:
+        rows.append(sample_row(stage, latencies[stage]))
+
+    print_table(rows)
+
+
 def main(argv):
     parser = argparse.ArgumentParser(
-            description='A simple analysis script to get statistics on time taken for IPA calls')
+            description='A simple analysis script to get statistics on time taken for IPA calls, and on the latency of the processing stages of frames')
     parser.add_argument('-p', '--pipeline', type=str,
                         help='Name of pipeline to filter for')
     parser.add_argument('trace_path', type=str,
@@ -28,50 +192,37 @@ def main(argv):
 
     traces = bt2.TraceCollectionMessageIterator(args.trace_path)
     for msg in traces:
-        if type(msg) is not bt2._EventMessageConst or \
-           'pipeline_name' not in msg.event.payload_field or \
-           (args.pipeline is not None and \
-            msg.event.payload_field['pipeline_name'] != args.pipeline):
+        if type(msg) is not bt2._EventMessageConst:
             continue
 
-        pipeline = msg.event.payload_field['pipeline_name']
-        event = msg.event.name
-        func = msg.event.payload_field['function_name']
-        timestamp_ns = msg.default_clock_snapshot.ns_from_origin
-
-        if event == 'libcamera:ipa_call_begin':
-            if pipeline not in timestamps:
-                timestamps[pipeline] = {}
-            if func not in timestamps[pipeline]:
-                timestamps[pipeline][func] = []
-            timestamps[pipeline][func].append(timestamp_ns)
-
-        if event == 'libcamera:ipa_call_end':
-            ts = timestamps[pipeline][func].pop()
-            key = f'{pipeline}:{func}'
-            if key not in samples:
-                samples[key] = []
-            samples[key].append(timestamp_ns - ts)
-
-    # Compute stats
-    rows = []
-    rows.append(['pipeline:function', 'min', 'max', 'mean', 'stddev'])
-    for k, v in samples.items():
-        mean = int(stats.mean(v))
-        stddev = int(stats.stdev(v))
-        minv = min(v)
-        maxv = max(v)
-        rows.append([k, str(minv), str(maxv), str(mean), str(stddev)])
+        payload = msg.event.payload_field
+        if 'pipeline_name' in payload:
+            pipeline = str(payload['pipeline_name'])
+            if args.pipeline is not None and pipeline != args.pipeline:
+                continue
+        else:
+            pipeline = None
 
-    # Get maximum string width for every column
-    widths = []
-    for i in range(len(rows[0])):
-        widths.append(max([len(row[i]) for row in rows]))
+        if msg.event.name.startswith(('libcamera:ipa_call_',
+                                      'libcamera:ipa_async_call_')):
+            timestamp_ns = msg.default_clock_snapshot.ns_from_origin
+            process_ipa_call(msg, pipeline, timestamp_ns)
+        else:
+            process_frame_event(msg, event_time(msg))
+
+    for sequence, time in control_applies.items():
+        frame = sequence_frames.get(sequence)
+        if frame is not None:
+            frame_stage(frame, 'delayed_controls_apply', time)
+
+    if samples:
+        print_ipa_stats()
+
+    if frames:
+        if samples:
+            print()
+        print_frame_stats()
 
-    # Print stats table
-    for row in rows:
-        fmt = [row[i].rjust(widths[i]) for i in range(1, 5)]
-        print('{} {} {} {} {}'.format(row[0].ljust(widths[0]), *fmt))
 
 if __name__ == '__main__':
     sys.exit(main(sys.argv))
@@ -2,10 +2,10 @@ from distutils.core import setup, Extension
 
 kcamera = Extension('kcamera', 
 	sources = ['kcameramodule.c', 'kcamera.c', 'dobj.c', 'streamer.c', 'framelist.c', 
-        'run.cpp'],
-	include_dirs = ['./libcamera/include', './libcamera/build/include'],
-       library_dirs =['./libcamera/build/src/libcamera'], 
-	libraries = ['camera'],
+        'run.cpp', 'kccolor.cpp'],
+	include_dirs = ['./libcamera/include', './libcamera/build/include', './libcamera/src/color'],
+       library_dirs =['./libcamera/build/src/libcamera', './libcamera/build/src/color'], 
+	libraries = ['camera-color', 'camera'],
 	extra_compile_args = [ #'-ggdb', '-O1', 
         '-DNDEBUG', '-mfpu=neon-fp-armv8', '-ftree-vectorize', '-O3', 
         '-std=c++17'
@@ -193,12 +193,38 @@ static PyObject *streamer_frame(Streamer* self, PyObject *args, PyObject *kwds)
         Py_RETURN_NONE;
     }
 
+    if (!strcmp(type, "i420"))
+    {
+        // The frame is our own copy, so convert it for the encoder without 
+        // holding the record mutex or the GIL.
+        if (mutex)
+        {
+            pthread_mutex_unlock(mutex);
+            mutex = NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        frame = kcConvertFrame(frame, FRAME_I420);
+        Py_END_ALLOW_THREADS
+        if (frame==NULL)
+        {
+            PyErr_SetString(PyExc_Exception, "cannot convert frame to I420");
+            return NULL;
+        }
+    }
+
     // create new deallocation object
     object = (PyObject *)PyObject_New(DObj, &dObjType);
     // copy frame pointer into deallocation object
     ((DObj *)object)->memory = frame;
     if (!strcmp(type, "bytes"))
-        array = PyBytes_FromStringAndSize((char *)frame->m_data, frame->m_width*frame->m_height*3);
+        array = PyBytes_FromStringAndSize((char *)frame->m_data, kcSizeofFrameData(frame->m_width, frame->m_height, frame->m_type));
+    else if (frame->m_type==FRAME_I420)
+    {
+        // same layout as cv2.cvtColor(frame, cv2.COLOR_BGR2YUV_I420)
+        dims[0] = frame->m_height*3/2;
+        dims[1] = frame->m_width;
+        array = PyArray_SimpleNewFromData(2, dims, NPY_UINT8, frame->m_data); 
+    }
     else
     {
         dims[0] = frame->m_height;